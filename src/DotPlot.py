@@ -88,6 +88,27 @@ class DotPlot:
 		# the total size of all the sequences. in the above example the value would be 119. There is one number for each dimension
 		self.size=[sum([a for a in fileoff]) for fileoff in self.filebounds]
 		
+		# sequences this long need the 64 bit coordinate build of libfreckle
+		self.widecoords=max(self.size)>=2**31
+		if self.widecoords:
+			UseWideCoordinates()
+		
+		# set this to a filename to checkpoint each comparison there, so a killed run can be restarted where it was
+		self.checkpoint=None
+		
+		# set this to render every match whole from a segment index, so the dot stores needn't be interpolated first
+		self.segments=False
+		
+		# and this to render them anti-aliased, each pixel getting the exact length of match crossing it
+		self.antialias=False
+		
+		# how the image turns counts into grey levels. One of EQUALISE, LINEAR, LOG or PERCENTILE from pyfreckle
+		self.normalise=EQUALISE
+		
+		# what the averaged grids' cells are. AUTO picks the narrowest that won't saturate, and UINT8 or UINT16 save
+		# memory on very large plots at the cost of saturating the busiest pixels
+		self.celltype=AUTO
+		
 		def accumulate(sequence):
 			"""Takes a sequence of values like [10,4,25] and adds each to the next to create the ascending list [10,14,39]"""
 			out=[]
@@ -114,6 +135,9 @@ class DotPlot:
 		# the same kind of index but for a calculated average grid
 		self.grid={}
 		
+		# and for the density pyramid of each pair of stores, saved with them so coarse views needn't touch the dots
+		self.pyramid={}
+		
 		# scale is initially unknown
 		self.scale=None
 		
@@ -147,6 +171,7 @@ class DotPlot:
 			newds[key]=(self.dotstore[key][0].Filter(length),self.dotstore[key][1].Filter(length))
 			
 		self.dotstore=newds
+		self.pyramid={}
 		
 	def Interpolate(self):
 		"""Interpolate all the dot stores"""
@@ -155,6 +180,23 @@ class DotPlot:
 			self.dotstore[key][1].Interpolate(self.window)
 			
 		
+	def Statistics(self):
+		"""
+		\brief summary statistics of the calculated matches, for each strand
+		\return a dictionary with 'forward' and 'reverse' entries, each with the count, total bases, min and max lengths
+		and log2 length histogram summed over all the dot stores of that strand
+		"""
+		stats={}
+		for strand,name in enumerate(('forward','reverse')):
+			stores=[self.dotstore[key][strand] for key in self.dotstore.keys()]
+			each=[ds.Statistics() for ds in stores if len(ds)]
+			stats[name]={	'count':sum([s['count'] for s in each]),
+					'bases':sum([s['bases'] for s in each]),
+					'minlength':min([s['minlength'] for s in each] or [0]),
+					'maxlength':max([s['maxlength'] for s in each] or [0]),
+					'histogram':[sum(b) for b in zip(*[s['histogram'] for s in each])]	}
+		return stats
+		
 	def GetSequenceLength(self,dimension):
 		"""
 		\brief return the length of the full sequence specified for dimension.
@@ -228,6 +270,7 @@ class DotPlot:
 		
 		#shortcuts for our dotplot results.
 		pos,neg = self.dotstore.items()[0][1]
+		pos.Unfold()				# we walk the dots one by one, so a self plot needs its reflections made real
 		pos1,neg1=dp1.dotstore.items()[0][1]
 		pos2,neg2=dp2.dotstore.items()[0][1]
 		
@@ -534,6 +577,7 @@ class DotPlot:
 		
 		#print "step 2..."
 		pos,neg = self.dotstore.items()[0][1]
+		pos.Unfold()				# we walk the dots one by one, so a self plot needs its reflections made real
 		pos1,neg1=dp1.dotstore.items()[0][1]
 		pos2,neg2=dp2.dotstore.items()[0][1]
 		
@@ -989,6 +1033,7 @@ class DotPlot:
 
 		# our dotstores
 		forward, backward = self.dotstore.items()[0][1]
+		forward.Unfold()			# we walk the dots one by one, so a self plot needs its reflections made real
 
 		# for each dot&length in the dotstore
 		for dotnum in range(len(forward)):
@@ -1081,6 +1126,7 @@ class DotPlot:
 		# and a reverse dotstore
 		revdotstore=self.Compare(tables[3], tables[2], compseq[::-1], self.ktup, self.window, self.mismatch, self.minmatch)
 		self.dotstore[ (dimension,start,end,compstart,compend) ] = (dotstore, revdotstore)
+		self.pyramid.pop((dimension,start,end,compstart,compend), None)
 				
 		# make sure the dotstore sizes are the same (and maximal)
 		maxx=max(dotstore.GetMaxX(), revdotstore.GetMaxX())
@@ -1094,7 +1140,7 @@ class DotPlot:
 		return (dotstore, revdotstore)
 	
 	def Compare(self,table,tableseq,compseq,ktup,window,mismatch,minmatch):
-		return doComparison(table,tableseq,compseq,ktup,window,mismatch,minmatch)
+		return doComparison(table,tableseq,compseq,ktup,window,mismatch,minmatch,checkpoint=self.checkpoint)
 	
 	def Save(self,filename):
 		"""
@@ -1104,7 +1150,7 @@ class DotPlot:
 		
 		# version numbers
 		MAJOR=0
-		MINOR=1
+		MINOR=2
 		
 		# write the header to the file
 		file.write(pack("4sii","_FDP",MAJOR,MINOR))
@@ -1113,9 +1159,18 @@ class DotPlot:
 		# ktup, window, minmatch, mismatch
 		file.write(pack("iiii",self.ktup, self.window, self.minmatch, self.mismatch))
 		
-		# write the generating filenames and filebounds.
+		# the density pyramids are saved after the dots, so they only need working out once
+		self.BuildPyramids()
+		
+		# write the generating filenames and filebounds. Anything extra goes in a trailing dictionary. The dot
+		# sections carry their own symmetry now, so only the coordinate size and the number of pyramids are needed
+		extras={}
+		if self.widecoords:
+			extras['coordsize']=8
+		if self.pyramid:
+			extras['pyramids']=len(self.pyramid)
 		pickle.dump([self.filenames, self.sequencebounds, self.sequenceboundids,
-			self.filebounds, self.size, self.globalfilebounds, self.globalsequencebounds], file)
+			self.filebounds, self.size, self.globalfilebounds, self.globalsequencebounds]+(extras and [extras] or []), file)
 		
 		# write a datetime stamp
 		file.write(pack("i",int(time())))
@@ -1128,19 +1183,61 @@ class DotPlot:
 			value=self.dotstore[key]
 			
 			#write key
-			file.write(pack("iiiii",*key))
+			file.write(pack(self.widecoords and "qqqqq" or "iiiii",*key))
 			
-			# write forward and then backward store
-			[ds.Save(file) for ds in value]
+			# write forward and then backward store as tiled, compressed sections
+			[ds.WriteSection(file) for ds in value]
+			
+		# then each pyramid, after the key of its stores
+		for key in self.pyramid.keys():
+			file.write(pack(self.widecoords and "qqqqq" or "iiiii",*key))
+			self.pyramid[key].WriteSection(file)
 			
 		# done. close the file
 		file.close()
 		
 
 		
-	def Load(self, filename):
+	def Export(self, filename, compress=None, minlength=0):
+		"""
+		\brief writes every match out as a line of tab separated text: xname, xstart, xend, strand, yname, ystart, yend and length
+		\details coordinates are from 0 within each sequence record and the ends are one past the last base, so the
+		output reads like BED or PAF. Reverse strand matches are given in forward coordinates.
+		\param compress gzip the output. By default only when the filename ends in .gz
+		\param minlength leave out matches shorter than this
+		"""
+		if compress==None:
+			compress=filename.endswith(".gz")
+		
+		exporter=DotExporter(filename, compress)
+		
+		# the records of each axis, laid end to end
+		records=[]
+		for axis in (0,1):
+			ends=reduce(lambda a,b:a+b, self.globalsequencebounds[axis])
+			names=reduce(lambda a,b:a+b, self.sequenceboundids[axis])
+			records.append(([0]+ends[:-1], names))
+		
+		for key in self.dotstore.keys():
+			if type(key)!=tuple:
+				continue				# conserved regions aren't matches
+			
+			# the tabled sequence is along x of the stores, and the compared one along y
+			dimension,start,end,compstart,compend=key
+			exporter.SetRecords(0, *records[1-dimension])
+			exporter.SetRecords(1, *records[dimension])
+			
+			forward,reverse=self.dotstore[key]
+			exporter.Write(forward, '+', compstart, start, end-start, minlength)
+			exporter.Write(reverse, '-', compstart, start, end-start, minlength)
+		
+		exporter.Close()
+		
+	def Load(self, filename, region=None):
 		"""
 		\brief loads the dotplot structure from a file
+		\param region (x1,y1,x2,y2). If given, only the dots reaching into this area of each store are loaded. Files
+		older than version 0.2 are always loaded whole
 		"""
 		file=open(filename,"rb")
 		
@@ -1158,18 +1255,19 @@ class DotPlot:
 		
 		#try to call the relevant reader
 		try:
-			result=eval("self.Load_%d_%d(file)"%(major,minor))
+			loader=getattr(self,"Load_%d_%d"%(major,minor))
 		except AttributeError, e:
 			file.close()
 			raise DotPlotFileError, "Cannot load version %d.%d of the freckle file format. Do you have the latest version?"%(major,minor)
 		
+		result=loader(file,region)
 		file.close()
 		
 		return result
 	
-	def Load_0_1(self,file):
+	def Load_0_1(self,file,region=None):
 		"""
-		\brief load version 0.1 of the file format
+		\brief load version 0.1 of the file format. The dots are stored raw, so region is ignored
 		"""
 		reader=lambda format: unpack(format, file.read( calcsize( format ) ) )
 		
@@ -1178,8 +1276,18 @@ class DotPlot:
 		self.ktup,self.window,self.minmatch,self.mismatch=reader("iiii")
 		
 		# write the generating filenames and filebounds.
+		metadata=pickle.load(file)
 		[self.filenames, self.sequencebounds, self.sequenceboundids,
-			self.filebounds, self.size, self.globalfilebounds, self.globalsequencebounds]=pickle.load(file)
+			self.filebounds, self.size, self.globalfilebounds, self.globalsequencebounds]=metadata[:7]
+		extras=len(metadata)>7 and metadata[7] or {}
+		
+		# stores saved with 64 bit coordinates can only be loaded by the 64 bit library
+		self.widecoords=extras.get('coordsize',4)==8
+		if self.widecoords:
+			UseWideCoordinates()
+		
+		# self comparisons that were saved by half
+		symmetric=extras.get('symmetric',[])
 		
 		# read the datetime stamp
 		self.generatedon=reader("i")[0]
@@ -1189,16 +1297,65 @@ class DotPlot:
 		
 		# read each dotstore in
 		self.dotstore={}
+		self.pyramid={}
 		
 		for i in xrange(numstores):
-			key=reader("iiiii")
+			key=reader(self.widecoords and "qqqqq" or "iiiii")
 			fds,rds=DotStore(),DotStore()
+			if key in symmetric:
+				fds.SetSymmetric()
 			fds.Load(file)
 			rds.Load(file)
 			self.dotstore[key]=(fds,rds)
 		
 		
 	
+	def Load_0_2(self,file,region=None):
+		"""
+		\brief load version 0.2 of the file format. The same as 0.1 but the dots are in tiled, compressed sections
+		"""
+		reader=lambda format: unpack(format, file.read( calcsize( format ) ) )
+		
+		# read the generating parameters
+		# ktup, window, minmatch, mismatch
+		self.ktup,self.window,self.minmatch,self.mismatch=reader("iiii")
+		
+		# read the generating filenames and filebounds.
+		metadata=pickle.load(file)
+		[self.filenames, self.sequencebounds, self.sequenceboundids,
+			self.filebounds, self.size, self.globalfilebounds, self.globalsequencebounds]=metadata[:7]
+		extras=len(metadata)>7 and metadata[7] or {}
+		
+		self.widecoords=extras.get('coordsize',4)==8
+		if self.widecoords:
+			UseWideCoordinates()
+		
+		# read the datetime stamp
+		self.generatedon=reader("i")[0]
+		
+		# read number of dotstores
+		numstores=reader("i")[0]
+		
+		# read each dotstore in. The sections know if they are symmetric
+		self.dotstore={}
+		
+		for i in xrange(numstores):
+			key=reader(self.widecoords and "qqqqq" or "iiiii")
+			fds,rds=DotStore(),DotStore()
+			fds.ReadSection(file,region)
+			rds.ReadSection(file,region)
+			self.dotstore[key]=(fds,rds)
+		
+		# and the density pyramids, in files that have them. They are always whole, whatever region was loaded
+		self.pyramid={}
+		for i in xrange(extras.get('pyramids',0)):
+			key=reader(self.widecoords and "qqqqq" or "iiiii")
+			pyramid=DensityPyramid()
+			pyramid.ReadSection(file)
+			self.pyramid[key]=pyramid
+		
+		
+	
 	def IndexDotStores(self):
 		"""
 		\brief Indexes all the calculated DotStore
@@ -1206,6 +1363,23 @@ class DotPlot:
 		# create indexes
 		[[dots.CreateIndex() for dots in stores] for stores in self.dotstore.values()]
 	
+	def BuildPyramids(self):
+		"""
+		\brief Works out the density pyramid of every pair of stores that hasn't got one
+		\details the stores are indexed, but needn't be interpolated. See DensityPyramid
+		"""
+		for key in self.dotstore.keys():
+			if type(key)!=tuple or key in self.pyramid:
+				continue				# conserved regions aren't matches
+			
+			(dim,start,end,compstart,compend)=key
+			forward,reverse=self.dotstore[key]
+			forward.CreateIndex()
+			reverse.CreateIndex()
+			pyramid=DensityPyramid()
+			pyramid.Create(forward,reverse,compend-compstart,end-start)
+			self.pyramid[key]=pyramid
+	
 	def MakeAverageGrid(self,scale,x1=None,y1=None,x2=None,y2=None,storekey=None, conserved=False):
 		"""
 		\brief Calculates the reduced score grid
@@ -1235,15 +1409,62 @@ class DotPlot:
 			x2=width
 			y2=height
 				
-		# forward and reverse grid
-		grid=[DotGrid(),DotGrid()]
+		# forward and reverse in one grid, the reverse dots flipped upside down as they go in
+		sources=list(self.dotstore[key])
+		transforms=[GridTransform(),GridTransform(flip=True)]
+		grid=DotGrid()
+		
+		# any view no finer than the pyramid's cells is resampled from it rather than made from the dots. a zoomed out
+		# view is where counting the dots costs the most, and there the bases in each cell are what there is to see
+		pyramid=self.pyramid.get(key)
+		resampled=pyramid.MakeGrid(x1,y1,x2,y2,scale) if pyramid and scale>=pyramid.GetCellSize() else None
+		if resampled:
+			grid=resampled
+		elif self.antialias:
+			grid.CalculateFractional(sources,x1,y1,x2,y2,scale,transforms)
+		elif self.segments:
+			grid.CalculateCoverage(sources,x1,y1,x2,y2,scale,self.celltype,transforms)
+		else:
+			grid.Calculate(sources,x1,y1,x2,y2,scale,self.window,self.celltype,transforms)
+		self.grid[key]=grid
+		
+		return grid
+		
+	def WriteImage(self, filename, scale, storekey=None, bits=8):
+		"""
+		\brief Writes the bare dot plot straight out to an image file, with no axes or annotations
+		\details the file is a PGM if filename ends in .pgm or .pnm, and a PNG otherwise. Rows are streamed out as they
+		are made rather than going through PIL, so the plot can be as big as the disk allows. Unless segments or
+		antialias are set the grid is never made whole either, just a band of rows at a time
+		\param scale as for MakeAverageGrid
+		"""
+		if storekey==None:
+			storekey=(1,0,self.GetSequenceLength(1),0,self.GetSequenceLength(0))
+		
+		format=PNM if os.path.splitext(filename)[1].lower() in (".pgm",".pnm") else PNG
 		
-		[g.Calculate(dots,x1,y1,x2,y2,scale,self.window) for g,dots in zip(grid,self.dotstore[key])]
-		grid[1].FlipInplace()
-		grid[0].AddInplace(grid[1])
-		self.grid[key]=grid[0]
+		if self.segments or self.antialias:
+			self.MakeAverageGrid(scale,storekey=storekey).WriteImage(filename,format,self.normalise,bits)
+			return
 		
-		return grid[0]
+		(dim,start,end,compstart,compend)=storekey
+		forward,reverse=self.dotstore[storekey]
+		WriteBandedImage(filename,forward,reverse,0,0,compend-compstart,end-start,scale,self.window,format,self.normalise,bits)
+		
+	def WriteTiles(self, path, scale, storekey=None, layout=XYZ, tilesize=256, bits=8):
+		"""
+		\brief Writes the dot plot out as a pyramid of image tiles for a zoomable viewer
+		\details the finest level is worked out from the dots a band of tiles at a time and each coarser level is made
+		from the one below, so nothing bigger than a band of each level is ever held. See WriteTilePyramid
+		\param scale the bases across a cell of the finest level
+		\param layout XYZ for path/z/x/y.png, or DEEPZOOM for path.dzi and path_files/
+		"""
+		if storekey==None:
+			storekey=(1,0,self.GetSequenceLength(1),0,self.GetSequenceLength(0))
+		
+		(dim,start,end,compstart,compend)=storekey
+		WriteTilePyramid(path,list(self.dotstore[storekey]),compend-compstart,end-start,scale,self.window,
+			[GridTransform(),GridTransform(flip=True)],layout,tilesize,PNG,self.normalise,bits)
 		
 	def MakeImage(self, storekey=None,major=None,minor=None,seqbound=(0,0,255),filebound=(255,0,0),alpha=24, conserved=False, invert=False):
 		"""
@@ -1254,7 +1475,7 @@ class DotPlot:
 		
 		key="conserved" if conserved else storekey
 		
-		string=self.grid[key].ToString()
+		string=self.grid[key].ToString(self.normalise)
 		image=Image.fromstring("L", (self.grid[key].GetWidth(),self.grid[key].GetHeight()), string)
 		
 		if invert:
@@ -1683,9 +1904,14 @@ class LBDotPlot(DotPlot):
 		compseq=decodeseq(self.GetSubSequence(dimension,start,end))
 		tableseq=decodeseq(self.GetSubSequence(1-dimension,compstart,compend))
 		
+		# libfreckle spots a self comparison by being handed the same sequence twice, and then only stores half of it
+		if compseq==tableseq:
+			compseq=tableseq
+		
 		# make a dotstore for this region
 		dotstore,revdotstore=self.Compare(None, tableseq, compseq, self.ktup, self.window, self.mismatch, self.minmatch)
 		self.dotstore[ (dimension,start,end,compstart,compend) ] = (dotstore, revdotstore)
+		self.pyramid.pop((dimension,start,end,compstart,compend), None)
 				
 		# make sure the dotstore sizes are the same (and maximal)
 		maxx=max(dotstore.GetMaxX(), revdotstore.GetMaxX())
@@ -1702,7 +1928,7 @@ class LBDotPlot(DotPlot):
 		return (dotstore, revdotstore)
 	
 	def Compare(self,table,tableseq,compseq,ktup,window,mismatch,minmatch):
-		return doFastComparison(tableseq,compseq,ktup,window,mismatch,minmatch)
+		return doFastComparison(tableseq,compseq,ktup,window,mismatch,minmatch,checkpoint=self.checkpoint)
 
 
 #	
@@ -175,19 +175,11 @@ def main():
 	plot.IndexDotStores()
 	print time()-t,"seconds"
 	
-	# now we start drawing our subimages
-	width,height=plot.GetSequenceLength(0),plot.GetSequenceLength(1)
-	
-	for level in xrange(10):
-		order=2**level
-		sw=float(width)/order
-		sh=float(height)/order
-		for xpos in xrange(2**level):
-			for ypos in xrange(2**level):
-				print "processing",level,xpos,ypos
-				grid=plot.MakeAverageGrid(scale/order,xpos*sw,ypos*sh,xpos*sw+sw,ypos*sh+sh)
-				image=grid.MakeImage()
-				image.save("tiled/image-%d-%d-%d.png"%(level,xpos,ypos))
+	# now we draw the tiles, ten levels of them, as tiled/z/x/y.png
+	print "tiling"
+	t=time()
+	plot.WriteTiles("tiled",scale/2**9,tilesize=imagesize+imagesize%2)
+	print time()-t,"seconds"
 	
 	#print "averaging"
 	#t=time()
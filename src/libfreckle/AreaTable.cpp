@@ -0,0 +1,44 @@
+#include "AreaTable.h"
+#include <string.h>
+
+AreaTable::AreaTable(Coord cellsize, int width, int height)
+{
+	assert(cellsize>0);
+	assert(width>=0 && height>=0);
+
+	this->cellsize=cellsize;
+	this->width=width;
+	this->height=height;
+	integrated=false;
+
+	size_t num=(size_t)(width+1)*(height+1);
+	sums=new long long[num];
+	memset(sums,0,sizeof(long long)*num);
+}
+
+AreaTable::~AreaTable()
+{
+	delete [] sums;
+}
+
+void AreaTable::Integrate()
+{
+	assert(!integrated);
+
+	// along each row, then down each column. The first row and column stay 0
+	size_t stride=width+1;
+	for(int y=1; y<=height; y++)
+	{
+		long long *row=sums+(size_t)y*stride;
+		for(int x=1; x<=width; x++)
+			row[x]+=row[x-1];
+	}
+	for(int y=2; y<=height; y++)
+	{
+		long long *row=sums+(size_t)y*stride, *above=row-stride;
+		for(int x=1; x<=width; x++)
+			row[x]+=above[x];
+	}
+
+	integrated=true;
+}
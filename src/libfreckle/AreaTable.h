@@ -0,0 +1,71 @@
+#ifndef _AREATABLE_H_
+#define _AREATABLE_H_
+
+#include "Dot.h"
+#include <assert.h>
+#include <stddef.h>
+
+/*
+** AreaTable
+** =========
+** a summed-area table of the bases of match in every cell of a plot, the cells cellsize bases across. Once it is
+** integrated, the bases in any block of whole cells are four lookups, however many dots there are.
+**
+** Entry x,y is the sum of the cells above and to the left of it, so the table is one bigger each way than the cells
+** and its first row and column are 0. DotStore::CreateAreaTable() fills it from the dots and integrates it, and
+** DotStore::CountAreaBases() uses it for the whole cells of a rectangle, leaving only its ragged edges to the index.
+*/
+
+class AreaTable
+{
+private:
+	Coord cellsize;
+	int width, height;			// in cells
+	long long *sums;
+	bool integrated;
+
+public:
+	//! \brief an empty table of width by height cells, each cellsize bases across
+	AreaTable(Coord cellsize, int width, int height);
+	~AreaTable();
+
+	//! \brief add bases to cell x,y. Only before the table is integrated
+	inline void Add(int x, int y, long long bases)
+	{
+		assert(!integrated);
+		assert(x>=0 && x<width);
+		assert(y>=0 && y<height);
+		sums[(size_t)(y+1)*(width+1)+x+1]+=bases;
+	}
+
+	//! \brief turn the cells into the running sums that Sum() looks up
+	void Integrate();
+
+	//! \brief the bases in cells x1,y1 to x2,y2 (inclusive)
+	inline long long Sum(int x1, int y1, int x2, int y2) const
+	{
+		assert(integrated);
+		assert(x1>=0 && x1<=x2 && x2<width);
+		assert(y1>=0 && y1<=y2 && y2<height);
+		size_t stride=width+1;
+		return sums[(size_t)(y2+1)*stride+x2+1]-sums[(size_t)y1*stride+x2+1]-sums[(size_t)(y2+1)*stride+x1]+sums[(size_t)y1*stride+x1];
+	}
+
+	inline Coord GetCellSize() const
+	{
+		return cellsize;
+	}
+
+	//! \brief how many cells across and down the table is
+	inline int GetWidth() const
+	{
+		return width;
+	}
+
+	inline int GetHeight() const
+	{
+		return height;
+	}
+};
+
+#endif
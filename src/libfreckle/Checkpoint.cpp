@@ -0,0 +1,268 @@
+#include "Checkpoint.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define CHECKPOINT_RECORDSIZE	(4*sizeof(Coord))
+
+/*
+** CheckpointSink
+*/
+CheckpointSink::CheckpointSink(ComparisonCheckpoint *checkpoint, int strand, DotSink *next)
+{
+	this->checkpoint=checkpoint;
+	this->strand=strand;
+	this->next=next;
+}
+
+void CheckpointSink::SetSymmetric(bool sym)
+{
+	next->SetSymmetric(sym);
+}
+
+void CheckpointSink::AddDot(Coord x, Coord y, Coord length)
+{
+	checkpoint->Log(strand, x, y, length);
+	next->AddDot(x, y, length);
+}
+
+bool CheckpointSink::Close()
+{
+	return next->Close();
+}
+
+/*
+** ComparisonCheckpoint
+*/
+ComparisonCheckpoint::ComparisonCheckpoint(const char *path, int interval)
+{
+	this->path=strdup(path);
+	this->interval=interval;
+
+	fd=-1;
+	ok=false;
+	lastmark=time(NULL);
+
+	buffer=new Coord[CHECKPOINT_BUFFERSIZE*4];
+	buffered=0;
+
+	sinks[0]=sinks[1]=NULL;
+}
+
+// the checkpoint file is left behind, so a killed comparison can be started again
+ComparisonCheckpoint::~ComparisonCheckpoint()
+{
+	if(fd!=-1)
+		close(fd);
+
+	delete sinks[0];
+	delete sinks[1];
+	delete [] buffer;
+	free(path);
+}
+
+// FNV-1a
+unsigned long long ComparisonCheckpoint::Hash(const char *seq1, Coord len1, const char *seq2, Coord len2, const int *parameters, int numparameters)
+{
+	unsigned long long hash=14695981039346656037ULL;
+	const unsigned long long prime=1099511628211ULL;
+
+	for(Coord i=0; i<len1; i++)
+		hash=(hash^(unsigned char)seq1[i])*prime;
+	hash=(hash^0xff)*prime;				// so moving bases from one sequence to the other changes the hash
+	for(Coord i=0; i<len2; i++)
+		hash=(hash^(unsigned char)seq2[i])*prime;
+
+	Coord lengths[2]={len1, len2};
+	const unsigned char *bytes=(const unsigned char *)lengths;
+	for(size_t i=0; i<sizeof(lengths); i++)
+		hash=(hash^bytes[i])*prime;
+
+	bytes=(const unsigned char *)parameters;
+	for(size_t i=0; i<numparameters*sizeof(int); i++)
+		hash=(hash^bytes[i])*prime;
+
+	return hash;
+}
+
+bool ComparisonCheckpoint::StartAfresh(unsigned long long hash)
+{
+	unsigned char header[CHECKPOINT_HEADERSIZE];
+	unsigned int coordsize=sizeof(Coord);
+	memcpy(header, "FCP1", 4);
+	memcpy(header+4, &coordsize, 4);
+	memcpy(header+8, &hash, 8);
+
+	return ftruncate(fd, 0)==0 && pwrite(fd, header, CHECKPOINT_HEADERSIZE, 0)==CHECKPOINT_HEADERSIZE &&
+		lseek(fd, CHECKPOINT_HEADERSIZE, SEEK_SET)==CHECKPOINT_HEADERSIZE;
+}
+
+bool ComparisonCheckpoint::Start(unsigned long long hash, DotSink *forward, DotSink *reverse, int *strand, Coord *position)
+{
+	*strand=0;
+	*position=0;
+	buffered=0;
+
+	fd=open(path, O_RDWR|O_CREAT, 0644);
+	if(fd==-1)
+	{
+		printf("ComparisonCheckpoint: could not open %s. Carrying on without checkpoints\n",path);
+		return ok=false;
+	}
+
+	// is this a checkpoint of the same comparison?
+	unsigned char header[CHECKPOINT_HEADERSIZE];
+	unsigned int coordsize=0;
+	unsigned long long filehash=0;
+	bool same=(pread(fd, header, CHECKPOINT_HEADERSIZE, 0)==CHECKPOINT_HEADERSIZE && !memcmp(header, "FCP1", 4));
+	if(same)
+	{
+		memcpy(&coordsize, header+4, 4);
+		memcpy(&filehash, header+8, 8);
+		same=(coordsize==sizeof(Coord) && filehash==hash);
+	}
+
+	if(!same)
+	{
+		ok=StartAfresh(hash);
+		if(!ok)
+			printf("ComparisonCheckpoint: could not write %s. Carrying on without checkpoints\n",path);
+		lastmark=time(NULL);
+		return ok;
+	}
+
+	// find the last mark. anything after it was found after the checkpoint and will be found again
+	Coord *records=buffer;
+	off_t offset=CHECKPOINT_HEADERSIZE, markend=CHECKPOINT_HEADERSIZE;
+	ssize_t got;
+	while((got=pread(fd, records, CHECKPOINT_BUFFERSIZE*CHECKPOINT_RECORDSIZE, offset))>0)
+	{
+		int num=got/CHECKPOINT_RECORDSIZE;
+		for(int i=0; i<num; i++)
+			if(records[i*4]==CHECKPOINT_MARK)
+			{
+				markend=offset+(i+1)*CHECKPOINT_RECORDSIZE;
+				*strand=records[i*4+1];
+				*position=records[i*4+2];
+			}
+
+		if(num<CHECKPOINT_BUFFERSIZE)
+			break;
+		offset+=got;
+	}
+
+	// replay the dots up to it
+	off_t replayed=CHECKPOINT_HEADERSIZE;
+	for(offset=CHECKPOINT_HEADERSIZE; offset<markend; )
+	{
+		size_t want=markend-offset;
+		if(want>CHECKPOINT_BUFFERSIZE*CHECKPOINT_RECORDSIZE)
+			want=CHECKPOINT_BUFFERSIZE*CHECKPOINT_RECORDSIZE;
+		got=pread(fd, records, want, offset);
+		if(got!=(ssize_t)want)
+			break;
+
+		for(int i=0; i<(int)(want/CHECKPOINT_RECORDSIZE); i++)
+		{
+			Coord *record=records+i*4;
+			if(record[0]==0)
+				forward->AddDot(record[1], record[2], record[3]);
+			else if(record[0]==1)
+				reverse->AddDot(record[1], record[2], record[3]);
+			else if(record[0]==CHECKPOINT_MARK)
+			{
+				replayed=offset+(i+1)*CHECKPOINT_RECORDSIZE;
+				*strand=record[1];
+				*position=record[2];
+			}
+		}
+		offset+=got;
+	}
+
+	if(replayed!=markend)
+	{
+		// we read it a moment ago, so this is a failing disk. Carry on from the last mark we got to; the dots
+		// replayed after it will turn up twice
+		printf("ComparisonCheckpoint: could not read all of %s\n",path);
+		markend=replayed;
+		if(markend==CHECKPOINT_HEADERSIZE)
+			*strand=*position=0;
+	}
+
+	ok=(ftruncate(fd, markend)==0 && lseek(fd, markend, SEEK_SET)==markend);
+	if(!ok)
+		printf("ComparisonCheckpoint: could not write %s. Carrying on without checkpoints\n",path);
+
+	printf("ComparisonCheckpoint: resuming strand %d from %lld\n",*strand,(long long)*position);
+	lastmark=time(NULL);
+	return ok;
+}
+
+DotSink *ComparisonCheckpoint::GetSink(int strand, DotSink *next)
+{
+	assert(strand==0 || strand==1);
+	delete sinks[strand];
+	sinks[strand]=new CheckpointSink(this, strand, next);
+	return sinks[strand];
+}
+
+bool ComparisonCheckpoint::Append(Coord tag, Coord x, Coord y, Coord length)
+{
+	Coord *record=buffer+buffered*4;
+	record[0]=tag;
+	record[1]=x;
+	record[2]=y;
+	record[3]=length;
+
+	if(++buffered==CHECKPOINT_BUFFERSIZE)
+		return Flush();
+	return ok;
+}
+
+bool ComparisonCheckpoint::Flush()
+{
+	const char *p=(const char *)buffer;
+	size_t length=buffered*CHECKPOINT_RECORDSIZE;
+	buffered=0;
+
+	while(ok && length)
+	{
+		ssize_t written=write(fd, p, length);
+		if(written<=0)
+		{
+			printf("ComparisonCheckpoint: failed writing %s. Carrying on without checkpoints\n",path);
+			ok=false;
+			break;
+		}
+		p+=written;
+		length-=written;
+	}
+
+	return ok;
+}
+
+bool ComparisonCheckpoint::Mark(int strand, Coord position)
+{
+	if(!ok)
+		return false;
+
+	// the mark only counts once everything before it is safely on disk
+	if(Append(CHECKPOINT_MARK, strand, position, 0) && Flush())
+		fdatasync(fd);
+
+	lastmark=time(NULL);
+	return ok;
+}
+
+void ComparisonCheckpoint::Finish()
+{
+	if(fd!=-1)
+		close(fd);
+	fd=-1;
+	ok=false;
+
+	unlink(path);
+}
@@ -0,0 +1,108 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <time.h>
+#include "Dot.h"
+#include "DotSink.h"
+
+/*
+** ComparisonCheckpoint
+** ====================
+** lets a long comparison pick up where it left off after being killed.
+**
+** Every dot the engine finds is journalled to a sidecar file as it goes to its sink, and every so often the engine
+** marks how far it has got (which strand, and the outer loop position it will do next). When a comparison is started
+** again with the same checkpoint file, and the file was made from the same sequences and parameters (checked by
+** hash), the journalled dots up to the last mark are replayed into the new sinks, anything after the mark is thrown
+** away, and the engine carries on from the mark.
+**
+** file layout (native byte order)  "FCP1" u32 coordsize, u64 hash of the inputs
+**                                  then records of four Coords: tag, x, y, length
+**                                  tag 0 is a forward dot, tag 1 a reverse dot, tag 2 a mark where x is the strand and
+**                                  y is the position
+*/
+
+#define CHECKPOINT_HEADERSIZE	16
+#define CHECKPOINT_BUFFERSIZE	4096			// records journalled before they are written out
+
+#define CHECKPOINT_MARK		2
+
+#define CHECKPOINT_CHECKMASK	1023			// the engines look at the clock every 1024 times round their loops
+
+class ComparisonCheckpoint;
+
+// passes dots on to a real sink, journalling them on the way
+class CheckpointSink : public DotSink
+{
+private:
+	ComparisonCheckpoint *checkpoint;
+	int strand;
+	DotSink *next;
+
+public:
+	CheckpointSink(ComparisonCheckpoint *checkpoint, int strand, DotSink *next);
+
+	void SetSymmetric(bool sym);
+	void AddDot(Coord x, Coord y, Coord length);
+	bool Close();
+};
+
+class ComparisonCheckpoint
+{
+private:
+	char *path;
+	int fd;
+	bool ok;
+
+	int interval;					// seconds between marks
+	time_t lastmark;
+
+	Coord *buffer;					// journal records waiting to be written
+	int buffered;
+
+	CheckpointSink *sinks[2];
+
+	bool Append(Coord tag, Coord x, Coord y, Coord length);
+	bool Flush();
+	bool StartAfresh(unsigned long long hash);
+
+public:
+	//! \brief a checkpoint kept in the file at path, marked at most every interval seconds
+	ComparisonCheckpoint(const char *path, int interval=60);
+	~ComparisonCheckpoint();
+
+	//! \brief a hash of the sequences and the parameters of a comparison, for Start()
+	static unsigned long long Hash(const char *seq1, Coord len1, const char *seq2, Coord len2, const int *parameters, int numparameters);
+
+	//! \brief open the checkpoint file for a comparison with inputs that hash to hash
+	//! \details if the file holds a checkpoint of the same comparison, its dots are sent to forward and reverse and
+	//! strand and position are set to where the comparison got to. Otherwise the file is started again and they are 0.
+	//! forward and reverse must already know if they are symmetric
+	//! \return false if the file could not be used. The comparison can still run, it just won't be checkpointed
+	bool Start(unsigned long long hash, DotSink *forward, DotSink *reverse, int *strand, Coord *position);
+
+	//! \brief the sink the engine should send the dots of a strand (0 forward, 1 reverse) to
+	DotSink *GetSink(int strand, DotSink *next);
+
+	//! \brief record a dot on its way to a sink
+	inline void Log(int strand, Coord x, Coord y, Coord length)
+	{
+		if(ok)
+			Append(strand, x, y, length);
+	}
+
+	//! \brief the engine has finished everything before position on strand. Marks the checkpoint if it is due
+	inline void Reached(int strand, Coord position)
+	{
+		if(ok && time(NULL)-lastmark>=interval)
+			Mark(strand, position);
+	}
+
+	//! \brief write out everything journalled so far and mark the checkpoint at strand and position now
+	bool Mark(int strand, Coord position);
+
+	//! \brief the comparison is complete. The checkpoint file is removed
+	void Finish();
+};
+
+#endif
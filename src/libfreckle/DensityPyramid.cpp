@@ -0,0 +1,341 @@
+#include "DensityPyramid.h"
+#include "SectionIO.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+DensityPyramid::DensityPyramid()
+{
+	width=height=0;
+	cellsize=0;
+	numlevels=0;
+	widths=heights=NULL;
+	levels=NULL;
+}
+
+DensityPyramid::~DensityPyramid()
+{
+	Free();
+}
+
+void DensityPyramid::Free()
+{
+	for(int level=0; level<numlevels; level++)
+		delete [] levels[level];
+	delete [] levels;
+	delete [] widths;
+	delete [] heights;
+
+	levels=NULL;
+	widths=heights=NULL;
+	numlevels=0;
+}
+
+void DensityPyramid::Allocate(Coord width, Coord height, Coord cellsize)
+{
+	Free();
+
+	this->width=width;
+	this->height=height;
+	this->cellsize=cellsize;
+
+	// halved until it is a single cell
+	int w=(int)((width+cellsize-1)/cellsize), h=(int)((height+cellsize-1)/cellsize);
+	numlevels=1;
+	for(int lw=w, lh=h; lw>1 || lh>1; numlevels++)
+	{
+		lw=(lw+1)/2;
+		lh=(lh+1)/2;
+	}
+
+	widths=new int[numlevels];
+	heights=new int[numlevels];
+	levels=new long long*[numlevels];
+	for(int level=0; level<numlevels; level++)
+	{
+		widths[level]=w;
+		heights[level]=h;
+		size_t num=(size_t)2*w*h;
+		levels[level]=new long long[num];
+		memset(levels[level],0,sizeof(long long)*num);
+		w=(w+1)/2;
+		h=(h+1)/2;
+	}
+}
+
+void DensityPyramid::CountBases(DotStore *store, long long *cells)
+{
+	int columns=widths[0], rows=heights[0];
+	store->GetSegmentIndex();		// made now, rather than by the first thread to want it
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int y=0; y<rows; y++)
+		for(int x=0; x<columns; x++)
+		{
+			// the last cells stop at the end of the plot, as matches running past it are cut off there
+			Coord x2=(x+1)*cellsize<width?(x+1)*cellsize:width, y2=(y+1)*cellsize<height?(y+1)*cellsize:height;
+			cells[(size_t)y*columns+x]=store->CountAreaBases(x*cellsize,y*cellsize,x2-1,y2-1);
+		}
+}
+
+void DensityPyramid::Create(DotStore *forward, DotStore *reverse, Coord width, Coord height, Coord cellsize)
+{
+	assert(forward);
+	assert(width>0 && height>0);
+
+	if(cellsize<=0)
+	{
+		Coord longest=width>height?width:height;
+		cellsize=(longest+DENSITYPYRAMID_MAXSIDE-1)/DENSITYPYRAMID_MAXSIDE;
+	}
+	Allocate(width,height,cellsize);
+
+	CountBases(forward,levels[0]);
+	if(reverse)
+		CountBases(reverse,levels[0]+(size_t)widths[0]*heights[0]);
+
+	// every cell above is the sum of the two by two below it, forward and reverse rows alike
+	for(int level=1; level<numlevels; level++)
+	{
+		int belowcolumns=widths[level-1], belowrows=heights[level-1];
+		int columns=widths[level], rows=heights[level];
+		for(int strand=0; strand<2; strand++)
+		{
+			const long long *from=levels[level-1]+(size_t)strand*belowcolumns*belowrows;
+			long long *to=levels[level]+(size_t)strand*columns*rows;
+			for(int y=0; y<belowrows; y++)
+				for(int x=0; x<belowcolumns; x++)
+					to[(size_t)(y/2)*columns+x/2]+=from[(size_t)y*belowcolumns+x];
+		}
+	}
+}
+
+long long DensityPyramid::Write(int fd, long long offset) const
+{
+	assert(numlevels);
+
+	long long position=DENSITYPYRAMID_HEADERSIZE;
+	bool ok=true;
+	for(int level=0; level<numlevels && ok; level++)
+	{
+		size_t num=(size_t)2*widths[level]*heights[level];
+		uLongf rawsize=num*8;
+		unsigned char *raw=new unsigned char[rawsize];
+		for(size_t i=0; i<num; i++)
+			Put64(raw+i*8,levels[level][i]);
+
+		uLongf compressedsize=compressBound(rawsize);
+		unsigned char *compressed=new unsigned char[8+compressedsize];
+		if(compress2(compressed+8,&compressedsize,raw,rawsize,Z_DEFAULT_COMPRESSION)!=Z_OK)
+		{
+			printf("DensityPyramid: failed to compress level %d\n",level);
+			ok=false;
+		}
+		else
+		{
+			Put64(compressed,compressedsize);
+			ok=WriteAt(fd,compressed,8+compressedsize,offset+position);
+			position+=8+compressedsize;
+		}
+
+		delete [] compressed;
+		delete [] raw;
+	}
+
+	if(ok)
+	{
+		unsigned char header[DENSITYPYRAMID_HEADERSIZE];
+		memcpy(header,"FDPY",4);
+		Put32(header+4,DENSITYPYRAMID_VERSION);
+		Put32(header+8,0);
+		Put64(header+12,cellsize);
+		Put64(header+20,width);
+		Put64(header+28,height);
+		Put64(header+36,numlevels);
+		Put64(header+44,position);
+		ok=WriteAt(fd,header,DENSITYPYRAMID_HEADERSIZE,offset);
+	}
+
+	if(!ok)
+	{
+		printf("DensityPyramid: could not write the pyramid\n");
+		return -1;
+	}
+	return offset+position;
+}
+
+long long DensityPyramid::Read(int fd, long long offset)
+{
+	unsigned char header[DENSITYPYRAMID_HEADERSIZE];
+	if(!ReadAt(fd,header,DENSITYPYRAMID_HEADERSIZE,offset) || memcmp(header,"FDPY",4))
+	{
+		printf("DensityPyramid: no pyramid section at %lld\n",offset);
+		return -1;
+	}
+
+	if(Get32(header+4)!=DENSITYPYRAMID_VERSION)
+	{
+		printf("DensityPyramid: unknown pyramid section version %u\n",Get32(header+4));
+		return -1;
+	}
+
+	// the sizes drive the allocation, so check them before they are used. A level can't be much bigger than the section
+	// it was compressed into, as zlib packs at best a little over 1000 to 1
+	long long cell=Get64(header+12), w=Get64(header+20), h=Get64(header+28);
+	long long end=offset+Get64(header+44), filesize=FileSize(fd);
+	long long columns=cell>0?(w+cell-1)/cell:0, rows=cell>0?(h+cell-1)/cell:0;
+	if(cell<=0 || w<=0 || h<=0 || (Coord)cell!=cell || (Coord)w!=w || (Coord)h!=h ||
+		end<=offset+DENSITYPYRAMID_HEADERSIZE || end>filesize ||
+		(double)columns*(double)rows*16>(double)(end-offset)*1100)
+	{
+		printf("DensityPyramid: the pyramid at %lld has a bad size\n",offset);
+		return -1;
+	}
+
+	Allocate((Coord)w,(Coord)h,(Coord)cell);
+	if(Get64(header+36)!=numlevels)
+	{
+		printf("DensityPyramid: the pyramid at %lld has %lld levels rather than %d\n",offset,Get64(header+36),numlevels);
+		Free();
+		return -1;
+	}
+
+	long long position=offset+DENSITYPYRAMID_HEADERSIZE;
+	bool ok=true;
+	for(int level=0; level<numlevels && ok; level++)
+	{
+		unsigned char length[8];
+		ok=ReadAt(fd,length,8,position);
+		if(!ok)
+			break;
+		long long compressedsize=Get64(length);
+		position+=8;
+		if(compressedsize<=0 || compressedsize>end-position)
+		{
+			ok=false;
+			break;
+		}
+
+		size_t num=(size_t)2*widths[level]*heights[level];
+		uLongf rawsize=num*8;
+		unsigned char *compressed=new unsigned char[compressedsize];
+		unsigned char *raw=new unsigned char[rawsize];
+		ok=ReadAt(fd,compressed,compressedsize,position);
+		ok=ok && uncompress(raw,&rawsize,compressed,compressedsize)==Z_OK && rawsize==num*8;
+		for(size_t i=0; ok && i<num; i++)
+			levels[level][i]=Get64(raw+i*8);
+		position+=compressedsize;
+
+		delete [] raw;
+		delete [] compressed;
+	}
+
+	if(!ok)
+	{
+		printf("DensityPyramid: could not read the pyramid at %lld\n",offset);
+		Free();
+		return -1;
+	}
+	return end;
+}
+
+// the cells of a level, size across and num of them, that each of cells grid cells overlaps. Grid cell i runs from
+// start+i*scale to start+(i+1)*scale, or end if that is sooner. It overlaps count[i] level cells from first[i] on,
+// and weights has the fraction of each of them it covers, span to a grid cell. The last level cell stops at limit,
+// the end of the plot, as its bases do
+static void Overlaps(double start, double end, double scale, double size, double limit, int num, int cells, int span, int *first, int *count, double *weights)
+{
+	for(int i=0; i<cells; i++)
+	{
+		double a=start+i*scale, b=start+(i+1)*scale;
+		if(b>end)
+			b=end;
+
+		int c1=(int)floor(a/size), c2=(int)ceil(b/size)-1;
+		if(c1<0)
+			c1=0;
+		if(c2>num-1)
+			c2=num-1;
+
+		first[i]=c1;
+		count[i]=0;
+		for(int c=c1; c<=c2 && count[i]<span; c++)
+		{
+			double cellend=(c+1)*size<limit?(c+1)*size:limit;
+			double lo=c*size>a?c*size:a, hi=cellend<b?cellend:b;
+			weights[i*span+count[i]++]=hi>lo?(hi-lo)/(cellend-c*size):0.0;
+		}
+	}
+}
+
+bool DensityPyramid::Resample(DotGrid *grid, double x1, double y1, double x2, double y2, double scale, int strands) const
+{
+	assert(numlevels);
+	assert(x2>x1 && y2>y1);
+
+	if(scale<(double)cellsize)
+		return false;
+
+	// the coarsest level whose cells are no bigger than the grid's
+	int level=0;
+	while(level+1<numlevels && (double)cellsize*(double)(1LL<<(level+1))<=scale)
+		level++;
+	double size=(double)cellsize*(double)(1LL<<level);
+	int levelwidth=widths[level], levelheight=heights[level];
+
+	// sized as CalculateFractionalGrid() sizes it
+	int numx=(int)ceil((x2-x1)/scale-1e-9);
+	int numy=(int)ceil((y2-y1)/scale-1e-9);
+	grid->Destroy();
+	grid->CreateFractional(numx,numy);
+
+	// a grid cell is less than two level cells across, so it overlaps no more than span of them each way
+	int span=(int)(scale/size)+2;
+	int *colfirst=new int[numx], *colcount=new int[numx], *rowfirst=new int[numy], *rowcount=new int[numy];
+	double *colweights=new double[(size_t)numx*span], *rowweights=new double[(size_t)numy*span];
+	Overlaps(x1,x2,scale,size,(double)width,levelwidth,numx,span,colfirst,colcount,colweights);
+	Overlaps(y1,y2,scale,size,(double)height,levelheight,numy,span,rowfirst,rowcount,rowweights);
+
+	const long long *forward=levels[level], *reverse=forward+(size_t)levelwidth*levelheight;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int y=0; y<numy; y++)
+		for(int x=0; x<numx; x++)
+		{
+			double bases=0.0;
+			for(int strand=0; strand<2; strand++)
+			{
+				if(!(strands&(strand?DENSITYPYRAMID_REVERSE:DENSITYPYRAMID_FORWARD)))
+					continue;
+
+				// the reverse grid is flipped, so its row y is made from the level rows of row numy-1-y
+				int row=strand?numy-1-y:y;
+				const long long *cells=strand?reverse:forward;
+				for(int j=0; j<rowcount[row]; j++)
+				{
+					const long long *from=cells+(size_t)(rowfirst[row]+j)*levelwidth+colfirst[x];
+					double sum=0.0;
+					for(int i=0; i<colcount[x]; i++)
+						sum+=colweights[x*span+i]*(double)from[i];
+					bases+=rowweights[row*span+j]*sum;
+				}
+			}
+			grid->SetFraction(x,y,(float)bases);
+		}
+
+	delete [] colfirst;
+	delete [] colcount;
+	delete [] rowfirst;
+	delete [] rowcount;
+	delete [] colweights;
+	delete [] rowweights;
+
+	return true;
+}
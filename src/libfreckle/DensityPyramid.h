@@ -0,0 +1,125 @@
+#ifndef _DENSITYPYRAMID_H_
+#define _DENSITYPYRAMID_H_
+
+#include "DotStore.h"
+#include "DotGrid.h"
+
+/*
+** DensityPyramid
+** ==============
+** the bases of match in every cell of a plot at a ladder of resolutions, for the forward and the reverse store, so a
+** view of the plot at any zoom coarser than the finest level can be drawn without going back to the dots. It is made
+** once, saved in the dot plot file after the dot sections, and a view is resampled from the nearest level, which
+** costs the same however many dots there are.
+**
+** The finest level's cells are cellsize bases across, each the DotStore::CountAreaBases() of its square. A cell of
+** every level above is the sum of the two by two below it, which is exactly the bases in its bigger square. The last
+** cells of a level run past the end of the plot, so they are taken as ending where it does.
+**
+** Like a dot section, a pyramid section is little endian and 64 bit whatever the library is built with:
+**
+** section header  "FDPY" u32 version, u32 flags, i64 cellsize, plot width, plot height, numlevels, end
+** levels          for each level, finest first: i64 compressed size, then the zlib compressed cells as i64s, the
+**                 forward rows and then the reverse rows
+**
+** end is from the start of the section
+*/
+
+#define DENSITYPYRAMID_VERSION		1
+#define DENSITYPYRAMID_HEADERSIZE	(4+4+4+8*5)
+
+// the finest level has no more cells than this along the longest side of the plot
+#define DENSITYPYRAMID_MAXSIDE		1024
+
+// which stores Resample() adds up. The reverse one is flipped upside down within the grid, as a dot plot draws it
+#define DENSITYPYRAMID_FORWARD		1
+#define DENSITYPYRAMID_REVERSE		2
+#define DENSITYPYRAMID_BOTH		3
+
+class DensityPyramid
+{
+private:
+	Coord width, height;			// of the plot, in bases
+	Coord cellsize;
+	int numlevels;
+	int *widths, *heights;
+	long long **levels;			// the forward rows of each level, then the reverse rows
+
+	void Free();
+
+	// room for the levels of a plot width by height bases
+	void Allocate(Coord width, Coord height, Coord cellsize);
+
+	// the bases of one store in each cell of the finest level
+	void CountBases(DotStore *store, long long *cells);
+
+public:
+	DensityPyramid();
+	~DensityPyramid();
+
+	//! \brief make the pyramid of a plot width by height bases from its forward and reverse stores
+	//! \details the stores must be indexed. reverse may be NULL for a plot with only forward matches
+	//! \param cellsize the bases across a cell of the finest level. 0 picks the smallest that keeps the finest level
+	//! within DENSITYPYRAMID_MAXSIDE cells
+	void Create(DotStore *forward, DotStore *reverse, Coord width, Coord height, Coord cellsize=0);
+
+	//! \brief write the pyramid as a section of the file open as fd, starting at offset
+	//! \return the offset just after the section, or -1 on failure
+	long long Write(int fd, long long offset) const;
+
+	//! \brief read the section at offset of the file open as fd, replacing what we held
+	//! \return the offset just after the section, or -1 if there is no readable pyramid there
+	long long Read(int fd, long long offset);
+
+	//! \brief fill grid with the bases of match in each cell of the area x1,y1 - x2,y2, resampled from the pyramid
+	//! \details whatever the grid held is replaced. It is made fractional and sized just as DotGrid::CalculateFractionalGrid() sizes it, and it is
+	//! near what that would give: each cell takes the part of every cell of the coarsest level no bigger than it that
+	//! it overlaps, as though the bases in those were spread evenly
+	//! \param strands DENSITYPYRAMID_FORWARD, DENSITYPYRAMID_REVERSE or DENSITYPYRAMID_BOTH
+	//! \return false, leaving the grid alone, if scale is finer than the finest level. The dots are needed then
+	bool Resample(DotGrid *grid, double x1, double y1, double x2, double y2, double scale, int strands=DENSITYPYRAMID_BOTH) const;
+
+	inline Coord GetWidth() const
+	{
+		return width;
+	}
+
+	inline Coord GetHeight() const
+	{
+		return height;
+	}
+
+	inline Coord GetCellSize() const
+	{
+		return cellsize;
+	}
+
+	inline int GetNumLevels() const
+	{
+		return numlevels;
+	}
+
+	//! \brief the size of a level in cells. Level 0 is the finest, and the cells of level n are cellsize*2^n across
+	inline int GetLevelWidth(int level) const
+	{
+		assert(level>=0 && level<numlevels);
+		return widths[level];
+	}
+
+	inline int GetLevelHeight(int level) const
+	{
+		assert(level>=0 && level<numlevels);
+		return heights[level];
+	}
+
+	//! \brief the bases of the forward (reverse false) or reverse store in cell x,y of a level
+	inline long long GetCell(int level, bool reverse, int x, int y) const
+	{
+		assert(level>=0 && level<numlevels);
+		assert(x>=0 && x<widths[level]);
+		assert(y>=0 && y<heights[level]);
+		return levels[level][((size_t)reverse*heights[level]+y)*widths[level]+x];
+	}
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "DiagonalIndex.h"
+#include "RadixSort.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// for the odd store too spread out to make sort keys of
+static int CompareEntries(const void *a, const void *b)
+{
+	const DiagonalEntry *ea=(const DiagonalEntry *)a, *eb=(const DiagonalEntry *)b;
+	if(ea->diagonal!=eb->diagonal)
+		return (ea->diagonal<eb->diagonal)?-1:1;
+	if(ea->x!=eb->x)
+		return (ea->x<eb->x)?-1:1;
+	return 0;
+}
+
+// how many bits it takes to hold v
+static int Bits(unsigned long long v)
+{
+	int bits=0;
+	while(bits<64 && v>>bits)
+		bits++;
+	return bits;
+}
+
+DiagonalIndex::DiagonalIndex(DotStorageChunk *head, Coord numdots)
+{
+	num=numdots;
+	entries=new DiagonalEntry[num>0?num:1];
+	mindiagonal=maxdiagonal=minx=0;
+	xbits=0;
+	table=NULL;
+	tablesize=0;
+	removed=NULL;
+
+	if(!num)
+		return;
+
+	Coord maxx=0, n=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++, n++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			DiagonalEntry *entry=entries+n;
+			entry->diagonal=dot->x-dot->y;
+			entry->x=dot->x;
+
+			if(!n || entry->diagonal<mindiagonal) mindiagonal=entry->diagonal;
+			if(!n || entry->diagonal>maxdiagonal) maxdiagonal=entry->diagonal;
+			if(!n || entry->x<minx) minx=entry->x;
+			if(!n || entry->x>maxx) maxx=entry->x;
+		}
+	assert(n==num);
+
+	// differences taken unsigned, as they may not fit a Coord
+	xbits=Bits((unsigned long long)maxx-(unsigned long long)minx);
+	int diagonalbits=Bits((unsigned long long)maxdiagonal-(unsigned long long)mindiagonal);
+	if(xbits+diagonalbits<=64)
+	{
+		SortKey key;
+		key.mindiagonal=mindiagonal;
+		key.minx=minx;
+		key.xbits=xbits;
+
+		DiagonalEntry *scratch=new DiagonalEntry[num];
+		RadixSort(entries, scratch, num, xbits+diagonalbits, key);
+		delete [] scratch;
+	}
+	else
+		qsort(entries, num, sizeof(DiagonalEntry), CompareEntries);
+
+	BuildTable();
+}
+
+DiagonalIndex::~DiagonalIndex()
+{
+	delete [] entries;
+	delete [] table;
+	delete [] removed;
+}
+
+void DiagonalIndex::BuildTable()
+{
+	unsigned long long diagonals=(unsigned long long)maxdiagonal-(unsigned long long)mindiagonal+1;
+	if(!diagonals || diagonals>(unsigned long long)num*DIAGONAL_TABLERATIO)
+		return;
+
+	tablesize=diagonals;
+	table=new Coord[tablesize+1];
+
+	Coord diagonal=0;
+	for(Coord i=0; i<num; i++)
+		while(diagonal<=entries[i].diagonal-mindiagonal)
+			table[diagonal++]=i;
+	while(diagonal<=tablesize)
+		table[diagonal++]=num;
+}
+
+Coord DiagonalIndex::Find(Coord diagonal, Coord x, bool after) const
+{
+	Coord lo=0, hi=num;
+	if(table)
+	{
+		lo=table[diagonal-mindiagonal];
+		hi=table[diagonal-mindiagonal+1];
+	}
+	while(lo<hi)
+	{
+		Coord mid=lo+(hi-lo)/2;
+		if(entries[mid].diagonal<diagonal || (entries[mid].diagonal==diagonal && (entries[mid].x<x || (after && entries[mid].x==x))))
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	return lo;
+}
+
+Coord DiagonalIndex::Gap(Coord x, Coord y) const
+{
+	Coord diagonal=x-y;
+	if(!num || diagonal<mindiagonal || diagonal>maxdiagonal)
+		return 0;
+
+	// the first entry after x,y that hasn't been removed
+	Coord lo=Find(diagonal,x,true);
+	if(removed)
+		while(lo<num && removed[lo] && entries[lo].diagonal==diagonal)
+			lo++;
+
+	if(lo==num || entries[lo].diagonal!=diagonal)
+		return 0;
+	return entries[lo].x-x;
+}
+
+Coord DiagonalIndex::Remove(Coord x, Coord y)
+{
+	Coord diagonal=x-y;
+	if(!num || diagonal<mindiagonal || diagonal>maxdiagonal)
+		return 0;
+
+	if(!removed)
+	{
+		removed=new unsigned char[num];
+		memset(removed, 0, num);
+	}
+
+	// any one of the entries at x,y that is still there, counting the rest
+	Coord left=0;
+	bool done=false;
+	for(Coord i=Find(diagonal,x,false); i<num && entries[i].diagonal==diagonal && entries[i].x==x; i++)
+		if(!removed[i])
+		{
+			if(done)
+				left++;
+			else
+				removed[i]=1;
+			done=true;
+		}
+	return left;
+}
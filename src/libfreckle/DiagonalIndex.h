@@ -0,0 +1,90 @@
+#ifndef _DIAGONALINDEX_H_
+#define _DIAGONALINDEX_H_
+
+#include "Dot.h"
+#include "DotStorageChunk.h"
+#include <assert.h>
+#include <stdio.h>
+
+/*
+** DiagonalIndex
+** =============
+** a static index of the dots of a store by the diagonal they lie on, for walking along a match to where the next dot
+** on its diagonal starts.
+**
+** The dots' positions are radix sorted on their diagonal (x-y) and then x into one flat array, so each diagonal is a
+** contiguous run sorted by x and the next dot along is found by binary searching it. When there are not many more
+** diagonals than dots, where each diagonal's run starts is kept in a table so only that run is searched. Otherwise
+** the search is over the whole array. Dots deleted from the store later are flagged rather than taken out.
+*/
+
+#define DIAGONAL_TABLERATIO	4			// diagonals per dot we will keep a table of run starts for
+
+struct DiagonalEntry
+{
+	Coord diagonal;					// x-y
+	Coord x;
+};
+
+class DiagonalIndex
+{
+private:
+	DiagonalEntry *entries;				// sorted by diagonal and then by x
+	Coord num;
+
+	Coord mindiagonal, maxdiagonal;
+	Coord minx;
+	int xbits;					// bits of x, from minx, in a sort key
+
+	Coord *table;					// where the run of each diagonal from mindiagonal starts, and num. Or NULL
+	Coord tablesize;
+
+	unsigned char *removed;				// the entries of dots deleted since we were made. NULL until there are any
+
+	// the key entries are sorted on: the diagonal above the x, both from their smallest
+	struct SortKey
+	{
+		Coord mindiagonal, minx;
+		int xbits;
+
+		inline unsigned long long operator()(const DiagonalEntry &entry) const
+		{
+			return (((unsigned long long)entry.diagonal-(unsigned long long)mindiagonal)<<xbits) | ((unsigned long long)entry.x-(unsigned long long)minx);
+		}
+	};
+
+	void BuildTable();
+
+	// the first entry of diagonal from x on, or from just after x if after is set
+	Coord Find(Coord diagonal, Coord x, bool after) const;
+
+public:
+	//! \brief index the numdots dots in the chunks from head on
+	DiagonalIndex(DotStorageChunk *head, Coord numdots);
+	~DiagonalIndex();
+
+	inline Coord GetNum() const
+	{
+		return num;
+	}
+
+	//! \brief how far down the diagonal from x,y the next dot starts, so it is at x+gap,y+gap
+	//! \return the gap, or 0 if there are no more dots on the diagonal
+	Coord Gap(Coord x, Coord y) const;
+
+	//! \brief forget a dot at x,y, so Gap() passes over it. For a dot deleted from the store, which is still indexed
+	//! \return how many other dots are left at x,y
+	Coord Remove(Coord x, Coord y);
+
+#ifdef DEBUG
+	// dump the index to stdout
+	inline void Dump() const
+	{
+		printf("DiagonalIndex(%lld dots)\n=========================\n",(long long)num);
+		for(Coord i=0; i<num; i++)
+			printf("%lld\t%lld\n",(long long)entries[i].diagonal,(long long)entries[i].x);
+	}
+#endif
+};
+
+#endif
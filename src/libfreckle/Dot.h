@@ -1,14 +1,26 @@
 #ifndef _DOT_H_
 #define _DOT_H_
 
+// the type of our coordinates and lengths.
+// the default 32 bit layout keeps a Dot at 12 bytes and is good for sequences up to 2^31 bases. Build with
+// FRECKLE_64BIT_COORDS for anything bigger (eg. very large concatenated multi file axes).
+#ifdef FRECKLE_64BIT_COORDS
+typedef long long Coord;
+#else
+typedef int Coord;
+#endif
+
 struct structDot
 {
-	int x;
-	int y;
-	int length;
+	Coord x;
+	Coord y;
+	Coord length;
 };
 
 typedef struct structDot Dot;
 
-#endif
+// the length of a dot deleted from under an index. It stays where it is, so the index's pointers to the dots around it
+// stay good, until the store compacts it away. See DotStore::DelDot()
+#define DOT_DELETED		((Coord)-1)
 
+#endif
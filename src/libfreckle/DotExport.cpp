@@ -0,0 +1,299 @@
+#include "DotExport.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// the widest a number can print, sign included
+#define DOTEXPORT_NUMBERWIDTH	21
+
+// print a number in decimal. a lot quicker than going through printf
+static char *PutNumber(char *p, long long value)
+{
+	unsigned long long magnitude=value;
+	if(value<0)
+	{
+		*p++='-';
+		magnitude=-(unsigned long long)value;
+	}
+
+	char digits[DOTEXPORT_NUMBERWIDTH];
+	int n=0;
+	do
+	{
+		digits[n++]='0'+magnitude%10;
+		magnitude/=10;
+	}
+	while(magnitude);
+
+	while(n)
+		*p++=digits[--n];
+	return p;
+}
+
+DotExporter::DotExporter()
+{
+	fd=-1;
+	gz=NULL;
+	ok=false;
+
+	memset(axes, 0, sizeof(axes));
+
+	strand='+';
+	xoffset=yoffset=ylength=0;
+
+	block=new Dot[DOTEXPORT_BLOCKSIZE];
+	blockfill=0;
+	text=NULL;
+	slicecapacity=0;
+	SizeText();
+}
+
+DotExporter::~DotExporter()
+{
+	Close();
+
+	FreeAxis(0);
+	FreeAxis(1);
+	delete [] block;
+	delete [] text;
+}
+
+void DotExporter::FreeAxis(int axis)
+{
+	DotExportAxis *a=&axes[axis];
+	for(int i=0; i<a->numrecords; i++)
+		free(a->names[i]);
+	delete [] a->names;
+	delete [] a->starts;
+	memset(a, 0, sizeof(DotExportAxis));
+}
+
+// make room for a whole block of the longest lines we can write
+void DotExporter::SizeText()
+{
+	size_t longestline=axes[0].longestname+axes[1].longestname+6*DOTEXPORT_NUMBERWIDTH+16;
+	size_t capacity=longestline*DOTEXPORT_SLICESIZE;
+	if(text && capacity<=slicecapacity)
+		return;
+
+	delete [] text;
+	slicecapacity=capacity;
+	text=new char[slicecapacity*DOTEXPORT_NUMSLICES];
+}
+
+bool DotExporter::Open(const char *path, bool compress, int level)
+{
+	Close();
+
+	if(!strcmp(path,"-"))
+		fd=dup(1);
+	else
+		fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+
+	if(fd==-1)
+	{
+		printf("DotExporter: could not create %s\n",path);
+		return ok=false;
+	}
+
+	if(compress)
+	{
+		char mode[8];
+		sprintf(mode,"wb%d",level);
+		gz=gzdopen(fd, mode);
+		if(!gz)
+		{
+			printf("DotExporter: could not start compressing %s\n",path);
+			close(fd);
+			fd=-1;
+			return ok=false;
+		}
+	}
+
+	return ok=true;
+}
+
+bool DotExporter::Close()
+{
+	if(fd==-1)
+		return ok;
+
+	FlushBlock();
+
+	if(gz)
+	{
+		// closing the gzip stream closes fd too
+		if(gzclose(gz)!=Z_OK)
+			ok=false;
+		gz=NULL;
+	}
+	else if(close(fd)!=0)
+		ok=false;
+	fd=-1;
+
+	return ok;
+}
+
+void DotExporter::SetRecords(int axis, int num, const Coord *starts, const char * const *names)
+{
+	assert(axis==0 || axis==1);
+	assert(blockfill==0);
+
+	FreeAxis(axis);
+
+	DotExportAxis *a=&axes[axis];
+	a->numrecords=num;
+	a->starts=new Coord[num>0?num:1];
+	a->names=new char *[num>0?num:1];
+	for(int i=0; i<num; i++)
+	{
+		assert(i==0 || starts[i]>=starts[i-1]);
+		a->starts[i]=starts[i];
+		a->names[i]=strdup(names[i]);
+
+		int length=strlen(names[i]);
+		if(length>a->longestname)
+			a->longestname=length;
+	}
+
+	SizeText();
+}
+
+bool DotExporter::Write(DotStore *store, char strand, Coord xoffset, Coord yoffset, Coord ylength, Coord minlength)
+{
+	assert(fd!=-1);
+
+	// the block holds dots of one store at a time
+	FlushBlock();
+
+	this->strand=strand;
+	this->xoffset=xoffset;
+	this->yoffset=yoffset;
+	this->ylength=ylength;
+
+	bool symmetric=store->IsSymmetric();
+	for(DotStorageChunk *chunk=store->GetHead(); chunk && ok; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->length<minlength)
+				continue;
+
+			// leave room for a mirror
+			if(blockfill>=DOTEXPORT_BLOCKSIZE-1)
+				FlushBlock();
+
+			block[blockfill++]=*dot;
+			if(symmetric && dot->x!=dot->y)
+			{
+				block[blockfill].x=dot->y;
+				block[blockfill].y=dot->x;
+				block[blockfill].length=dot->length;
+				blockfill++;
+			}
+		}
+
+	FlushBlock();
+	return ok;
+}
+
+// format the block a slice per thread, then write the slices out in order
+void DotExporter::FlushBlock()
+{
+	if(!blockfill)
+		return;
+
+	int numslices=(blockfill+DOTEXPORT_SLICESIZE-1)/DOTEXPORT_SLICESIZE;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int slice=0; slice<numslices; slice++)
+	{
+		int first=slice*DOTEXPORT_SLICESIZE;
+		int count=blockfill-first<DOTEXPORT_SLICESIZE?blockfill-first:DOTEXPORT_SLICESIZE;
+		slicelength[slice]=FormatSlice(block+first, count, text+slice*slicecapacity);
+	}
+
+	for(int slice=0; slice<numslices && ok; slice++)
+		ok=WriteText(text+slice*slicecapacity, slicelength[slice]);
+
+	blockfill=0;
+}
+
+size_t DotExporter::FormatSlice(const Dot *dots, int count, char *out)
+{
+	char *p=out;
+	for(int i=0; i<count; i++)
+	{
+		Coord y=dots[i].y;
+		if(strand=='-' && ylength)
+			y=ylength-y-dots[i].length;
+
+		p=FormatPosition(p, 0, xoffset+dots[i].x, dots[i].length);
+		*p++=strand;
+		*p++='\t';
+		p=FormatPosition(p, 1, yoffset+y, dots[i].length);
+		p=PutNumber(p, dots[i].length);
+		*p++='\n';
+	}
+
+	assert((size_t)(p-out)<=slicecapacity);
+	return p-out;
+}
+
+// write "name\tstart\tend\t" for a position on an axis
+char *DotExporter::FormatPosition(char *p, int axis, Coord position, Coord length)
+{
+	DotExportAxis *a=&axes[axis];
+
+	// find the record the position is in
+	if(a->numrecords)
+	{
+		int low=0, high=a->numrecords-1;
+		while(low<high)
+		{
+			int mid=(low+high+1)/2;
+			if(a->starts[mid]<=position)
+				low=mid;
+			else
+				high=mid-1;
+		}
+
+		for(const char *name=a->names[low]; *name; )
+			*p++=*name++;
+		position-=a->starts[low];
+	}
+	else
+		*p++='*';
+	*p++='\t';
+
+	p=PutNumber(p, position);
+	*p++='\t';
+	p=PutNumber(p, position+length);
+	*p++='\t';
+
+	return p;
+}
+
+bool DotExporter::WriteText(const char *buffer, size_t length)
+{
+	if(gz)
+		return gzwrite(gz, buffer, length)==(int)length;
+
+	while(length)
+	{
+		ssize_t written=write(fd, buffer, length);
+		if(written<=0)
+		{
+			printf("DotExporter: write failed\n");
+			return false;
+		}
+		buffer+=written;
+		length-=written;
+	}
+	return true;
+}
@@ -0,0 +1,82 @@
+#ifndef _DOTEXPORT_H_
+#define _DOTEXPORT_H_
+
+#include <zlib.h>
+#include "Dot.h"
+#include "DotStore.h"
+
+/*
+** DotExporter
+** ===========
+** writes dots out as tab separated text, one match per line, optionally gzipped:
+**
+**   xname  xstart  xend  strand  yname  ystart  yend  length
+**
+** Coordinates are from 0 within the named sequence record and the ends are one past the last base, like BED and PAF.
+** The dots are gathered a block at a time, the block is cut into slices that are formatted in parallel (when built
+** with OpenMP), and the text goes out in one write per slice.
+*/
+
+#define DOTEXPORT_BLOCKSIZE	65536			// dots gathered before formatting
+#define DOTEXPORT_SLICESIZE	4096			// dots formatted by one thread at a time
+#define DOTEXPORT_NUMSLICES	(DOTEXPORT_BLOCKSIZE/DOTEXPORT_SLICESIZE)
+
+// the sequence records laid end to end along one axis
+struct DotExportAxis
+{
+	int numrecords;
+	Coord *starts;				// where each record starts on the axis, ascending
+	char **names;
+	int longestname;
+};
+
+class DotExporter
+{
+private:
+	int fd;
+	gzFile gz;				// NULL if we aren't compressing
+	bool ok;
+
+	DotExportAxis axes[2];
+
+	// what the dots being written now are
+	char strand;
+	Coord xoffset, yoffset, ylength;
+
+	// the gathered block of dots, and the text each slice of it formats to
+	Dot *block;
+	int blockfill;
+	char *text;
+	size_t slicecapacity;
+	size_t slicelength[DOTEXPORT_NUMSLICES];
+
+	void FreeAxis(int axis);
+	void SizeText();
+	void FlushBlock();
+	size_t FormatSlice(const Dot *dots, int count, char *out);
+	char *FormatPosition(char *p, int axis, Coord position, Coord length);
+	bool WriteText(const char *buffer, size_t length);
+
+public:
+	DotExporter();
+	~DotExporter();
+
+	//! \brief start a new file at path ("-" is standard output), gzipped at level if compress is set
+	bool Open(const char *path, bool compress=false, int level=1);
+
+	//! \brief name the sequence records along an axis (0 is x, 1 is y). starts are where each one begins on the axis
+	//! \details with no records an axis is written with the name "*" and its coordinates as they are
+	void SetRecords(int axis, int num, const Coord *starts, const char * const *names);
+
+	//! \brief write out every dot of store that is at least minlength long. A symmetric store has its mirror dots written too
+	//! \param strand '+' or '-'. The y coordinates of a '-' store run along the reverse complement, so when ylength (the
+	//! length of the compared y sequence) is given they are turned back into forward coordinates
+	//! \param xoffset,yoffset where the store's sequences start on each axis
+	bool Write(DotStore *store, char strand, Coord xoffset=0, Coord yoffset=0, Coord ylength=0, Coord minlength=0);
+
+	//! \brief finish the file
+	//! \return false if anything failed to write
+	bool Close();
+};
+
+#endif
@@ -0,0 +1,458 @@
+#include "DotFile.h"
+#include "SectionIO.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// zigzag encode a value so small negative numbers are small too, and write it as a varint. at most 10 bytes
+static unsigned char *PutVarint(unsigned char *p, long long v)
+{
+	unsigned long long z=((unsigned long long)v<<1)^(unsigned long long)(v>>63);
+	while(z>=0x80)
+	{
+		*p++=(unsigned char)(z|0x80);
+		z>>=7;
+	}
+	*p++=(unsigned char)z;
+	return p;
+}
+
+// read a varint back. returns NULL if it runs off the end of the buffer
+static const unsigned char *GetVarint(const unsigned char *p, const unsigned char *end, long long *v)
+{
+	unsigned long long z=0;
+	for(int shift=0; p<end && shift<64; shift+=7)
+	{
+		unsigned char b=*p++;
+		z|=(unsigned long long)(b&0x7f)<<shift;
+		if(!(b&0x80))
+		{
+			*v=(long long)(z>>1)^-(long long)(z&1);
+			return p;
+		}
+	}
+	return NULL;
+}
+
+// which tile a coordinate falls in, rounding down for negative coordinates too
+static long long TileOf(long long c, long long tilesize)
+{
+	return c>=0?c/tilesize:-((-c+tilesize-1)/tilesize);
+}
+
+// whether a dot can reach the region x1<=x<x2, y1<=y<y2, given as {x1,y1,x2,y2}
+static bool DotReaches(long long x, long long y, long long length, const Coord *region)
+{
+	return x<region[2] && y<region[3] && x+length>region[0] && y+length>region[1];
+}
+
+// whether a tile holds dots that can start before the region ends, and can be long enough to reach into it
+static bool TileReaches(const DotFileTile *t, long long tilesize, const Coord *region)
+{
+	return t->tilex*tilesize<region[2] && (t->tilex+1)*tilesize+t->maxlength>region[0] &&
+		t->tiley*tilesize<region[3] && (t->tiley+1)*tilesize+t->maxlength>region[1];
+}
+
+// the order of the dots within a tile
+static int CompareDots(const void *a, const void *b)
+{
+	const Dot *da=(const Dot *)a;
+	const Dot *db=(const Dot *)b;
+
+	if(da->y!=db->y)
+		return da->y<db->y?-1:1;
+	if(da->x!=db->x)
+		return da->x<db->x?-1:1;
+	if(da->length!=db->length)
+		return da->length<db->length?-1:1;
+	return 0;
+}
+
+DotFile::DotFile(int fd, long long offset)
+{
+	this->fd=fd;
+	this->offset=offset;
+
+	flags=0;
+	tilesize=0;
+	maxx=maxy=numdots=0;
+	end=-1;
+
+	tiles=NULL;
+	numtiles=0;
+}
+
+DotFile::~DotFile()
+{
+	FreeTiles();
+}
+
+void DotFile::FreeTiles()
+{
+	if(tiles)
+		delete [] tiles;
+	tiles=NULL;
+	numtiles=0;
+}
+
+// The dots are sorted into their tiles with a counting sort over the tile grid. This needs a copy of all the dots
+long long DotFile::Write(DotStore *store, Coord size)
+{
+	FreeTiles();
+	end=-1;
+
+	flags=store->IsSymmetric()?DOTFILE_SYMMETRIC:0;
+	maxx=store->GetMaxX();
+	maxy=store->GetMaxY();
+	numdots=store->GetNum();
+
+	// dots can sit outside of 0 to max after being moved around, so find where they really are
+	long long minx=0, miny=0, topx=maxx, topy=maxy;
+	for(DotStorageChunk *chunk=store->GetHead(); chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->x<minx) minx=dot->x;
+			if(dot->y<miny) miny=dot->y;
+			if(dot->x>topx) topx=dot->x;
+			if(dot->y>topy) topy=dot->y;
+		}
+
+	// pick a tile size that keeps the directory small
+	tilesize=size;
+	if(tilesize<=0)
+	{
+		long long extent=(topx-minx>topy-miny?topx-minx:topy-miny)+1;
+		tilesize=(extent+DOTFILE_MAXTILES-1)/DOTFILE_MAXTILES;
+		if(tilesize<DOTFILE_MINTILESIZE)
+			tilesize=DOTFILE_MINTILESIZE;
+	}
+
+	long long firsttx=TileOf(minx,tilesize), firstty=TileOf(miny,tilesize);
+	long long gridwidth=TileOf(topx,tilesize)-firsttx+1;
+	long long gridheight=TileOf(topy,tilesize)-firstty+1;
+	if(gridwidth*gridheight > (long long)DOTFILE_MAXTILES*DOTFILE_MAXTILES*16)
+	{
+		printf("DotFile: tile size %lld makes too many tiles\n",tilesize);
+		return -1;
+	}
+
+	// count the dots in each tile, then turn the counts into where each tile starts in the sorted copy
+	long long numcells=gridwidth*gridheight;
+	long long *cellstart=new long long[numcells+1];
+	memset(cellstart, 0, sizeof(long long)*(numcells+1));
+
+	for(DotStorageChunk *chunk=store->GetHead(); chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			cellstart[(TileOf(dot->y,tilesize)-firstty)*gridwidth+TileOf(dot->x,tilesize)-firsttx+1]++;
+		}
+
+	numtiles=0;
+	for(long long c=0; c<numcells; c++)
+	{
+		if(cellstart[c+1])
+			numtiles++;
+		cellstart[c+1]+=cellstart[c];
+	}
+
+	Dot *sorted=new Dot[numdots>0?numdots:1];
+	long long *cellfill=new long long[numcells];
+	memcpy(cellfill, cellstart, sizeof(long long)*numcells);
+
+	for(DotStorageChunk *chunk=store->GetHead(); chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			sorted[cellfill[(TileOf(dot->y,tilesize)-firstty)*gridwidth+TileOf(dot->x,tilesize)-firsttx]++]=*dot;
+		}
+
+	delete [] cellfill;
+
+	// now encode and write each tile that has dots
+	tiles=new DotFileTile[numtiles>0?numtiles:1];
+	long long position=DOTFILE_HEADERSIZE;
+	long long tile=0;
+	bool ok=true;
+
+	unsigned char *raw=NULL;
+	unsigned char *compressed=NULL;
+	long long rawcapacity=0;
+	uLongf compressedcapacity=0;
+
+	for(long long c=0; c<numcells && ok; c++)
+	{
+		long long count=cellstart[c+1]-cellstart[c];
+		if(!count)
+			continue;
+
+		Dot *dots=sorted+cellstart[c];
+		qsort(dots, count, sizeof(Dot), CompareDots);
+
+		DotFileTile *t=&tiles[tile++];
+		t->tilex=firsttx+c%gridwidth;
+		t->tiley=firstty+c/gridwidth;
+		t->numdots=count;
+		t->maxlength=0;
+
+		if(count*30>rawcapacity)
+		{
+			delete [] raw;
+			delete [] compressed;
+			rawcapacity=count*30;
+			raw=new unsigned char[rawcapacity];
+			compressedcapacity=compressBound(rawcapacity);
+			compressed=new unsigned char[compressedcapacity];
+		}
+
+		long long lastx=t->tilex*tilesize, lasty=t->tiley*tilesize;
+		unsigned char *p=raw;
+		for(long long i=0; i<count; i++)
+		{
+			if(dots[i].y!=lasty)
+				lastx=t->tilex*tilesize;
+			p=PutVarint(p, dots[i].y-lasty);
+			p=PutVarint(p, dots[i].x-lastx);
+			p=PutVarint(p, dots[i].length);
+			lastx=dots[i].x;
+			lasty=dots[i].y;
+
+			if(dots[i].length>t->maxlength)
+				t->maxlength=dots[i].length;
+		}
+		t->rawsize=p-raw;
+
+		uLongf compressedsize=compressedcapacity;
+		if(compress2(compressed, &compressedsize, raw, t->rawsize, Z_DEFAULT_COMPRESSION)!=Z_OK)
+		{
+			printf("DotFile: failed to compress a tile\n");
+			ok=false;
+			break;
+		}
+		t->compressedsize=compressedsize;
+		t->offset=position;
+
+		ok=WriteAt(fd, compressed, compressedsize, offset+position);
+		position+=compressedsize;
+	}
+
+	delete [] raw;
+	delete [] compressed;
+	delete [] sorted;
+	delete [] cellstart;
+
+	// the directory goes after the tiles
+	long long directory=position;
+	if(ok && numtiles)
+	{
+		unsigned char *buffer=new unsigned char[numtiles*DOTFILE_TILEENTRYSIZE];
+		for(long long i=0; i<numtiles; i++)
+		{
+			unsigned char *e=buffer+i*DOTFILE_TILEENTRYSIZE;
+			Put64(e, tiles[i].tilex);
+			Put64(e+8, tiles[i].tiley);
+			Put64(e+16, tiles[i].numdots);
+			Put64(e+24, tiles[i].maxlength);
+			Put64(e+32, tiles[i].offset);
+			Put64(e+40, tiles[i].compressedsize);
+			Put64(e+48, tiles[i].rawsize);
+		}
+		ok=WriteAt(fd, buffer, numtiles*DOTFILE_TILEENTRYSIZE, offset+directory);
+		delete [] buffer;
+	}
+	position+=numtiles*DOTFILE_TILEENTRYSIZE;
+
+	// and finally the header, now we know where everything is
+	unsigned char header[DOTFILE_HEADERSIZE];
+	memcpy(header, "FDS2", 4);
+	Put32(header+4, DOTFILE_VERSION);
+	Put32(header+8, flags);
+	Put64(header+12, tilesize);
+	Put64(header+20, maxx);
+	Put64(header+28, maxy);
+	Put64(header+36, numdots);
+	Put64(header+44, numtiles);
+	Put64(header+52, directory);
+	Put64(header+60, position);
+	if(ok)
+		ok=WriteAt(fd, header, DOTFILE_HEADERSIZE, offset);
+
+	if(!ok)
+	{
+		printf("DotFile: failed to write the dot section\n");
+		FreeTiles();
+		return -1;
+	}
+
+	end=offset+position;
+	return end;
+}
+
+bool DotFile::Open()
+{
+	FreeTiles();
+	end=-1;
+
+	unsigned char header[DOTFILE_HEADERSIZE];
+	if(!ReadAt(fd, header, DOTFILE_HEADERSIZE, offset) || memcmp(header, "FDS2", 4))
+	{
+		printf("DotFile: no dot section at %lld\n",offset);
+		return false;
+	}
+
+	if(Get32(header+4)!=DOTFILE_VERSION)
+	{
+		printf("DotFile: unknown dot section version %u\n",Get32(header+4));
+		return false;
+	}
+
+	flags=Get32(header+8);
+	tilesize=Get64(header+12);
+	maxx=Get64(header+20);
+	maxy=Get64(header+28);
+	numdots=Get64(header+36);
+	numtiles=Get64(header+44);
+	long long directory=Get64(header+52);
+	long long length=Get64(header+60);
+
+	// the header sizes the allocations below, so it has to fit the file before it is trusted. The directory sits between
+	// the tile blocks and the end of the section
+	long long filesize=FileSize(fd);
+	if(tilesize<=0 || numdots<0 || numtiles<0 || length<DOTFILE_HEADERSIZE || length>filesize-offset ||
+		directory<DOTFILE_HEADERSIZE || directory>length || numtiles>(length-directory)/DOTFILE_TILEENTRYSIZE)
+	{
+		printf("DotFile: the dot section at %lld has a bad header\n",offset);
+		FreeTiles();
+		return false;
+	}
+
+	tiles=new DotFileTile[numtiles>0?numtiles:1];
+	if(numtiles)
+	{
+		unsigned char *buffer=new unsigned char[numtiles*DOTFILE_TILEENTRYSIZE];
+		bool ok=ReadAt(fd, buffer, numtiles*DOTFILE_TILEENTRYSIZE, offset+directory);
+		for(long long i=0; ok && i<numtiles; i++)
+		{
+			unsigned char *e=buffer+i*DOTFILE_TILEENTRYSIZE;
+			DotFileTile *t=tiles+i;
+			t->tilex=Get64(e);
+			t->tiley=Get64(e+8);
+			t->numdots=Get64(e+16);
+			t->maxlength=Get64(e+24);
+			t->offset=Get64(e+32);
+			t->compressedsize=Get64(e+40);
+			t->rawsize=Get64(e+48);
+
+			// each block lies before the directory, zlib packs at best a little over 1000 to 1, and every dot takes at
+			// least three bytes decoded, so none of the sizes ReadTile() allocates from can be bigger than the file allows
+			ok=t->offset>=DOTFILE_HEADERSIZE && t->compressedsize>0 && t->compressedsize<=directory-t->offset &&
+				t->rawsize>=0 && t->rawsize/1100<=t->compressedsize && t->numdots>=0 && t->numdots<=t->rawsize/3;
+		}
+		delete [] buffer;
+
+		if(!ok)
+		{
+			printf("DotFile: could not read the tile directory\n");
+			FreeTiles();
+			return false;
+		}
+	}
+
+	end=offset+length;
+	return true;
+}
+
+bool DotFile::ReadTile(DotFileTile *tile, DotStore *store, const Coord *region)
+{
+	unsigned char *compressed=new unsigned char[tile->compressedsize];
+	unsigned char *raw=new unsigned char[tile->rawsize];
+	Dot *dots=new Dot[tile->numdots];
+
+	uLongf rawsize=tile->rawsize;
+	bool ok=ReadAt(fd, compressed, tile->compressedsize, offset+tile->offset) &&
+		uncompress(raw, &rawsize, compressed, tile->compressedsize)==Z_OK && (long long)rawsize==tile->rawsize;
+
+	// decode, keeping the dots that reach the region. In a symmetric section a dot is kept for its reflection too
+	bool symmetric=(flags&DOTFILE_SYMMETRIC);
+	long long kept=0;
+	long long lastx=tile->tilex*tilesize, lasty=tile->tiley*tilesize;
+	const unsigned char *p=raw, *rawend=raw+rawsize;
+	long long dy, dx, length;
+	for(long long i=0; ok && i<tile->numdots; i++)
+	{
+		ok=(p=GetVarint(p,rawend,&dy)) && (p=GetVarint(p,rawend,&dx)) && (p=GetVarint(p,rawend,&length));
+		if(!ok)
+			break;
+
+		if(dy)
+			lastx=tile->tilex*tilesize;
+		lasty+=dy;
+		lastx+=dx;
+
+		if(region && !DotReaches(lastx,lasty,length,region) && !(symmetric && DotReaches(lasty,lastx,length,region)))
+			continue;
+
+		dots[kept].x=(Coord)lastx;
+		dots[kept].y=(Coord)lasty;
+		dots[kept].length=(Coord)length;
+		kept++;
+	}
+
+	if(ok)
+		store->AddDots(dots, kept);
+	else
+		printf("DotFile: tile %lld,%lld is corrupt\n",tile->tilex,tile->tiley);
+
+	delete [] dots;
+	delete [] raw;
+	delete [] compressed;
+
+	return ok;
+}
+
+bool DotFile::Read(DotStore *store)
+{
+	return ReadRegion(store, 0, 0, 0, 0);
+}
+
+// an empty region (x2<=x1) means the whole section
+bool DotFile::ReadRegion(DotStore *store, Coord x1, Coord y1, Coord x2, Coord y2)
+{
+	if(end==-1 && !Open())
+		return false;
+
+	// a 32 bit build can't hold coordinates past 2^31
+	if(sizeof(Coord)<8 && (maxx!=(Coord)maxx || maxy!=(Coord)maxy))
+	{
+		printf("DotFile: this dot section needs the 64 bit coordinate build of libfreckle\n");
+		return false;
+	}
+
+	store->Empty();
+	store->SetSymmetric(flags&DOTFILE_SYMMETRIC);
+	store->SetMaxX((Coord)maxx);
+	store->SetMaxY((Coord)maxy);
+
+	Coord region[4]={x1,y1,x2,y2};
+	Coord transposed[4]={y1,x1,y2,x2};
+	bool whole=(x2<=x1 || y2<=y1);
+	bool symmetric=(flags&DOTFILE_SYMMETRIC);
+
+	for(long long i=0; i<numtiles; i++)
+	{
+		DotFileTile *t=&tiles[i];
+
+		// only the x>=y half of a symmetric section is stored, so a tile is also needed if its reflection reaches the region
+		if(!whole && !TileReaches(t, tilesize, region) && !(symmetric && TileReaches(t, tilesize, transposed)))
+			continue;
+
+		if(!ReadTile(t, store, whole?NULL:region))
+			return false;
+	}
+
+	return true;
+}
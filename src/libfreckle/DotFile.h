@@ -0,0 +1,104 @@
+#ifndef _DOTFILE_H_
+#define _DOTFILE_H_
+
+#include "Dot.h"
+#include "DotStore.h"
+
+/*
+** DotFile
+** =======
+** reads and writes one DotStore as a section of a version 0.2 freckle dot plot file.
+**
+** The dots are sorted into square tiles. Each tile is a block of zigzag/varint delta encoded dots compressed with zlib,
+** and a directory of the tiles at the end of the section says where each block is and how long its longest dot is. So
+** a region of the plot can be loaded by decoding only the tiles that can reach it.
+**
+** Everything is little endian and 64 bit, whatever coordinate size the library is built with.
+**
+** section header  "FDS2" u32 version, u32 flags, i64 tilesize, maxx, maxy, numdots, numtiles, directory, end
+** tile blocks     zlib compressed varints. for each dot (sorted by y then x): zigzag(y-lasty), zigzag(x-lastx), zigzag(length)
+**                 lastx and lasty start at the tile origin. lastx goes back to the tile origin when y changes
+** directory       for each tile: i64 tilex, tiley, numdots, maxlength, offset, compressedsize, rawsize
+**
+** offsets in the header and directory are from the start of the section
+*/
+
+#define DOTFILE_VERSION		2
+#define DOTFILE_SYMMETRIC	1			// flag. the store only holds one half of a self comparison
+
+#define DOTFILE_HEADERSIZE	(4+4+4+8*7)
+#define DOTFILE_TILEENTRYSIZE	(8*7)
+
+// tiles are at least this big, and grow so there are no more than DOTFILE_MAXTILES across the longest side
+#define DOTFILE_MINTILESIZE	4096
+#define DOTFILE_MAXTILES	1024
+
+struct DotFileTile
+{
+	long long tilex, tiley;				// tile position in tiles
+	long long numdots;
+	long long maxlength;				// the longest dot starting in this tile
+	long long offset;				// where the compressed block is, from the start of the section
+	long long compressedsize;
+	long long rawsize;
+};
+
+class DotFile
+{
+private:
+	int fd;
+	long long offset;				// where our section starts in the file
+
+	// what we know of the section. filled by Write() or Open()
+	unsigned int flags;
+	long long tilesize;
+	long long maxx, maxy, numdots;
+	long long end;
+
+	DotFileTile *tiles;
+	long long numtiles;
+
+	void FreeTiles();
+
+	// read and decode one tile block, adding the dots within the region (all of them if region is NULL) to store
+	bool ReadTile(DotFileTile *tile, DotStore *store, const Coord *region);
+
+public:
+	//! \brief a section of the file open as fd, starting at offset
+	DotFile(int fd, long long offset);
+	~DotFile();
+
+	//! \brief write store out as our section
+	//! \param tilesize the size of the tiles. 0 picks one from the size of the store
+	//! \return the offset in the file just after the section. -1 on failure
+	long long Write(DotStore *store, Coord tilesize=0);
+
+	//! \brief read the section header and tile directory
+	//! \return false if there is no readable section here
+	bool Open();
+
+	//! \brief load the whole section into store, replacing what it held
+	bool Read(DotStore *store);
+
+	//! \brief load only the dots that can reach the region x1<=x<x2, y1<=y<y2 into store, replacing what it held
+	//! \details in a symmetric section that is every dot whose reflection can reach it too
+	bool ReadRegion(DotStore *store, Coord x1, Coord y1, Coord x2, Coord y2);
+
+	//! \brief the offset in the file just after our section. Only valid after Write() or Open()
+	inline long long GetEnd() const
+	{
+		return end;
+	}
+
+	inline long long GetNumTiles() const
+	{
+		return numtiles;
+	}
+
+	inline long long GetTileSize() const
+	{
+		return tilesize;
+	}
+};
+
+#endif
@@ -1,11 +1,14 @@
 #include "DotGrid.h"
 #include <memory.h>
+#include <math.h>
 #include <assert.h>
 
 DotGrid::DotGrid()
 {
 	width=height=0;
-	data=NULL;
+	cells=NULL;
+	celltype=DOTGRID_INT32;
+	autotype=false;
 }
 
 DotGrid::~DotGrid()
@@ -13,70 +16,180 @@ DotGrid::~DotGrid()
 	Destroy();
 }
 
-void DotGrid::Create(int xsize, int ysize)
+int DotGrid::GetCellBytes(int type)
 {
-	data=new int [xsize*ysize];
+	switch(type)
+	{
+		case DOTGRID_UINT8:
+			return sizeof(unsigned char);
+		case DOTGRID_UINT16:
+			return sizeof(unsigned short);
+		case DOTGRID_INT32:
+			return sizeof(int);
+		case DOTGRID_FLOAT:
+			return sizeof(float);
+	}
+	assert(0);
+	return 0;
+}
+
+void DotGrid::Create(int xsize, int ysize, int type)
+{
+	assert(type!=DOTGRID_AUTO);
+
+	size_t bytes=(size_t)xsize*ysize*GetCellBytes(type);
+	cells=new char [bytes];
 
-	memset(data,0,xsize*ysize*sizeof(int));
+	memset(cells,0,bytes);
 
-	assert(data);
+	assert(cells);
 
+	celltype=type;
+	autotype=false;
 	width=xsize;
 	height=ysize;
 }
 
+void DotGrid::CreateFractional(int xsize, int ysize)
+{
+	Create(xsize,ysize,DOTGRID_FLOAT);
+}
+
 void DotGrid::Destroy()
 {
-	if(data)
-		delete data;
+	if(cells)
+		delete [] (char *)cells;
+
+	cells=NULL;
+}
+
+// the grey level every count from 0 to max comes out as, from black at 0 up to white at top. histogram is cumulative
+template<class T> static T *MakeLUT(const int *histogram, int max, int num, int mode, double clip, double top)
+{
+	T *lut=new T [max+1];
+	assert(lut);
+
+	// an empty cell is white whatever the mode, so an empty grid is a white square
+	int empty=histogram[0];
+	lut[0]=(T)top;
+
+	switch(mode)
+	{
+		case DOTGRID_EQUALISE:
+			for(int v=1; v<=max; v++)
+				lut[v]=(T)(top-top*(double)num*((double)histogram[v]-(double)empty)/(((double)num-(double)empty)*(double)num));
+			break;
+
+		case DOTGRID_LINEAR:
+			for(int v=1; v<=max; v++)
+				lut[v]=(T)(top-top*(double)v/(double)max);
+			break;
+
+		case DOTGRID_LOG:
+			for(int v=1; v<=max; v++)
+				lut[v]=(T)(top-top*log(1.+(double)v)/log(1.+(double)max));
+			break;
+
+		case DOTGRID_PERCENTILE:
+		{
+			// the smallest count at least 1-clip of the non empty cells are at or below. Anything over it is black
+			double keep=(double)(num-empty)*(1.-clip);
+			int limit=max;
+			while(limit>1 && (double)(histogram[limit-1]-empty)>=keep)
+				limit--;
+
+			for(int v=1; v<=max; v++)
+				lut[v]=(T)(v>=limit?0.:top-top*(double)v/(double)limit);
+			break;
+		}
+
+		default:
+			assert(0);
+	}
+
+	return lut;
+}
+
+// look every value up in the table, bits wide
+template<class T> static void ApplyLUT(unsigned char *string, const int *values, int num, const T *lut)
+{
+	T *out=(T *)string;
+	for(int pos=0; pos<num; pos++)
+		out[pos]=lut[values[pos]];
+}
+
+// the lookup table for a mode, bits wide, as bytes
+unsigned char *DotGrid::MakeLevels(const int *histogram, int max, int num, int mode, int bits, double clip)
+{
+	assert(bits==8 || bits==16);
+	assert(clip>=0. && clip<1.);
 
-	data=NULL;
+	if(bits==8)
+		return MakeLUT<unsigned char>(histogram,max,num,mode,clip,255.);
+	return (unsigned char *)MakeLUT<unsigned short>(histogram,max,num,mode,clip,65535.);
 }
 
-unsigned char *DotGrid::ToString() const
+void DotGrid::LookUp(unsigned char *string, const int *values, int num, const unsigned char *levels, int bits)
 {
-	unsigned char *out=new unsigned char [width*height];
-	assert(out);	
+	if(bits==8)
+		ApplyLUT(string,values,num,levels);
+	else
+		ApplyLUT(string,values,num,(const unsigned short *)levels);
+}
 
-	// normalise the histogram
-	int numpixels=width*height;
-	int *histogram=CalculateHistogram();
+void DotGrid::FreeLevels(unsigned char *levels, int bits)
+{
+	if(bits==8)
+		delete [] levels;
+	else
+		delete [] (unsigned short *)levels;
+}
 
-	assert(histogram);
+unsigned char *DotGrid::ToString(int mode, int bits, double clip) const
+{
+	int max;
+	int *histogram=Histogram(max);
 
 	// print our histogram
-// 	for(int i=0; i<GetMax()+1;i++)
+// 	for(int i=0; i<max+1;i++)
 // 		printf("%d => %d\n",i,histogram[i]);
 
-	if(GetMax()==0)
-	{
-		// no dots. we would be normalised to be a black square. Lets make this a white square.
-		// TODO: replace this with a histogram algo that works in corner cases too
-		for(int pos=0; pos<width*height; pos++)
-			out[pos]=(unsigned char)255;
-	}
-	else
-	{
-		for(int pos=0; pos<width*height; pos++)
-			out[pos]=(unsigned char)(255.-255.*(double)numpixels*((double)histogram[data[pos]]-(double)histogram[0])/(((double)numpixels-(double)histogram[0])*(double)numpixels));
-	}
+	unsigned char *levels=MakeLevels(histogram,max,width*height,mode,bits,clip);
+
+	// a row at a time, so cells that aren't ints needn't all be turned into them at once
+	int rowbytes=width*(bits/8);
+	unsigned char *out=new unsigned char [(size_t)height*rowbytes];
+	assert(out);
+	int *values=new int[width];
+	for(int y=0; y<height; y++)
+		LookUp(out+(size_t)y*rowbytes,RowValues(y,values),width,levels,bits);
+
+	delete [] values;
+	FreeLevels(levels,bits);
 
 	// free histogram
-	delete histogram;
+	delete [] histogram;
 
 	return out;
 }
 
 int *DotGrid::CalculateHistogram() const
 {
-	int max=GetMax();
+	int max;
+	return Histogram(max);
+}
 
-	int *histogram= new int[max+1];
-	assert(histogram);
-	memset(histogram, 0, sizeof(int)*(max+1));
+int *DotGrid::Histogram(int &max) const
+{
+	int *histogram=NULL;
+	int size=0;
+	max=0;
+	CountValues(NULL,0,histogram,size,max);
 
-	for(int pos=0; pos<width*height; pos++)
-		histogram[data[pos]]++;
+	int *values=new int[width];
+	for(int y=0; y<height; y++)
+		CountValues(RowValues(y,values),width,histogram,size,max);
+	delete [] values;
 
 	//cumulative histogram
 	for(int i=1; i<max+1;i++)
@@ -85,8 +198,245 @@ int *DotGrid::CalculateHistogram() const
 	return histogram;
 }
 
+void DotGrid::CountValues(const int *values, int num, int *&histogram, int &size, int &max)
+{
+	// grown as bigger values turn up, so we needn't scan for the largest first
+	if(!histogram)
+	{
+		size=256;
+		histogram=new int[size];
+		assert(histogram);
+		memset(histogram, 0, sizeof(int)*size);
+	}
+
+	for(int pos=0; pos<num; pos++)
+	{
+		int value=values[pos];
+		assert(value>=0);
+		if(value>=size)
+		{
+			int grown=size*2>value?size*2:value+1;
+			int *bigger=new int[grown];
+			assert(bigger);
+			memcpy(bigger, histogram, sizeof(int)*size);
+			memset(bigger+size, 0, sizeof(int)*(grown-size));
+			delete [] histogram;
+			histogram=bigger;
+			size=grown;
+		}
+		histogram[value]++;
+		if(value>max)
+			max=value;
+	}
+}
+
+const int *DotGrid::RowValues(int y, int *buffer) const
+{
+	size_t start=(size_t)y*width;
+	switch(celltype)
+	{
+		case DOTGRID_INT32:
+			return (const int *)cells+start;
+
+		case DOTGRID_UINT8:
+			for(int x=0; x<width; x++)
+				buffer[x]=((const unsigned char *)cells)[start+x];
+			break;
+
+		case DOTGRID_UINT16:
+			for(int x=0; x<width; x++)
+				buffer[x]=((const unsigned short *)cells)[start+x];
+			break;
+
+		case DOTGRID_FLOAT:
+			for(int x=0; x<width; x++)
+				buffer[x]=(int)(((const float *)cells)[start+x]*DOTGRID_FRACTIONSTEPS+0.5f);
+			break;
+	}
+	return buffer;
+}
+
+// add whole counts into cells of type T, saturating at max
+template<class T> static void AddSaturated(T *to, const int *from, int num, long long max)
+{
+	for(int pos=0; pos<num; pos++)
+	{
+		long long sum=(long long)to[pos]+from[pos];
+		to[pos]=(T)(sum>max?max:(sum<0?0:sum));
+	}
+}
+
+// add whole counts into a row of cells, as many as they hold
+static void AddRow(void *cells, int celltype, size_t start, const int *from, int num)
+{
+	switch(celltype)
+	{
+		case DOTGRID_UINT8:
+			AddSaturated((unsigned char *)cells+start,from,num,UCHAR_MAX);
+			break;
+		case DOTGRID_UINT16:
+			AddSaturated((unsigned short *)cells+start,from,num,USHRT_MAX);
+			break;
+		case DOTGRID_INT32:
+			AddSaturated((int *)cells+start,from,num,INT_MAX);
+			break;
+		case DOTGRID_FLOAT:
+			for(int pos=0; pos<num; pos++)
+				((float *)cells)[start+pos]+=(float)from[pos];
+			break;
+	}
+}
+
+void DotGrid::StoreBand(const int *band, int firstrow, int rows)
+{
+	// the rows start empty, so adding is storing
+	AddRow(cells,celltype,(size_t)firstrow*width,band,rows*width);
+}
+
+void DotGrid::Widen(int type)
+{
+	assert(type>celltype && type<=DOTGRID_INT32);
+
+	char *wider=new char [(size_t)width*height*GetCellBytes(type)];
+	memset(wider,0,(size_t)width*height*GetCellBytes(type));
+
+	int *values=new int[width];
+	for(int y=0; y<height; y++)
+		AddRow(wider,type,(size_t)y*width,RowValues(y,values),width);
+	delete [] values;
+
+	delete [] (char *)cells;
+	cells=wider;
+	celltype=type;
+}
+
+int DotGrid::CellTypeFor(long long max)
+{
+	if(max<=UCHAR_MAX)
+		return DOTGRID_UINT8;
+	if(max<=USHRT_MAX)
+		return DOTGRID_UINT16;
+	return DOTGRID_INT32;
+}
+
+long long DotGrid::ExpectedMax(DotStore *source, double scale)
+{
+	// a cell holds at most ceil(scale)+1 bases each way, and each is only counted once, even reflected
+	long long side=(long long)ceil(scale)+1;
+	long long bases=source->GetTotalBases();
+	return side*side<bases?side*side:bases;
+}
+
+bool DotGrid::WriteImage(const char *path, int format, int mode, int bits, double clip, bool invert) const
+{
+	assert(cells);
+
+	// a row at a time, so the cells are never copied whole
+	int *values=new int[width];
+	int max;
+	int *histogram=Histogram(max);
+	unsigned char *levels=MakeLevels(histogram,max,width*height,mode,bits,clip);
+
+	ImageWriter writer;
+	bool ok=writer.Open(path,width,height,format,bits);
+	unsigned char *row=new unsigned char[writer.GetRowBytes()];
+	for(int y=0; y<height && ok; y++)
+	{
+		LookUp(row,RowValues(y,values),width,levels,bits);
+		ok=writer.WriteRows(row,1,invert);
+	}
+	ok=writer.Close() && ok;
+
+	delete [] row;
+	FreeLevels(levels,bits);
+	delete [] histogram;
+	delete [] values;
+
+	return ok;
+}
+
+// rows firstrow to firstrow+rows-1 of what CalculateGrid() would make of the sources
+static void MakeBand(int *band, int width, int firstrow, int rows, int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double scale, int window)
+{
+	memset(band,0,sizeof(int)*width*rows);
+	for(int i=0; i<num; i++)
+		sources[i]->AddGridMatches(band,width,rows,x1,y1,scale,window,firstrow,transforms+i);
+}
+
+bool DotGrid::WriteBandedImage(const char *path, DotStore *source, DotStore *flipped, double x1, double y1, double x2, double y2, double scale, int window, int format, int mode, int bits, double clip, bool invert)
+{
+	assert(x2>x1 && y2>y1);
+
+	// sized just as CalculateGrid() sizes it
+	int width=(int)((x2-x1)/scale);
+	int height=(int)((y2-y1)/scale);
+
+	// flipped is turned upside down as its dots go in, rather than being made on its own and added
+	DotStore *sources[2]={source,flipped};
+	GridTransform transforms[2];
+	transforms[1].flip=true;
+	transforms[1].rows=height;
+	int num=flipped?2:1;
+
+	int *band=new int[DOTGRID_IMAGEBAND*width];
+
+	// the levels depend on every cell, so the bands are made once to count them, and again to write them out
+	int *histogram=NULL;
+	int size=0, max=0;
+	for(int row=0; row<height; row+=DOTGRID_IMAGEBAND)
+	{
+		int rows=row+DOTGRID_IMAGEBAND<height?DOTGRID_IMAGEBAND:height-row;
+		MakeBand(band,width,row,rows,num,sources,transforms,x1,y1,scale,window);
+		CountValues(band,rows*width,histogram,size,max);
+	}
+	for(int i=1; i<max+1;i++)
+		histogram[i]+=histogram[i-1];
+	unsigned char *levels=MakeLevels(histogram,max,width*height,mode,bits,clip);
+
+	ImageWriter writer;
+	bool ok=writer.Open(path,width,height,format,bits);
+	unsigned char *string=new unsigned char[DOTGRID_IMAGEBAND*writer.GetRowBytes()];
+	for(int row=0; row<height && ok; row+=DOTGRID_IMAGEBAND)
+	{
+		int rows=row+DOTGRID_IMAGEBAND<height?DOTGRID_IMAGEBAND:height-row;
+		MakeBand(band,width,row,rows,num,sources,transforms,x1,y1,scale,window);
+		LookUp(string,band,rows*width,levels,bits);
+		ok=writer.WriteRows(string,rows,invert);
+	}
+	ok=writer.Close() && ok;
+
+	delete [] string;
+	FreeLevels(levels,bits);
+	delete [] histogram;
+	delete [] band;
+
+	return ok;
+}
+
+GridTransform DotGrid::SourceTransform(const GridTransform *transforms, int i, int rows)
+{
+	GridTransform transform;
+	if(transforms)
+		transform=transforms[i];
+	transform.rows=rows;
+	return transform;
+}
+
+long long DotGrid::ExpectedMax(int num, DotStore **sources, double scale)
+{
+	long long max=0;
+	for(int i=0; i<num; i++)
+		max+=ExpectedMax(sources[i],scale);
+	return max;
+}
+
 // Calculate a sum from a window on the source dotstore
-void DotGrid::CalculateGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int window)
+void DotGrid::CalculateGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int window, int type)
+{
+	CalculateGrid(1,&source,NULL,x1,y1,x2,y2,scale,window,type);
+}
+
+void DotGrid::CalculateGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale, int window, int type)
 {
 	double xsize=x2-x1;
 	double ysize=y2-y1;
@@ -94,6 +444,7 @@ void DotGrid::CalculateGrid(DotStore *source, double x1, double y1, double x2, d
 	// the start and end values for the window should be in the proper order. top left to bottom right
 	assert(xsize>0);
 	assert(ysize>0);
+	assert(num>0);
 
 	// check we divide evenly
 // 	assert( (xsize / scale) - (double)(int)(xsize / scale) == 0.0 );
@@ -104,13 +455,126 @@ void DotGrid::CalculateGrid(DotStore *source, double x1, double y1, double x2, d
 	int numy=(int)(ysize/scale);
 
 	// make sure we haven't already got a grid
-	assert(!data);
+	assert(!cells);
+
+	Create(numx,numy,type==DOTGRID_AUTO?CellTypeFor(ExpectedMax(num,sources,scale)):type);
+	autotype=type==DOTGRID_AUTO;
+
+	GridTransform *transformed=new GridTransform[num];
+	for(int i=0; i<num; i++)
+		transformed[i]=SourceTransform(transforms,i,numy);
 
-	Create(numx,numy);
+	// each point is the sum of sources[i]->CountAreaMatches(x*scale+x1, y*scale+y1, (x+1)*scale+x1, (y+1)*scale+y1, window)
+	// over the sources, each moved as its transform says. Every source counts straight into the cells
+	if(celltype==DOTGRID_INT32)
+	{
+		for(int i=0; i<num; i++)
+			sources[i]->AddGridMatches((int *)cells,numx,numy,x1,y1,scale,window,0,transformed+i);
+		delete [] transformed;
+		return;
+	}
 
+	// narrower cells can't be counted into directly, so it is made as ints a band of rows at a time
+	int *band=new int[DOTGRID_CELLBAND*numx];
+	for(int row=0; row<numy; row+=DOTGRID_CELLBAND)
+	{
+		int rows=row+DOTGRID_CELLBAND<numy?DOTGRID_CELLBAND:numy-row;
+		MakeBand(band,numx,row,rows,num,sources,transformed,x1,y1,scale,window);
+		StoreBand(band,row,rows);
+	}
+	delete [] band;
+	delete [] transformed;
+}
+
+// Calculate the bases of the matches crossing each cell of a window on the source dotstore
+void DotGrid::CalculateCoverageGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int type)
+{
+	CalculateCoverageGrid(1,&source,NULL,x1,y1,x2,y2,scale,type);
+}
+
+void DotGrid::CalculateCoverageGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale, int type)
+{
+	double xsize=x2-x1;
+	double ysize=y2-y1;
+
+	assert(xsize>0);
+	assert(ysize>0);
+	assert(num>0);
+
+	int numx=(int)(xsize/scale);
+	int numy=(int)(ysize/scale);
+
+	assert(!cells);
+
+	Create(numx,numy,type==DOTGRID_AUTO?CellTypeFor(ExpectedMax(num,sources,scale)):type);
+	autotype=type==DOTGRID_AUTO;
+
+	// made now, rather than by the first thread to want them
+	GridTransform *transformed=new GridTransform[num];
+	for(int i=0; i<num; i++)
+	{
+		transformed[i]=SourceTransform(transforms,i,numy);
+		sources[i]->GetSegmentIndex();
+	}
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
 	for(int y=0; y<numy; y++)
+	{
 		for(int x=0; x<numx; x++)
-			SetPoint(x,y,source->CountAreaMatches(x*scale+x1, y*scale+y1, (x+1)*scale+x1, (y+1)*scale+y1, window) );
+		{
+			// each source's count is of the cell its matches land in this one from
+			Coord bases=0;
+			for(int i=0; i<num; i++)
+			{
+				const GridTransform &t=transformed[i];
+				int sy=t.flip?numy-1-y:y;
+				Coord top=(Coord)floor(sy*scale+y1)-t.yoffset, bottom=(Coord)floor((sy+1)*scale+y1)-1-t.yoffset;
+				Coord left=(Coord)floor(x*scale+x1)-t.xoffset, right=(Coord)floor((x+1)*scale+x1)-1-t.xoffset;
+				if(left>right || top>bottom)
+					continue;
+				if(t.transpose)
+					bases+=sources[i]->CountAreaBases(top,left,bottom,right);
+				else
+					bases+=sources[i]->CountAreaBases(left,top,right,bottom);
+			}
+			if(bases)
+				SetPoint(x,y,bases>INT_MAX?INT_MAX:(int)bases);
+		}
+	}
+
+	delete [] transformed;
+}
+
+// Calculate the exact length of match in each cell of a window on the source dotstore
+void DotGrid::CalculateFractionalGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale)
+{
+	CalculateFractionalGrid(1,&source,NULL,x1,y1,x2,y2,scale);
+}
+
+void DotGrid::CalculateFractionalGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale)
+{
+	double xsize=x2-x1;
+	double ysize=y2-y1;
+
+	assert(xsize>0);
+	assert(ysize>0);
+	assert(num>0);
+
+	// the last cells take what is left over, unless that is only rounding
+	int numx=(int)ceil(xsize/scale-1e-9);
+	int numy=(int)ceil(ysize/scale-1e-9);
+
+	assert(!cells);
+
+	CreateFractional(numx,numy);
+
+	for(int i=0; i<num; i++)
+	{
+		GridTransform transform=SourceTransform(transforms,i,numy);
+		sources[i]->AddGridCoverage((float *)cells,numx,numy,x1,y1,x2,y2,scale,&transform);
+	}
 }
 
 // Add the values from another grid. Grid must have the same dimensions. Used to combine forward and reverse plots
@@ -124,27 +588,63 @@ void DotGrid::AddInplace(DotGrid *second)
 // 		for(int x=0; x<GetWidth(); x++)
 // 			SetPoint(x,y,GetPoint(x,y)+second->GetPoint(x,y));
 
+	// a fractional grid only adds to another
+	assert(IsFractional()==second->IsFractional());
+	if(IsFractional())
+	{
+		float *to=(float *)cells;
+		const float *from=second->GetFractions();
+		for(size_t pos=0; pos<(size_t)width*height; pos++)
+			to[pos]+=from[pos];
+		return;
+	}
+
+	int *values=new int[width];
+	int *ours=new int[width];
+
+	// widen first if the sums won't fit
+	if(autotype && celltype<DOTGRID_INT32)
+	{
+		long long max=0;
+		for(int y=0; y<height; y++)
+		{
+			const int *from=second->RowValues(y,values);
+			const int *to=RowValues(y,ours);
+			for(int x=0; x<width; x++)
+				if((long long)to[x]+from[x]>max)
+					max=(long long)to[x]+from[x];
+		}
+		if(CellTypeFor(max)>celltype)
+			Widen(CellTypeFor(max));
+	}
+
 	// fast version
-	for(int pos=0; pos<width*height; pos++)
-		data[pos]+=second->GetData(pos);
+	for(int y=0; y<height; y++)
+		AddRow(cells,celltype,(size_t)y*width,second->RowValues(y,values),width);
+
+	delete [] ours;
+	delete [] values;
 }
 
 // flip this grid upside down
 void DotGrid::FlipInplace()
 {
-	int *store=new int[width];
+	char *cells=(char *)this->cells;
+	int rowbytes=width*GetCellBytes(celltype);
+
+	char *store=new char[rowbytes];
 	for(int y=0; y<height/2; y++)
 	{
 		//copy row into store
-		memcpy(store, &data[y*width], width*sizeof(int));
+		memcpy(store, &cells[y*rowbytes], rowbytes);
 		
 		//copy end row into head row
-		memcpy(&data[y*width], &data[(height-1-y)*width], width*sizeof(int));
+		memcpy(&cells[y*rowbytes], &cells[(height-1-y)*rowbytes], rowbytes);
 
 		// copy store into end row
-		memcpy(&data[(height-1-y)*width], store, width*sizeof(int));
+		memcpy(&cells[(height-1-y)*rowbytes], store, rowbytes);
 	}
-	delete store;
+	delete [] store;
 }
 
 
@@ -2,9 +2,36 @@
 #define _DOTGRID_H_
 
 #include "DotStore.h"
+#include "ImageWriter.h"
 
 
 #include <assert.h>
+#include <limits.h>
+
+// a fractional grid is normalised for ToString() in steps of this much of a base
+#define DOTGRID_FRACTIONSTEPS	16
+
+// how ToString() turns counts into grey levels. More is always darker, and empty cells are always white
+#define DOTGRID_EQUALISE	0		// histogram equalised
+#define DOTGRID_LINEAR		1		// in proportion to the count
+#define DOTGRID_LOG		2		// in proportion to the log of the count
+#define DOTGRID_PERCENTILE	3		// in proportion to the count, with the busiest cells clipped to black
+
+// the fraction of the non empty cells DOTGRID_PERCENTILE clips by default
+#define DOTGRID_CLIP		0.01
+
+// how many rows WriteBandedImage() makes at a time
+#define DOTGRID_IMAGEBAND	64
+
+// what a grid's cells are. The whole count types saturate at the most they hold rather than wrapping round
+#define DOTGRID_AUTO		0		// the narrowest that holds every count a calculation can give
+#define DOTGRID_UINT8		1
+#define DOTGRID_UINT16		2
+#define DOTGRID_INT32		3		// plain ints, as grids always were
+#define DOTGRID_FLOAT		4		// fractions of a base. See CalculateFractionalGrid()
+
+// how many rows CalculateGrid() makes at a time for cells narrower than an int
+#define DOTGRID_CELLBAND	256
 
 class DotGrid
 {
@@ -12,15 +39,98 @@ private:
 	int width;
 	int height;
 
-	int *data;			// where we store the grid data
+	void *cells;			// where we store the grid data, as celltype
+	int celltype;
+	bool autotype;			// celltype was picked by a calculation, so it can be widened when it has to be
+
+	// the cumulative histogram of the grid, in one pass. max is set to the largest value, the last entry of it
+	int *Histogram(int &max) const;
+
+	// count values into a histogram of size entries (NULL to start one), growing it as bigger values turn up. max
+	// is the largest counted so far
+	static void CountValues(const int *values, int num, int *&histogram, int &size, int &max);
+
+	// the values of row y as ToString() normalises them. Unless the cells are ints they are worked out in buffer
+	const int *RowValues(int y, int *buffer) const;
+
+	// saturate rows firstrow to firstrow+rows-1 of whole counts into the cells
+	void StoreBand(const int *band, int firstrow, int rows);
+
+	// change the cells to a wider whole count type
+	void Widen(int type);
+
+	// the narrowest cell type that holds max, and the most a cell of a grid scale across can count of source
+	static int CellTypeFor(long long max);
+	static long long ExpectedMax(DotStore *source, double scale);
+	static long long ExpectedMax(int num, DotStore **sources, double scale);
+
+	inline void SetData(int pos, int point)
+	{
+		switch(celltype)
+		{
+			case DOTGRID_UINT8:
+				((unsigned char *)cells)[pos]=point<0?0:(point>UCHAR_MAX?UCHAR_MAX:point);
+				break;
+			case DOTGRID_UINT16:
+				((unsigned short *)cells)[pos]=point<0?0:(point>USHRT_MAX?USHRT_MAX:point);
+				break;
+			case DOTGRID_INT32:
+				((int *)cells)[pos]=point;
+				break;
+			default:
+				assert(0);
+		}
+	}
 
 public:
 	DotGrid();
 	~DotGrid();
 
-	void Create(int xsize, int ysize);
+	//! \brief make an empty grid
+	//! \param type what the cells are. One of DOTGRID_UINT8, DOTGRID_UINT16, DOTGRID_INT32 or DOTGRID_FLOAT
+	void Create(int xsize, int ysize, int type=DOTGRID_INT32);
 	void Destroy();
 
+	//! \brief make the grid hold fractions of a base rather than whole counts
+	//! \details only the fraction calls below and the whole grid operations (ToString, AddInplace, FlipInplace) work
+	//! on a fractional grid
+	void CreateFractional(int xsize, int ysize);
+
+	inline int GetCellType() const
+	{
+		return celltype;
+	}
+
+	//! \brief how many bytes a cell of a type takes
+	static int GetCellBytes(int type);
+
+	inline bool IsFractional() const
+	{
+		return celltype==DOTGRID_FLOAT;
+	}
+
+	inline float GetFraction(int x, int y) const
+	{
+		assert(cells && celltype==DOTGRID_FLOAT);
+		assert(x>=0 && x<width);
+		assert(y>=0 && y<height);
+		return ((float *)cells)[y*width+x];
+	}
+
+	inline void SetFraction(int x, int y, float value)
+	{
+		assert(cells && celltype==DOTGRID_FLOAT);
+		assert(x>=0 && x<width);
+		assert(y>=0 && y<height);
+		((float *)cells)[y*width+x]=value;
+	}
+
+	inline const float *GetFractions() const
+	{
+		assert(celltype==DOTGRID_FLOAT);
+		return (const float *)cells;
+	}
+
 	// some helpers
 	inline int GetWidth() const
 	{
@@ -37,28 +147,47 @@ public:
 		return width*height;
 	}	
 
-	// for internal class use (just to make more robust and bounds test)
+	// for internal class use (just to make more robust and bounds test). Points saturate in narrow cells
 	inline void SetPoint(int x, int y, int point)
 	{
-		assert(data);
+		assert(cells);
 		assert(x>=0 && x<width);
 		assert(y>=0 && y<height);
-		data[y*width+x]=point;
+		SetData(y*width+x,point);
 	}
 
 	inline int GetPoint(int x, int y) const
 	{
-		assert(data);
+		assert(cells);
 		assert(x>=0 && x<width);
 		assert(y>=0 && y<height);
-		return data[y*width+x];
+		return GetData(y*width+x);
 	}
 
+	// the pieces of ToString() for images made a band at a time (see TilePyramid). The levels are a lookup table from
+	// each count up to max to its grey level, made from a cumulative histogram of num counts. Free them with FreeLevels
+	static unsigned char *MakeLevels(const int *histogram, int max, int num, int mode, int bits, double clip);
+	static void LookUp(unsigned char *string, const int *values, int num, const unsigned char *levels, int bits);
+	static void FreeLevels(unsigned char *levels, int bits);
+
+	// transforms[i], or none if transforms is NULL, flipping within a grid rows high
+	static GridTransform SourceTransform(const GridTransform *transforms, int i, int rows);
+
 	inline int GetData(int pos) const
 	{
-		assert(data);
+		assert(cells);
 		assert(pos>=0 && pos<width*height);
-		return data[pos];
+		switch(celltype)
+		{
+			case DOTGRID_UINT8:
+				return ((unsigned char *)cells)[pos];
+			case DOTGRID_UINT16:
+				return ((unsigned short *)cells)[pos];
+			case DOTGRID_INT32:
+				return ((int *)cells)[pos];
+		}
+		assert(0);
+		return 0;
 	}
 	//
 	// \brief helper function to calculate maximum array value (for scaling)
@@ -66,11 +195,11 @@ public:
 	// \param 
 	inline int GetMax() const
 	{
-		assert(data);
+		assert(cells);
 		int max=-999999;
 		for(int pos=0; pos<width*height; pos++)
-			if(data[pos]>max)
-				max=data[pos];
+			if(GetData(pos)>max)
+				max=GetData(pos);
 		return max;
 	} 
 
@@ -80,19 +209,38 @@ public:
 	// \param 
 	inline int GetMin() const
 	{
-		assert(data);
+		assert(cells);
 		int min=99999999;
 		for(int pos=0; pos<width*height; pos++)
-			if(data[pos]<min)
-				min=data[pos];
+			if(GetData(pos)<min)
+				min=GetData(pos);
 		return min;
 	} 
 
-	// turn the averaged grid into a luminance image string for the higher level language
-	unsigned char *ToString() const;
+	//! \brief turn the averaged grid into a luminance image string for the higher level language
+	//! \param mode how counts become grey levels. One of DOTGRID_EQUALISE, DOTGRID_LINEAR, DOTGRID_LOG or
+	//! DOTGRID_PERCENTILE
+	//! \param bits 8 for a byte a pixel, or 16 for two in native byte order, from 0 to 65535
+	//! \param clip for DOTGRID_PERCENTILE, the fraction of the non empty cells to clip to black
+	//! \details one pass gathers a histogram of the grid, the mode turns it into a lookup table from count to level,
+	//! and a second pass looks every cell up. Free the string with delete []
+	unsigned char *ToString(int mode=DOTGRID_EQUALISE, int bits=8, double clip=DOTGRID_CLIP) const;
 
 	int *CalculateHistogram() const;
 
+	//! \brief write the grid out as an image file, normalised as ToString() does it, a row at a time
+	//! \param format IMAGEWRITER_PNG or IMAGEWRITER_PNM
+	//! \param invert write it inverted, as dark dots on light rather than light on dark
+	//! \return false if it couldn't all be written
+	bool WriteImage(const char *path, int format=IMAGEWRITER_PNG, int mode=DOTGRID_EQUALISE, int bits=8, double clip=DOTGRID_CLIP, bool invert=false) const;
+
+	//! \brief write the image of the grid CalculateGrid() would make of source, with that of flipped (if not NULL)
+	//! flipped upside down and added, without the grid ever being made whole
+	//! \details DOTGRID_IMAGEBAND rows are worked out at a time, once to gather the histogram for the levels and
+	//! again to write them out, so only a couple of bands are ever held however big the image is. The stores must be
+	//! indexed. The other parameters are as for WriteImage()
+	static bool WriteBandedImage(const char *path, DotStore *source, DotStore *flipped, double x1, double y1, double x2, double y2, double scale, int window, int format=IMAGEWRITER_PNG, int mode=DOTGRID_EQUALISE, int bits=8, double clip=DOTGRID_CLIP, bool invert=false);
+
 	// \brief Taking data from the specified source, calculate an aveage grid using the window (x1,y1) - (x2,y2) as the source area
 	//
 	// \param source The DotStore from which to take our dot data
@@ -102,9 +250,43 @@ public:
 	// \param y2 the y position of the bottom right corner of the source window
 	// \param scale how much to shrink the window by in averaging. A value of 10 means make the grid 1/10th of the original window size. scale must be an even divisor of both the width and the height of the souce window
 	// \param window the window size used during the DotStore calculations: TODO: grab this value from the dotstore itself
-	void CalculateGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int window);
+	// \param type what the cells are (see Create). DOTGRID_AUTO picks the narrowest that can't saturate: no cell can
+	// count more bases than fit in it, nor more than the source has
+	//
+	// \details each point is what source->CountAreaMatches() gives for its cell, but worked out in one pass over the
+	// dots by DotStore::AddGridMatches() rather than one query per cell. Cells narrower than an int are worked out
+	// DOTGRID_CELLBAND rows at a time and saturated into the grid
+	void CalculateGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int window, int type=DOTGRID_AUTO);
+
+	// \brief CalculateGrid of several sources added together, each transposed, moved and flipped as its transform says
+	//
+	// \details every source's dots go straight into their cells where the transform puts them, so a forward and a
+	// reverse plot make one grid in a single pass, with no grid of each to flip and add. transforms may be NULL for
+	// none, and the rows of each are filled in here. DOTGRID_AUTO allows for the sources adding up
+	void CalculateGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale, int window, int type=DOTGRID_AUTO);
+
+	// \brief like CalculateGrid, but each point is the number of bases of matches in its cell (see DotStore::CountAreaBases)
+	//
+	// \details every match crossing a cell is counted, wherever it starts, so the source needn't be interpolated. The
+	// cells are the whole bases from x1+x*scale up to x1+(x+1)*scale. The source must be indexed. type is as for
+	// CalculateGrid
+	void CalculateCoverageGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale, int type=DOTGRID_AUTO);
+
+	// \brief CalculateCoverageGrid of several sources added together, as the CalculateGrid that takes transforms
+	void CalculateCoverageGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale, int type=DOTGRID_AUTO);
+
+	// \brief like CalculateCoverageGrid, but anti-aliased. Each point is the exact length of match in its cell
+	//
+	// \details the grid is made fractional, and each match adds just the part of its diagonal that crosses each cell
+	// (see DotStore::AddGridCoverage). Cells needn't line up with bases, and the last column and row end at x2 and y2
+	// rather than being dropped when scale doesn't divide the window. The source must be indexed
+	void CalculateFractionalGrid(DotStore *source, double x1, double y1, double x2, double y2, double scale);
+
+	// \brief CalculateFractionalGrid of several sources added together, as the CalculateGrid that takes transforms
+	void CalculateFractionalGrid(int num, DotStore **sources, const GridTransform *transforms, double x1, double y1, double x2, double y2, double scale);
 
 	// Add the values from another grid. Grid must have the same dimensions. Used to combine forward and reverse plots
+	// A grid whose cell type was picked automatically is widened if the sums need it. Otherwise they saturate
 	void AddInplace(DotGrid *second);
 
 	// flip this grid upside down
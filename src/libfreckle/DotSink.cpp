@@ -0,0 +1,242 @@
+#include "DotSink.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+void DotSink::AddDots(const Dot *dots, Coord count)
+{
+	for(Coord i=0; i<count; i++)
+		AddDot(dots[i].x, dots[i].y, dots[i].length);
+}
+
+/*
+** DotStoreSink
+*/
+DotStoreSink::DotStoreSink(DotStore *store)
+{
+	assert(store);
+	this->store=store;
+}
+
+void DotStoreSink::SetSymmetric(bool sym)
+{
+	store->SetSymmetric(sym);
+}
+
+void DotStoreSink::AddDot(Coord x, Coord y, Coord length)
+{
+	store->AddDot(x,y,length);
+}
+
+void DotStoreSink::AddDots(const Dot *dots, Coord count)
+{
+	store->AddDots(dots,count);
+}
+
+/*
+** CountingDotSink
+*/
+CountingDotSink::CountingDotSink()
+{
+	symmetric=false;
+	numdots=numdiagonal=0;
+	maxx=maxy=0;
+	totalbases=diagonalbases=0;
+	minlength=maxlength=0;
+	memset(lengthhistogram, 0, sizeof(lengthhistogram));
+	memset(diagonalhistogram, 0, sizeof(diagonalhistogram));
+}
+
+void CountingDotSink::SetSymmetric(bool sym)
+{
+	assert(!numdots);
+	symmetric=sym;
+}
+
+// the same book keeping DotStore does as its dots are added
+void CountingDotSink::AddDot(Coord x, Coord y, Coord length)
+{
+	if(x>maxx)
+		maxx=x;
+	if(y>maxy)
+		maxy=y;
+	if(symmetric)
+		maxy=maxx;
+
+	int bin=DotStore::LengthBin(length);
+	lengthhistogram[bin]++;
+	totalbases+=length;
+
+	if(x==y)
+	{
+		numdiagonal++;
+		diagonalhistogram[bin]++;
+		diagonalbases+=length;
+	}
+
+	if(!numdots || length<minlength)
+		minlength=length;
+	if(!numdots || length>maxlength)
+		maxlength=length;
+
+	numdots++;
+}
+
+void CountingDotSink::FillHeader(DotStoreMapHeader *header) const
+{
+	assert(DOTSTORE_HISTOGRAMBINS<=64);
+
+	header->symmetric=symmetric;
+	header->maxx=maxx;
+	header->maxy=maxy;
+	header->numdots=numdots;
+	header->numdiagonal=numdiagonal;
+	header->totalbases=totalbases;
+	header->diagonalbases=diagonalbases;
+	header->minlength=minlength;
+	header->maxlength=maxlength;
+	for(unsigned int bin=0; bin<DOTSTORE_HISTOGRAMBINS; bin++)
+	{
+		header->lengthhistogram[bin]=lengthhistogram[bin];
+		header->diagonalhistogram[bin]=diagonalhistogram[bin];
+	}
+}
+
+/*
+** FilterDotSink
+*/
+FilterDotSink::FilterDotSink(DotSink *next, Coord minlength)
+{
+	assert(next);
+	this->next=next;
+	this->minlength=minlength;
+}
+
+void FilterDotSink::SetSymmetric(bool sym)
+{
+	next->SetSymmetric(sym);
+}
+
+void FilterDotSink::AddDot(Coord x, Coord y, Coord length)
+{
+	if(length>=minlength)
+		next->AddDot(x,y,length);
+}
+
+// pass on runs of long enough dots as batches
+void FilterDotSink::AddDots(const Dot *dots, Coord count)
+{
+	Coord start=0;
+	for(Coord i=0; i<count; i++)
+		if(dots[i].length<minlength)
+		{
+			if(i>start)
+				next->AddDots(dots+start, i-start);
+			start=i+1;
+		}
+
+	if(count>start)
+		next->AddDots(dots+start, count-start);
+}
+
+bool FilterDotSink::Close()
+{
+	return next->Close();
+}
+
+/*
+** DotFileSink
+*/
+DotFileSink::DotFileSink(const char *path, int buffersize)
+{
+	assert(buffersize>0);
+
+	this->path=strdup(path);
+	this->buffersize=buffersize;
+	buffer=new Dot[buffersize];
+	buffered=0;
+
+	// the header goes in when we close, once we know what it says. the dots start after it
+	fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	ok=(fd!=-1 && lseek(fd, DOTSTORE_MAPHEADERSIZE, SEEK_SET)==DOTSTORE_MAPHEADERSIZE);
+	if(!ok)
+		printf("DotFileSink: could not create %s\n",path);
+}
+
+DotFileSink::~DotFileSink()
+{
+	if(fd!=-1)
+		Close();
+
+	delete [] buffer;
+	free(path);
+}
+
+void DotFileSink::SetSymmetric(bool sym)
+{
+	counts.SetSymmetric(sym);
+}
+
+void DotFileSink::AddDot(Coord x, Coord y, Coord length)
+{
+	buffer[buffered].x=x;
+	buffer[buffered].y=y;
+	buffer[buffered].length=length;
+	counts.AddDot(x,y,length);
+
+	if(++buffered==buffersize)
+		Flush();
+}
+
+bool DotFileSink::Flush()
+{
+	const char *p=(const char *)buffer;
+	size_t length=buffered*sizeof(Dot);
+	buffered=0;
+
+	while(ok && length)
+	{
+		ssize_t written=write(fd, p, length);
+		if(written<=0)
+		{
+			printf("DotFileSink: failed writing %s\n",path);
+			ok=false;
+			break;
+		}
+		p+=written;
+		length-=written;
+	}
+
+	return ok;
+}
+
+bool DotFileSink::Close()
+{
+	if(fd==-1)
+		return ok;
+
+	Flush();
+
+	char page[DOTSTORE_MAPHEADERSIZE];
+	memset(page, 0, DOTSTORE_MAPHEADERSIZE);
+	DotStoreMapHeader *header=(DotStoreMapHeader *)page;
+	memcpy(header->magic, "FDM1", 4);
+	header->byteorder=DOTSTORE_MAPBYTEORDER;
+	header->coordsize=sizeof(Coord);
+	counts.FillHeader(header);
+
+	if(ok && pwrite(fd, page, DOTSTORE_MAPHEADERSIZE, 0)!=DOTSTORE_MAPHEADERSIZE)
+	{
+		printf("DotFileSink: failed writing the header of %s\n",path);
+		ok=false;
+	}
+
+	if(close(fd)!=0)
+		ok=false;
+	fd=-1;
+
+	return ok;
+}
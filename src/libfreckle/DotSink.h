@@ -0,0 +1,141 @@
+#ifndef _DOTSINK_H_
+#define _DOTSINK_H_
+
+#include "Dot.h"
+#include "DotStore.h"
+
+/*
+** DotSink
+** =======
+** where a comparison engine sends its dots as it finds them. The engine doesn't care if they are being kept
+** in a DotStore, streamed out to a file, filtered or just counted.
+*/
+class DotSink
+{
+public:
+	virtual ~DotSink() {}
+
+	//! \brief the comparison is of a sequence against itself. Only the dots on and above the diagonal will be sent
+	//! \details must be called before any dots are added
+	virtual void SetSymmetric(bool sym) {}
+
+	virtual void AddDot(Coord x, Coord y, Coord length)=0;
+
+	//! \brief add a batch of dots. By default just adds them one at a time
+	virtual void AddDots(const Dot *dots, Coord count);
+
+	//! \brief every dot has been sent
+	//! \return false if they could not all be kept
+	virtual bool Close()
+	{
+		return true;
+	}
+};
+
+// keeps the dots in a DotStore, just as the engines always have. We don't own the store
+class DotStoreSink : public DotSink
+{
+private:
+	DotStore *store;
+
+public:
+	DotStoreSink(DotStore *store);
+
+	void SetSymmetric(bool sym);
+	void AddDot(Coord x, Coord y, Coord length);
+	void AddDots(const Dot *dots, Coord count);
+};
+
+// counts the dots and keeps their statistics, but throws the dots themselves away
+class CountingDotSink : public DotSink
+{
+private:
+	bool symmetric;
+	Coord numdots, numdiagonal;
+	Coord maxx, maxy;
+	long long totalbases, diagonalbases;		// 64 bit like DotStore's: the sums outgrow Coord long before the dots do
+	Coord minlength, maxlength;
+	long long lengthhistogram[DOTSTORE_HISTOGRAMBINS];
+	long long diagonalhistogram[DOTSTORE_HISTOGRAMBINS];
+
+public:
+	CountingDotSink();
+
+	void SetSymmetric(bool sym);
+	void AddDot(Coord x, Coord y, Coord length);
+
+	//! \brief fill in the counts and statistics part of a dot file header
+	void FillHeader(DotStoreMapHeader *header) const;
+
+	inline Coord GetNum() const
+	{
+		return numdots;
+	}
+
+	//! \brief the number of dots counting the mirrored half of a symmetric comparison
+	inline Coord GetLogicalNum() const
+	{
+		return symmetric?numdots*2-numdiagonal:numdots;
+	}
+
+	//! \brief the sum of the match lengths, counting the mirrored half like GetLogicalNum()
+	inline long long GetTotalBases() const
+	{
+		return symmetric?totalbases*2-diagonalbases:totalbases;
+	}
+
+	inline Coord GetMaxLength() const
+	{
+		return maxlength;
+	}
+};
+
+// passes on only the dots that are at least minlength long
+class FilterDotSink : public DotSink
+{
+private:
+	DotSink *next;
+	Coord minlength;
+
+public:
+	FilterDotSink(DotSink *next, Coord minlength);
+
+	void SetSymmetric(bool sym);
+	void AddDot(Coord x, Coord y, Coord length);
+	void AddDots(const Dot *dots, Coord count);
+	bool Close();
+};
+
+// streams the dots out to a dot file in big buffered writes. The finished file can be loaded with DotStore::MapFile()
+class DotFileSink : public DotSink
+{
+private:
+	int fd;
+	char *path;
+	bool ok;
+
+	Dot *buffer;
+	int buffered, buffersize;
+
+	CountingDotSink counts;				// what goes in the header when we close
+
+	bool Flush();
+
+public:
+	//! \brief create or truncate path. Dots are written out buffersize at a time
+	DotFileSink(const char *path, int buffersize=65536);
+	~DotFileSink();
+
+	void SetSymmetric(bool sym);
+	void AddDot(Coord x, Coord y, Coord length);
+
+	//! \brief write out the last of the dots and the header, and close the file
+	bool Close();
+
+	inline Coord GetNum() const
+	{
+		return counts.GetNum();
+	}
+};
+
+#endif
@@ -2,19 +2,116 @@
 #include <malloc.h>			// gives us NULL
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+DotStorageSlab::DotStorageSlab()
+{
+	base=NULL;
+	used=0;
+	spooloffset=-1;
+	next=NULL;
+}
+
+DotStorageSlab::~DotStorageSlab()
+{
+	if(base)
+		munmap(base, GetChunkSpan()*DOTSTORAGESLABCHUNKS);
+}
+
+bool DotStorageSlab::Map()
+{
+	assert(!base);
+	void *map=mmap(NULL, GetChunkSpan()*DOTSTORAGESLABCHUNKS, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+	if(map==MAP_FAILED)
+		return false;
+
+	base=(char *)map;
+	return true;
+}
+
+Dot *DotStorageSlab::Allocate()
+{
+	assert(base && !IsFull());
+	return (Dot *)(base+GetChunkSpan()*used++);
+}
+
+size_t DotStorageSlab::GetChunkSpan()
+{
+	size_t pagesize=sysconf(_SC_PAGESIZE);
+	return ((DOTSTORAGECHUNKBYTES+pagesize-1)/pagesize)*pagesize;
+}
+
+off_t DotStorageSlab::GetSpoolOffset(const Dot *storage) const
+{
+	assert(HasSpoolOffset());
+	assert((const char *)storage>=base && (const char *)storage<base+GetChunkSpan()*used);
+	return spooloffset+((const char *)storage-base);
+}
 
 DotStorageChunk::DotStorageChunk()
 {
 	num=0;
+	deleted=0;
+
+	dots=new Dot[DOTSTORAGECHUNKSIZE];
+	assert(dots);
+
+	slab=NULL;
+	spilled=false;
+	mapping=NULL;
+	mappinglength=0;
+	borrowed=false;
 	
 	next=NULL;
 	prev=NULL;
 
 }
 
-DotStorageChunk::~DotStorageChunk()
+DotStorageChunk::DotStorageChunk(DotStorageSlab *slab)
 {
+	assert(slab);
 
+	num=0;
+	deleted=0;
+
+	this->slab=slab;
+	dots=slab->Allocate();
+
+	spilled=false;
+	mapping=NULL;
+	mappinglength=0;
+	borrowed=false;
+
+	next=NULL;
+	prev=NULL;
+}
+
+DotStorageChunk::DotStorageChunk(Dot *storage, int count)
+{
+	assert(storage);
+	assert(count>=0 && count<=DOTSTORAGECHUNKSIZE);
+
+	num=count;
+	deleted=0;
+	dots=storage;
+
+	slab=NULL;
+	spilled=false;
+	mapping=NULL;
+	mappinglength=0;
+	borrowed=true;
+
+	next=NULL;
+	prev=NULL;
+}
+
+DotStorageChunk::~DotStorageChunk()
+{
+	if(mapping)
+		munmap(mapping, mappinglength);
+	else if(!borrowed && !slab)
+		delete [] dots;
 }
 
 Dot *DotStorageChunk::GetDot(int index)
@@ -24,7 +121,7 @@ Dot *DotStorageChunk::GetDot(int index)
         return &dots[index];
 }
 
-void DotStorageChunk::AddDot(int x, int y, int length)
+void DotStorageChunk::AddDot(Coord x, Coord y, Coord length)
 {
         assert(num<DOTSTORAGECHUNKSIZE);                // make sure we are not full
         dots[num].x=x;
@@ -33,11 +130,59 @@ void DotStorageChunk::AddDot(int x, int y, int length)
         num++;
 }
 
+int DotStorageChunk::AddDots(const Dot *source, int count, Coord dx, Coord dy)
+{
+	if(count>DOTSTORAGECHUNKSIZE-num)
+		count=DOTSTORAGECHUNKSIZE-num;
+
+	Dot *dest=dots+num;
+	for(int i=0; i<count; i++)
+	{
+		dest[i].x=source[i].x+dx;
+		dest[i].y=source[i].y+dy;
+		dest[i].length=source[i].length;
+	}
+	num+=count;
+
+	return count;
+}
+
+void DotStorageChunk::Offset(Coord dx, Coord dy)
+{
+	for(int i=0; i<num; i++)
+	{
+		dots[i].x+=dx;
+		dots[i].y+=dy;
+	}
+}
+
+void DotStorageChunk::FlipX(Coord length)
+{
+	for(int i=0; i<num; i++)
+		dots[i].x=length-dots[i].x;
+}
+
+void DotStorageChunk::FlipY(Coord length)
+{
+	for(int i=0; i<num; i++)
+		dots[i].y=length-dots[i].y;
+}
+
+void DotStorageChunk::Transpose()
+{
+	for(int i=0; i<num; i++)
+	{
+		Coord x=dots[i].x;
+		dots[i].x=dots[i].y;
+		dots[i].y=x;
+	}
+}
+
 void DotStorageChunk::DelDot(int index)
 {
         assert(index<num);
         // move them all down one
-        for(int i=index; i<num; i++)
+        for(int i=index; i<num-1; i++)
         {
                 dots[i].x=dots[i+1].x;
                 dots[i].y=dots[i+1].y;
@@ -46,6 +191,112 @@ void DotStorageChunk::DelDot(int index)
         num--;
 }
 
+void DotStorageChunk::MarkDeleted(int index)
+{
+	assert(index>=0 && index<num);
+	assert(dots[index].length!=DOT_DELETED);
+	dots[index].length=DOT_DELETED;
+	deleted++;
+}
+
+int DotStorageChunk::Compact()
+{
+	if(!deleted)
+		return 0;
+
+	int kept=0;
+	for(int i=0; i<num; i++)
+		if(dots[i].length!=DOT_DELETED)
+		{
+			if(kept!=i)
+				dots[kept]=dots[i];
+			kept++;
+		}
+
+	int dropped=num-kept;
+	num=kept;
+	deleted=0;
+	return dropped;
+}
+
+// one pass sliding the kept dots down over the gaps, rather than a DelDot() for every dot that goes
+int DotStorageChunk::Filter(Coord minlength)
+{
+	assert(!deleted);			// Compact() first
+	int kept=0;
+	for(int i=0; i<num; i++)
+		if(dots[i].length>=minlength)
+		{
+			if(kept!=i)
+				dots[kept]=dots[i];
+			kept++;
+		}
+
+	int dropped=num-kept;
+	num=kept;
+	return dropped;
+}
+
+// spill our dots to the spool file and map them back in. Over our storage if it is in a slab, so they don't move.
+// The mapping is private and writable so any later change to a spilled dot (DelDot, or a caller writing through a Dot *)
+// is copy-on-write and never touches the spool file. Untouched pages stay clean so the kernel is free to drop them.
+bool DotStorageChunk::Spill(int fd, off_t offset)
+{
+	assert(!spilled && !borrowed);
+	assert(IsFull());				// only sealed chunks are spilled
+
+	// write the whole dot array out
+	const char *buffer=(const char *)dots;
+	size_t remaining=DOTSTORAGECHUNKBYTES;
+	off_t pos=offset;
+	while(remaining)
+	{
+		ssize_t written=pwrite(fd, buffer, remaining, pos);
+		if(written<=0)
+			return false;
+		buffer+=written;
+		pos+=written;
+		remaining-=written;
+	}
+
+	if(slab)
+	{
+		void *map=mmap(dots, DOTSTORAGECHUNKBYTES, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, offset);
+		if(map!=MAP_FAILED)
+		{
+			spilled=true;
+			return true;
+		}
+
+		// a failed fixed mapping may have taken our pages with it, so the file is mapped in somewhere else. Whatever
+		// is left where they were is still the slab's, and is plugged so nothing else is given it before the slab goes
+		map=mmap(NULL, DOTSTORAGECHUNKBYTES, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, offset);
+		if(map==MAP_FAILED)
+			return false;
+		mmap(dots, DOTSTORAGECHUNKBYTES, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_FIXED|MAP_NORESERVE, -1, 0);
+
+		mapping=map;
+		mappinglength=DOTSTORAGECHUNKBYTES;
+		dots=(Dot *)map;
+		spilled=true;
+		return true;
+	}
+
+	// off the heap, the file is mapped in wherever it goes
+	void *map=mmap(NULL, DOTSTORAGECHUNKBYTES, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, offset);
+	if(map==MAP_FAILED)
+		return false;
+
+	delete [] dots;
+
+	mapping=map;
+	mappinglength=DOTSTORAGECHUNKBYTES;
+	dots=(Dot *)map;
+	spilled=true;
+
+	return true;
+}
+
 // link 'insert' in before this in any linked chain
 void DotStorageChunk::LinkBefore(DotStorageChunk *insert)
 {
@@ -96,4 +347,3 @@ void DotStorageChunk::LinkAfter(DotStorageChunk *insert)
 	}
 }
 
-
@@ -1,19 +1,109 @@
+
 #ifndef _DOTSTORAGECHUNK_H_
 #define _DOTSTORAGECHUNK_H_
 
 #include <malloc.h>			//give us NULL
 #include <assert.h>
 #include <stdio.h>
+#include <sys/types.h>			//give us off_t
 #include "Dot.h"
 
 #define DOTSTORAGECHUNKSIZE	8192
 
+// the size in bytes of the dot array of a full chunk
+#define DOTSTORAGECHUNKBYTES	(DOTSTORAGECHUNKSIZE*sizeof(Dot))
+
+// how many chunks' storage is mapped in one go
+#define DOTSTORAGESLABCHUNKS	64
+
+/*
+** DotStorageSlab
+** ==============
+** the storage for DOTSTORAGESLABCHUNKS chunks, in one mapping, so a big store is a mapping per slab rather than one per
+** chunk. Each chunk's storage starts on a page, so when it is spilled the spool file can be mapped back in right where
+** it was. A slab gets its own stretch of the spool file, laid out just as the slab is, so its spilled chunks sit next to
+** each other in both and the kernel keeps them as one mapping too.
+**
+** The slab owns its whole mapping, spilled chunks and all, and unmaps it when it goes. Nothing else unmaps any of it.
+*/
+class DotStorageSlab
+{
+private:
+	char	*base;			// NULL if we couldn't be mapped
+	int	used;			// how many chunks we have handed storage to
+	off_t	spooloffset;		// where our stretch of the spool file starts. -1 until we are given one
+
+	DotStorageSlab		*next;	// the slabs of a store, newest first
+
+public:
+	DotStorageSlab();
+	~DotStorageSlab();
+
+	//! \brief map the storage
+	//! \return false if it couldn't be
+	bool	Map();
+
+	//! \brief storage for the next chunk. We must be mapped, and not full
+	Dot	*Allocate();
+
+	//! \brief the bytes a chunk takes in a slab and in the spool file. A full chunk, rounded up to whole pages
+	static size_t GetChunkSpan();
+
+	//! \brief the bytes a slab takes in the spool file
+	static inline off_t GetSpoolSpan()
+	{
+		return (off_t)GetChunkSpan()*DOTSTORAGESLABCHUNKS;
+	}
+
+	//! \brief where storage we handed out goes in the spool file. We must have been given our stretch of it
+	off_t	GetSpoolOffset(const Dot *storage) const;
+
+	inline bool HasSpoolOffset() const
+	{
+		return spooloffset>=0;
+	}
+
+	inline void SetSpoolOffset(off_t offset)
+	{
+		spooloffset=offset;
+	}
+
+	inline bool IsFull() const
+	{
+		return used==DOTSTORAGESLABCHUNKS;
+	}
+
+	inline DotStorageSlab *GetNext()
+	{
+		return next;
+	}
+
+	inline void SetNext(DotStorageSlab *slab)
+	{
+		next=slab;
+	}
+};
+
 class DotStorageChunk
 {
 private:
-	Dot	dots[DOTSTORAGECHUNKSIZE];
+	Dot	*dots;			// our dot array. On the heap, in a slab, or mapped in from a spool file
 	
 	int	num;
+	int	deleted;		// how many of our dots are marked DOT_DELETED
+
+	// the slab our storage is in, or NULL. It is the slab's to unmap, even once we are spilled over it
+	DotStorageSlab	*slab;
+
+	// if we have been spilled to disk
+	bool	spilled;
+
+	// and if that was to a mapping of our own rather than over our slab storage, this is it
+	void	*mapping;
+	size_t	mappinglength;
+
+	// our dots live in somebody else's mapping (a mapped dot file) and are not ours to free
+	bool	borrowed;
 
 	// doubly linked list of storage chunks
 	DotStorageChunk		*prev, *next;
@@ -22,24 +112,74 @@ public:
 	DotStorageChunk();
 	~DotStorageChunk();
 
+	//! \brief a chunk with its storage in slab, which must have room for it
+	DotStorageChunk(DotStorageSlab *slab);
+
+	//! \brief a chunk over count dots that already exist in memory we don't own, such as a mapped dot file.
+	//! \details the storage must have room for a whole chunk as later dots get added after the first count
+	DotStorageChunk(Dot *storage, int count);
+
 	Dot	*GetDot(int num);
-	void	AddDot(int x, int y, int length);
+	void	AddDot(Coord x, Coord y, Coord length);
 	void	DelDot(int index);
 
+	//! \brief mark a dot DOT_DELETED where it is, leaving the dots after it in place. It still counts in GetNum()
+	void	MarkDeleted(int index);
+
+	//! \brief drop the dots marked deleted, keeping the rest in order at the front
+	//! \return how many dots were dropped
+	int	Compact();
+
+	//! \brief drop the dots shorter than minlength, keeping the rest in order at the front
+	//! \return how many dots were dropped
+	int	Filter(Coord minlength);
+
+	//! \brief copy up to count dots from source onto our end, moving each by (dx,dy)
+	//! \return how many dots fitted
+	int	AddDots(const Dot *source, int count, Coord dx, Coord dy);
+
+	// in place transforms of every dot we hold
+	void	Offset(Coord dx, Coord dy);
+	void	FlipX(Coord length);			// x becomes length-x
+	void	FlipY(Coord length);			// y becomes length-y
+	void	Transpose();				// x and y swap
+
 	void LinkBefore(DotStorageChunk *insert);
 	void LinkAfter(DotStorageChunk *insert);
 
-	inline int GetDotX(int num)
+	//! \brief write our dots out to the file descriptor at offset, and map them back in from the file
+	//! \details a chunk in a slab is mapped back in where it was, so its dots keep their addresses and pointers to them
+	//! stay good. A chunk on the heap, or one the file can't be mapped over, is mapped in somewhere else
+	//! \return true if we were spilled. false if the write or the mapping failed, in which case we are left untouched in ram
+	bool	Spill(int fd, off_t offset);
+
+	inline bool IsSpilled() const
+	{
+		return spilled;
+	}
+
+	//! \brief the slab our storage is in, or NULL
+	inline DotStorageSlab *GetSlab()
+	{
+		return slab;
+	}
+
+	inline bool IsBorrowed() const
+	{
+		return borrowed;
+	}
+
+	inline Coord GetDotX(int num)
 	{
 		return GetDot(num)->x;
 	}
 
-	inline int GetDotY(int num)
+	inline Coord GetDotY(int num)
 	{
 		return GetDot(num)->y;
 	}
 
-	inline int GetDotLength(int num)
+	inline Coord GetDotLength(int num)
 	{
 		return GetDot(num)->length;
 	}
@@ -78,6 +218,12 @@ public:
 	{
 		return num;
 	}
+
+	//! \brief how many of GetNum() are marked deleted
+	inline int	GetNumDeleted() const
+	{
+		return deleted;
+	}
 };
 
 #endif
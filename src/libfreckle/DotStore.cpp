@@ -3,6 +3,15 @@
 #include <memory.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+long long DotStore::defaultmemorylimit=0;
+char *DotStore::defaultspooldir=NULL;
 
 //construct
 DotStore::DotStore()
@@ -13,9 +22,34 @@ DotStore::DotStore()
 	numchunks=0;
 	numdots=0;
 
+	spoolfd=-1;
+	spooloffset=0;
+	residentchunks=0;
+	spillfrom=NULL;
+	roomfrom=NULL;
+	slabs=NULL;
+	memorylimit=defaultmemorylimit;
+	spooldir=defaultspooldir?strdup(defaultspooldir):NULL;
+
+	filemapping=NULL;
+	filemappinglength=0;
+	borrowedchunks=0;
+
 	maxx=maxy=0;
 
+	symmetric=false;
+	numdiagonal=0;
+	ResetStatistics();
+
 	index=NULL;
+	diagonalindex=NULL;
+	profile=NULL;
+	segmentindex=NULL;
+	areatable=NULL;
+	pending=NULL;
+	pendingstale=false;
+	indexstale=false;
+	numdeleted=0;
 
 	averagearray=NULL;
 	pixwidth=0;
@@ -26,6 +60,9 @@ DotStore::DotStore()
 DotStore::~DotStore()
 {
 	Empty();
+
+	if(spooldir)
+		free(spooldir);
 }
 
 //empty
@@ -48,22 +85,74 @@ void DotStore::Empty()
 
 	numchunks=0;
 	numdots=0;
+	numdiagonal=0;
+	ResetStatistics();
+
+	// and the slabs their storage was in
+	DotStorageSlab *nextslab=NULL;
+	for(DotStorageSlab *slab=slabs; slab; slab=nextslab)
+	{
+		nextslab=slab->GetNext();
+		delete slab;
+	}
+	slabs=NULL;
+
+	// the spool file only held the chunks we just freed. we keep our memory limit and symmetry though
+	CloseSpool();
+	residentchunks=0;
+	spillfrom=NULL;
+	roomfrom=NULL;
+
+	// and the chunks that borrowed from our mapped file are gone, so it can go too
+	if(filemapping)
+		munmap(filemapping, filemappinglength);
+	filemapping=NULL;
+	filemappinglength=0;
+	borrowedchunks=0;
 
 	maxx=maxy=0;
 
 	index=NULL;
+	diagonalindex=NULL;
+	profile=NULL;
+	segmentindex=NULL;
+	areatable=NULL;
+	pending=NULL;
+	pendingstale=false;
+	indexstale=false;
+	numdeleted=0;
 
 	averagearray=NULL;
 	pixwidth=0;
 	pixheight=0;
 }
 
+// a chunk with its storage in our newest slab, or a new one. If a slab can't be had it goes on the heap, where it can
+// still be spilled but its dots move when it is
+DotStorageChunk *DotStore::NewChunk()
+{
+	if(!slabs || slabs->IsFull())
+	{
+		DotStorageSlab *slab=new DotStorageSlab();
+		if(!slab->Map())
+		{
+			printf("DotStore: could not map storage for more dots. Putting them on the heap\n");
+			delete slab;
+			return new DotStorageChunk();
+		}
+		slab->SetNext(slabs);
+		slabs=slab;
+	}
+
+	return new DotStorageChunk(slabs);
+}
+
 void DotStore::AddDotStorageChunk()
 {
 	if(!head && !tail)
 	{
 		//first chunk
-		head=tail=new DotStorageChunk();
+		head=tail=NewChunk();
 		assert(head);
 		assert(tail);
 		numchunks++;
@@ -71,13 +160,315 @@ void DotStore::AddDotStorageChunk()
 	else
 	{
 		//subsequenct chunk
-		DotStorageChunk *newchunk=new DotStorageChunk();
+		DotStorageChunk *newchunk=NewChunk();
 		assert(newchunk);
 		
 		tail->LinkAfter(newchunk);
 		tail=newchunk;
 		numchunks++;
 	}
+
+	residentchunks++;
+
+	// are we over budget?
+	if(memorylimit && (long long)residentchunks*(long long)DOTSTORAGECHUNKBYTES > memorylimit)
+		SpillChunks();
+}
+
+void DotStore::SetMemoryLimit(long long bytes, const char *tmpdir)
+{
+	assert(bytes>=0);
+	memorylimit=bytes;
+
+	if(spooldir)
+		free(spooldir);
+	spooldir=tmpdir?strdup(tmpdir):NULL;
+
+	if(memorylimit && (long long)residentchunks*(long long)DOTSTORAGECHUNKBYTES > memorylimit)
+		SpillChunks();
+}
+
+void DotStore::SetDefaultMemoryLimit(long long bytes, const char *tmpdir)
+{
+	assert(bytes>=0);
+	defaultmemorylimit=bytes;
+
+	if(defaultspooldir)
+		free(defaultspooldir);
+	defaultspooldir=tmpdir?strdup(tmpdir):NULL;
+}
+
+// create our spool file. It is unlinked straight away so it goes away with us, however we die
+bool DotStore::OpenSpool()
+{
+	assert(spoolfd==-1);
+
+	const char *dir=spooldir;
+	if(!dir)
+		dir=getenv("TMPDIR");
+	if(!dir)
+		dir="/tmp";
+
+	char *path=new char[strlen(dir)+32];
+	sprintf(path,"%s/freckleXXXXXX",dir);
+
+	spoolfd=mkstemp(path);
+	if(spoolfd!=-1)
+		unlink(path);
+	else
+		printf("DotStore: could not create a spool file in %s. Keeping all dots in ram\n",dir);
+
+	delete [] path;
+
+	spooloffset=0;
+	return spoolfd!=-1;
+}
+
+void DotStore::CloseSpool()
+{
+	if(spoolfd!=-1)
+		close(spoolfd);
+	spoolfd=-1;
+	spooloffset=0;
+}
+
+// write out the oldest full chunks that are still in ram until we are back under our memory limit
+// the tail is never spilled as thats where the next dots are going
+void DotStore::SpillChunks()
+{
+	if(spoolfd==-1 && !OpenSpool())
+	{
+		// no spool. stop trying
+		memorylimit=0;
+		return;
+	}
+
+	// chunk offsets in the spool have to be page aligned to be mapped
+	off_t chunkspan=DotStorageSlab::GetChunkSpan();
+
+	// the chunks before spillfrom are gone already, so they aren't walked again for every chunk we add
+	if(!spillfrom)
+		spillfrom=head;
+	while(spillfrom!=tail && (spillfrom->IsSpilled() || spillfrom->IsBorrowed()))
+		spillfrom=spillfrom->GetNext();
+
+	for(DotStorageChunk *chunk=spillfrom; chunk && chunk!=tail; chunk=chunk->GetNext())
+	{
+		if((long long)residentchunks*(long long)DOTSTORAGECHUNKBYTES <= memorylimit)
+			break;
+
+		if(chunk->IsSpilled() || chunk->IsBorrowed() || !chunk->IsFull())
+			continue;
+
+		// a chunk in a slab goes where it is in the slab's stretch of the spool file, which it gets the first time
+		DotStorageSlab *slab=chunk->GetSlab();
+		off_t offset=spooloffset;
+		if(slab)
+		{
+			if(!slab->HasSpoolOffset())
+			{
+				slab->SetSpoolOffset(spooloffset);
+				spooloffset+=DotStorageSlab::GetSpoolSpan();
+			}
+			offset=slab->GetSpoolOffset(chunk->GetDot(0));
+		}
+
+		Dot *dots=chunk->GetDot(0);
+		if(!chunk->Spill(spoolfd, offset))
+		{
+			printf("DotStore: failed to spill to the spool file. Keeping remaining dots in ram\n");
+			memorylimit=0;
+			return;
+		}
+
+		if(!slab)
+			spooloffset+=chunkspan;
+		residentchunks--;
+
+		// its dots are mapped back in where they were, so the index still has them. Unless they couldn't be
+		if(index && chunk->GetDot(0)!=dots)
+			InvalidateIndex();
+	}
+}
+
+void DotStore::SetSymmetric(bool sym)
+{
+	if(sym==symmetric)
+		return;
+
+	if(!sym)
+	{
+		Unfold();
+		return;
+	}
+
+	// we can't tell which of any dots already here are mirrors of each other
+	assert(!numdots);
+	symmetric=true;
+
+	if(maxx>maxy)
+		maxy=maxx;
+	else
+		maxx=maxy;
+}
+
+void DotStore::Unfold()
+{
+	if(!symmetric)
+		return;
+
+	// collect the mirrors first. adding them as we walk would move the dots around under us
+	DotStore *mirrors=new DotStore();
+	Dot *dot=NULL;
+	for(Coord i=0; i<GetNum(); i++)
+	{
+		dot=GetDot(i);
+		if(dot->x!=dot->y)
+			mirrors->AddDot(dot->y,dot->x,dot->length);
+	}
+
+	symmetric=false;
+	for(Coord i=0; i<mirrors->GetNum(); i++)
+	{
+		dot=mirrors->GetDot(i);
+		AddDot(dot->x,dot->y,dot->length);
+	}
+
+	delete mirrors;
+}
+
+// put a dot on the end of the store. For a symmetric store, the dot must already be on or above the diagonal
+void DotStore::AppendDot(Coord x, Coord y, Coord length)
+{
+	if(!tail || tail->IsFull())
+		AddDotStorageChunk();
+
+	tail->AddDot(x,y,length);
+	CountDot(x,y,length);
+	numdots++;
+	if(x==y)
+		numdiagonal++;
+
+	if(x>maxx)
+		maxx=x;
+	if(y>maxy)
+		maxy=y;
+	if(symmetric)
+		maxy=maxx;
+
+	IndexDot(x,y,length);
+}
+
+void DotStore::RecountDiagonal()
+{
+	numdiagonal=0;
+	memset(diagonalhistogram, 0, sizeof(diagonalhistogram));
+	diagonalbases=0;
+
+	Dot *dot;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			dot=chunk->GetDot(i);
+			if(dot->x==dot->y)
+			{
+				numdiagonal++;
+				diagonalhistogram[LengthBin(dot->length)]++;
+				diagonalbases+=dot->length;
+			}
+		}
+}
+
+void DotStore::ResetStatistics()
+{
+	memset(lengthhistogram, 0, sizeof(lengthhistogram));
+	memset(diagonalhistogram, 0, sizeof(diagonalhistogram));
+	totalbases=diagonalbases=0;
+	minlength=maxlength=0;
+	lengthrangestale=false;
+}
+
+// a dot has been added. numdots and numdiagonal are looked after by the caller
+void DotStore::CountDot(Coord x, Coord y, Coord length)
+{
+	int bin=LengthBin(length);
+	lengthhistogram[bin]++;
+	totalbases+=length;
+
+	if(x==y)
+	{
+		diagonalhistogram[bin]++;
+		diagonalbases+=length;
+	}
+
+	if(!numdots || length<minlength)
+		minlength=length;
+	if(!numdots || length>maxlength)
+		maxlength=length;
+}
+
+// a dot is being removed
+void DotStore::UncountDot(Coord x, Coord y, Coord length)
+{
+	int bin=LengthBin(length);
+	lengthhistogram[bin]--;
+	totalbases-=length;
+
+	if(x==y)
+	{
+		diagonalhistogram[bin]--;
+		diagonalbases-=length;
+	}
+
+	if(length==minlength || length==maxlength)
+		lengthrangestale=true;
+}
+
+void DotStore::RescanLengthRange()
+{
+	minlength=maxlength=0;
+	bool first=true;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Coord length=chunk->GetDot(i)->length;
+			if(length==DOT_DELETED)
+				continue;
+			if(first || length<minlength)
+				minlength=length;
+			if(first || length>maxlength)
+				maxlength=length;
+			first=false;
+		}
+
+	lengthrangestale=false;
+}
+
+Coord DotStore::GetMinLength()
+{
+	if(lengthrangestale)
+		RescanLengthRange();
+	return minlength;
+}
+
+Coord DotStore::GetMaxLength()
+{
+	if(lengthrangestale)
+		RescanLengthRange();
+	return maxlength;
+}
+
+Coord DotStore::LengthThreshold(Coord n) const
+{
+	long long count=0;
+	for(int bin=DOTSTORE_HISTOGRAMBINS-1; bin>=0; bin--)
+	{
+		count+=GetLengthHistogram(bin);
+		if(count>=n && n>0)
+			return (Coord)1<<bin;
+	}
+
+	return 0;
 }
 
 // This will collapse the dot storage chunks into the minimum size
@@ -89,13 +480,23 @@ void DotStore::CollapseDotStorageChunks()
 
 
 // AddDot(x,y,length)
-void DotStore::AddDot(int x, int y, int length)
+void DotStore::AddDot(Coord x, Coord y, Coord length)
 {
-	// keep track of maximums
+	// a symmetric store keeps everything on or above the diagonal
+	if(symmetric && x<y)
+	{
+		Coord t=x;
+		x=y;
+		y=t;
+	}
+
+	// keep track of maximums. a symmetric store is square
 	if(x>maxx)
 		maxx=x;
 	if(y>maxy)
 		maxy=y;
+	if(symmetric)
+		maxy=maxx;
 
 	// if we have no chunks
 	if(!head && !tail)
@@ -108,7 +509,12 @@ void DotStore::AddDot(int x, int y, int length)
 	{
 		// chunk with space found
 		chunk->AddDot(x,y,length);
+		CountDot(x,y,length);
 		numdots++;
+		if(x==y)
+			numdiagonal++;
+
+		IndexDot(x,y,length);
 	}
 	else
 	{
@@ -118,51 +524,161 @@ void DotStore::AddDot(int x, int y, int length)
 	}
 }
 
-Dot *DotStore::GetDot(int ind)
+void DotStore::AddDots(const Dot *dots, Coord count)
+{
+	for(Coord i=0; i<count; i++)
+	{
+		if(symmetric && dots[i].x<dots[i].y)
+			AppendDot(dots[i].y,dots[i].x,dots[i].length);
+		else
+			AppendDot(dots[i].x,dots[i].y,dots[i].length);
+	}
+}
+
+Dot *DotStore::GetDot(Coord ind)
 {
 	assert(ind>=0);
 	if(!head || !tail || !numdots || ind>numdots-1)
 		return NULL;			//no dots here, or index too high or too low
 
-	DotStorageChunk *chunk=head;
-	
-	// return the pointer to dot with index 'index'
-	while(ind>=chunk->GetNum())
+	DotStorageChunk *chunk;
+	int position;
+	return LocateDot(ind,chunk,position);
+}
+
+// the dots marked deleted aren't counted, so a chunk with any in it is walked to find the dot
+Dot *DotStore::LocateDot(Coord ind, DotStorageChunk *&chunk, int &position)
+{
+	chunk=head;
+	while(ind>=chunk->GetNum()-chunk->GetNumDeleted())
 	{
-		ind-=chunk->GetNum();
+		ind-=chunk->GetNum()-chunk->GetNumDeleted();
 		chunk=chunk->GetNext();
-		assert(chunk);			// if we run out of chunks something horrid has happened. Because above we tested if index was too high
+		assert(chunk);			// if we run out of chunks something horrid has happened. The caller tested if index was too high
 	}
 
-	//so chunk now contains the relevant dot. return it
-	return chunk->GetDot(ind);
+	position=(int)ind;
+	if(chunk->GetNumDeleted())
+		for(position=0; ; position++)
+		{
+			if(chunk->GetDot(position)->length==DOT_DELETED)
+				continue;
+			if(!ind)
+				break;
+			ind--;
+		}
+
+	return chunk->GetDot(position);
 }
 
-void DotStore::DelDot(int index)
+void DotStore::DelDot(Coord index)
 {
 	assert(index>=0);
 	assert(head && tail && numdots && index<numdots);		//no dots here, or index too high or too low
 
-	DotStorageChunk *chunk=head;
-	
-	// find the dot with index 'index'
-	while(index>=chunk->GetNum())
+	DotStorageChunk *chunk;
+	int position;
+	LocateDot(index,chunk,position);
+	DeleteAt(chunk,position);
+}
+
+void DotStore::DeleteAt(DotStorageChunk *chunk, int position)
+{
+	Dot *dot=chunk->GetDot(position);
+	Dot deleted=*dot;
+	UncountDot(dot->x,dot->y,dot->length);
+	if(dot->x==dot->y)
+		numdiagonal--;
+	numdots--;
+
+	// with no index to keep, the dots after it in its chunk just move down one
+	if(!index || indexstale)
 	{
-		index-=chunk->GetNum();
-		chunk=chunk->GetNext();
-		assert(chunk);			// if we run out of chunks something horrid has happened. Because above we tested if index was too high
+		chunk->DelDot(position);
+		roomfrom=NULL;
+		return;
 	}
 
-	//so chunk now contains the relevant dot. lets delete it
-	chunk->DelDot(index);
-	numdots--;
+	// under one it stays put, and if it was added since the index was made its copy in pending goes too
+	if(!MarkDeleted(chunk,position))
+	{
+		pending->DeleteCopy(deleted.x,deleted.y,deleted.length);
+		pendingstale=true;
+	}
+	DeletedUnderIndex();
+}
+
+// no pending dot starts where an indexed one does (see IndexDot()), so if the index has a dot there this one is ours
+bool DotStore::MarkDeleted(DotStorageChunk *chunk, int position)
+{
+	Dot *dot=chunk->GetDot(position);
+	Dot *indexed=index->GetDot(dot->x,dot->y);
+
+	// the index kept only the longest of the dots starting here. If that goes, the next longest has to be indexed
+	if(indexed && diagonalindex->Remove(dot->x,dot->y) && indexed==dot)
+		InvalidateIndex();
+
+	chunk->MarkDeleted(position);
+	numdeleted++;
+	return indexed!=NULL;
+}
+
+void DotStore::DeletedUnderIndex()
+{
+	// the profile and area table were made with the deleted dots
+	delete profile;
+	delete areatable;
+	profile=NULL;
+	areatable=NULL;
+
+	// past a point it is cheaper to make the index again than to keep passing over them
+	if(numdeleted>=DOTSTORE_MINPENDING && numdeleted>=numdots/DOTSTORE_DELETEDFRACTION)
+		InvalidateIndex();
+}
+
+// pending is small, so the copy is just looked for. Any live dot the same will do, as they are all copies alike
+void DotStore::DeleteCopy(Coord x, Coord y, Coord length)
+{
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->x==x && dot->y==y && dot->length==length)
+			{
+				DeleteAt(chunk,i);
+				return;
+			}
+		}
+
+	assert(0);			// pending has a copy of every dot added since the index was made
+}
+
+void DotStore::Compact()
+{
+	if(!numdeleted)
+		return;
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		chunk->Compact();
+	numdeleted=0;
+	roomfrom=NULL;
+
+	// the dots after each deleted one have moved down
+	if(index)
+		InvalidateIndex();
 }
 
 void DotStore::Dump()
 {
 	printf("i\tx\ty\tlen\n=\t=\t=\t===\n");
-	for(int i=0; i<numdots; i++)
-		printf("%d\t%d\t%d\t%d\n",i,GetDot(i)->x,GetDot(i)->y,GetDot(i)->length);
+	for(Coord i=0; i<numdots; i++)
+		printf("%lld\t%lld\t%lld\t%lld\n",(long long)i,(long long)GetDot(i)->x,(long long)GetDot(i)->y,(long long)GetDot(i)->length);
+
+	// and the mirrors we represent
+	if(symmetric)
+		for(Coord i=0, n=numdots; i<numdots; i++)
+			if(GetDot(i)->x!=GetDot(i)->y)
+				printf("%lld\t%lld\t%lld\t%lld\n",(long long)n++,(long long)GetDot(i)->y,(long long)GetDot(i)->x,(long long)GetDot(i)->length);
 }
 
 // indexes the dots by y and then by x
@@ -179,6 +695,9 @@ void DotStore::CreateIndex()
 		DestroyIndex();
 	}
 
+	// and the dots deleted from under it can go for good
+	Compact();
+
 	if(numdots==0)
 	{
 // 		printf("numdots==0\n");
@@ -198,16 +717,82 @@ void DotStore::CreateIndex()
 	if(maxy==0)
 		maxy=1;
 
-	// create a new index
-// 	printf("creating quadtree\n");
-	index=new QuadTree(0,0,maxx,maxy);
+	// create a new index over every dot in one go
+	index=new MortonIndex(head,numdots);
+	diagonalindex=new DiagonalIndex(head,numdots);
+}
+
+void DotStore::RefreshIndex()
+{
+	if(!index)
+		return;
+
+	if(indexstale)
+		CreateIndex();
+	else if(pendingstale)
+	{
+		// once pending has an index it is kept, and only the dots added to it since get indexed
+		if(pending->index)
+			pending->RefreshIndex();
+		else
+			pending->CreateIndex();
+		pendingstale=false;
+	}
+}
+
+void DotStore::IndexDot(Coord x, Coord y, Coord length)
+{
+	if(!index || indexstale)
+		return;
+
+	// the profile and area table won't have it
+	if(profile)
+	{
+		delete profile;
+		profile=NULL;
+	}
+	if(areatable)
+	{
+		delete areatable;
+		areatable=NULL;
+	}
+
+	// the index only keeps the longest of the dots at one place, so one added where there is a dot already is a new longest
+	// or has to be hidden. Both need the index made again
+	if(index->GetDot(x,y))
+	{
+		InvalidateIndex();
+		return;
+	}
 
-	// go through every dot
-// 	printf("adding dots: %d\n",numdots);
-	for(int i=0; i<numdots; i++)
+	if(!pending)
+	{
+		pending=new DotStore();
+		pending->SetMemoryLimit(0);		// it is small, and not worth a spool file of its own
+	}
+	else if(pending->numdots>=DOTSTORE_MINPENDING && pending->numdots>=numdots/DOTSTORE_PENDINGFRACTION)
 	{
-		index->AddDot(GetDot(i));
+		// cheaper to make the whole index again than to keep going
+		InvalidateIndex();
+		return;
 	}
+
+	// if pending is indexed the dot goes on into its own pending store, and is indexed on the next query
+	pending->AppendDot(x,y,length);
+	pendingstale=true;
+}
+
+void DotStore::InvalidateIndex()
+{
+	indexstale=true;
+
+	delete pending;
+	delete profile;
+	delete areatable;
+	pending=NULL;
+	pendingstale=false;
+	profile=NULL;
+	areatable=NULL;
 }
 
 void DotStore::DestroyIndex()
@@ -216,8 +801,20 @@ void DotStore::DestroyIndex()
 	assert(index);	
 
 	delete index;
+	delete diagonalindex;
+	delete profile;
+	delete segmentindex;
+	delete areatable;
+	delete pending;
 
 	index=NULL;
+	diagonalindex=NULL;
+	profile=NULL;
+	segmentindex=NULL;
+	areatable=NULL;
+	pending=NULL;
+	pendingstale=false;
+	indexstale=false;
 }
 
 #ifdef DEBUG
@@ -229,213 +826,820 @@ void DotStore::DumpIndex()
 }
 #endif
 
+// the first dot it is shown that hasn't been deleted
+struct DotStore::FirstDotVisitor
+{
+	Dot *dot;
+
+	FirstDotVisitor() { dot=NULL; }
+
+	inline void Visit(Dot *dot) { if(!this->dot && dot->length!=DOT_DELETED) this->dot=dot; }
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
 // use the index to quickly find a dot
-Dot *DotStore::GetIndexDot(int x,int y)
+Dot *DotStore::GetIndexDot(Coord x,Coord y)
 {
 	assert(index);				//we must be indexed
-	
-	LinkedListVal<Dot *> *result=index->SpatialQuery(x,y,x,y);
+	RefreshIndex();
+
+	if(symmetric && x<y)
+	{
+		// below the diagonal we only have the reflection
+		Dot *dot=GetIndexDot(y,x);
+		if(!dot)
+			return NULL;
+
+		mirror.x=dot->y;
+		mirror.y=dot->x;
+		mirror.length=dot->length;
+		return &mirror;
+	}
+
+	FirstDotVisitor visitor;
+	QueryIndex(x,y,x,y,visitor);
+	return visitor.dot;
+}
+
+// use the diagonal index to find where the next dot down the diagonal starts
+Coord DotStore::GetIndexDiagonalGap(Coord x, Coord y)
+{
+	assert(diagonalindex);			//we must be indexed
+	RefreshIndex();
 
-	if( not(result->Length()==1 || result->Length()==0))
+	// below the diagonal we walk the reflection of a stored diagonal, which is just as far
+	if(symmetric && x<y)
 	{
-		printf("Length: %d\n",result->Length());
-		printf("X: %d Y: %d\n",x,y);
+		Coord t=x;
+		x=y;
+		y=t;
 	}
 
-	assert(result->Length()==1 || result->Length()==0);
+	return DiagonalGap(x,y);
+}
+
+// the nearer of the next indexed dot and the next pending one
+Coord DotStore::DiagonalGap(Coord x, Coord y)
+{
+	Coord gap=diagonalindex->Gap(x,y);
+	if(pending)
+	{
+		Coord pendinggap=pending->DiagonalGap(x,y);
+		if(pendinggap && (!gap || pendinggap<gap))
+			gap=pendinggap;
+	}
+	return gap;
+}
+
+// keeps the longest dot it is shown. If offdiagonal is set, dots on the diagonal are ignored
+struct DotStore::LongestDotVisitor
+{
+	bool offdiagonal;
+	Dot *longest;
 
-	if(result->Length()==0)
+	LongestDotVisitor(bool offdiagonal) { this->offdiagonal=offdiagonal; longest=NULL; }
+
+	inline void Visit(Dot *dot)
 	{
-		delete result;
-		return NULL;
+		if(offdiagonal && dot->x==dot->y)
+			return;
+
+		if(dot->length>0 && (!longest || dot->length>longest->length))
+			longest=dot;
 	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
 
-	Dot *dot=result->Pop();
+// the longest dot stored in the rectangle
+Dot *DotStore::LongestDot(Coord x1, Coord y1, Coord x2, Coord y2, bool offdiagonal)
+{
+	LongestDotVisitor visitor(offdiagonal);
+	QueryIndex(x1,y1,x2,y2,visitor);
+	return visitor.longest;
+}
 
-	delete result;
+MatchProfile *DotStore::GetProfile()
+{
+	assert(index);				//we must be indexed
+	RefreshIndex();
 
-	// found it
-	return dot;
+	if(!profile)
+		profile=new MatchProfile(head,numdots+numdeleted,symmetric);
+	return profile;
 }
 
 // use the index to quickly find the longest dot match on a particular row
-Dot *DotStore::GetIndexLongestMatchingRowDot(int y)
+Dot *DotStore::GetIndexLongestMatchingRowDot(Coord y)
 {
 	assert(index);				//we must be indexed
+	RefreshIndex();
+
+	if(profile)
+	{
+		if(!profile->GetRowLength(y))
+			return NULL;
+		mirror.x=profile->GetRowX(y);
+		mirror.y=y;
+		mirror.length=profile->GetRowLength(y);
+		return &mirror;
+	}
 
-	//printf("Doing spatial query on %ld (%d,%d,%d,%d)\n",(long)index,0,y,maxx,y);
-	LinkedListVal<Dot *> *result = index->SpatialQuery(0,y,maxx,y);
-	
 	// find out which dot matched is the longest
-	Dot *longest=NULL;
-	int maxlength=0;
-	int dotlength=0;
-	for( LinkedListVal<Dot *>::Iterator i(*result); !i.Done(); i++)
+	Dot *longest=LongestDot(0,y,maxx,y,false);
+
+	if(symmetric)
 	{
-		dotlength = (*i)->length;
+		// the dots reflected onto this row are stored in column y
+		Dot *reflected=LongestDot(y,0,y,maxy,true);
 
-		if(dotlength>maxlength)
+		if(reflected && (!longest || reflected->length>longest->length))
 		{
-			maxlength=dotlength;
-			longest=(*i);
+			mirror.x=reflected->y;
+			mirror.y=reflected->x;
+			mirror.length=reflected->length;
+			longest=&mirror;
 		}
 	}
 
-	delete result;
 	return longest;
 }
 
 // use the index to quickly find the longest dot match on a particular column
-Dot *DotStore::GetIndexLongestMatchingColumnDot(int x)
+Dot *DotStore::GetIndexLongestMatchingColumnDot(Coord x)
 {
 	assert(index);				//we must be indexed
+	RefreshIndex();
+
+	if(profile)
+	{
+		if(!profile->GetColumnLength(x))
+			return NULL;
+		mirror.x=x;
+		mirror.y=profile->GetColumnY(x);
+		mirror.length=profile->GetColumnLength(x);
+		return &mirror;
+	}
 
-	LinkedListVal<Dot *> *result = index->SpatialQuery(x,0,x,maxy);
-	
 	// find out which dot matched is the longest
-	Dot *longest=NULL;
-	int maxlength=0;
-	int dotlength=0;
-	for( LinkedListVal<Dot *>::Iterator i(*result); !i.Done(); i++)
+	Dot *longest=LongestDot(x,0,x,maxy,false);
+
+	if(symmetric)
 	{
-		dotlength = (*i)->length;
+		// the dots reflected onto this column are stored in row x
+		Dot *reflected=LongestDot(0,x,maxx,x,true);
 
-		if(dotlength>maxlength)
+		if(reflected && (!longest || reflected->length>longest->length))
 		{
-			maxlength=dotlength;
-			longest=(*i);
+			mirror.x=reflected->y;
+			mirror.y=reflected->x;
+			mirror.length=reflected->length;
+			longest=&mirror;
 		}
 	}
 
-	delete result;
 	return longest;
 }
 
-int DotStore::CountAreaMatches(double x1, double y1, double x2, double y2, int window)
+// how many matches a single dot contributes to the area. The dot itself may be a reflection, so nothing here may
+// assume it is stored in the index. Each walk along the dot stops where the next dot on its diagonal starts, which is
+// looked up once rather than probed for at every base. gap starts at -1 and is kept once looked up, so a caller
+// counting the same dot into many areas only looks it up the once
+Coord DotStore::CountDotInArea(const Dot *dot, double x1, double y1, double x2, double y2, double dwindow, Coord &gap)
 {
-	assert(index);				// we must be indexed
-	//printf("%f,%f\n",x2-x1,y2-y1);
-	//assert(x2-x1 == y2-y1);			// we must be square. TODO: add support for rectangular area
-
-	double dwindow=(double)window;
+	Coord count=0;
+
+	if ( dot->x >= x1-dwindow && dot->y >= y1-dwindow && dot->x < x2 && dot->y < y2 )
+	{ 
+		// applicable x and y
+		double x=(double)dot->x+0.5;
+		double y=(double)dot->y+0.5;
+		double length=(double)dot->length;
+		double protrude=length;			//how much protrudes into this calculation square
+		// which zone are we in?
+		// 1. inside the window
+		if( x>=x1 && x<x2 && y>=y1 && y<y2)
+		{
+			//we are inside the window
+			// truncate protrude if we extend outside to the bottom or the right of the window
+			if(x+protrude > x2)
+				protrude=x2-x;
+			if(y+protrude > y2)
+				protrude=y2-y;
+			
 
-	//printf("DotStore::CountAreaMatches(): %d\n",numdots);
-
-	int count=0;
-
-	// do a spatial query on the index and get a list of matching dots. TODO deal with fractions properly by testing the dots to make sure they should *really* be included
-	LinkedListVal<Dot *> *result=index->SpatialQuery((int)floor(x1-dwindow),(int)floor(y1-dwindow),(int)ceil(x2),(int)ceil(y2));
-
-	for(LinkedListVal<Dot *>::Iterator i(*result); !i.Done(); i++)
-	{
-		if ( (*i)->x >= x1-dwindow && (*i)->y >= y1-dwindow && (*i)->x < x2 && (*i)->y < y2 )
-		{ 
-			// applicable x and y
-			double x=(double)(*i)->x+0.5;
-			double y=(double)(*i)->y+0.5;
-			double length=(double)(*i)->length;
-			double protrude=length;			//how much protrudes into this calculation square
-			// which zone are we in?
-			// 1. inside the window
-			if( x>=x1 && x<x2 && y>=y1 && y<y2)
+			//scan down and to the right to see when our next match point comes up or until our length is exhausted. add one for each point
+			if(protrude)
+			{
+				if(gap<0)
+					gap=GetIndexDiagonalGap((Coord)x,(Coord)y);
+				Coord step=0;
+				do
+				{ 
+					count++;
+					protrude-=1.0;
+				} while( ++step!=gap && protrude>=1.0);
+			}
+		}
+		// 2. The parallelogram above the areaand including right on the line
+		else if( x>=(y-y1+x1) && x<(y-y1+x2) )
+		{
+			//we are above the window
+			if(length>y1-y)
 			{
-				//we are inside the window
-				// truncate protrude if we extend outside to the bottom or the right of the window
-				if(x+protrude > x2)
-					protrude=x2-x;
-				if(y+protrude > y2)
-					protrude=y2-y;
+				//we extend into the window
+				protrude=length-(y1-y);
 				
-	
-				//scan down and to the right to see when our next match point comes up or until our length is exhausted. add one for each point
-				if(protrude)
+				
+				// check if we extend out of the window to the right too
+				double sigma=length-(x2-x);
+				if(sigma>0)
+					protrude-=sigma;
+		
+				// TODO: Check if we extend out of the bottom (non square window)
+
+				Coord yp=(Coord)y;
+				if(gap<0)
+					gap=GetIndexDiagonalGap((Coord)x,yp);
+				Coord step=0;
+				do
 				{
-					int xp=(int)x;
-					int yp=(int)y;
-					do
-					{ 
+					if(yp+step>=y1)
+					{
 						count++;
 						protrude-=1.0;
-					} while( (!GetIndexDot(++xp,++yp)) && protrude>=1.0);
-				}
+					}
+				} while(++step!=gap && protrude >=1.0);
 			}
-			// 2. The parallelogram above the areaand including right on the line
-			else if( x>=(y-y1+x1) && x<(y-y1+x2) )
+		}
+		// 3. The parallelogram to the left of the area
+		else if( y>(x-x1+y1) && y<(x-x1+y2) )
+		{
+			//we are to the left of the window
+			if(length>x1-x)
 			{
-				//we are above the window
-				if(length>y1-y)
-				{
-					//we extend into the window
-					protrude=length-(y1-y);
-					
+				protrude=length-(x1-x);
+				
+				// check if we extend out of the window to the bottom too
+				double sigma=length-(y2-y);
+				if(sigma>0)
+					protrude-=sigma;
 					
-					// check if we extend out of the window to the right too
-					double sigma=length-(x2-x);
-					if(sigma>0)
-						protrude-=sigma;
-			
-					// TODO: Check if we extend out of the bottom (non square window)
-	
-					int xp=(int)x;
-					int yp=(int)y;
-					do
+				// TODO: Check if we extend out of the window to the right, too (non square window)
+				
+				Coord xp=(Coord)x;
+				if(gap<0)
+					gap=GetIndexDiagonalGap(xp,(Coord)y);
+				Coord step=0;
+				do
+				{
+					if(xp+step>=x1)
 					{
-						if(yp>=y1)
-						{
-							count++;
-							protrude-=1.0;
-						}
-					} while((!GetIndexDot(++xp,++yp)) && protrude >=1.0);
-				}
+						count++;
+						protrude-=1.0;
+					}
+				} while(++step!=gap && protrude >= 1.0);
 			}
-			// 3. The parallelogram to the left of the area
-			else if( y>(x-x1+y1) && y<(x-x1+y2) )
+		}
+	}
+
+	return count;
+}
+
+// sums up CountDotInArea() over the dots it is shown, or their reflections
+struct DotStore::AreaVisitor
+{
+	DotStore *store;
+	double x1, y1, x2, y2, dwindow;
+	bool reflect;
+	Coord count;
+
+	AreaVisitor(DotStore *store, double x1, double y1, double x2, double y2, double dwindow, bool reflect)
+	{
+		this->store=store;
+		this->x1=x1;
+		this->y1=y1;
+		this->x2=x2;
+		this->y2=y2;
+		this->dwindow=dwindow;
+		this->reflect=reflect;
+		count=0;
+	}
+
+	inline void Visit(Dot *dot)
+	{
+		if(dot->length==DOT_DELETED)
+			return;
+
+		Coord gap=-1;
+		if(!reflect)
+		{
+			count+=store->CountDotInArea(dot,x1,y1,x2,y2,dwindow,gap);
+			return;
+		}
+
+		if(dot->x==dot->y)
+			return;				// the diagonal is its own reflection
+
+		Dot reflected;
+		reflected.x=dot->y;
+		reflected.y=dot->x;
+		reflected.length=dot->length;
+		count+=store->CountDotInArea(&reflected,x1,y1,x2,y2,dwindow,gap);
+	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
+Coord DotStore::CountAreaMatches(double x1, double y1, double x2, double y2, int window)
+{
+	assert(index);				// we must be indexed
+	RefreshIndex();
+	//printf("%f,%f\n",x2-x1,y2-y1);
+	//assert(x2-x1 == y2-y1);			// we must be square. TODO: add support for rectangular area
+
+	double dwindow=(double)window;
+
+	//printf("DotStore::CountAreaMatches(): %d\n",numdots);
+
+	// visit the dots that could reach the area. TODO deal with fractions properly by testing the dots to make sure they should *really* be included
+	AreaVisitor visitor(this,x1,y1,x2,y2,dwindow,false);
+	QueryIndex((Coord)floor(x1-dwindow),(Coord)floor(y1-dwindow),(Coord)ceil(x2),(Coord)ceil(y2),visitor);
+
+	if(symmetric)
+	{
+		// the reflected dots reaching this area are the stored dots reaching its transpose
+		visitor.reflect=true;
+		QueryIndex((Coord)floor(y1-dwindow),(Coord)floor(x1-dwindow),(Coord)ceil(y2),(Coord)ceil(x2),visitor);
+	}
+
+	return visitor.count;
+}
+
+// adds what each dot it is shown contributes to the cells of a band of grid rows, or what their reflections do.
+// mirror is set for the second pass over a symmetric store, which must leave out the diagonal
+struct DotStore::GridVisitor
+{
+	DotStore *store;
+	int *grid;
+	int width, rowbase, rowstep, row1, row2;
+	double x1, y1, scale, dwindow;
+	bool reflect, mirror;
+
+	inline void Visit(Dot *dot)
+	{
+		if(dot->length==DOT_DELETED)
+			return;
+
+		if(!reflect)
+		{
+			store->AddDotToGrid(dot,grid,width,rowbase,rowstep,row1,row2,x1,y1,scale,dwindow,-1);
+			return;
+		}
+
+		if(mirror && dot->x==dot->y)
+			return;				// the diagonal is its own reflection
+
+		// only a symmetric store can find the gap after a reflection, so a transposed dot's is found from the dot
+		Dot reflected;
+		reflected.x=dot->y;
+		reflected.y=dot->x;
+		reflected.length=dot->length;
+		Coord gap=store->symmetric?-1:store->GetIndexDiagonalGap(dot->x,dot->y);
+		store->AddDotToGrid(&reflected,grid,width,rowbase,rowstep,row1,row2,x1,y1,scale,dwindow,gap);
+	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
+// the first and last of cells first to last along an axis whose area a dot at p can count in. A cell's area runs from
+// start+cell*scale to start+(cell+1)*scale, and reaches back dwindow before that. The guess is put right with the very
+// sums CountAreaMatches() would be given
+static inline void GridCells(Coord p, double start, double scale, double dwindow, int first, int last, int &from, int &to)
+{
+	double dp=(double)p;
+	double lo=floor((dp-start)/scale), hi=floor((dp+dwindow-start)/scale);
+	from=lo<(double)first?first:(lo>(double)last?last:(int)lo);
+	to=hi<(double)first?first:(hi>(double)last?last:(int)hi);
+
+	// the first cell that ends after p
+	while(from<=last && !(dp<(from+1)*scale+start))
+		from++;
+	while(from>first && dp<from*scale+start)
+		from--;
+
+	// and the last that reaches back to p
+	while(to>=first && !(dp>=to*scale+start-dwindow))
+		to--;
+	while(to<last && dp>=(to+1)*scale+start-dwindow)
+		to++;
+}
+
+void DotStore::AddDotToGrid(const Dot *dot, int *grid, int width, int rowbase, int rowstep, int row1, int row2, double x1, double y1, double scale, double dwindow, Coord gap)
+{
+	int cx1, cx2, cy1, cy2;
+	GridCells(dot->x,x1,scale,dwindow,0,width-1,cx1,cx2);
+	GridCells(dot->y,y1,scale,dwindow,row1,row2-1,cy1,cy2);
+
+	// each cell is the very area CalculateGrid() used to ask CountAreaMatches() about
+	for(int y=cy1; y<=cy2; y++)
+		for(int x=cx1; x<=cx2; x++)
+		{
+			Coord count=CountDotInArea(dot, x*scale+x1, y*scale+y1, (x+1)*scale+x1, (y+1)*scale+y1, dwindow, gap);
+			if(count)
+				grid[(rowbase+rowstep*y)*width+x]+=(int)count;
+		}
+}
+
+void DotStore::AddGridMatches(int *grid, int width, int height, double x1, double y1, double scale, int window, int firstrow, const GridTransform *transform)
+{
+	assert(index);				// we must be indexed
+	RefreshIndex();				// before the threads share it
+
+	GridTransform none;
+	if(!transform)
+		transform=&none;
+
+	// the cells are worked out where our own dots are, and only moved at the last moment. A flipped grid's band comes
+	// from the rows at the other end, upside down
+	double dwindow=(double)window;
+	double sx1=x1-(double)transform->xoffset, sy1=y1-(double)transform->yoffset;
+	int srcfirst=firstrow, rowbase=-firstrow, rowstep=1;
+	if(transform->flip)
+	{
+		srcfirst=transform->rows-firstrow-height;
+		rowbase=transform->rows-1-firstrow;
+		rowstep=-1;
+	}
+	int numbands=(height+DOTSTORE_GRIDBAND-1)/DOTSTORE_GRIDBAND;
+
+	// every band of rows is a task of its own, with no cells shared with any other
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int band=0; band<numbands; band++)
+	{
+		GridVisitor visitor;
+		visitor.store=this;
+		visitor.grid=grid;
+		visitor.width=width;
+		visitor.rowbase=rowbase;
+		visitor.rowstep=rowstep;
+		visitor.row1=srcfirst+band*DOTSTORE_GRIDBAND;
+		visitor.row2=band*DOTSTORE_GRIDBAND+DOTSTORE_GRIDBAND<height?visitor.row1+DOTSTORE_GRIDBAND:srcfirst+height;
+		visitor.x1=sx1;
+		visitor.y1=sy1;
+		visitor.scale=scale;
+		visitor.dwindow=dwindow;
+		visitor.reflect=transform->transpose;
+		visitor.mirror=false;
+
+		// the area of the band, stretched just as CountAreaMatches() stretches the area of each cell
+		double ax1=sx1, ay1=visitor.row1*scale+sy1, ax2=width*scale+sx1, ay2=visitor.row2*scale+sy1;
+		Coord qx1=(Coord)floor(ax1-dwindow), qy1=(Coord)floor(ay1-dwindow), qx2=(Coord)ceil(ax2), qy2=(Coord)ceil(ay2);
+
+		// transposed dots reaching the band are the stored dots reaching its transpose
+		if(transform->transpose)
+			QueryIndex(qy1,qx1,qy2,qx2,visitor);
+		else
+			QueryIndex(qx1,qy1,qx2,qy2,visitor);
+
+		// and the reflections of a symmetric store are the other way round
+		if(symmetric)
+		{
+			visitor.reflect=!transform->transpose;
+			visitor.mirror=true;
+			if(transform->transpose)
+				QueryIndex(qx1,qy1,qx2,qy2,visitor);
+			else
+				QueryIndex(qy1,qx1,qy2,qx2,visitor);
+		}
+	}
+}
+
+SegmentIndex *DotStore::GetSegmentIndex()
+{
+	assert(index);				//we must be indexed
+	RefreshIndex();
+
+	if(!segmentindex)
+	{
+		// it is made over all our dots, so the pending ones have to be in the index first
+		if(pending)
+			CreateIndex();
+		segmentindex=new SegmentIndex(index);
+	}
+
+	// and any added after that get one of their own
+	if(pending)
+		pending->GetSegmentIndex();
+	return segmentindex;
+}
+
+// adds up the bases of the segments it is shown up to the next dot on their diagonal, or of their reflections
+struct DotStore::AreaBaseVisitor
+{
+	DotStore *store;
+	bool reflect;
+	Coord bases;
+
+	AreaBaseVisitor(DotStore *store, bool reflect) { this->store=store; this->reflect=reflect; bases=0; }
+
+	inline void Visit(Dot *dot, Coord first, Coord last)
+	{
+		if(reflect && dot->x==dot->y)
+			return;				// the diagonal is its own reflection
+
+		// a reflection is just as far from the next dot on its diagonal as the dot is
+		Coord gap=store->GetIndexDiagonalGap(dot->x,dot->y);
+		if(gap && last>=gap)
+			last=gap-1;
+		if(first<=last)
+			bases+=last-first+1;
+	}
+};
+
+Coord DotStore::CountSegmentBases(Coord x1, Coord y1, Coord x2, Coord y2)
+{
+	GetSegmentIndex();
+
+	AreaBaseVisitor visitor(this,false);
+	QuerySegments(x1,y1,x2,y2,visitor);
+
+	if(symmetric)
+	{
+		// the reflected matches crossing this area are the stored matches crossing its transpose
+		visitor.reflect=true;
+		QuerySegments(y1,x1,y2,x2,visitor);
+	}
+
+	return visitor.bases;
+}
+
+Coord DotStore::CountAreaBases(Coord x1, Coord y1, Coord x2, Coord y2)
+{
+	if(!areatable || x1>x2 || y1>y2)
+		return CountSegmentBases(x1,y1,x2,y2);
+
+	// the whole cells inside the rectangle
+	Coord size=areatable->GetCellSize();
+	Coord cx1=x1>0?(x1+size-1)/size:0, cy1=y1>0?(y1+size-1)/size:0;
+	Coord cx2=(x2+1)/size-1, cy2=(y2+1)/size-1;
+	if(cx2>=areatable->GetWidth())
+		cx2=areatable->GetWidth()-1;
+	if(cy2>=areatable->GetHeight())
+		cy2=areatable->GetHeight()-1;
+	if(cx1>cx2 || cy1>cy2)
+		return CountSegmentBases(x1,y1,x2,y2);
+
+	// they are looked up, and the strips above, below, left and right of them counted from the index
+	Coord ix1=cx1*size, iy1=cy1*size, ix2=(cx2+1)*size-1, iy2=(cy2+1)*size-1;
+	Coord bases=(Coord)areatable->Sum((int)cx1,(int)cy1,(int)cx2,(int)cy2);
+	if(y1<iy1)
+		bases+=CountSegmentBases(x1,y1,x2,iy1-1);
+	if(y2>iy2)
+		bases+=CountSegmentBases(x1,iy2+1,x2,y2);
+	if(x1<ix1)
+		bases+=CountSegmentBases(x1,iy1,ix1-1,iy2);
+	if(x2>ix2)
+		bases+=CountSegmentBases(ix2+1,iy1,x2,iy2);
+	return bases;
+}
+
+void DotStore::AddToAreaTable(Coord x, Coord y, Coord length)
+{
+	Coord size=areatable->GetCellSize();
+	int width=areatable->GetWidth(), height=areatable->GetHeight();
+
+	// a cell at a time from where it comes onto the plot, stepping on at whichever edge of a cell it reaches first
+	Coord t=0;
+	if(-x>t) t=-x;
+	if(-y>t) t=-y;
+	while(t<length)
+	{
+		Coord cx=(x+t)/size, cy=(y+t)/size;
+		if(cx>=width || cy>=height)
+			break;
+
+		Coord step=(cx+1)*size-(x+t);
+		if((cy+1)*size-(y+t)<step)
+			step=(cy+1)*size-(y+t);
+		if(length-t<step)
+			step=length-t;
+		areatable->Add((int)cx,(int)cy,step);
+		t+=step;
+	}
+}
+
+// adds each match up to the next dot on its diagonal as CountAreaBases() follows it, and its reflection
+struct DotStore::AreaTableVisitor
+{
+	DotStore *store;
+
+	AreaTableVisitor(DotStore *store) { this->store=store; }
+
+	inline void Visit(Dot *dot)
+	{
+		if(dot->length<=0)
+			return;
+
+		Coord length=dot->length, gap=store->GetIndexDiagonalGap(dot->x,dot->y);
+		if(gap && length>gap)
+			length=gap;
+		store->AddToAreaTable(dot->x,dot->y,length);
+		if(store->symmetric && dot->x!=dot->y)
+			store->AddToAreaTable(dot->y,dot->x,length);
+	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
+void DotStore::CreateAreaTable(Coord cellsize)
+{
+	assert(cellsize>0);
+	GetSegmentIndex();			// for the gaps, and to fold any pending dots into the index
+
+	delete areatable;
+	areatable=NULL;
+
+	// how far the matches reach, as MatchProfile measures it
+	Coord width=0, height=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->x<0 || dot->y<0 || dot->length<=0)
+				continue;
+
+			Coord xend=dot->x+dot->length, yend=dot->y+dot->length;
+			if(symmetric)
 			{
-				//we are to the left of the window
-				if(length>x1-x)
-				{
-					protrude=length-(x1-x);
-					
-					// check if we extend out of the window to the bottom too
-					double sigma=length-(y2-y);
-					if(sigma>0)
-						protrude-=sigma;
-						
-					// TODO: Check if we extend out of the window to the right, too (non square window)
-					
-					int xp=(int)x;
-					int yp=(int)y;
-					do
-					{
-						if(xp>=x1)
-						{
-							count++;
-							protrude-=1.0;
-						}
-					} while((!GetIndexDot(++xp,++yp)) && protrude >= 1.0);
-				}
+				if(yend>xend)
+					xend=yend;
+				yend=xend;
+			}
+			if(xend>width)
+				width=xend;
+			if(yend>height)
+				height=yend;
+		}
+
+	areatable=new AreaTable(cellsize,(int)((width+cellsize-1)/cellsize),(int)((height+cellsize-1)/cellsize));
+
+	// then every match the index has, as CountAreaBases() finds them
+	AreaTableVisitor visitor(this);
+	VisitIndexed(visitor);
+
+	areatable->Integrate();
+}
+
+// walks the part of each segment it is shown that is inside a band of grid rows from cell to cell, adding the length
+// in each. Reflections are walked instead if reflect is set, and mirror leaves out the diagonal as AreaBaseVisitor does.
+// Row cy is stored in grid row rowbase+rowstep*cy
+struct DotStore::CoverageVisitor
+{
+	DotStore *store;
+	float *grid;
+	int width, rowbase, rowstep, row1, row2;
+	double x1, y1, x2, y2, scale;		// the band, not the whole grid
+	bool reflect, mirror;
+
+	inline void Visit(Dot *dot, Coord first, Coord last)
+	{
+		if(mirror && dot->x==dot->y)
+			return;				// the diagonal is its own reflection
+
+		Coord gap=store->GetIndexDiagonalGap(dot->x,dot->y);
+		if(gap && last>=gap)
+			last=gap-1;
+
+		double dx=(double)(reflect?dot->y:dot->x), dy=(double)(reflect?dot->x:dot->y);
+
+		// the stretch of the diagonal from dx+t,dy+t that is in the band
+		double t=(double)first, end=(double)(last+1);
+		if(x1-dx>t) t=x1-dx;
+		if(y1-dy>t) t=y1-dy;
+		if(x2-dx<end) end=x2-dx;
+		if(y2-dy<end) end=y2-dy;
+		if(t>=end)
+			return;
+
+		int cx=(int)floor((dx+t-x1)/scale), cy=row1+(int)floor((dy+t-y1)/scale);
+		if(cx<0) cx=0;
+		if(cx>=width) cx=width-1;
+		if(cy<row1) cy=row1;
+		if(cy>=row2) cy=row2-1;
+
+		// add what is in each cell and step on to whichever edge of it comes first
+		for(;;)
+		{
+			double xedge=x1+(cx+1)*scale-dx, yedge=y1+(cy+1-row1)*scale-dy;
+			double next=xedge<yedge?xedge:yedge;
+			if(next>end)
+				next=end;
+			if(next>t)
+			{
+				grid[(rowbase+rowstep*cy)*width+cx]+=(float)(next-t);
+				t=next;
+			}
+			if(next>=end)
+				break;
+
+			bool moved=false;
+			if(xedge<=next && cx<width-1)
+			{
+				cx++;
+				moved=true;
+			}
+			if(yedge<=next && cy<row2-1)
+			{
+				cy++;
+				moved=true;
+			}
+
+			// past the last cell by no more than rounding
+			if(!moved)
+			{
+				grid[(rowbase+rowstep*cy)*width+cx]+=(float)(end-t);
+				break;
 			}
 		}
 	}
+};
 
-	delete result;
+void DotStore::AddGridCoverage(float *grid, int width, int height, double x1, double y1, double x2, double y2, double scale, const GridTransform *transform)
+{
+	GetSegmentIndex();			// made now, rather than by the first thread to want it
 
-	return count;
+	GridTransform none;
+	if(!transform)
+		transform=&none;
+
+	// as in AddGridMatches(), the bands are walked where our own matches are
+	double sx1=x1-(double)transform->xoffset, sy1=y1-(double)transform->yoffset;
+	double sx2=x2-(double)transform->xoffset, sy2=y2-(double)transform->yoffset;
+	int rowbase=0, rowstep=1;
+	if(transform->flip)
+	{
+		rowbase=transform->rows-1;
+		rowstep=-1;
+	}
+	int numbands=(height+DOTSTORE_GRIDBAND-1)/DOTSTORE_GRIDBAND;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for(int band=0; band<numbands; band++)
+	{
+		CoverageVisitor visitor;
+		visitor.store=this;
+		visitor.grid=grid;
+		visitor.width=width;
+		visitor.rowbase=rowbase;
+		visitor.rowstep=rowstep;
+		visitor.row1=band*DOTSTORE_GRIDBAND;
+		visitor.row2=visitor.row1+DOTSTORE_GRIDBAND<height?visitor.row1+DOTSTORE_GRIDBAND:height;
+		visitor.scale=scale;
+		visitor.x1=sx1;
+		visitor.x2=sx2;
+		visitor.y1=visitor.row1*scale+sy1;
+		visitor.y2=visitor.row2*scale+sy1;
+		if(visitor.y2>sy2)
+			visitor.y2=sy2;
+		visitor.reflect=transform->transpose;
+		visitor.mirror=false;
+
+		// the whole bases the band touches
+		Coord bx1=(Coord)floor(sx1), bx2=(Coord)ceil(sx2)-1, by1=(Coord)floor(visitor.y1), by2=(Coord)ceil(visitor.y2)-1;
+		if(bx1>bx2 || by1>by2)
+			continue;
+
+		if(transform->transpose)
+			QuerySegments(by1,bx1,by2,bx2,visitor);
+		else
+			QuerySegments(bx1,by1,bx2,by2,visitor);
+
+		if(symmetric)
+		{
+			visitor.reflect=!transform->transpose;
+			visitor.mirror=true;
+			if(transform->transpose)
+				QuerySegments(bx1,by1,bx2,by2,visitor);
+			else
+				QuerySegments(by1,bx1,by2,bx2,visitor);
+		}
+	}
 }
 
-int *DotStore::ToBuffer()
+Coord *DotStore::ToBuffer()
 {
-	// buffer returned is a pointer to an array of ints
-	// the first two ints are the maxx and maxy records
-	// the next int is the number of records (n)
-	// it is followed by n*3 ints of the actual record data
+	// buffer returned is a pointer to an array of Coords (ints unless we are built with 64 bit coordinates)
+	// the first two values are the maxx and maxy records
+	// the next value is the number of records (n)
+	// it is followed by n*3 values of the actual record data
 	
 	// allocate the buffer
-	int buffsize=GetNum()*3+3;
-	int *buffer=new int[buffsize];
-	memset(buffer, 0, sizeof(int)*buffsize);
+	Coord buffsize=GetNum()*3+3;
+	Coord *buffer=new Coord[buffsize];
+	memset(buffer, 0, sizeof(Coord)*buffsize);
 
-	int *buffp=buffer;
+	Coord *buffp=buffer;
 
 	// the maxx and maxy
 	*buffp++=maxx;
@@ -446,7 +1650,7 @@ int *DotStore::ToBuffer()
 
 	// now all the records
 	Dot *dot;
-	for(int i=0; i<GetNum(); i++)
+	for(Coord i=0; i<GetNum(); i++)
 	{
 		dot=GetDot(i);
 		*buffp++=dot->x;
@@ -460,45 +1664,213 @@ int *DotStore::ToBuffer()
 	return buffer;
 }
 
-void DotStore::FromBuffer(int *buffer)
+void DotStore::FromBuffer(Coord *buffer)
 {
 	// empty our dots
 	Empty();
 
-	int *buffp=buffer;
+	Coord *buffp=buffer;
 	
 	// maxx and maxy
 	maxx=*buffp++;
 	maxy=*buffp++;
 
 	//number of records
-	int num=*buffp++;
+	Coord num=*buffp++;
 
-	// read each record
-	for(int i=0; i<num; i++)
-	{
-		AddDot(buffp[0], buffp[1], buffp[2]);
-		buffp+=3;
-	}
+	// read the records. each one is laid out just like a Dot
+	AddDots((Dot *)buffp, num);
 
 	// we should have the same number of records we expected
 	assert(GetNum() == num);
 }
 
-int DotStore::BufferSize(int *buffer)
+Coord DotStore::BufferSize(Coord *buffer)
 {
 	return buffer[2]*3+3;
 }
 
-DotStore *DotStore::Filter(int minlength)
+static bool WriteAll(int fd, const void *buffer, size_t length)
+{
+	const char *p=(const char *)buffer;
+	while(length)
+	{
+		ssize_t written=write(fd, p, length);
+		if(written<=0)
+			return false;
+		p+=written;
+		length-=written;
+	}
+	return true;
+}
+
+bool DotStore::WriteMapFile(const char *path)
+{
+	assert(DOTSTORE_HISTOGRAMBINS<=64);
+
+	int fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if(fd==-1)
+	{
+		printf("DotStore: could not create %s\n",path);
+		return false;
+	}
+
+	char page[DOTSTORE_MAPHEADERSIZE];
+	memset(page, 0, DOTSTORE_MAPHEADERSIZE);
+	DotStoreMapHeader *header=(DotStoreMapHeader *)page;
+
+	memcpy(header->magic, "FDM1", 4);
+	header->byteorder=DOTSTORE_MAPBYTEORDER;
+	header->coordsize=sizeof(Coord);
+	header->symmetric=symmetric;
+	header->maxx=maxx;
+	header->maxy=maxy;
+	header->numdots=numdots;
+	header->numdiagonal=numdiagonal;
+	header->totalbases=totalbases;
+	header->diagonalbases=diagonalbases;
+	header->minlength=GetMinLength();
+	header->maxlength=GetMaxLength();
+	for(unsigned int bin=0; bin<DOTSTORE_HISTOGRAMBINS; bin++)
+	{
+		header->lengthhistogram[bin]=lengthhistogram[bin];
+		header->diagonalhistogram[bin]=diagonalhistogram[bin];
+	}
+
+	// then the dots, chunk after chunk
+	bool ok=WriteAll(fd, page, DOTSTORE_MAPHEADERSIZE);
+	Dot *live=NULL;
+	for(DotStorageChunk *chunk=head; ok && chunk; chunk=chunk->GetNext())
+	{
+		if(!chunk->GetNumDeleted())
+		{
+			if(chunk->GetNum())
+				ok=WriteAll(fd, chunk->GetDot(0), chunk->GetNum()*sizeof(Dot));
+			continue;
+		}
+
+		// a chunk with deleted dots in it has its live ones gathered up, leaving it, and the index, as they are
+		if(!live)
+			live=new Dot[DOTSTORAGECHUNKSIZE];
+		int num=0;
+		for(int i=0; i<chunk->GetNum(); i++)
+			if(chunk->GetDot(i)->length!=DOT_DELETED)
+				live[num++]=*chunk->GetDot(i);
+		if(num)
+			ok=WriteAll(fd, live, num*sizeof(Dot));
+	}
+	delete [] live;
+
+	if(close(fd)!=0)
+		ok=false;
+
+	if(!ok)
+		printf("DotStore: failed writing %s\n",path);
+	return ok;
+}
+
+bool DotStore::MapFile(const char *path)
+{
+	int fd=open(path, O_RDONLY);
+	if(fd==-1)
+	{
+		printf("DotStore: could not open %s\n",path);
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info)!=0 || info.st_size<DOTSTORE_MAPHEADERSIZE)
+	{
+		printf("DotStore: %s is not a dot file\n",path);
+		close(fd);
+		return false;
+	}
+
+	// private and writable, so changes to dots are copy on write and stay ours
+	size_t length=info.st_size;
+	void *map=mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map==MAP_FAILED)
+	{
+		printf("DotStore: could not map %s\n",path);
+		return false;
+	}
+
+	const DotStoreMapHeader *header=(const DotStoreMapHeader *)map;
+	const char *problem=NULL;
+	if(memcmp(header->magic, "FDM1", 4))
+		problem="is not a dot file";
+	else if(header->byteorder!=DOTSTORE_MAPBYTEORDER || header->coordsize!=sizeof(Coord))
+		problem="was written by a different machine or coordinate size";
+	else if(header->numdots<0 || (long long)length<DOTSTORE_MAPHEADERSIZE+header->numdots*(long long)sizeof(Dot))
+		problem="is truncated";
+
+	if(problem)
+	{
+		printf("DotStore: %s %s\n",path,problem);
+		munmap(map, length);
+		return false;
+	}
+
+	Empty();
+	filemapping=map;
+	filemappinglength=length;
+
+	// the full chunks borrow their dots where they are. a partly filled last chunk would have its next dots added
+	// past the end of the file, so that one gets copied onto the heap
+	Dot *dots=(Dot *)((char *)map+DOTSTORE_MAPHEADERSIZE);
+	Coord full=header->numdots/DOTSTORAGECHUNKSIZE;
+	for(Coord i=0; i<full; i++)
+	{
+		DotStorageChunk *chunk=new DotStorageChunk(dots+i*DOTSTORAGECHUNKSIZE, DOTSTORAGECHUNKSIZE);
+		if(!head)
+			head=tail=chunk;
+		else
+		{
+			tail->LinkAfter(chunk);
+			tail=chunk;
+		}
+		numchunks++;
+		borrowedchunks++;
+	}
+
+	Coord rest=header->numdots-full*DOTSTORAGECHUNKSIZE;
+	if(rest)
+	{
+		AddDotStorageChunk();
+		tail->AddDots(dots+full*DOTSTORAGECHUNKSIZE, rest, 0, 0);
+	}
+
+	symmetric=header->symmetric!=0;
+	maxx=header->maxx;
+	maxy=header->maxy;
+	numdots=header->numdots;
+	numdiagonal=header->numdiagonal;
+
+	totalbases=header->totalbases;
+	diagonalbases=header->diagonalbases;
+	minlength=header->minlength;
+	maxlength=header->maxlength;
+	lengthrangestale=false;
+	for(unsigned int bin=0; bin<DOTSTORE_HISTOGRAMBINS; bin++)
+	{
+		lengthhistogram[bin]=header->lengthhistogram[bin];
+		diagonalhistogram[bin]=header->diagonalhistogram[bin];
+	}
+
+	return true;
+}
+
+DotStore *DotStore::Filter(Coord minlength)
 {
 	DotStore *filteredstore=new DotStore();
 	filteredstore->maxx=maxx;
 	filteredstore->maxy=maxy;
+	filteredstore->symmetric=symmetric;
 
 	// loop through every dot and if they are less that the minlength then ignore them, else add them to the new dotstore
 	Dot *dot=NULL;
-	for(int i=0; i<GetNum(); i++)
+	for(Coord i=0; i<GetNum(); i++)
 	{
 		dot=GetDot(i);
 		if(dot->length >= minlength)
@@ -508,47 +1880,246 @@ DotStore *DotStore::Filter(int minlength)
 	return filteredstore;
 }
 
+void DotStore::FilterInPlace(Coord minlength)
+{
+	Coord dropped=0;
+
+	// under an index the short dots are marked deleted where they are, as DelDot() does
+	if(index && !indexstale)
+	{
+		for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+			for(int i=0; i<chunk->GetNum(); i++)
+			{
+				Dot *dot=chunk->GetDot(i);
+				if(dot->length==DOT_DELETED || dot->length>=minlength)
+					continue;
+
+				UncountDot(dot->x,dot->y,dot->length);
+				if(dot->x==dot->y)
+					numdiagonal--;
+				MarkDeleted(chunk,i);
+				dropped++;
+			}
+
+		// and the copies of any added since go from pending the same way
+		if(pending)
+		{
+			pending->FilterInPlace(minlength);
+			pendingstale=true;
+		}
+
+		numdots-=dropped;
+		if(dropped)
+			DeletedUnderIndex();
+		return;
+	}
+
+	Compact();
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+	{
+		// count the dots out before they go
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->length<minlength)
+			{
+				UncountDot(dot->x,dot->y,dot->length);
+				if(dot->x==dot->y)
+					numdiagonal--;
+			}
+		}
+
+		// the space left at the end of each chunk is filled by later AddDot()s
+		dropped+=chunk->Filter(minlength);
+	}
+	roomfrom=NULL;
+	numdots-=dropped;
+
+	if(dropped && index)
+		InvalidateIndex();
+}
+
+void DotStore::Append(DotStore *other, Coord dx, Coord dy)
+{
+	assert(other);
+
+	// we can only stay symmetric if what we add is symmetric about the same diagonal
+	if(symmetric && !(other->symmetric && dx==dy))
+		Unfold();
+
+	// if other is still symmetric and we aren't, its reflections have to be added as real dots
+	bool reflect=other->symmetric && !symmetric;
+
+	// other may be us, so only take the dots that are there now
+	Coord remaining=other->numdots;
+	Coord othermaxx=other->maxx, othermaxy=other->maxy;
+
+	for(DotStorageChunk *chunk=other->head; chunk && remaining; chunk=chunk->GetNext())
+	{
+		// dots deleted from under other's index are left out one by one, so as not to disturb it
+		if(chunk->GetNumDeleted())
+		{
+			for(int i=0; i<chunk->GetNum() && remaining; i++)
+			{
+				Dot dot=*chunk->GetDot(i);
+				if(dot.length==DOT_DELETED)
+					continue;
+				AppendDot(dot.x+dx,dot.y+dy,dot.length);
+				remaining--;
+			}
+			continue;
+		}
+
+		int num=chunk->GetNum()<remaining?chunk->GetNum():(int)remaining;
+
+		// count them in where they are going to land
+		Dot *dot;
+		for(int i=0; i<num; i++)
+		{
+			dot=chunk->GetDot(i);
+			CountDot(dot->x+dx,dot->y+dy,dot->length);
+			numdots++;
+			if(dot->x-dot->y==dy-dx)
+				numdiagonal++;
+			IndexDot(dot->x+dx,dot->y+dy,dot->length);
+		}
+
+		for(int done=0; done<num; )
+		{
+			if(!tail || tail->IsFull())
+				AddDotStorageChunk();
+			done+=tail->AddDots(chunk->GetDot(done), num-done, dx, dy);
+		}
+
+		remaining-=num;
+	}
+
+	if(reflect)
+	{
+		Dot dot;
+		for(Coord i=0; i<other->numdots; i++)
+		{
+			dot=*other->GetDot(i);
+			if(dot.x!=dot.y)
+				AppendDot(dot.y+dx,dot.x+dy,dot.length);
+		}
+	}
+
+	// our extents grow to cover the other store where it now sits
+	if(othermaxx+dx>maxx)
+		maxx=othermaxx+dx;
+	if(othermaxy+dy>maxy)
+		maxy=othermaxy+dy;
+	if(symmetric)
+		maxy=maxx;
+}
+
+void DotStore::Offset(Coord dx, Coord dy)
+{
+	if(index)
+		DestroyIndex();
+	Compact();
+
+	if(symmetric && dx!=dy)
+		Unfold();
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		chunk->Offset(dx,dy);
+
+	maxx+=dx;
+	maxy+=dy;
+
+	if(dx!=dy)
+		RecountDiagonal();
+}
+
+void DotStore::FlipX(Coord xlength)
+{
+	if(index)
+		DestroyIndex();
+	Compact();
+
+	if(symmetric)
+		Unfold();
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		chunk->FlipX(xlength);
+
+	RecountDiagonal();
+}
+
+void DotStore::FlipY(Coord ylength)
+{
+	if(index)
+		DestroyIndex();
+	Compact();
+
+	if(symmetric)
+		Unfold();
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		chunk->FlipY(ylength);
+
+	RecountDiagonal();
+}
+
+void DotStore::Transpose()
+{
+	// a symmetric store is its own transpose
+	if(symmetric)
+		return;
+
+	if(index)
+		DestroyIndex();
+	Compact();
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		chunk->Transpose();
+
+	Coord t=maxx;
+	maxx=maxy;
+	maxy=t;
+}
+
 // Any matches that are greater than length window are processed
 // added to the dot store are a bunch of sub matches to step across the window
 void DotStore::Interpolate(int window)
 {
-	DotStore *extradots=new DotStore();
-
-	Dot *dot=NULL;
-
 	//printf("PREInterpolate\n");
 	//Dump();
 
-	for(int i=0; i<GetNum(); i++)
+	// the extra dots go on our end, so only walk the dots that were here to start with
+	Compact();
+	Coord remaining=numdots;
+	for(DotStorageChunk *chunk=head; chunk && remaining; chunk=chunk->GetNext())
 	{
-		dot=GetDot(i);
+		int num=chunk->GetNum()<remaining?chunk->GetNum():(int)remaining;
 
-		if(dot->length > window)
+		for(int i=0; i<num; i++)
 		{
-			// break it down, now!
-			int remainder=dot->length-window;
-			int xpos=dot->x+window;
-			int ypos=dot->y+window;
+			// take a copy. appending can spill this chunk out from under a pointer
+			Dot dot=*chunk->GetDot(i);
 
-			while(remainder>0)
+			if(dot.length > window)
 			{
-				extradots->AddDot(xpos,ypos,remainder);
-				xpos+=window;
-				ypos+=window;
-				remainder-=window;
+				// break it down, now!
+				Coord remainder=dot.length-window;
+				Coord xpos=dot.x+window;
+				Coord ypos=dot.y+window;
+
+				while(remainder>0)
+				{
+					AppendDot(xpos,ypos,remainder);
+					xpos+=window;
+					ypos+=window;
+					remainder-=window;
+				}
 			}
 		}
-	}
 
-	// now add all these extra dots into our store
-	for(int i=0; i<extradots->GetNum(); i++)
-	{
-		dot=extradots->GetDot(i);
-		AddDot(dot->x,dot->y,dot->length);
+		remaining-=num;
 	}
 
-	delete extradots;
-
 	//printf("POSTInterpolate\n");
 	//Dump();
 }
@@ -3,7 +3,54 @@
 
 #include "Dot.h"
 #include "DotStorageChunk.h"
-#include "QuadTree.h"
+#include "MortonIndex.h"
+#include "DiagonalIndex.h"
+#include "MatchProfile.h"
+#include "SegmentIndex.h"
+#include "AreaTable.h"
+
+// how many bins the match length histogram has. bin n holds the lengths from 2^n up to 2^(n+1)-1 (bin 0 holds 1 and below)
+#define DOTSTORE_HISTOGRAMBINS	(sizeof(Coord)*8)
+
+// the header of a dot file written by WriteMapFile(). It is padded out to a whole page so the dots after it are page aligned
+#define DOTSTORE_MAPHEADERSIZE	4096
+#define DOTSTORE_MAPBYTEORDER	0x01020304
+
+// the dots added to an indexed store are indexed on their own until there are more than this many, and more than our
+// dots over DOTSTORE_PENDINGFRACTION. Then the whole index is made again
+#define DOTSTORE_MINPENDING	8192
+#define DOTSTORE_PENDINGFRACTION	16
+
+// dots deleted from an indexed store are left in place, marked deleted, until there are more than DOTSTORE_MINPENDING
+// of them and more than our dots over DOTSTORE_DELETEDFRACTION. Then they are compacted away and the index made again
+#define DOTSTORE_DELETEDFRACTION	8
+
+// how many rows of a grid AddGridMatches() fills from each index query
+#define DOTSTORE_GRIDBAND	16
+
+struct DotStoreMapHeader
+{
+	char magic[4];				// "FDM1"
+	unsigned int byteorder;			// DOTSTORE_MAPBYTEORDER, as the writing machine saw it
+	unsigned int coordsize;			// sizeof(Coord) of the writing library
+	unsigned int symmetric;
+	long long maxx, maxy, numdots, numdiagonal;
+
+	// the statistics of the dots, so they don't need counting again
+	long long totalbases, diagonalbases, minlength, maxlength;
+	long long lengthhistogram[64], diagonalhistogram[64];
+};
+
+// where the dots of a store go on a grid made from several stores. See AddGridMatches() and DotGrid::CalculateGrid()
+struct GridTransform
+{
+	bool transpose;				// swap each dot's x and y
+	Coord xoffset, yoffset;			// then move it this far
+	bool flip;				// and turn the grid upside down, as DotGrid::FlipInplace() would
+	int rows;				// the rows of the whole grid, for flip
+
+	GridTransform() { transpose=false; xoffset=yoffset=0; flip=false; rows=0; }
+};
 
 // Our dot storage class
 class DotStore
@@ -11,91 +58,286 @@ class DotStore
 private:
 	DotStorageChunk *head, *tail;
 	int numchunks;
-	int numdots;
+	Coord numdots;
+
+	Coord maxx, maxy;
 
-	int maxx, maxy;
+	// self comparisons are symmetric about the diagonal, so we only keep the dots with x>=y and
+	// reflect them across the diagonal on the fly when they are queried
+	bool symmetric;
+	Coord numdiagonal;			// how many of our dots sit on the diagonal (and so have no mirror)
+	Dot mirror;				// scratch space for returning a reflected dot
 	
 	void AddDotStorageChunk();
 	void CollapseDotStorageChunks();
 
+	// add a dot straight onto the tail, without searching for space in earlier chunks
+	void AppendDot(Coord x, Coord y, Coord len);
+
+	// count the dots on the diagonal again after a transform has moved them
+	void RecountDiagonal();
+
+	// running statistics of the match lengths, kept up to date as dots come and go. They are kept for all our stored
+	// dots and again for just the ones on the diagonal, so a symmetric store can count its reflections too. The counts
+	// and sums can cover more than Coord can hold, even when the individual coordinates and lengths fit, so they are
+	// 64 bit in every build
+	long long lengthhistogram[DOTSTORE_HISTOGRAMBINS];
+	long long diagonalhistogram[DOTSTORE_HISTOGRAMBINS];
+	long long totalbases, diagonalbases;
+	Coord minlength, maxlength;
+	bool lengthrangestale;			// a dot with the min or max length was removed. rescan when next asked
+
+	void ResetStatistics();
+	void CountDot(Coord x, Coord y, Coord length);
+	void UncountDot(Coord x, Coord y, Coord length);
+	void RescanLengthRange();
+
+	// spilling sealed chunks to disk once we go over our memory budget
+	long long memorylimit;			// in bytes. 0 means no limit (never spill)
+	char *spooldir;				// where we make our spool file. NULL means $TMPDIR or /tmp
+	int spoolfd;				// the (already unlinked) spool file. -1 if not open yet
+	off_t spooloffset;			// the end of the spool file. A slab's stretch of it, or a heap chunk, goes here
+	int residentchunks;			// how many chunks are still in ram
+	DotStorageChunk *spillfrom;		// no chunk before this one is left in ram to spill. NULL for the head
+	DotStorageChunk *roomfrom;		// no chunk before this one has room for another dot. NULL for the head
+
+	// where our chunks' storage comes from. See DotStorageChunk.h
+	DotStorageSlab *slabs;			// newest first. Only the newest has room left
+	DotStorageChunk *NewChunk();
+
+	bool OpenSpool();
+	void CloseSpool();
+	void SpillChunks();
+
+	// a dot file we have mapped in with MapFile(). our first chunks borrow their dots straight out of it
+	void *filemapping;
+	size_t filemappinglength;
+	int borrowedchunks;
+
+	// the memory limit given to each new DotStore
+	static long long defaultmemorylimit;
+	static char *defaultspooldir;
+
 public:
 	DotStore();
+
+	//! \brief which bin of the length histogram a match length goes in
+	inline static int LengthBin(Coord length)
+	{
+		return length>1?(int)(sizeof(unsigned long long)*8-1-__builtin_clzll((unsigned long long)length)):0;
+	}
+
 	~DotStore();
 	
-	void AddDot(int x, int y, int len);
-	Dot *GetDot(int index);
-	void DelDot(int index);
+	void AddDot(Coord x, Coord y, Coord len);
+	Dot *GetDot(Coord index);
+
+	//! \brief add a whole array of dots onto our end
+	void AddDots(const Dot *dots, Coord count);
+
+	//! \brief delete a dot. The dots after it move down one index
+	//! \details in an indexed store it stays where it is in the chunks, marked deleted, so the index is kept rather
+	//! than made again. See Sorted Indexing Functions below
+	void DelDot(Coord index);
 	
 	//! \brief empty the entire store of all its dots
 	void Empty();
 
+	//! \brief mark the store as holding a self comparison
+	//! \details a symmetric store only keeps the dots on or above the diagonal (x>=y). Dots added below the diagonal
+	//! are reflected onto it. The index queries, area counts and dumps all see the reflected dots as well. The store
+	//! must be empty to be made symmetric. Setting it back to false unfolds the mirrors into real dots.
+	void SetSymmetric(bool sym);
+
+	inline bool IsSymmetric() const
+	{
+		return symmetric;
+	}
+
+	//! \brief turn a symmetric store into an ordinary one by adding the mirror of every off diagonal dot
+	void Unfold();
+
+	//! \brief limit the ram used for dot storage
+	//! \details once more than bytes worth of chunks are in ram, the full chunks are written out to a temporary
+	//! file in tmpdir and mapped back in from there. Pass 0 for no limit.
+	void SetMemoryLimit(long long bytes, const char *tmpdir=NULL);
+
+	inline long long GetMemoryLimit() const
+	{
+		return memorylimit;
+	}
+
+	//! \brief set the memory limit that every DotStore constructed from now on will start with
+	static void SetDefaultMemoryLimit(long long bytes, const char *tmpdir=NULL);
+
+	//! \brief how many of our chunks have been spilled to disk
+	inline int GetNumSpilledChunks() const
+	{
+		return numchunks-residentchunks-borrowedchunks;
+	}
+
+	//! \brief write our dots out as a dot file that MapFile() can load without parsing
+	//! \details the file is in native byte order and coordinate size, so it is a cache for this machine and
+	//! this build of the library, not something to pass around. Saved plots should use DotFile.
+	bool WriteMapFile(const char *path);
+
+	//! \brief replace our dots with the ones in a file written by WriteMapFile()
+	//! \details the file is mapped private and our chunks use its dots where they lie, so loading costs only the
+	//! page faults of the dots that get looked at. Changing a dot copies its page and never touches the file.
+	bool MapFile(const char *path);
+
+	//! \brief how many of our chunks are using dots straight out of a mapped file
+	inline int GetNumBorrowedChunks() const
+	{
+		return borrowedchunks;
+	}
+
 	/**
 	** \brief Turns the dotstore into a buffer for saving to disk/ram/whatever
 	*/
-	int *ToBuffer();
+	Coord *ToBuffer();
 	
 	//!
 	//! \brief Fills the dotstore by decoding the passed in buffer
-	void FromBuffer(int *buffer);
+	void FromBuffer(Coord *buffer);
 
 	//! \brief returns the size in bytes of the buffer that is passed in
-	int BufferSize(int *buffer);
+	Coord BufferSize(Coord *buffer);
 
 	//! \brief filter out any dots that are less than a particular length
-	DotStore *Filter(int minlength);
+	DotStore *Filter(Coord minlength);
+
+	//! \brief drop our own dots that are less than a particular length, keeping the rest in order
+	//! \details an index is kept, as it is by DelDot()
+	void FilterInPlace(Coord minlength);
 	
 	//! \brief interpolate long matches into many small matches
 	void Interpolate(int window);
 
-	inline int GetMaxX() const
+	/*
+	** Bulk transforms
+	** ===============
+	** these work straight on the chunk memory. Any index is destroyed by the transforms, as its dots have moved, but
+	** appended dots are added to it. A symmetric store is unfolded first by any transform that would break its symmetry.
+	*/
+
+	//! \brief add every dot of another store (which may be us) to our end, moved by (dx,dy)
+	void Append(DotStore *other, Coord dx=0, Coord dy=0);
+
+	//! \brief move every dot by (dx,dy)
+	void Offset(Coord dx, Coord dy);
+
+	//! \brief reflect every dot about an axis length. x becomes xlength-x (or y becomes ylength-y)
+	void FlipX(Coord xlength);
+	void FlipY(Coord ylength);
+
+	//! \brief swap the x and y of every dot
+	void Transpose();
+
+	inline Coord GetMaxX() const
 	{
 		return maxx;
 	}
 	
-	inline int GetMaxY() const
+	inline Coord GetMaxY() const
 	{
 		return maxy;
 	}
 
-	inline void SetMaxX(int m)
+	inline void SetMaxX(Coord m)
 	{
 		maxx=m;
 	}
 	
-	inline void SetMaxY(int m)
+	inline void SetMaxY(Coord m)
 	{
 		maxy=m;
 	}
 
 	
 	
-	inline int GetDotX(int index)
+	inline Coord GetDotX(Coord index)
 	{
 		return GetDot(index)->x;
 	}
 
-	inline int GetDotY(int index)
+	inline Coord GetDotY(Coord index)
 	{
 		return GetDot(index)->y;
 	}
 
-	inline int GetDotLength(int index)
+	inline Coord GetDotLength(Coord index)
 	{
 		return GetDot(index)->length;
 	}
 
-	inline int GetNum()
+	inline Coord GetNum()
 	{
 		return numdots;
 	}
 
-	// find first non empty chunk
+	//! \brief how many dots we represent, counting the mirrors of a symmetric store
+	inline Coord GetLogicalNum() const
+	{
+		return symmetric?numdots*2-numdiagonal:numdots;
+	}
+
+	/*
+	** Statistics
+	** ==========
+	** these are all kept as the dots are added, so they cost nothing to ask for. Like GetLogicalNum() they count the
+	** mirrors of a symmetric store.
+	*/
+
+	//! \brief how many dots have a length that falls in a histogram bin. see DOTSTORE_HISTOGRAMBINS
+	inline long long GetLengthHistogram(int bin) const
+	{
+		assert(bin>=0 && bin<(int)DOTSTORE_HISTOGRAMBINS);
+		return symmetric?lengthhistogram[bin]*2-diagonalhistogram[bin]:lengthhistogram[bin];
+	}
+
+	//! \brief the sum of all the match lengths
+	inline long long GetTotalBases() const
+	{
+		return symmetric?totalbases*2-diagonalbases:totalbases;
+	}
+
+	//! \brief the shortest and longest match lengths. 0 when we are empty
+	Coord GetMinLength();
+	Coord GetMaxLength();
+
+	//! \brief the length a filter would need to keep at least n of our dots, to the nearest power of two
+	//! \details returns the largest power of two where n or more dots are at least that long. 0 if we have less than n dots
+	Coord LengthThreshold(Coord n) const;
+
+	//! \brief the first chunk, for walking all the dots in order without indexing
+	//! \details any dots deleted from under the index are compacted away first, so every dot in the chunks is live
+	inline DotStorageChunk *GetHead()
+	{
+		Compact();
+		return head;
+	}
+
+	//! \brief how many deleted dots are still marked in the chunks, waiting to be compacted away
+	inline Coord GetNumDeleted() const
+	{
+		return numdeleted;
+	}
+
+	// find first non empty chunk. The full ones before it aren't looked at again until dots are taken out of them
 	inline DotStorageChunk *FindFirstNonEmptyChunk()
 	{
 		assert(head);
-		for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
-			if(!chunk->IsFull())
-				return chunk;
+		if(!roomfrom)
+			roomfrom=head;
+		for(;;)
+		{
+			if(!roomfrom->IsFull())
+				return roomfrom;
+			if(!roomfrom->GetNext())
+				break;
+			roomfrom=roomfrom->GetNext();
+		}
 
 		// none found
 		return NULL;
@@ -111,34 +353,196 @@ public:
 ** the following functions are to create a sorted rapid access index of all the dots once they have been calculated.
 ** 
 ** It works like this
-** for each y value stored sorted in an array there is a pointer
-** following this pointer gives us an array of x values sorted in order
-** with each value is the length of the match
+** the dots are sorted on their Morton code (their x and y bits interleaved) into one flat array, and every quadtree
+** node over the plot is a contiguous run of it. See MortonIndex.h
+**
+** alongside it the dots are sorted by their diagonal, so a walk along a match can jump straight to where the next dot
+** on it starts. See DiagonalIndex.h
+**
+** the matches can also be indexed as the segments they are, to find every one crossing an area wherever it starts.
+** See SegmentIndex.h
+**
+** the indexes are static, but the store isn't. Dots added once the index is made go into a small store of their own
+** with its own index, which is made when it's next queried. Dots added after that go into its own pending store in
+** turn, so a query after a few more dots only indexes those. Every query looks in all of them. Once a pending store
+** gets too big, or the dots are moved from under the index (which holds pointers to them), the index over them is
+** made again when it's next queried. A run of changes between queries costs one rebuild at most.
+**
+** Deleted dots don't move. They are marked DOT_DELETED where they are, which the queries pass over, and the diagonal
+** index forgets them. Once there are too many of them they are compacted away and the whole index made again.
+**
+** Dots starting at the same place are one match, as long as the longest of them, and only that one is indexed. Adding
+** a dot where there is one already, or deleting the longest of several, can change which that is, so the index is made
+** again.
 */
 private:
-	QuadTree *index;
+	MortonIndex *index;
+	DiagonalIndex *diagonalindex;
+	MatchProfile *profile;				// made on request, and thrown away with the index or any change
+	SegmentIndex *segmentindex;			// made on request, and thrown away with the index
+	AreaTable *areatable;				// made on request, and thrown away with the index or any change
+
+	DotStore *pending;				// the dots added since the index was made. NULL if there are none
+	bool pendingstale;				// pending has changed since its own index was brought up to date
+	bool indexstale;				// our dots have moved under the index, so it must be made again
+	Coord numdeleted;				// dots marked DOT_DELETED in our chunks, not counted in numdots
+
+	// keep the index up to date with a dot we have just added
+	void IndexDot(Coord x, Coord y, Coord length);
+
+	// the index has lost track of our dots
+	void InvalidateIndex();
+
+	// the dot at index, counting only live dots, and where it is in the chunks
+	Dot *LocateDot(Coord index, DotStorageChunk *&chunk, int &position);
+
+	// delete the dot at position in chunk. See DelDot()
+	void DeleteAt(DotStorageChunk *chunk, int position);
+
+	// mark a dot deleted under the index. Returns false if the index doesn't have it, as it was added since
+	bool MarkDeleted(DotStorageChunk *chunk, int position);
+
+	// dots have been marked deleted. Compacts them away when there are too many
+	void DeletedUnderIndex();
+
+	// delete a live dot at x,y of length. For the copy pending has of a dot deleted from its store
+	void DeleteCopy(Coord x, Coord y, Coord length);
+
+	// take the dots marked deleted out of the chunks for good, which moves the dots after them
+	void Compact();
+
+	// GetIndexDiagonalGap() without the reflection, over the index and the pending ones
+	Coord DiagonalGap(Coord x, Coord y);
+
+	// query the index and the ones over the pending dots. See MortonIndex.h
+	template<class Visitor> inline void QueryIndex(Coord x1, Coord y1, Coord x2, Coord y2, Visitor &visitor)
+	{
+		index->Query(x1,y1,x2,y2,visitor);
+		if(pending)
+			pending->QueryIndex(x1,y1,x2,y2,visitor);
+	}
+
+	// and the same for the segment indexes. GetSegmentIndex() must have been called. See SegmentIndex.h
+	template<class Visitor> inline void QuerySegments(Coord x1, Coord y1, Coord x2, Coord y2, Visitor &visitor)
+	{
+		segmentindex->Query(x1,y1,x2,y2,visitor);
+		if(pending)
+			pending->QuerySegments(x1,y1,x2,y2,visitor);
+	}
+
+	// hand every indexed dot to visitor, the pending ones too. See MortonIndex.h
+	template<class Visitor> inline void VisitIndexed(Visitor &visitor)
+	{
+		index->VisitAll(visitor);
+		if(pending)
+			pending->VisitIndexed(visitor);
+	}
 	int pixwidth;
 	int pixheight;
 	int *averagearray;
 
+	// how much of a single dot falls in the area for CountAreaMatches. gap caches where the next dot on its diagonal is,
+	// and starts at -1
+	Coord CountDotInArea(const Dot *dot, double x1, double y1, double x2, double y2, double dwindow, Coord &gap);
+
+	// CountAreaBases() from the segment index alone
+	Coord CountSegmentBases(Coord x1, Coord y1, Coord x2, Coord y2);
+
+	// add length bases of a match from x,y to the cells of the area table they fall in
+	void AddToAreaTable(Coord x, Coord y, Coord length);
+
+	// add what a single dot counts in each cell of rows row1 to row2-1, row y going into grid row rowbase+rowstep*y.
+	// gap is as for CountDotInArea(). See AddGridMatches()
+	void AddDotToGrid(const Dot *dot, int *grid, int width, int rowbase, int rowstep, int row1, int row2, double x1, double y1, double scale, double dwindow, Coord gap);
+
+	// query visitors. See MortonIndex.h
+	struct FirstDotVisitor;
+	struct LongestDotVisitor;
+	struct AreaTableVisitor;
+	struct AreaVisitor;
+	struct GridVisitor;
+	struct AreaBaseVisitor;
+	struct CoverageVisitor;
+
+	// the longest dot stored in a rectangle
+	Dot *LongestDot(Coord x1, Coord y1, Coord x2, Coord y2, bool offdiagonal);
+
 public:
 	void CreateIndex();
 	void DestroyIndex();
 	void DumpIndex();
 
-	// index access functions
-	Dot *GetIndexDot(int x, int y);
+	//! \brief catch the index up with the dots added and removed since it was made
+	//! \details the queries do this themselves. Threads sharing a store must have it done before they start
+	void RefreshIndex();
 
-	// Get the longest matching dot from a row or column (used for calculating conserved regions in other sequences)
-	Dot *GetIndexLongestMatchingRowDot(int y);
-	Dot *GetIndexLongestMatchingColumnDot(int x);
+	inline bool IsIndexed() const
+	{
+		return index!=NULL;
+	}
+
+	// index access functions. For a symmetric store a reflected dot is returned in scratch space that is
+	// overwritten by the next call
+	Dot *GetIndexDot(Coord x, Coord y);
+
+	// how far down the diagonal from x,y the next dot starts, or 0 if there are no more on it
+	Coord GetIndexDiagonalGap(Coord x, Coord y);
+
+	// Get the longest matching dot from a row or column (used for calculating conserved regions in other sequences).
+	// Once a profile has been made these are looked up in it, and the dot is returned in scratch space
+	Dot *GetIndexLongestMatchingRowDot(Coord y);
+	Dot *GetIndexLongestMatchingColumnDot(Coord x);
+
+	//! \brief the longest matches of every row and column, made in one pass the first time it's asked for
+	//! \details for callers looking up many rows or columns. The index must have been created, and the profile
+	//! goes when it does
+	MatchProfile *GetProfile();
 
 	//
 	// \brief sum the amount of dots within the passed in window 
 	// 
 	// uses an efficient algorithm and the index must have been created
 	//
-	int CountAreaMatches(double x1, double x2, double y1, double y2, int window);
+	Coord CountAreaMatches(double x1, double x2, double y1, double y2, int window);
+
+	//! \brief add CountAreaMatches() of every cell of a grid into it, visiting each dot once per band of rows
+	//! \details cell x,y of the width by height grid is the area x1+x*scale,y1+y*scale - x1+(x+1)*scale,y1+(y+1)*scale.
+	//! Each dot is counted into the few cells it can reach, rather than every cell querying the index for the dots
+	//! reaching it. The bands are shared out between threads. The index must have been created
+	//! \param firstrow the row of the whole grid the first row of grid is, so a grid can be made a band at a time
+	//! \param transform where our dots go on the grid, so several stores can be added into it without flipping or
+	//! adding whole grids. NULL leaves them where they are
+	void AddGridMatches(int *grid, int width, int height, double x1, double y1, double scale, int window, int firstrow=0, const GridTransform *transform=NULL);
+
+	//! \brief the segment index of the matches, made the first time it's asked for. The index must have been created
+	SegmentIndex *GetSegmentIndex();
+
+	//! \brief how many bases of matches are in the rectangle x1,y1 - x2,y2 (inclusive)
+	//! \details every match crossing it is found whole, so the store needn't have been interpolated. Like
+	//! CountAreaMatches() a match is only followed as far as the next dot starting on its diagonal, so overlapping
+	//! pieces of a match aren't counted twice. The index must have been created
+	Coord CountAreaBases(Coord x1, Coord y1, Coord x2, Coord y2);
+
+	//! \brief make a summed-area table of our bases, cellsize across, in one pass over the dots
+	//! \details once there is one, CountAreaBases() counts the whole cells of a rectangle from it in constant time
+	//! and only queries the index for the strips round the edge. It replaces any table made before, and goes with the
+	//! index or any change to the dots. The index must have been created
+	void CreateAreaTable(Coord cellsize);
+
+	//! \brief the table made by CreateAreaTable(), or NULL if there isn't one
+	inline const AreaTable *GetAreaTable() const
+	{
+		return areatable;
+	}
+
+	//! \brief add the exact length of match inside each cell of a grid into it, fractions of a base and all
+	//! \details the grid is width by height cells over the area x1,y1 - x2,y2, each scale across, and the last column
+	//! and row stop at x2 and y2 however much of a cell that leaves. Base i of a match is the stretch of its diagonal
+	//! from x+i,y+i to x+i+1,y+i+1, so every cell gets just the part of it that crosses the cell, and a grid over the
+	//! whole plot adds up to CountAreaBases() of it. Matches stop at the next dot on their diagonal as they do there.
+	//! The rows are shared out between threads in bands. The index must have been created
+	//! \param transform where our matches go on the grid, as for AddGridMatches()
+	void AddGridCoverage(float *grid, int width, int height, double x1, double y1, double x2, double y2, double scale, const GridTransform *transform=NULL);
 
 };
 
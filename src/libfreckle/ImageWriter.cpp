@@ -0,0 +1,228 @@
+#include "ImageWriter.h"
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+// a 32 bit number as PNG has it, biggest byte first
+static inline unsigned char *PutBigEndian(unsigned char *p, unsigned int value)
+{
+	p[0]=(unsigned char)(value>>24);
+	p[1]=(unsigned char)(value>>16);
+	p[2]=(unsigned char)(value>>8);
+	p[3]=(unsigned char)value;
+	return p+4;
+}
+
+ImageWriter::ImageWriter()
+{
+	file=NULL;
+	ok=false;
+
+	format=IMAGEWRITER_PNG;
+	width=height=rowsdone=0;
+	bits=8;
+	channels=1;
+
+	memset(&zs, 0, sizeof(zs));
+	deflating=false;
+	row=NULL;
+	chunk=new unsigned char[IMAGEWRITER_CHUNKSIZE];
+}
+
+ImageWriter::~ImageWriter()
+{
+	Close();
+
+	delete [] chunk;
+}
+
+bool ImageWriter::Open(const char *path, int width, int height, int format, int bits, int channels, int level)
+{
+	Close();
+
+	assert(width>0 && height>0);
+	assert(bits==8 || bits==16);
+	assert(channels==1 || channels==3);
+
+	this->format=format;
+	this->width=width;
+	this->height=height;
+	this->bits=bits;
+	this->channels=channels;
+	rowsdone=0;
+
+	if(!strcmp(path,"-"))
+		file=fdopen(dup(1),"wb");
+	else
+		file=fopen(path,"wb");
+
+	if(!file)
+	{
+		printf("ImageWriter: could not create %s\n",path);
+		return ok=false;
+	}
+
+	ok=true;
+	row=new unsigned char[GetRowBytes()+1];
+
+	if(format==IMAGEWRITER_PNM)
+	{
+		char header[64];
+		int length=sprintf(header,"P%c\n%d %d\n%d\n",channels==1?'5':'6',width,height,bits==8?255:65535);
+		WriteBytes(header,length);
+		return ok;
+	}
+
+	assert(format==IMAGEWRITER_PNG);
+
+	static const unsigned char signature[8]={137,'P','N','G','\r','\n',26,'\n'};
+	WriteBytes(signature,8);
+
+	unsigned char header[13];
+	unsigned char *p=PutBigEndian(header,width);
+	p=PutBigEndian(p,height);
+	*p++=(unsigned char)bits;
+	*p++=channels==1?0:2;			// grey or truecolour
+	*p++=0;					// deflate
+	*p++=0;					// adaptive filtering. Every row says which filter it uses
+	*p++=0;					// not interlaced
+	WriteChunk("IHDR",header,13);
+
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit(&zs, level)!=Z_OK)
+	{
+		printf("ImageWriter: could not start compressing %s\n",path);
+		return ok=false;
+	}
+	deflating=true;
+	zs.next_out=chunk;
+	zs.avail_out=IMAGEWRITER_CHUNKSIZE;
+
+	return ok;
+}
+
+bool ImageWriter::WriteRows(const unsigned char *rows, int num, bool invert)
+{
+	assert(file);
+	assert(rowsdone+num<=height);
+
+	int rowbytes=GetRowBytes();
+	unsigned char *out=row+1;
+	row[0]=0;				// PNG filter: none. Dot plots are mostly background, which deflates well as it is
+
+	for(int r=0; r<num && ok; r++, rowsdone++)
+	{
+		const unsigned char *in=rows+(size_t)r*rowbytes;
+
+		// both formats want 16 bit samples big endian
+		if(bits==8)
+		{
+			if(invert)
+				for(int i=0; i<rowbytes; i++)
+					out[i]=255-in[i];
+			else
+				memcpy(out,in,rowbytes);
+		}
+		else
+		{
+			const unsigned short *samples=(const unsigned short *)in;
+			unsigned short flip=invert?65535:0;
+			for(int i=0; i<rowbytes/2; i++)
+			{
+				unsigned short sample=samples[i]^flip;
+				out[2*i]=(unsigned char)(sample>>8);
+				out[2*i+1]=(unsigned char)sample;
+			}
+		}
+
+		if(format==IMAGEWRITER_PNM)
+			WriteBytes(out,rowbytes);
+		else
+			Deflate(row,rowbytes+1,Z_NO_FLUSH);
+	}
+
+	return ok;
+}
+
+bool ImageWriter::Close()
+{
+	if(!file)
+		return ok;
+
+	if(rowsdone!=height)
+	{
+		printf("ImageWriter: closed after %d of %d rows\n",rowsdone,height);
+		ok=false;
+	}
+
+	if(deflating)
+	{
+		Deflate(NULL,0,Z_FINISH);
+		WriteChunk("IDAT",chunk,IMAGEWRITER_CHUNKSIZE-zs.avail_out);
+		deflateEnd(&zs);
+		deflating=false;
+		WriteChunk("IEND",NULL,0);
+	}
+
+	if(fclose(file)!=0)
+		ok=false;
+	file=NULL;
+
+	delete [] row;
+	row=NULL;
+
+	return ok;
+}
+
+bool ImageWriter::WriteBytes(const void *data, size_t length)
+{
+	if(ok && length && fwrite(data,1,length,file)!=length)
+	{
+		printf("ImageWriter: write failed\n");
+		ok=false;
+	}
+	return ok;
+}
+
+bool ImageWriter::WriteChunk(const char *type, const unsigned char *data, size_t length)
+{
+	// length, type, data, and a CRC of the type and data
+	unsigned char head[8];
+	PutBigEndian(head,(unsigned int)length);
+	memcpy(head+4,type,4);
+
+	uLong crc=crc32(0L,Z_NULL,0);
+	crc=crc32(crc,head+4,4);
+	if(length)
+		crc=crc32(crc,data,length);
+	unsigned char tail[4];
+	PutBigEndian(tail,(unsigned int)crc);
+
+	WriteBytes(head,8);
+	WriteBytes(data,length);
+	return WriteBytes(tail,4);
+}
+
+// feed the deflate stream, writing out an IDAT chunk every time one fills up
+bool ImageWriter::Deflate(const unsigned char *data, size_t length, int flush)
+{
+	zs.next_in=(Bytef *)data;
+	zs.avail_in=length;
+
+	while(ok)
+	{
+		int result=deflate(&zs, flush);
+		assert(result!=Z_STREAM_ERROR);
+
+		if(zs.avail_out==0)
+		{
+			WriteChunk("IDAT",chunk,IMAGEWRITER_CHUNKSIZE);
+			zs.next_out=chunk;
+			zs.avail_out=IMAGEWRITER_CHUNKSIZE;
+		}
+		else if(flush==Z_FINISH?result==Z_STREAM_END:zs.avail_in==0)
+			break;
+	}
+
+	return ok;
+}
@@ -0,0 +1,69 @@
+#ifndef _IMAGEWRITER_H_
+#define _IMAGEWRITER_H_
+
+#include <stdio.h>
+#include <zlib.h>
+
+/*
+** ImageWriter
+** ===========
+** streams an image out to a file a few rows at a time, as a PNG or as a binary PGM (grey) or PPM (colour). Only the
+** row being written is ever held, so the size of an image is limited by the disk rather than by memory.
+**
+** Rows are handed over as 8 bit samples, or as 16 bit ones in native byte order, and can be inverted on the way out.
+** A PNG's rows are deflated as they come, and the compressed data goes out in IDAT chunks of up to
+** IMAGEWRITER_CHUNKSIZE bytes.
+*/
+
+#define IMAGEWRITER_PNG		0
+#define IMAGEWRITER_PNM		1			// PGM for grey, PPM for colour
+
+#define IMAGEWRITER_CHUNKSIZE	65536			// compressed bytes in a PNG IDAT chunk
+
+class ImageWriter
+{
+private:
+	FILE *file;
+	bool ok;
+
+	int format;
+	int width, height, bits, channels;
+	int rowsdone;
+
+	// a PNG's deflate stream, the row it is being fed (behind its filter byte), and the IDAT chunk filling up
+	z_stream zs;
+	bool deflating;
+	unsigned char *row;
+	unsigned char *chunk;
+
+	bool WriteBytes(const void *data, size_t length);
+	bool WriteChunk(const char *type, const unsigned char *data, size_t length);
+	bool Deflate(const unsigned char *data, size_t length, int flush);
+
+public:
+	ImageWriter();
+	~ImageWriter();
+
+	//! \brief start a new width by height image at path ("-" is standard output)
+	//! \param format IMAGEWRITER_PNG or IMAGEWRITER_PNM
+	//! \param bits 8 or 16 bits a sample
+	//! \param channels 1 for grey, 3 for RGB
+	//! \param level how hard to compress a PNG, from 1 to 9
+	bool Open(const char *path, int width, int height, int format=IMAGEWRITER_PNG, int bits=8, int channels=1, int level=6);
+
+	//! \brief how many bytes a row is handed over in
+	inline int GetRowBytes() const
+	{
+		return width*channels*(bits/8);
+	}
+
+	//! \brief write out the next num rows, one after another. 16 bit samples are in native byte order
+	//! \param invert write every sample as its largest value less itself
+	bool WriteRows(const unsigned char *rows, int num, bool invert=false);
+
+	//! \brief finish the file. Every row must have been written
+	//! \return false if anything failed to write
+	bool Close();
+};
+
+#endif
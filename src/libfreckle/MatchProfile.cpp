@@ -0,0 +1,144 @@
+#include "MatchProfile.h"
+#include "RadixSort.h"
+#include <string.h>
+
+// a position and the longest match starting there, for sorting on the length
+struct ProfileEntry
+{
+	Coord length;
+	Coord start;
+};
+
+struct ProfileSortKey
+{
+	inline unsigned long long operator()(const ProfileEntry &entry) const { return (unsigned long long)entry.length; }
+};
+
+MatchProfile::MatchProfile(DotStorageChunk *head, Coord numdots, bool symmetric)
+{
+	// how far the matches reach. Dots off the top or left of the plot, and empty ones, aren't profiled
+	width=height=0;
+	Coord n=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++, n++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->x<0 || dot->y<0 || dot->length<=0)
+				continue;
+
+			Coord xend=dot->x+dot->length, yend=dot->y+dot->length;
+			if(symmetric)
+			{
+				if(yend>xend)
+					xend=yend;
+				yend=xend;
+			}
+			if(xend>width)
+				width=xend;
+			if(yend>height)
+				height=yend;
+		}
+	assert(n==numdots);
+
+	rowlength=new Coord[height+1];
+	rowx=new Coord[height+1];
+	rowcover=new Coord[height+1];
+	columnlength=new Coord[width+1];
+	columny=new Coord[width+1];
+	columncover=new Coord[width+1];
+	memset(rowlength, 0, (height+1)*sizeof(Coord));
+	memset(rowx, 0, (height+1)*sizeof(Coord));
+	memset(columnlength, 0, (width+1)*sizeof(Coord));
+	memset(columny, 0, (width+1)*sizeof(Coord));
+
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++)
+		{
+			Dot *dot=chunk->GetDot(i);
+			if(dot->x<0 || dot->y<0 || dot->length<=0)
+				continue;
+
+			AddDot(dot->x, dot->y, dot->length);
+			if(symmetric && dot->x!=dot->y)
+				AddDot(dot->y, dot->x, dot->length);
+		}
+
+	Cover(rowlength, rowcover, height);
+	Cover(columnlength, columncover, width);
+}
+
+MatchProfile::~MatchProfile()
+{
+	delete [] rowlength;
+	delete [] rowx;
+	delete [] rowcover;
+	delete [] columnlength;
+	delete [] columny;
+	delete [] columncover;
+}
+
+// the matches are laid down longest first, each only filling the positions no longer match has reached. next[p] leads
+// on to the first unfilled position from p, so every position is filled once
+void MatchProfile::Cover(const Coord *length, Coord *cover, Coord size)
+{
+	memset(cover, 0, (size+1)*sizeof(Coord));
+
+	Coord num=0, longest=0;
+	for(Coord p=0; p<size; p++)
+		if(length[p])
+		{
+			num++;
+			if(length[p]>longest)
+				longest=length[p];
+		}
+	if(!num)
+		return;
+
+	ProfileEntry *entries=new ProfileEntry[num];
+	num=0;
+	for(Coord p=0; p<size; p++)
+		if(length[p])
+		{
+			entries[num].length=length[p];
+			entries[num].start=p;
+			num++;
+		}
+
+	int bits=0;
+	while(bits<(int)sizeof(Coord)*8 && (unsigned long long)longest>>bits)
+		bits++;
+	ProfileEntry *scratch=new ProfileEntry[num];
+	RadixSort(entries, scratch, num, bits, ProfileSortKey());
+	delete [] scratch;
+
+	Coord *next=new Coord[size+1];
+	for(Coord p=0; p<=size; p++)
+		next[p]=p;
+
+	for(Coord i=num-1; i>=0; i--)
+	{
+		Coord end=entries[i].start+entries[i].length;
+		Coord p=entries[i].start;
+		for(;;)
+		{
+			// find the first unfilled position, shortening the path behind us
+			Coord q=p;
+			while(next[q]!=q)
+				q=next[q];
+			while(next[p]!=p)
+			{
+				Coord after=next[p];
+				next[p]=q;
+				p=after;
+			}
+			if(p>=end)
+				break;
+
+			cover[p]=entries[i].length;
+			next[p]=p+1;
+		}
+	}
+
+	delete [] next;
+	delete [] entries;
+}
@@ -0,0 +1,77 @@
+#ifndef _MATCHPROFILE_H_
+#define _MATCHPROFILE_H_
+
+#include "Dot.h"
+#include "DotStorageChunk.h"
+#include <assert.h>
+
+/*
+** MatchProfile
+** ============
+** the longest matches of a store along each axis, worked out for every row and column in one pass over the dots.
+**
+** For each row it keeps the longest match starting on it and the x that match starts at, and for each column the
+** longest match starting on it and its y. It also keeps the longest match covering each row and column anywhere
+** along its length, which makes a coverage track for the side of a plot.
+**
+** The arrays are dense, one entry for every row and column from 0 out to the furthest any match reaches, so they can
+** be handed out as they are. A length of 0 means no match starts on, or covers, that row or column.
+*/
+
+class MatchProfile
+{
+private:
+	Coord width, height;
+
+	Coord *rowlength, *rowx, *rowcover;
+	Coord *columnlength, *columny, *columncover;
+
+	// keep the dot if it is the longest starting on its row and column so far
+	inline void AddDot(Coord x, Coord y, Coord length)
+	{
+		if(length>rowlength[y])
+		{
+			rowlength[y]=length;
+			rowx[y]=x;
+		}
+		if(length>columnlength[x])
+		{
+			columnlength[x]=length;
+			columny[x]=y;
+		}
+	}
+
+	// fill cover from the longest match starting at each position
+	static void Cover(const Coord *length, Coord *cover, Coord size);
+
+public:
+	//! \brief profile the numdots dots in the chunks from head on. A symmetric store's reflections are included
+	MatchProfile(DotStorageChunk *head, Coord numdots, bool symmetric);
+	~MatchProfile();
+
+	//! \brief how many columns and rows are profiled
+	inline Coord GetWidth() const { return width; }
+	inline Coord GetHeight() const { return height; }
+
+	//! \brief the length of the longest match starting on row y, and the x it starts at
+	inline Coord GetRowLength(Coord y) const { return (y>=0 && y<height)?rowlength[y]:0; }
+	inline Coord GetRowX(Coord y) const { assert(GetRowLength(y)); return rowx[y]; }
+
+	//! \brief the length of the longest match starting on column x, and the y it starts at
+	inline Coord GetColumnLength(Coord x) const { return (x>=0 && x<width)?columnlength[x]:0; }
+	inline Coord GetColumnY(Coord x) const { assert(GetColumnLength(x)); return columny[x]; }
+
+	//! \brief the length of the longest match anywhere over row y or column x
+	inline Coord GetRowCover(Coord y) const { return (y>=0 && y<height)?rowcover[y]:0; }
+	inline Coord GetColumnCover(Coord x) const { return (x>=0 && x<width)?columncover[x]:0; }
+
+	//! \brief the whole arrays, height entries for the rows and width for the columns
+	inline const Coord *GetRowLengths() const { return rowlength; }
+	inline const Coord *GetRowXs() const { return rowx; }
+	inline const Coord *GetRowCovers() const { return rowcover; }
+	inline const Coord *GetColumnLengths() const { return columnlength; }
+	inline const Coord *GetColumnYs() const { return columny; }
+	inline const Coord *GetColumnCovers() const { return columncover; }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "MortonIndex.h"
+#include <assert.h>
+#include <stdlib.h>
+
+// for the runs of a code that holds more than one position
+static int ComparePositions(const void *a, const void *b)
+{
+	const Dot *da=((const MortonEntry *)a)->dot, *db=((const MortonEntry *)b)->dot;
+	if(da->x!=db->x)
+		return da->x<db->x?-1:1;
+	if(da->y!=db->y)
+		return da->y<db->y?-1:1;
+	return 0;
+}
+
+MortonIndex::MortonIndex(DotStorageChunk *head, Coord numdots)
+{
+	num=numdots;
+	entries=new MortonEntry[num>0?num:1];
+
+	// the chunks go in an array so they can be shared out between threads
+	int numchunks=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		numchunks++;
+
+	DotStorageChunk **chunks=new DotStorageChunk *[numchunks>0?numchunks:1];
+	Coord *starts=new Coord[numchunks+1];
+	starts[0]=0;
+	numchunks=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext(), numchunks++)
+	{
+		chunks[numchunks]=chunk;
+		starts[numchunks+1]=starts[numchunks]+chunk->GetNum();
+	}
+	assert(starts[numchunks]==num);
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int c=0; c<numchunks; c++)
+		for(int i=0; i<chunks[c]->GetNum(); i++)
+			entries[starts[c]+i].dot=chunks[c]->GetDot(i);
+
+	delete [] starts;
+	delete [] chunks;
+
+	Build();
+}
+
+MortonIndex::MortonIndex(Dot * const *dots, Coord numdots)
+{
+	num=numdots;
+	entries=new MortonEntry[num>0?num:1];
+	for(Coord i=0; i<num; i++)
+		entries[i].dot=dots[i];
+
+	Build();
+}
+
+void MortonIndex::Build()
+{
+	minx=miny=maxx=maxy=0;
+	shift=0;
+	bits=0;
+	table=NULL;
+	tablebits=0;
+
+	if(!num)
+		return;
+
+	// the extent of the dots. Worked out in blocks and then put together
+	int numblocks=(num+MORTON_BLOCKSIZE-1)/MORTON_BLOCKSIZE;
+	Coord *bounds=new Coord[numblocks*4];
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int block=0; block<numblocks; block++)
+	{
+		Coord *b=bounds+block*4;
+		Coord start=(Coord)block*MORTON_BLOCKSIZE;
+		Coord end=(num-start<MORTON_BLOCKSIZE)?num:start+MORTON_BLOCKSIZE;
+
+		Dot *dot=entries[start].dot;
+		b[0]=b[2]=dot->x;
+		b[1]=b[3]=dot->y;
+		for(Coord i=start+1; i<end; i++)
+		{
+			dot=entries[i].dot;
+			if(dot->x<b[0]) b[0]=dot->x;
+			if(dot->y<b[1]) b[1]=dot->y;
+			if(dot->x>b[2]) b[2]=dot->x;
+			if(dot->y>b[3]) b[3]=dot->y;
+		}
+	}
+
+	minx=bounds[0];
+	miny=bounds[1];
+	maxx=bounds[2];
+	maxy=bounds[3];
+	for(int block=1; block<numblocks; block++)
+	{
+		Coord *b=bounds+block*4;
+		if(b[0]<minx) minx=b[0];
+		if(b[1]<miny) miny=b[1];
+		if(b[2]>maxx) maxx=b[2];
+		if(b[3]>maxy) maxy=b[3];
+	}
+	delete [] bounds;
+
+	// differences taken unsigned, as they may not fit a Coord
+	unsigned long long span=((unsigned long long)maxx-(unsigned long long)minx)|((unsigned long long)maxy-(unsigned long long)miny);
+	while(bits<64 && span>>bits)
+		bits++;
+	if(bits>MORTON_MAXBITS)
+	{
+		shift=bits-MORTON_MAXBITS;
+		bits=MORTON_MAXBITS;
+	}
+
+	// code every dot
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(Coord i=0; i<num; i++)
+		entries[i].code=Code(entries[i].dot->x, entries[i].dot->y);
+
+	MortonEntry *scratch=new MortonEntry[num];
+	RadixSort(entries, scratch, num, bits*2, SortKey());
+	delete [] scratch;
+
+	Collapse();
+	BuildTable();
+}
+
+void MortonIndex::Collapse()
+{
+	Coord kept=0;
+	for(Coord start=0, end; start<num; start=end)
+	{
+		// the run of a code. With bits dropped from the codes it can hold more than one position, so it is sorted on them
+		for(end=start+1; end<num && entries[end].code==entries[start].code; end++)
+			;
+		if(shift && end-start>1)
+			qsort(entries+start, end-start, sizeof(MortonEntry), ComparePositions);
+
+		for(Coord i=start; i<end; i++)
+		{
+			// the first of a run is always kept, so after it the last one kept is in the run too
+			Dot *dot=entries[i].dot, *last=(i>start)?entries[kept-1].dot:NULL;
+			if(last && last->x==dot->x && last->y==dot->y)
+			{
+				if(dot->length>last->length)
+					entries[kept-1].dot=dot;
+				continue;
+			}
+			entries[kept++]=entries[i];
+		}
+	}
+	num=kept;
+}
+
+MortonIndex::~MortonIndex()
+{
+	delete [] entries;
+	delete [] table;
+}
+
+void MortonIndex::BuildTable()
+{
+	tablebits=(bits<MORTON_TABLEBITS)?bits:MORTON_TABLEBITS;
+	Coord size=(Coord)1<<(2*tablebits);
+	table=new Coord[size+1];
+
+	int codeshift=2*(bits-tablebits);
+	Coord node=0;
+	for(Coord i=0; i<num; i++)
+		while(node<=(Coord)(entries[i].code>>codeshift))
+			table[node++]=i;
+	while(node<=size)
+		table[node++]=num;
+}
+
+Coord MortonIndex::LowerBound(Coord lo, Coord hi, unsigned long long code) const
+{
+	while(lo<hi)
+	{
+		Coord mid=lo+(hi-lo)/2;
+		if(entries[mid].code<code)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	return lo;
+}
+
+LinkedListVal<Dot *> *MortonIndex::SpatialQuery(Coord x1, Coord y1, Coord x2, Coord y2) const
+{
+	LinkedListVal<Dot *> *list=new LinkedListVal<Dot *>;
+	MortonListVisitor visitor(list);
+	Query(x1, y1, x2, y2, visitor);
+	return list;
+}
+
+Coord MortonIndex::SpatialQuery(Coord x1, Coord y1, Coord x2, Coord y2, Dot **buffer, Coord capacity) const
+{
+	MortonBufferVisitor visitor(buffer, capacity);
+	Query(x1, y1, x2, y2, visitor);
+	return visitor.found;
+}
+
+Coord MortonIndex::Count(Coord x1, Coord y1, Coord x2, Coord y2) const
+{
+	MortonCountVisitor visitor;
+	Query(x1, y1, x2, y2, visitor);
+	return visitor.count;
+}
+
+// the dots at x,y all have the same code, so they are found with a binary search in the run of their tabled node
+Dot *MortonIndex::GetDot(Coord x, Coord y) const
+{
+	if(!num || x<minx || y<miny || x>maxx || y>maxy)
+		return NULL;
+
+	unsigned long long code=Code(x, y);
+	unsigned long long node=code>>(2*(bits-tablebits));
+	Coord end=table[node+1];
+	for(Coord i=LowerBound(table[node], end, code); i<end && entries[i].code==code; i++)
+		if(entries[i].dot->x==x && entries[i].dot->y==y)
+			return entries[i].dot;
+
+	return NULL;
+}
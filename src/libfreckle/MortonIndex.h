@@ -0,0 +1,272 @@
+#ifndef _MORTONINDEX_H_
+#define _MORTONINDEX_H_
+
+#include "Dot.h"
+#include "DotStorageChunk.h"
+#include "LinkedListVal.h"
+#include "RadixSort.h"
+#include <assert.h>
+#include <stdio.h>
+
+/*
+** MortonIndex
+** ===========
+** a static spatial index of the dots of a store, built in one go rather than a dot at a time.
+**
+** Every dot gets the Morton (Z-order) code of its position, made by interleaving the bits of its x and y, and the dots
+** are radix sorted on it into one flat array. Every node of a quadtree over the plot is then a contiguous run of that
+** array: the dots whose codes share the node's prefix. So the tree needs no nodes at all. A query descends it by
+** binary searching for where each child's run starts, takes whole runs of nodes inside the query without looking at
+** their dots, and only checks dots one by one in small runs that straddle its edge. Where the runs of the nodes in the
+** top few levels start is kept in a table, so the searching is only done in the short runs further down.
+**
+** Coordinates are taken relative to the smallest x and y of the dots. If the dots span more than 32 bits the low bits
+** are dropped from the codes, which just makes the smallest cells of the tree bigger.
+**
+** Dots starting at the same x,y are the same match, as the quad tree this replaces had them. Only the longest of them is
+** indexed.
+*/
+
+#define MORTON_MAXBITS		32			// bits of each coordinate in a code
+#define MORTON_LEAFSIZE		16			// runs this short are checked dot by dot rather than split further
+#define MORTON_TABLEBITS	8			// levels of the tree whose run starts are tabled. The table has 4^this entries
+#define MORTON_BLOCKSIZE	8192			// dots each thread takes at a time working out the extent
+
+struct MortonEntry
+{
+	unsigned long long code;
+	Dot *dot;
+};
+
+// a query rectangle, both as it was asked and measured from the origin of an index
+struct MortonQuery
+{
+	Coord x1, y1, x2, y2;
+	unsigned long long ox1, oy1, ox2, oy2;
+};
+
+/*
+** Visitors
+** ========
+** a query hands the dots it finds to a visitor rather than making a list of them. A visitor has
+**
+**   void Visit(Dot *dot)					for a dot found on its own
+**   void VisitRun(const MortonEntry *run, Coord n)		for a whole run of dots that are all in the query
+**
+** These are the common ones. Nothing is allocated by any of them.
+*/
+
+// puts the dots in a list, for the callers that want one
+struct MortonListVisitor
+{
+	LinkedListVal<Dot *> *list;
+
+	MortonListVisitor(LinkedListVal<Dot *> *list) { this->list=list; }
+
+	inline void Visit(Dot *dot) { list->Append(dot); }
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) list->Append(run[i].dot); }
+};
+
+// fills a buffer the caller gives. found keeps counting past the end of it
+struct MortonBufferVisitor
+{
+	Dot **buffer;
+	Coord capacity, found;
+
+	MortonBufferVisitor(Dot **buffer, Coord capacity) { this->buffer=buffer; this->capacity=capacity; found=0; }
+
+	inline void Visit(Dot *dot)
+	{
+		if(found<capacity)
+			buffer[found]=dot;
+		found++;
+	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
+// just counts. Whole runs are counted without looking at their dots
+struct MortonCountVisitor
+{
+	Coord count;
+
+	MortonCountVisitor() { count=0; }
+
+	inline void Visit(Dot *dot) { count++; }
+	inline void VisitRun(const MortonEntry *run, Coord n) { count+=n; }
+};
+
+class MortonIndex
+{
+private:
+	MortonEntry *entries;				// sorted by code
+	Coord num;
+
+	Coord minx, miny;				// the origin of the codes
+	Coord maxx, maxy;
+	int shift;					// low bits of the coordinates dropped from the codes
+	int bits;					// bits of each coordinate left in the codes. The depth of the tree
+
+	Coord *table;					// where the run of each node tablebits levels down starts, and num
+	int tablebits;
+
+	// spread the low 32 bits of v out into the even bits of the result
+	static inline unsigned long long SpreadBits(unsigned long long v)
+	{
+		v&=0xffffffffULL;
+		v=(v|(v<<16))&0x0000ffff0000ffffULL;
+		v=(v|(v<<8))&0x00ff00ff00ff00ffULL;
+		v=(v|(v<<4))&0x0f0f0f0f0f0f0f0fULL;
+		v=(v|(v<<2))&0x3333333333333333ULL;
+		v=(v|(v<<1))&0x5555555555555555ULL;
+		return v;
+	}
+
+	inline unsigned long long Code(Coord x, Coord y) const
+	{
+		return SpreadBits(((unsigned long long)x-(unsigned long long)minx)>>shift) | (SpreadBits(((unsigned long long)y-(unsigned long long)miny)>>shift)<<1);
+	}
+
+	// the key entries are sorted on
+	struct SortKey
+	{
+		inline unsigned long long operator()(const MortonEntry &entry) const { return entry.code; }
+	};
+
+	// code, sort and table the dots of the entries
+	void Build();
+
+	// keep the longest of each run of dots at the same x,y, once they are sorted
+	void Collapse();
+
+	void BuildTable();
+
+	// the first entry in [lo,hi) with a code at least code
+	Coord LowerBound(Coord lo, Coord hi, unsigned long long code) const;
+
+	// where the run of the node at level with prefix starts. It is somewhere in [lo,hi]
+	inline Coord RunStart(unsigned long long prefix, int level, Coord lo, Coord hi) const
+	{
+		int depth=bits-level;
+		if(depth<=tablebits)
+			return table[prefix<<(2*(tablebits-depth))];
+
+		// one past the last node of a full 32 bit tree has a code of 2^64
+		unsigned long long code=prefix<<(2*level);
+		if(prefix && !code)
+			return hi;
+		return LowerBound(lo, hi, code);
+	}
+
+	// the node at level covers the cells whose codes start with prefix. Its dots are entries lo to hi-1 and its corner
+	// is at nodex,nodey from the origin
+	template<class Visitor> void QueryRecurse(Visitor &visitor, const MortonQuery &q, unsigned long long prefix, int level, Coord lo, Coord hi,
+		unsigned long long nodex, unsigned long long nodey) const
+	{
+		if(lo==hi)
+			return;
+
+		unsigned long long extent=(1ULL<<(level+shift))-1;
+
+		// all of the node is in the query
+		if(nodex>=q.ox1 && nodex+extent<=q.ox2 && nodey>=q.oy1 && nodey+extent<=q.oy2)
+		{
+			visitor.VisitRun(entries+lo, hi-lo);
+			return;
+		}
+
+		if(hi-lo<=MORTON_LEAFSIZE || level==0)
+		{
+			for(Coord i=lo; i<hi; i++)
+			{
+				Dot *dot=entries[i].dot;
+				if(dot->x>=q.x1 && dot->x<=q.x2 && dot->y>=q.y1 && dot->y<=q.y2)
+					visitor.Visit(dot);
+			}
+			return;
+		}
+
+		// the children that reach the query. Even bits of a code are x, odd ones y
+		int childlevel=level-1;
+		unsigned long long childsize=1ULL<<(childlevel+shift);
+		for(unsigned long long child=0; child<4; child++)
+		{
+			unsigned long long childx=nodex+((child&1)?childsize:0), childy=nodey+((child&2)?childsize:0);
+			if(childx>q.ox2 || childx+childsize-1<q.ox1 || childy>q.oy2 || childy+childsize-1<q.oy1)
+				continue;
+
+			unsigned long long childprefix=(prefix<<2)|child;
+			Coord start=RunStart(childprefix, childlevel, lo, hi);
+			Coord end=RunStart(childprefix+1, childlevel, start, hi);
+			QueryRecurse(visitor, q, childprefix, childlevel, start, end, childx, childy);
+		}
+	}
+
+public:
+	//! \brief index the numdots dots in the chunks from head on
+	MortonIndex(DotStorageChunk *head, Coord numdots);
+
+	//! \brief index the numdots dots pointed to by dots. The array can go once this returns, the dots can't
+	MortonIndex(Dot * const *dots, Coord numdots);
+	~MortonIndex();
+
+	//! \brief how many dots are indexed. Dots at the same x,y count once
+	inline Coord GetNum() const
+	{
+		return num;
+	}
+
+	//! \brief hand every dot to visitor, in code order. See Visitors above
+	template<class Visitor> void VisitAll(Visitor &visitor) const
+	{
+		if(num)
+			visitor.VisitRun(entries, num);
+	}
+
+	//! \brief hand every dot inside the rectangle (inclusive) to visitor. See Visitors above
+	template<class Visitor> void Query(Coord x1, Coord y1, Coord x2, Coord y2, Visitor &visitor) const
+	{
+		assert(x1<=x2);
+		assert(y1<=y2);
+
+		if(!num || x2<minx || y2<miny || x1>maxx || y1>maxy)
+			return;
+
+		MortonQuery q;
+		q.x1=x1;
+		q.y1=y1;
+		q.x2=x2;
+		q.y2=y2;
+		q.ox1=(x1<minx)?0:(unsigned long long)x1-(unsigned long long)minx;
+		q.oy1=(y1<miny)?0:(unsigned long long)y1-(unsigned long long)miny;
+		q.ox2=(unsigned long long)x2-(unsigned long long)minx;
+		q.oy2=(unsigned long long)y2-(unsigned long long)miny;
+
+		QueryRecurse(visitor, q, 0, bits, 0, num, 0, 0);
+	}
+
+	//! \brief every dot inside the rectangle (inclusive), in a new list
+	LinkedListVal<Dot *> *SpatialQuery(Coord x1, Coord y1, Coord x2, Coord y2) const;
+
+	//! \brief the dots inside the rectangle, in a buffer with room for capacity of them
+	//! \return how many there are, which may be more than would fit
+	Coord SpatialQuery(Coord x1, Coord y1, Coord x2, Coord y2, Dot **buffer, Coord capacity) const;
+
+	//! \brief how many dots are inside the rectangle
+	Coord Count(Coord x1, Coord y1, Coord x2, Coord y2) const;
+
+	//! \brief a dot at exactly x,y, or NULL if there isn't one
+	Dot *GetDot(Coord x, Coord y) const;
+
+#ifdef DEBUG
+	// dump the index to stdout
+	inline void Dump() const
+	{
+		printf("MortonIndex(%lld dots)\n=======================\n",(long long)num);
+		printf("origin:%lld,%lld\tshift:%d\tbits:%d\n",(long long)minx,(long long)miny,shift,bits);
+		for(Coord i=0; i<num; i++)
+			printf("%016llx\t%lld\t%lld\t%lld\n",entries[i].code,(long long)entries[i].dot->x,(long long)entries[i].dot->y,(long long)entries[i].dot->length);
+	}
+#endif
+};
+
+#endif
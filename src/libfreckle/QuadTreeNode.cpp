@@ -220,8 +220,8 @@ void QuadTreeNode::DeleteDot(Dot *dot)
 {
 	assert(dot);
 
-	int xp=dot->x;
-	int yp=dot->y;
+	Type xp=dot->x;
+	Type yp=dot->y;
 
 	if(isLeaf())
 	{
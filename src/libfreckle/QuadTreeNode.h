@@ -7,7 +7,7 @@
 #include <stdio.h>
 
 // the type of units for the points
-typedef int Type;
+typedef Coord Type;
 
 #define NW	0
 #define NE	1
@@ -0,0 +1,98 @@
+#ifndef _RADIXSORT_H_
+#define _RADIXSORT_H_
+
+#include "Dot.h"
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+** RadixSort
+** =========
+** least significant digit first radix sort of an array of entries on an unsigned 64 bit key, shared by the static dot
+** indexes. key(entry) gives the key of an entry, and only its low keybits bits are sorted on.
+**
+** Each thread counts and then scatters its own slice of the entries, and the slices are laid out in thread order within
+** each digit's bucket, so every pass is stable. scratch must have room for num entries.
+*/
+
+#define RADIXSORT_BITS		8			// bits sorted on in each pass
+#define RADIXSORT_SIZE		(1<<RADIXSORT_BITS)
+#define RADIXSORT_MINTHREADWORK	65536			// entries a thread should have to sort before it's worth starting it
+
+template<class Entry, class Key> void RadixSort(Entry *entries, Entry *scratch, Coord num, int keybits, const Key &key)
+{
+	int numthreads=1;
+#ifdef _OPENMP
+	numthreads=omp_get_max_threads();
+	if(num/RADIXSORT_MINTHREADWORK+1<numthreads)
+		numthreads=num/RADIXSORT_MINTHREADWORK+1;
+#endif
+
+	Coord *counts=new Coord[numthreads*RADIXSORT_SIZE];
+	Entry *from=entries, *to=scratch;
+
+	for(int pass=0; pass*RADIXSORT_BITS<keybits; pass++)
+	{
+		int digitshift=pass*RADIXSORT_BITS;
+		memset(counts, 0, numthreads*RADIXSORT_SIZE*sizeof(Coord));
+
+#ifdef _OPENMP
+		#pragma omp parallel num_threads(numthreads)
+#endif
+		{
+			int thread=0;
+#ifdef _OPENMP
+			thread=omp_get_thread_num();
+#endif
+			Coord *count=counts+thread*RADIXSORT_SIZE;
+			Coord end=(long long)num*(thread+1)/numthreads;
+			for(Coord i=(long long)num*thread/numthreads; i<end; i++)
+				count[(key(from[i])>>digitshift)&(RADIXSORT_SIZE-1)]++;
+		}
+
+		// where each thread's share of each digit goes. A pass where every key has the same digit changes nothing
+		Coord total=0;
+		bool skip=false;
+		for(int digit=0; digit<RADIXSORT_SIZE; digit++)
+		{
+			Coord start=total;
+			for(int thread=0; thread<numthreads; thread++)
+			{
+				Coord n=counts[thread*RADIXSORT_SIZE+digit];
+				counts[thread*RADIXSORT_SIZE+digit]=total;
+				total+=n;
+			}
+			if(total-start==num)
+				skip=true;
+		}
+		if(skip)
+			continue;
+
+#ifdef _OPENMP
+		#pragma omp parallel num_threads(numthreads)
+#endif
+		{
+			int thread=0;
+#ifdef _OPENMP
+			thread=omp_get_thread_num();
+#endif
+			Coord *offset=counts+thread*RADIXSORT_SIZE;
+			Coord end=(long long)num*(thread+1)/numthreads;
+			for(Coord i=(long long)num*thread/numthreads; i<end; i++)
+				to[offset[(key(from[i])>>digitshift)&(RADIXSORT_SIZE-1)]++]=from[i];
+		}
+
+		Entry *swap=from;
+		from=to;
+		to=swap;
+	}
+
+	if(from!=entries)
+		memcpy(entries, from, num*sizeof(Entry));
+
+	delete [] counts;
+}
+
+#endif
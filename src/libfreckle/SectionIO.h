@@ -0,0 +1,83 @@
+#ifndef _SECTIONIO_H_
+#define _SECTIONIO_H_
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+** SectionIO
+** =========
+** the little helpers shared by the sections of a freckle file. The headers and directories are packed little endian so
+** the files move between machines, and the sections are read and written in place with pread and pwrite so one open
+** file can hold several of them.
+*/
+
+static inline void Put32(unsigned char *p, unsigned int v)
+{
+	for(int i=0; i<4; i++)
+		p[i]=(unsigned char)(v>>(i*8));
+}
+
+static inline void Put64(unsigned char *p, long long v)
+{
+	for(int i=0; i<8; i++)
+		p[i]=(unsigned char)((unsigned long long)v>>(i*8));
+}
+
+static inline unsigned int Get32(const unsigned char *p)
+{
+	unsigned int v=0;
+	for(int i=0; i<4; i++)
+		v|=(unsigned int)p[i]<<(i*8);
+	return v;
+}
+
+static inline long long Get64(const unsigned char *p)
+{
+	unsigned long long v=0;
+	for(int i=0; i<8; i++)
+		v|=(unsigned long long)p[i]<<(i*8);
+	return (long long)v;
+}
+
+// read or write exactly length bytes at position. false on failure
+static inline bool ReadAt(int fd, void *buffer, size_t length, long long position)
+{
+	char *p=(char *)buffer;
+	while(length)
+	{
+		ssize_t done=pread(fd, p, length, (off_t)position);
+		if(done<=0)
+			return false;
+		p+=done;
+		length-=done;
+		position+=done;
+	}
+	return true;
+}
+
+static inline bool WriteAt(int fd, const void *buffer, size_t length, long long position)
+{
+	const char *p=(const char *)buffer;
+	while(length)
+	{
+		ssize_t done=pwrite(fd, p, length, (off_t)position);
+		if(done<=0)
+			return false;
+		p+=done;
+		length-=done;
+		position+=done;
+	}
+	return true;
+}
+
+// how long the file open as fd is, so the sizes in a header can be checked before they are trusted. -1 on failure
+static inline long long FileSize(int fd)
+{
+	struct stat info;
+	if(fstat(fd, &info))
+		return -1;
+	return (long long)info.st_size;
+}
+
+#endif
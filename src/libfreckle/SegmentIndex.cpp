@@ -0,0 +1,83 @@
+#include "SegmentIndex.h"
+#include <assert.h>
+
+SegmentIndex::SegmentIndex(DotStorageChunk *head, Coord numdots)
+{
+	Dot **dots=new Dot *[numdots>0?numdots:1];
+	Coord n=0;
+	for(DotStorageChunk *chunk=head; chunk; chunk=chunk->GetNext())
+		for(int i=0; i<chunk->GetNum(); i++, n++)
+			dots[n]=chunk->GetDot(i);
+	assert(n==numdots);
+
+	Build(dots, numdots);
+	delete [] dots;
+}
+
+SegmentIndex::SegmentIndex(const MortonIndex *index)
+{
+	Dot **dots=new Dot *[index->GetNum()>0?index->GetNum():1];
+	MortonBufferVisitor visitor(dots, index->GetNum());
+	index->VisitAll(visitor);
+
+	Build(dots, index->GetNum());
+	delete [] dots;
+}
+
+void SegmentIndex::Build(Dot * const *dots, Coord numdots)
+{
+	Coord counts[SEGMENT_CLASSES];
+	for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+	{
+		classes[c]=NULL;
+		counts[c]=longest[c]=0;
+	}
+
+	// how many dots go in each class, and how long they get
+	num=0;
+	for(Coord i=0; i<numdots; i++)
+	{
+		Dot *dot=dots[i];
+		if(dot->length<=0)
+			continue;
+
+		int c=Class(dot->length);
+		counts[c]++;
+		if(dot->length>longest[c])
+			longest[c]=dot->length;
+		num++;
+	}
+
+	// share the dots out, and index each class
+	Dot **classed=new Dot *[num>0?num:1];
+	Coord starts[SEGMENT_CLASSES+1];
+	starts[0]=0;
+	for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+		starts[c+1]=starts[c]+counts[c];
+
+	Coord fill[SEGMENT_CLASSES];
+	for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+		fill[c]=starts[c];
+	for(Coord i=0; i<numdots; i++)
+		if(dots[i]->length>0)
+			classed[fill[Class(dots[i]->length)]++]=dots[i];
+
+	for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+		if(counts[c])
+			classes[c]=new MortonIndex(classed+starts[c], counts[c]);
+
+	delete [] classed;
+}
+
+SegmentIndex::~SegmentIndex()
+{
+	for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+		delete classes[c];
+}
+
+Coord SegmentIndex::CountBases(Coord x1, Coord y1, Coord x2, Coord y2) const
+{
+	SegmentBaseVisitor visitor;
+	Query(x1, y1, x2, y2, visitor);
+	return visitor.bases;
+}
@@ -0,0 +1,130 @@
+#ifndef _SEGMENTINDEX_H_
+#define _SEGMENTINDEX_H_
+
+#include "Dot.h"
+#include "DotStorageChunk.h"
+#include "MortonIndex.h"
+
+/*
+** SegmentIndex
+** ============
+** a static index of the dots of a store as what they really are: diagonal segments from x,y to x+length-1,y+length-1.
+** It finds every match crossing a rectangle, wherever it starts, and how much of it is inside.
+**
+** The dots are split by length into power of two classes, like the length histogram of a store, and each class gets
+** its own MortonIndex of where its dots start. A segment crossing a rectangle must start in the rectangle stretched up
+** and left by no more than its length, so each class is queried with the rectangle stretched by the longest dot in
+** it. The stretch is small for the short dots there are most of, and the few long matches are caught whole without
+** having to be chopped up by DotStore::Interpolate(). Every candidate is then clipped to the rectangle exactly.
+*/
+
+#define SEGMENT_CLASSES		(sizeof(Coord)*8)
+
+/*
+** Visitors
+** ========
+** a query hands each segment it finds to a visitor as
+**
+**   void Visit(Dot *dot, Coord first, Coord last)
+**
+** where bases first to last (inclusive, counted from 0 at the start of the dot) are the part inside the rectangle.
+*/
+
+// counts the bases of the segments inside the rectangle
+struct SegmentBaseVisitor
+{
+	Coord bases;
+
+	SegmentBaseVisitor() { bases=0; }
+
+	inline void Visit(Dot *dot, Coord first, Coord last) { bases+=last-first+1; }
+};
+
+// clips the start points a MortonIndex query finds to the rectangle, and passes on the segments that reach it
+template<class Visitor> struct SegmentClipVisitor
+{
+	Visitor *visitor;
+	Coord x1, y1, x2, y2;
+
+	inline void Visit(Dot *dot)
+	{
+		Coord first=0, last=dot->length-1;
+		if(x1-dot->x>first) first=x1-dot->x;
+		if(y1-dot->y>first) first=y1-dot->y;
+		if(x2-dot->x<last) last=x2-dot->x;
+		if(y2-dot->y<last) last=y2-dot->y;
+		if(first<=last)
+			visitor->Visit(dot, first, last);
+	}
+	inline void VisitRun(const MortonEntry *run, Coord n) { for(Coord i=0; i<n; i++) Visit(run[i].dot); }
+};
+
+class SegmentIndex
+{
+private:
+	MortonIndex *classes[SEGMENT_CLASSES];		// NULL where no dots are that long
+	Coord longest[SEGMENT_CLASSES];			// the longest dot in each
+	Coord num;
+
+	// which class a length goes in. Class n holds the lengths from 2^n up to 2^(n+1)-1
+	static inline int Class(Coord length)
+	{
+		int c=0;
+		while(c<(int)SEGMENT_CLASSES-1 && length>>(c+1))
+			c++;
+		return c;
+	}
+
+	// index the numdots dots pointed to by dots, leaving out the ones with no length
+	void Build(Dot * const *dots, Coord numdots);
+
+public:
+	//! \brief index the numdots dots in the chunks from head on. Dots with no length aren't indexed
+	SegmentIndex(DotStorageChunk *head, Coord numdots);
+
+	//! \brief index the dots a MortonIndex has, so dots at the same x,y are only indexed once as they are there
+	SegmentIndex(const MortonIndex *index);
+	~SegmentIndex();
+
+	//! \brief how many dots are indexed
+	inline Coord GetNum() const
+	{
+		return num;
+	}
+
+	//! \brief hand every segment crossing the rectangle (inclusive) to visitor, with the part of it inside. See
+	//! Visitors above
+	template<class Visitor> void Query(Coord x1, Coord y1, Coord x2, Coord y2, Visitor &visitor) const
+	{
+		assert(x1<=x2);
+		assert(y1<=y2);
+
+		SegmentClipVisitor<Visitor> clip;
+		clip.visitor=&visitor;
+		clip.x1=x1;
+		clip.y1=y1;
+		clip.x2=x2;
+		clip.y2=y2;
+
+		for(int c=0; c<(int)SEGMENT_CLASSES; c++)
+			if(classes[c])
+			{
+				// stretched up and left, stopping at the smallest coordinate rather than wrapping past it
+				Coord stretch=longest[c]-1;
+				Coord sx=(x1<MinCoord()+stretch)?MinCoord():x1-stretch;
+				Coord sy=(y1<MinCoord()+stretch)?MinCoord():y1-stretch;
+				classes[c]->Query(sx, sy, x2, y2, clip);
+			}
+	}
+
+	//! \brief how many bases of the segments are inside the rectangle (inclusive)
+	Coord CountBases(Coord x1, Coord y1, Coord x2, Coord y2) const;
+
+	// the smallest a Coord can be
+	static inline Coord MinCoord()
+	{
+		return (Coord)((unsigned long long)1<<(sizeof(Coord)*8-1));
+	}
+};
+
+#endif
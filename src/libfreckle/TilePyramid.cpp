@@ -0,0 +1,401 @@
+#include "TilePyramid.h"
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+TilePyramid::TilePyramid()
+{
+	numsources=0;
+	sources=NULL;
+	transforms=NULL;
+	scale=1.0;
+	window=0;
+
+	path=NULL;
+	layout=TILEPYRAMID_XYZ;
+	tilesize=TILEPYRAMID_TILESIZE;
+	format=IMAGEWRITER_PNG;
+	mode=DOTGRID_EQUALISE;
+	bits=8;
+	clip=DOTGRID_CLIP;
+	invert=false;
+	ok=false;
+
+	numlevels=0;
+	widths=heights=NULL;
+	bands=NULL;
+	bandfirst=bandrows=NULL;
+	histograms=NULL;
+	sizes=maxes=NULL;
+	levels=NULL;
+}
+
+TilePyramid::~TilePyramid()
+{
+	Free();
+}
+
+void TilePyramid::Free()
+{
+	for(int level=0; level<numlevels; level++)
+	{
+		delete [] bands[level];
+		delete [] histograms[level];
+		if(levels && levels[level])
+			DotGrid::FreeLevels(levels[level],bits);
+	}
+
+	delete [] transforms;
+	delete [] widths;
+	delete [] heights;
+	delete [] bands;
+	delete [] bandfirst;
+	delete [] bandrows;
+	delete [] histograms;
+	delete [] sizes;
+	delete [] maxes;
+	delete [] levels;
+
+	transforms=NULL;
+	widths=heights=NULL;
+	bands=NULL;
+	bandfirst=bandrows=NULL;
+	histograms=NULL;
+	sizes=maxes=NULL;
+	levels=NULL;
+	numlevels=0;
+}
+
+bool TilePyramid::Write(const char *path, int num, DotStore **sources, const GridTransform *transforms, Coord width, Coord height, double scale, int window, int layout, int tilesize, int format, int mode, int bits, double clip, bool invert)
+{
+	assert(num>0);
+	assert(width>0 && height>0 && scale>0.0);
+	assert(tilesize>0 && tilesize%2==0);
+	assert(layout==TILEPYRAMID_XYZ || layout==TILEPYRAMID_DEEPZOOM);
+
+	Free();
+
+	this->path=path;
+	this->numsources=num;
+	this->sources=sources;
+	this->scale=scale;
+	this->window=window;
+	this->layout=layout;
+	this->tilesize=tilesize;
+	this->format=format;
+	this->mode=mode;
+	this->bits=bits;
+	this->clip=clip;
+	this->invert=invert;
+
+	// the finest level covers the whole plot, the last cells running past the end of it. Each level above is half
+	// the size, until the plot fits in one tile, or for deep zoom is one pixel
+	int w=(int)ceil((double)width/scale-1e-9), h=(int)ceil((double)height/scale-1e-9);
+	numlevels=1;
+	for(int lw=w, lh=h; layout==TILEPYRAMID_XYZ?(lw>tilesize || lh>tilesize):(lw>1 || lh>1); numlevels++)
+	{
+		lw=(lw+1)/2;
+		lh=(lh+1)/2;
+	}
+
+	widths=new int[numlevels];
+	heights=new int[numlevels];
+	bands=new int*[numlevels];
+	bandfirst=new int[numlevels];
+	bandrows=new int[numlevels];
+	histograms=new long long*[numlevels];
+	sizes=new int[numlevels];
+	maxes=new int[numlevels];
+	for(int level=0; level<numlevels; level++)
+	{
+		widths[level]=w;
+		heights[level]=h;
+		bands[level]=new int[(size_t)tilesize*w];
+		histograms[level]=NULL;
+		sizes[level]=maxes[level]=0;
+		w=(w+1)/2;
+		h=(h+1)/2;
+	}
+
+	this->transforms=new GridTransform[num];
+	for(int i=0; i<num; i++)
+		this->transforms[i]=DotGrid::SourceTransform(transforms,i,heights[0]);
+
+	// count every level
+	ok=true;
+	Run();
+
+	// and make the levels from the histograms. The counts are scaled down to fit an int if a level has more cells
+	// than that, which the tables only ever use the proportions of
+	levels=new unsigned char*[numlevels];
+	for(int level=0; level<numlevels; level++)
+	{
+		long long *histogram=histograms[level];
+		int max=maxes[level];
+		for(int v=1; v<=max; v++)
+			histogram[v]+=histogram[v-1];
+
+		long long cells=(long long)widths[level]*heights[level];
+		long long factor=cells/INT_MAX+1;
+		int *counts=new int[max+1];
+		for(int v=0; v<=max; v++)
+			counts[v]=(int)(histogram[v]/factor);
+		levels[level]=DotGrid::MakeLevels(counts,max,(int)(cells/factor),mode,bits,clip);
+		delete [] counts;
+	}
+
+	// then write them
+	ok=MakeDirectories();
+	if(ok)
+		Run();
+	if(ok && layout==TILEPYRAMID_DEEPZOOM)
+		ok=WriteDescriptor();
+
+	return ok;
+}
+
+void TilePyramid::Run()
+{
+	for(int level=0; level<numlevels; level++)
+		bandfirst[level]=bandrows[level]=0;
+
+	// the finest level a band at a time from the dots. The others fill up from it
+	int *band=bands[0];
+	for(int row=0; row<heights[0] && ok; row+=tilesize)
+	{
+		int rows=row+tilesize<heights[0]?tilesize:heights[0]-row;
+		memset(band,0,sizeof(int)*widths[0]*rows);
+		for(int i=0; i<numsources; i++)
+			sources[i]->AddGridMatches(band,widths[0],rows,0.0,0.0,scale,window,row,transforms+i);
+
+		bandfirst[0]=row;
+		bandrows[0]=rows;
+		Emit(0);
+	}
+}
+
+void TilePyramid::Emit(int level)
+{
+	if(levels)
+		WriteTiles(level);
+	else
+		Count(level);
+
+	if(level+1<numlevels)
+	{
+		Reduce(level);
+
+		// a band of the level above is done when it is full, or reaches the bottom of its level
+		int next=level+1;
+		if(bandrows[next]==tilesize || bandfirst[next]+bandrows[next]==heights[next])
+			Emit(next);
+	}
+
+	bandfirst[level]+=bandrows[level];
+	bandrows[level]=0;
+}
+
+void TilePyramid::Reduce(int level)
+{
+	int width=widths[level], rows=bandrows[level];
+	const int *from=bands[level];
+	int *to=bands[level+1]+(size_t)bandrows[level+1]*widths[level+1];
+
+	// bands start on even rows, so only the last one of a level can end with a row on its own
+	for(int y=0; y<rows; y+=2)
+	{
+		const int *top=from+(size_t)y*width, *bottom=y+1<rows?top+width:NULL;
+		for(int x=0; x<width; x+=2)
+		{
+			long long sum=top[x];
+			int n=1;
+			if(x+1<width)
+			{
+				sum+=top[x+1];
+				n++;
+			}
+			if(bottom)
+			{
+				sum+=bottom[x];
+				n++;
+				if(x+1<width)
+				{
+					sum+=bottom[x+1];
+					n++;
+				}
+			}
+			*to++=(int)((sum+n-1)/n);
+		}
+	}
+
+	bandrows[level+1]+=(rows+1)/2;
+}
+
+void TilePyramid::Count(int level)
+{
+	long long *&histogram=histograms[level];
+	int &size=sizes[level], &max=maxes[level];
+
+	// grown as bigger values turn up, as DotGrid::CountValues() does
+	if(!histogram)
+	{
+		size=256;
+		histogram=new long long[size];
+		memset(histogram,0,sizeof(long long)*size);
+	}
+
+	const int *values=bands[level];
+	int num=widths[level]*bandrows[level];
+	for(int pos=0; pos<num; pos++)
+	{
+		int value=values[pos];
+		assert(value>=0);
+		if(value>=size)
+		{
+			int newsize=size;
+			while(value>=newsize)
+				newsize*=2;
+			long long *bigger=new long long[newsize];
+			memcpy(bigger,histogram,sizeof(long long)*size);
+			memset(bigger+size,0,sizeof(long long)*(newsize-size));
+			delete [] histogram;
+			histogram=bigger;
+			size=newsize;
+		}
+		histogram[value]++;
+		if(value>max)
+			max=value;
+	}
+}
+
+void TilePyramid::WriteTiles(int level)
+{
+	int width=widths[level], rows=bandrows[level];
+	int columns=(width+tilesize-1)/tilesize, tilerow=bandfirst[level]/tilesize;
+	const int *band=bands[level];
+	const unsigned char *lut=levels[level];
+	bool pad=layout==TILEPYRAMID_XYZ;
+	int failed=0;
+
+	// every tile is a file of its own, so they are shared out between threads
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) reduction(+:failed)
+#endif
+	for(int column=0; column<columns; column++)
+	{
+		int x1=column*tilesize;
+		int cellwidth=x1+tilesize<width?tilesize:width-x1;
+		int tilewidth=pad?tilesize:cellwidth, tileheight=pad?tilesize:rows;
+
+		char *name=new char[strlen(path)+64];
+		TilePath(name,level,column,tilerow);
+
+		int *values=new int[tilewidth];
+		unsigned char *row=new unsigned char[tilewidth*(bits/8)];
+		ImageWriter writer;
+		bool written=writer.Open(name,tilewidth,tileheight,format,bits);
+		for(int y=0; y<tileheight && written; y++)
+		{
+			memset(values,0,sizeof(int)*tilewidth);
+			if(y<rows)
+				memcpy(values,band+(size_t)y*width+x1,sizeof(int)*cellwidth);
+			DotGrid::LookUp(row,values,tilewidth,lut,bits);
+			written=writer.WriteRows(row,1,invert);
+		}
+		written=writer.Close() && written;
+		if(!written)
+			failed++;
+
+		delete [] row;
+		delete [] values;
+		delete [] name;
+	}
+
+	if(failed)
+		ok=false;
+}
+
+void TilePyramid::TilePath(char *name, int level, int column, int row) const
+{
+	const char *extension=format==IMAGEWRITER_PNG?"png":"pgm";
+	int zoom=numlevels-1-level;
+
+	if(layout==TILEPYRAMID_XYZ)
+		sprintf(name,"%s/%d/%d/%d.%s",path,zoom,column,row,extension);
+	else
+		sprintf(name,"%s_files/%d/%d_%d.%s",path,zoom,column,row,extension);
+}
+
+// a directory, unless it is there already
+static bool MakeDirectory(const char *name)
+{
+	if(mkdir(name,0777)==0 || errno==EEXIST)
+		return true;
+
+	printf("TilePyramid: could not create directory %s\n",name);
+	return false;
+}
+
+bool TilePyramid::MakeDirectories()
+{
+	char *name=new char[strlen(path)+64];
+	bool made;
+
+	if(layout==TILEPYRAMID_XYZ)
+	{
+		// path/z/x for every column of every zoom
+		made=MakeDirectory(path);
+		for(int level=0; level<numlevels && made; level++)
+		{
+			int zoom=numlevels-1-level;
+			sprintf(name,"%s/%d",path,zoom);
+			made=MakeDirectory(name);
+
+			int columns=(widths[level]+tilesize-1)/tilesize;
+			for(int column=0; column<columns && made; column++)
+			{
+				sprintf(name,"%s/%d/%d",path,zoom,column);
+				made=MakeDirectory(name);
+			}
+		}
+	}
+	else
+	{
+		sprintf(name,"%s_files",path);
+		made=MakeDirectory(name);
+		for(int level=0; level<numlevels && made; level++)
+		{
+			sprintf(name,"%s_files/%d",path,numlevels-1-level);
+			made=MakeDirectory(name);
+		}
+	}
+
+	delete [] name;
+	return made;
+}
+
+bool TilePyramid::WriteDescriptor()
+{
+	char *name=new char[strlen(path)+64];
+	sprintf(name,"%s.dzi",path);
+	FILE *out=fopen(name,"w");
+	if(!out)
+	{
+		printf("TilePyramid: could not create %s\n",name);
+		delete [] name;
+		return false;
+	}
+
+	fprintf(out,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(out,"<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"%s\" Overlap=\"0\" TileSize=\"%d\">\n",format==IMAGEWRITER_PNG?"png":"pgm",tilesize);
+	fprintf(out,"  <Size Width=\"%d\" Height=\"%d\"/>\n",widths[0],heights[0]);
+	fprintf(out,"</Image>\n");
+
+	bool written=fclose(out)==0;
+	delete [] name;
+	return written;
+}
@@ -0,0 +1,110 @@
+#ifndef _TILEPYRAMID_H_
+#define _TILEPYRAMID_H_
+
+#include "DotGrid.h"
+
+/*
+** TilePyramid
+** ===========
+** writes a dot plot out as a pyramid of image tiles for a zoomable viewer. The finest level is worked out from the dots
+** a band of tile rows at a time, and each coarser level is made from the one below it as the bands go by, every cell
+** the mean of the two by two below it (rounded up, so a lone dot never fades away). Only one band of each level is
+** ever held, so the plot can be far bigger than memory.
+**
+** Each level is normalised as DotGrid::ToString() would normalise the whole level, so the pyramid is made twice: once
+** to gather the histograms, and again to write the tiles. The tiles of a band are written by several threads at once.
+**
+** The tiles are laid out in one of two ways:
+**	TILEPYRAMID_XYZ		path/z/x/y.png. Zoom 0 is the whole plot in one tile, and every tile is full size,
+**				padded out with empty cells past the edges of the plot
+**	TILEPYRAMID_DEEPZOOM	path.dzi and path_files/level/column_row.png, with levels down to a single pixel,
+**				tiles at the edges cut short, and no overlap
+*/
+
+#define TILEPYRAMID_XYZ		0
+#define TILEPYRAMID_DEEPZOOM	1
+
+#define TILEPYRAMID_TILESIZE	256
+
+class TilePyramid
+{
+private:
+	// what is tiled
+	int numsources;
+	DotStore **sources;
+	GridTransform *transforms;
+	double scale;
+	int window;
+
+	// and how
+	const char *path;
+	int layout, tilesize, format, mode, bits;
+	double clip;
+	bool invert;
+	bool ok;
+
+	// the levels, finest first. Each has a band of up to tilesize rows filling up, starting at row bandfirst
+	int numlevels;
+	int *widths, *heights;
+	int **bands;
+	int *bandfirst, *bandrows;
+
+	// the histogram of every level, and the lookup tables made from them. levels is NULL while they are counted
+	long long **histograms;
+	int *sizes, *maxes;
+	unsigned char **levels;
+
+	// make every level from the dots, counting or writing each band as it fills
+	void Run();
+
+	// a band of level is done with: count or write it, and pass it on to the next level up
+	void Emit(int level);
+
+	// the two by two means of the band of level, added on to the band of the level above
+	void Reduce(int level);
+
+	void Count(int level);
+	void WriteTiles(int level);
+
+	// where a tile goes, and the directories it goes in
+	void TilePath(char *name, int level, int column, int row) const;
+	bool MakeDirectories();
+	bool WriteDescriptor();
+
+	void Free();
+
+public:
+	TilePyramid();
+	~TilePyramid();
+
+	//! \brief write the tiles of the plot the sources make together under path
+	//! \details the sources and transforms are as for DotGrid::CalculateGrid(). The plot is width by height bases,
+	//! and the cells of the finest level are scale across, counted as DotStore::AddGridMatches() counts them. The
+	//! stores must be indexed
+	//! \param layout TILEPYRAMID_XYZ or TILEPYRAMID_DEEPZOOM
+	//! \param tilesize the width and height of a tile. It must be even
+	//! \param format, mode, bits, clip and invert are as for DotGrid::WriteImage()
+	//! \return false if any tile couldn't be written
+	bool Write(const char *path, int num, DotStore **sources, const GridTransform *transforms, Coord width, Coord height, double scale, int window, int layout=TILEPYRAMID_XYZ, int tilesize=TILEPYRAMID_TILESIZE, int format=IMAGEWRITER_PNG, int mode=DOTGRID_EQUALISE, int bits=8, double clip=DOTGRID_CLIP, bool invert=false);
+
+	//! \brief how many levels the last pyramid written has
+	inline int GetNumLevels() const
+	{
+		return numlevels;
+	}
+
+	//! \brief the size of a level of the last pyramid written, in cells. Level 0 is the coarsest, as in the layout
+	inline int GetLevelWidth(int level) const
+	{
+		assert(level>=0 && level<numlevels);
+		return widths[numlevels-1-level];
+	}
+
+	inline int GetLevelHeight(int level) const
+	{
+		assert(level>=0 && level<numlevels);
+		return heights[numlevels-1-level];
+	}
+};
+
+#endif
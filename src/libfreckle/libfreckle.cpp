@@ -35,6 +35,9 @@ const char *Bases="ACGTN";							// N means UNKNOWN
 const char *Aminos="ACDEFGHIKLMNPQRSTVWY-.";					// - = stop codon    . means UNKNOWN
 const char *TranslateUniversal="KNKNTTTTRSRSIIMIQHQHPPPPRRRRLLLLEDEDAAAAGGGGVVVV-Y-YSSSS-CWCLFLF";
 
+// so the higher level language can tell which coordinate layout this library was built with
+const int CoordSize=sizeof(Coord);
+
 /**
 ** \brief calculates the nth power of x.
 ** \details Uses tail recursion to calculate x to the power on n
@@ -112,11 +115,11 @@ TupleID getTupleID(const char *tuple, int len, const char *bases)
 */
 TupleStore **buildMappingTables( const char *sequence, int ktuplesize, const char *bases )
 {
-	int seqlen=strlen(sequence);
+	Coord seqlen=strlen(sequence);
 	assert(seqlen>0);
 
 	TupleStore ktuplearraysize=uipow(BASE_PAIRS(bases),ktuplesize);
-	int darraysize=seqlen-ktuplesize+1;
+	Coord darraysize=seqlen-ktuplesize+1;
 	
 	// we allocate our arrays
 	TupleStore *C=new TupleStore [ktuplearraysize];
@@ -128,7 +131,7 @@ TupleStore **buildMappingTables( const char *sequence, int ktuplesize, const cha
 
 	// Initialise D
 	const char *tuple=sequence;
-	for(int i=0; i<darraysize; i++, tuple++)
+	for(Coord i=0; i<darraysize; i++, tuple++)
 		//read the ith tuple from the sequence. Put its tuple id into D
 		D[i]=getTupleID(tuple,ktuplesize,bases);
 
@@ -136,7 +139,7 @@ TupleStore **buildMappingTables( const char *sequence, int ktuplesize, const cha
 	tuple=sequence;
 	TupleStore cval=0;
 	TupleStore dval=0;
-	for(int i=0; i<darraysize; i++, tuple++)
+	for(Coord i=0; i<darraysize; i++, tuple++)
 	{
 // 		printf("%d\n",i);
 		// the index, i, of D is assigned to C[D[i]]. So if D[1]=3, then C[3]=1
@@ -175,7 +178,7 @@ TupleStore **buildMappingTables( const char *sequence, int ktuplesize, const cha
 ** \return Nothing
 ** \see buildMappingTables
 */
-void freeMappingTables(int **tables)
+void freeMappingTables(TupleStore **tables)
 {
 	delete tables[0];
 	delete tables[1];
@@ -210,7 +213,7 @@ int sum(int *buffer, int length)
 ** \param mismatch How many mismatches to allow during the scan per window size for it still to be considered "a match"
 ** \param window The size of the window for appraising mismatches.
 */
-int matchAboveThreshold(const char *seq1, int p1, const char *seq2, int p2, int k, int mismatch, int window)
+Coord matchAboveThreshold(const char *seq1, Coord p1, const char *seq2, Coord p2, int k, int mismatch, int window)
 {
 	assert(window>0);
 	//assert(k>0);				//k=0 for methods 2 and 3 where we are using a coded ktuple to initiate these search locations
@@ -218,7 +221,7 @@ int matchAboveThreshold(const char *seq1, int p1, const char *seq2, int p2, int
 	
 	memset(ringbuf,0,sizeof(ringbuf));
 
-	int matchlength=0;
+	Coord matchlength=0;
 
 	const char *s1=seq1+p1;
 	const char *s2=seq2+p2;
@@ -251,46 +254,85 @@ int matchAboveThreshold(const char *seq1, int p1, const char *seq2, int p2, int
 ** \param window the window for appraising mismatches in matched subsequences
 ** \param mismatch how many characters per window can be allowed to mismatch for it still to be considered "matching"
 ** \param minmatch the minimum match length to store a dot for. This must be at least the size of the ktuple.
+** \param checkpoint if given, progress is checkpointed to it and a checkpointed comparison of the same inputs is resumed
+*/
+DotStore *doComparison(TupleStore **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, const char *bases, ComparisonCheckpoint *checkpoint )
+{
+	DotStore *dotstore=new DotStore();
+	DotStoreSink sink(dotstore);
+	doComparisonToSink(tables, tablesequence, newsequence, ktuplesize, window, mismatch, minmatch, &sink, bases, checkpoint);
+	return dotstore;
+}
+
+/**
+** \brief doComparison(), but the dots go to sink as they are found instead of into a new DotStore
+** \details the sink is closed at the end
+** \return false if the sink could not keep all the dots
 */
-DotStore *doComparison(unsigned int **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, const char *bases )
+bool doComparisonToSink(TupleStore **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, DotSink *sink, const char *bases, ComparisonCheckpoint *checkpoint )
 {
 	assert(mismatch<=window);
 	assert(window>=ktuplesize);
 
 	printf("doComparison(): tableseq=%d newseq=%d bases=%d\n",(int)strlen(tablesequence),(int)strlen(newsequence),(int)strlen(bases));
 
-	unsigned int *C, *D;
-	DotStore *dotstore=new DotStore();
+	TupleStore *C, *D;
 	C=tables[0];
 	D=tables[1];
 
-	int newseqlen=(int)strlen(newsequence);
+	// comparing a sequence against itself gives a plot that is symmetric about the diagonal. We only need one half
+	bool self=(tablesequence==newsequence || !strcmp(tablesequence,newsequence));
+	sink->SetSymmetric(self);
+
+	Coord newseqlen=(Coord)strlen(newsequence);
 	assert(newseqlen>0);
 
-	int darraysize=newseqlen-ktuplesize+1;
+	Coord darraysize=newseqlen-ktuplesize+1;
+
+	// pick up where a checkpointed run of the same comparison got to
+	int strand=0;
+	Coord start=0;
+	if(checkpoint)
+	{
+		unsigned long long baseshash=ComparisonCheckpoint::Hash(bases,strlen(bases),"",0,NULL,0);
+		int parameters[]={1, ktuplesize, window, mismatch, minmatch, (int)baseshash, (int)(baseshash>>32)};
+		unsigned long long hash=ComparisonCheckpoint::Hash(tablesequence,strlen(tablesequence),newsequence,newseqlen,parameters,sizeof(parameters)/sizeof(int));
+		checkpoint->Start(hash,sink,sink,&strand,&start);
+		sink=checkpoint->GetSink(0,sink);
+	}
 
 	// go through each k-tuple on the newsequence
-	const char *tuple=newsequence;
+	const char *tuple=newsequence+start;
 	int tupleid=0;
-	printf("%d\n",darraysize);
-	for(int i=0; i<darraysize; i++, tuple++)
+	printf("%lld\n",(long long)darraysize);
+	for(Coord i=start; i<darraysize; i++, tuple++)
 	{
+		if(checkpoint && !(i&CHECKPOINT_CHECKMASK))
+			checkpoint->Reached(0,i);
+
 		// first we get the id of this tuple
 		tupleid=getTupleID(tuple,ktuplesize,bases);
 		
 		//now we look it up in the table C to find the last occurance, and move backwards 
 		//through the linked list expressed in table D
-		for(int position=C[tupleid-1]; position; position=D[position-1])
+		for(Coord position=C[tupleid-1]; position; position=D[position-1])
 		{
+			// the other half is the mirror of this one
+			if(self && position-1<i)
+				continue;
+
 			// so position is a tuple position match in the tabled sequence
 			// now we search forward to see how long the match is (with threshold)
-			int matchlen=matchAboveThreshold(tablesequence,position-1,newsequence,i,ktuplesize,mismatch,window);
+			Coord matchlen=matchAboveThreshold(tablesequence,position-1,newsequence,i,ktuplesize,mismatch,window);
 			if(matchlen>=minmatch)
-				dotstore->AddDot(position-1,i,matchlen);
+				sink->AddDot(position-1,i,matchlen);
 		}
 	}
 	
-	return dotstore;
+	bool ok=sink->Close();
+	if(checkpoint && ok)
+		checkpoint->Finish();
+	return ok;
 }
 
 /*
@@ -312,7 +354,7 @@ DotStore *makeDotComparison(const char *seq1, const char *seq2, int ktuplesize,
 char **convertSequence(const char *sequence)
 {
 	printf("convertSequence()\n");
-	int seqlen=strlen(sequence);
+	Coord seqlen=strlen(sequence);
 
 	//translation table
 	TupleID codetablelen=strlen(TranslateUniversal);
@@ -327,13 +369,13 @@ char **convertSequence(const char *sequence)
 		memset(results[i],0,sizeof(char)*(seqlen/3+1));
 	}
 
-	printf("seqlen=%d, %d\n",seqlen,seqlen/3);
-	for(int i=0; i<seqlen/3; i++)
+	printf("seqlen=%lld, %lld\n",(long long)seqlen,(long long)seqlen/3);
+	for(Coord i=0; i<seqlen/3; i++)
 		for (int offset=0; offset<3; offset++)
 		{
 			if(i*3+offset+3<=seqlen)
 			{
-				printf("i:%d offset:%d seq[n]=%s\n",i,offset, sequence+i*3);
+				printf("i:%lld offset:%d seq[n]=%s\n",(long long)i,offset, sequence+i*3);
 				TupleID id=getTupleID(sequence+i*3+offset, 3)-1;
 				assert(id>=0);
 				assert(id<codetablelen);
@@ -360,7 +402,7 @@ DotStore *makeDotComparisonByTranslation(const char *seq1, const char *seq2, int
 	char **seq2translated=convertSequence(seq2);
 
 	//build three mapping tables for the 3 reading frames of sequence 1
-	unsigned int ***mappingtables=new unsigned int **[3];
+	TupleStore ***mappingtables=new TupleStore **[3];
 	for(int i=0; i<3; i++)
 	{
 		printf("=%d=\n",i);
@@ -380,20 +422,23 @@ DotStore *makeDotComparisonByTranslation(const char *seq1, const char *seq2, int
 			printf("s1:%s\n",seq1translated[xframe]);
 			printf("s2:%s\n",seq2translated[yframe]);
 			ds=doComparison( mappingtables[xframe], seq1translated[xframe], seq2translated[yframe], ktuplesize, window, mismatch/3, 1,Aminos);
-			printf("done. %d matches\n",ds->GetNum());
-			for(int num=0; num<ds->GetNum(); num++)
+			printf("done. %lld matches\n",(long long)ds->GetNum());
+
+			// the frames of a self comparison are only stored by half. we need every dot here
+			ds->Unfold();
+			for(Coord num=0; num<ds->GetNum(); num++)
 			{
 				Dot *dot=ds->GetDot(num);
-				int dx=dot->x;
-				int dy=dot->y;
+				Coord dx=dot->x;
+				Coord dy=dot->y;
 				//int length=dot->length;
 
 				// the positions in the original sequences
-				int originalx=dx*3+xframe;
-				int originaly=dy*3+yframe;
+				Coord originalx=dx*3+xframe;
+				Coord originaly=dy*3+yframe;
 
 				// get the original match length
-				int matchlen=matchAboveThreshold(seq1, originalx, seq2, originaly, 0, mismatch, window);
+				Coord matchlen=matchAboveThreshold(seq1, originalx, seq2, originaly, 0, mismatch, window);
 				if(matchlen>=minmatch)
 					dotstore->AddDot(originalx,originaly,matchlen);
 				
@@ -442,9 +487,10 @@ void Init_code_tables()
 
 }
 
-void EncodeNTSeq(const char *seq, int p1, int p2, int *c,int *d, int nm, int nMaxDNAKtup)
+void EncodeNTSeq(const char *seq, Coord p1, Coord p2, Coord *c,Coord *d, int nm, int nMaxDNAKtup)
 {          // c[i] contains last pos +1 of k_tuple No i
-int i, j,m, L=p2-p1+1;
+Coord i, L=p2-p1+1;
+int j,m;
 //char nt;
 int v[64], sv;
 	v[0]=1;
@@ -482,9 +528,10 @@ int v[64], sv;
 
 }
 
-int EncodeNTSeqConditional(const char *seq, int p1, int p2, int *c,int *d,int *cd, int nm, int maxHints, int nMaxDNAKtup)
+int EncodeNTSeqConditional(const char *seq, Coord p1, Coord p2, Coord *c,Coord *d,int *cd, int nm, int maxHints, int nMaxDNAKtup)
 {  //// c[i] contains last pos +1 of k_tuple No i
-int i, j,m, L=p2-p1+1;
+Coord i, L=p2-p1+1;
+int j,m;
 int v[64];
 	v[0]=1;
 	for (i=1;i<nMaxDNAKtup+1;i++) v[i]=v[i-1]*DNAOrder;
@@ -529,7 +576,7 @@ int *stat=new int[sv+1];
 		for(i=0;i<=sv;i++) {
 			if(stat[i]>maxHints) {
 				strncpy(txt,seq+c[i]-1,nm);txt[nm]=0;
-				printf("%s,code %d repeats %d times\n",txt,i, stat[i]);
+				printf("%s,code %lld repeats %d times\n",txt,(long long)i, stat[i]);
 				c[i]=0;
 				num++;
 			}
@@ -569,8 +616,22 @@ char *RCseq(char *a)
 
 }
 
-// This is the obfuscated lbdot original
-DotStore **DoFastComparison(char *Seq1, char *Seq2, int SeqLen1, int SeqLen2, int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup)
+DotStore **DoFastComparison(char *Seq1, char *Seq2, Coord SeqLen1, Coord SeqLen2, int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup, ComparisonCheckpoint *checkpoint)
+{
+	DotStore **result=new DotStore *[2];
+	result[0]=new DotStore();
+	result[1]=new DotStore();
+
+	DotStoreSink forward(result[0]), reverse(result[1]);
+	DoFastComparisonToSinks(Seq1, Seq2, SeqLen1, SeqLen2, CompWind, CompMism, nMaxRepeatKtup, nMaxDNAKtup, &forward, &reverse, checkpoint);
+
+	return result;
+}
+
+// This is the obfuscated lbdot original. The forward strand dots go to PlusDots and the reverse strand ones to MinusDots.
+// Both sinks are closed at the end. With a checkpoint, progress is checkpointed as the outer loops go round and a
+// checkpointed comparison of the same inputs carries on from where it got to
+bool DoFastComparisonToSinks(char *Seq1, char *Seq2, Coord SeqLen1, Coord SeqLen2, int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup, DotSink *PlusDots, DotSink *MinusDots, ComparisonCheckpoint *checkpoint)
 {
 // printf("initcodetables, %d, %d, %d, %d (%d,%d)\n",CompWind, CompMism, nMaxRepeatKtup, nMaxDNAKtup,SeqLen1,SeqLen2);
 // 
@@ -590,19 +651,29 @@ DotStore **DoFastComparison(char *Seq1, char *Seq2, int SeqLen1, int SeqLen2, in
 // 		printf("%c",*c);
 // printf("\n\n");
 
-DotStore **result=new DotStore *[2];
-
 Init_code_tables();
 
-DotStore *PlusDotArray=new DotStore();
-DotStore *MinusDotArray=new DotStore();
+// a sequence against itself only finds the dots on and above the diagonal. A store reflects the rest
+PlusDots->SetSymmetric(Seq1==Seq2);
+
+// hash the inputs before the reverse strand pass turns Seq2 around
+int resumestrand=0;
+Coord resumeposition=0;
+if(checkpoint){
+	int parameters[]={0, CompWind, CompMism, nMaxRepeatKtup, nMaxDNAKtup, Seq1==Seq2};
+	unsigned long long hash=ComparisonCheckpoint::Hash(Seq1,SeqLen1,Seq2,SeqLen2,parameters,sizeof(parameters)/sizeof(int));
+	checkpoint->Start(hash,PlusDots,MinusDots,&resumestrand,&resumeposition);
+	PlusDots=checkpoint->GetSink(0,PlusDots);
+	MinusDots=checkpoint->GetSink(1,MinusDots);
+}
 
-int x,i,ix,j,cmpNum, ic, ct, ctt, nBreak;
+Coord i,ix,j,ct,ctt;
+int cmpNum, ic, nBreak;
 int CompUnit=CompWind;
 int CompErr=CompMism;
 int CompKtup;
-int Length1=SeqLen1;
-int Length2=SeqLen2;
+Coord Length1=SeqLen1;
+Coord Length2=SeqLen2;
 bool bRCSeq=false, ok=true;
 
 int Reject1=0, Reject2=0;
@@ -610,8 +681,8 @@ int nQualified=0;
 Dot cp;
 char *s1= Seq1;
 char *s2= Seq2;
-int ONE=1, *pc;
-int *d1, *c1;
+Coord ONE=1, *pc;
+Coord *d1, *c1;
 int v[64], pos, scs, dp=-CompErr;
 char *sc=new char [CompUnit+2];
 
@@ -630,8 +701,8 @@ char *sc=new char [CompUnit+2];
 // 			CompWind,CompMism,CompKtup);
 
 	int pm=v[CompKtup];
-	c1=new int [pm+2];
-	d1=new int [Length1+2];
+	c1=new Coord [pm+2];
+	d1=new Coord [Length1+2];
 int *cd=new int [Length1+2];
 	for (i=0;i<=Length1; i++) cd[i]=0;
 
@@ -645,7 +716,7 @@ int *cd=new int [Length1+2];
 	}
 
 // 	printf("Comparing...\n");
-	for (ic=0;ic<cmpNum&&ok;ic++)  {
+	for (ic=resumestrand;ic<cmpNum&&ok;ic++)  {
 		Reject1=Reject2=0;
 		nQualified=0;
 		if(ic==1) {
@@ -656,15 +727,17 @@ int *cd=new int [Length1+2];
 		pc=(Seq1==Seq2&&!bRCSeq)?&j:&ONE;
 
 
-		int dd=Length2-CompKtup;
-		int ddt=dd/100+1;
+		Coord dd=Length2-CompKtup;
+		Coord ddt=dd/100+1;
 
 		if(Length2<pm*2){//bUseLessMem
 		////////when Length2>pm*2 the next method may run faster 
 		////////due to repetitive instructions with lookup table
 //////////////////////////////////////////////////////////////////////
 /////////////Here is the different block from above method/////+ j=d2[j] }
-			for(j=1;j<dd&&ok;j++){
+			for(j=(ic==resumestrand&&resumeposition)?resumeposition:1;j<dd&&ok;j++){
+				if(checkpoint && !(j&CHECKPOINT_CHECKMASK))
+					checkpoint->Reached(ic,j);
 				i=GetNtCode(s2+j-1,CompKtup,1, v);
 				if (i<0) continue;
 ////////////////////////////////////////////////////////////
@@ -734,14 +807,9 @@ int *cd=new int [Length1+2];
 					cp.x=ix-1;cp.y=j-1;cp.length=ct;
 
 					if(bRCSeq) {
-						MinusDotArray->AddDot(cp.x,cp.y,cp.length);
+						MinusDots->AddDot(cp.x,cp.y,cp.length);
 					} else {
-						PlusDotArray->AddDot(cp.x,cp.y,cp.length);
-							if(*pc>1){/// Add mirror point
-								x=cp.x; cp.x=cp.y; cp.y=x;
-								PlusDotArray->AddDot(cp.x,cp.y,cp.length);
-								x=cp.x; cp.x=cp.y; cp.y=x;
-							}
+						PlusDots->AddDot(cp.x,cp.y,cp.length);		/// mirror point is synthesised by the symmetric store
 					}
 
 					ix=d1[ix];
@@ -751,15 +819,15 @@ int *cd=new int [Length1+2];
 //				}
 			}
 		} else {
-			int *c2=NULL;
-			int *d2=NULL; 
+			Coord *c2=NULL;
+			Coord *d2=NULL; 
 
 			if(Seq1==Seq2&&!bRCSeq){
 				c2=c1; d2=d1;
 				pc=&j;
 			} else {
 				pc=&ONE;
-				c2=new int [pm+2];d2=new int [Length2+2];
+				c2=new Coord [pm+2];d2=new Coord [Length2+2];
 				EncodeNTSeq(s2,0,Length2-1, c2,d2, CompKtup, nMaxDNAKtup);
 			}
 
@@ -767,7 +835,9 @@ int *cd=new int [Length1+2];
 			ddt=pm/100+1;
 //////////////////////////////////////////////////////////////////////
 /////////////Here is the different block from above method/////+ j=d2[j] }
-			for (i=0;i<pm&&ok;i++){
+			for (i=(ic==resumestrand)?resumeposition:0;i<pm&&ok;i++){
+				if(checkpoint && !(i&CHECKPOINT_CHECKMASK))
+					checkpoint->Reached(ic,i);
 				if(c1[i]<1) continue; /// ignore if the other seq no such k-tuple
 				j=c2[i];
 				while(j>0){
@@ -836,14 +906,9 @@ int *cd=new int [Length1+2];
 						cp.x=ix-1;cp.y=j-1;cp.length=ct;
 
 						if(bRCSeq) {
-							MinusDotArray->AddDot(cp.x,cp.y,cp.length);
+							MinusDots->AddDot(cp.x,cp.y,cp.length);
 						} else {
-							PlusDotArray->AddDot(cp.x,cp.y,cp.length);
-							if(*pc>1){/// Add mirror point
-								x=cp.x; cp.x=cp.y; cp.y=x;
-								PlusDotArray->AddDot(cp.x,cp.y,cp.length);
-								x=cp.x; cp.x=cp.y; cp.y=x;
-							}
+							PlusDots->AddDot(cp.x,cp.y,cp.length);		/// mirror point is synthesised by the symmetric store
 						}
 
 						ix=d1[ix];
@@ -863,15 +928,11 @@ int *cd=new int [Length1+2];
 
 	if(Seq1==Seq2)delete s2;
 
-// 	delete MinusDotArray;
-	
-	//PlusDotArray->Interpolate(CompWind);
-	//MinusDotArray->Interpolate(CompWind);
-
-// 	return PlusDotArray;
-	result[0]=PlusDotArray;
-	result[1]=MinusDotArray;
-	return result;
+	bool plusok=PlusDots->Close();
+	bool minusok=MinusDots->Close();
+	if(checkpoint && plusok && minusok)
+		checkpoint->Finish();
+	return plusok && minusok;
 /*
 	return CompKtup;*/
 };
@@ -881,29 +942,90 @@ int *cd=new int [Length1+2];
 */
 DotStore *NewDotStore() { return new DotStore(); }
 void DelDotStore(DotStore *store) { delete store; } 
-void DotStoreAddDot(DotStore *store, int x, int y, int len) { store->AddDot(x,y,len); }
-int DotStoreGetDotX(DotStore *store, int index) { return store->GetDot(index)->x; }
-int DotStoreGetDotY(DotStore *store, int index) { return store->GetDot(index)->y; }
-int DotStoreGetDotLength(DotStore *store, int index) { return store->GetDot(index)->length; }
-Dot *DotStoreGetDot(DotStore *store, int index) { return store->GetDot(index); }
-int DotStoreGetNumDots(DotStore *store) { return store->GetNum(); }
+void DotStoreAddDot(DotStore *store, Coord x, Coord y, Coord len) { store->AddDot(x,y,len); }
+Coord DotStoreGetDotX(DotStore *store, Coord index) { return store->GetDot(index)->x; }
+Coord DotStoreGetDotY(DotStore *store, Coord index) { return store->GetDot(index)->y; }
+Coord DotStoreGetDotLength(DotStore *store, Coord index) { return store->GetDot(index)->length; }
+Dot *DotStoreGetDot(DotStore *store, Coord index) { return store->GetDot(index); }
+Coord DotStoreGetNumDots(DotStore *store) { return store->GetNum(); }
 void DotStoreCreateIndex(DotStore *store) { store->CreateIndex(); }
 void DotStoreDestroyIndex(DotStore *store) { store->DestroyIndex(); }
-int *DotStoreToBuffer(DotStore *store) { return store->ToBuffer(); }
-void DotStoreFromBuffer(DotStore *store, int *buffer) { store->FromBuffer(buffer); }
-int DotStoreBufferSize(DotStore *store, int *buffer) { return store->BufferSize(buffer); }
-void FreeIntBuffer(int *buffer) { assert(buffer); delete buffer; }
-DotStore *DotStoreFilter(DotStore *store, int minlen) { return store->Filter(minlen); } 
+Coord *DotStoreToBuffer(DotStore *store) { return store->ToBuffer(); }
+void DotStoreFromBuffer(DotStore *store, Coord *buffer) { store->FromBuffer(buffer); }
+Coord DotStoreBufferSize(DotStore *store, Coord *buffer) { return store->BufferSize(buffer); }
+void FreeIntBuffer(Coord *buffer) { assert(buffer); delete [] buffer; }
+DotStore *DotStoreFilter(DotStore *store, Coord minlen) { return store->Filter(minlen); } 
+void DotStoreFilterInPlace(DotStore *store, Coord minlen) { store->FilterInPlace(minlen); }
 void DotStoreInterpolate(DotStore *store, int window) { store->Interpolate(window); }
-
-void DotStoreSetMaxX(DotStore *store, int max) {store->SetMaxX(max);}
-void DotStoreSetMaxY(DotStore *store, int max) {store->SetMaxY(max);}
-int DotStoreGetMaxX(DotStore *store) {return store->GetMaxX();}
-int DotStoreGetMaxY(DotStore *store) {return store->GetMaxY();}
+void DotStoreSetSymmetric(DotStore *store, int symmetric) { store->SetSymmetric(symmetric!=0); }
+int DotStoreIsSymmetric(DotStore *store) { return store->IsSymmetric(); }
+void DotStoreUnfold(DotStore *store) { store->Unfold(); }
+Coord DotStoreGetLogicalNumDots(DotStore *store) { return store->GetLogicalNum(); }
+void DotStoreAppend(DotStore *store, DotStore *other, Coord dx, Coord dy) { store->Append(other,dx,dy); }
+void DotStoreOffset(DotStore *store, Coord dx, Coord dy) { store->Offset(dx,dy); }
+void DotStoreFlipX(DotStore *store, Coord xlength) { store->FlipX(xlength); }
+void DotStoreFlipY(DotStore *store, Coord ylength) { store->FlipY(ylength); }
+void DotStoreTranspose(DotStore *store) { store->Transpose(); }
+int DotStoreNumHistogramBins() { return DOTSTORE_HISTOGRAMBINS; }
+long long DotStoreGetLengthHistogram(DotStore *store, int bin) { return store->GetLengthHistogram(bin); }
+long long DotStoreGetTotalBases(DotStore *store) { return store->GetTotalBases(); }
+Coord DotStoreGetMinLength(DotStore *store) { return store->GetMinLength(); }
+Coord DotStoreGetMaxLength(DotStore *store) { return store->GetMaxLength(); }
+Coord DotStoreLengthThreshold(DotStore *store, Coord n) { return store->LengthThreshold(n); }
+void DotStoreSetMemoryLimit(DotStore *store, long long bytes, const char *tmpdir) { store->SetMemoryLimit(bytes, tmpdir); }
+void SetDefaultDotStoreMemoryLimit(long long bytes, const char *tmpdir) { DotStore::SetDefaultMemoryLimit(bytes, tmpdir); }
+
+// dot plot file sections. these return the offset just after the section, or -1 on failure
+long long DotStoreWriteSection(DotStore *store, int fd, long long offset) { DotFile file(fd, offset); return file.Write(store); }
+long long DotStoreReadSection(DotStore *store, int fd, long long offset) { DotFile file(fd, offset); return file.Read(store)?file.GetEnd():-1; }
+long long DotStoreReadSectionRegion(DotStore *store, int fd, long long offset, Coord x1, Coord y1, Coord x2, Coord y2) { DotFile file(fd, offset); return file.ReadRegion(store,x1,y1,x2,y2)?file.GetEnd():-1; }
+
+// native dot files that are mapped rather than read
+int DotStoreWriteMapFile(DotStore *store, const char *path) { return store->WriteMapFile(path); }
+int DotStoreMapFile(DotStore *store, const char *path) { return store->MapFile(path); }
+
+// dot sinks, for sending the dots of a comparison somewhere other than a new DotStore
+DotSink *NewDotStoreSink(DotStore *store) { return new DotStoreSink(store); }
+DotSink *NewDotFileSink(const char *path) { return new DotFileSink(path); }
+DotSink *NewFilterDotSink(DotSink *next, Coord minlength) { return new FilterDotSink(next, minlength); }
+CountingDotSink *NewCountingDotSink() { return new CountingDotSink(); }
+void DelDotSink(DotSink *sink) { delete sink; }
+int DotSinkClose(DotSink *sink) { return sink->Close(); }
+Coord CountingDotSinkGetNum(CountingDotSink *sink) { return sink->GetNum(); }
+Coord CountingDotSinkGetLogicalNum(CountingDotSink *sink) { return sink->GetLogicalNum(); }
+long long CountingDotSinkGetTotalBases(CountingDotSink *sink) { return sink->GetTotalBases(); }
+
+// tab separated text export
+DotExporter *NewDotExporter() { return new DotExporter(); }
+void DelDotExporter(DotExporter *exporter) { delete exporter; }
+int DotExporterOpen(DotExporter *exporter, const char *path, int compress) { return exporter->Open(path, compress!=0); }
+void DotExporterSetRecords(DotExporter *exporter, int axis, int num, const Coord *starts, const char * const *names) { exporter->SetRecords(axis, num, starts, names); }
+int DotExporterWrite(DotExporter *exporter, DotStore *store, char strand, Coord xoffset, Coord yoffset, Coord ylength, Coord minlength) { return exporter->Write(store, strand, xoffset, yoffset, ylength, minlength); }
+int DotExporterClose(DotExporter *exporter) { return exporter->Close(); }
+
+// checkpoints for the comparison engines
+ComparisonCheckpoint *NewComparisonCheckpoint(const char *path, int interval) { return new ComparisonCheckpoint(path, interval); }
+void DelComparisonCheckpoint(ComparisonCheckpoint *checkpoint) { delete checkpoint; }
+
+void DotStoreSetMaxX(DotStore *store, Coord max) {store->SetMaxX(max);}
+void DotStoreSetMaxY(DotStore *store, Coord max) {store->SetMaxY(max);}
+Coord DotStoreGetMaxX(DotStore *store) {return store->GetMaxX();}
+Coord DotStoreGetMaxY(DotStore *store) {return store->GetMaxY();}
 
 // conservation helper functions
-Dot *DotStoreGetIndexLongestMatchingRowDot(DotStore *store, int x) { return store->GetIndexLongestMatchingRowDot(x); }
-Dot *DotStoreGetIndexLongestMatchingColumnDot(DotStore *store, int y) { return store->GetIndexLongestMatchingColumnDot(y); }
+Dot *DotStoreGetIndexLongestMatchingRowDot(DotStore *store, Coord x) { return store->GetIndexLongestMatchingRowDot(x); }
+Dot *DotStoreGetIndexLongestMatchingColumnDot(DotStore *store, Coord y) { return store->GetIndexLongestMatchingColumnDot(y); }
+MatchProfile *DotStoreGetProfile(DotStore *store) { return store->GetProfile(); }
+Coord DotStoreCountAreaBases(DotStore *store, Coord x1, Coord y1, Coord x2, Coord y2) { return store->CountAreaBases(x1, y1, x2, y2); }
+void DotStoreCreateAreaTable(DotStore *store, Coord cellsize) { store->CreateAreaTable(cellsize); }
+Coord MatchProfileGetWidth(MatchProfile *profile) { return profile->GetWidth(); }
+Coord MatchProfileGetHeight(MatchProfile *profile) { return profile->GetHeight(); }
+const Coord *MatchProfileGetRowLengths(MatchProfile *profile) { return profile->GetRowLengths(); }
+const Coord *MatchProfileGetRowXs(MatchProfile *profile) { return profile->GetRowXs(); }
+const Coord *MatchProfileGetRowCovers(MatchProfile *profile) { return profile->GetRowCovers(); }
+const Coord *MatchProfileGetColumnLengths(MatchProfile *profile) { return profile->GetColumnLengths(); }
+const Coord *MatchProfileGetColumnYs(MatchProfile *profile) { return profile->GetColumnYs(); }
+const Coord *MatchProfileGetColumnCovers(MatchProfile *profile) { return profile->GetColumnCovers(); }
 
 /*
 ** helper function to interface with the dotgrid
@@ -911,6 +1033,8 @@ Dot *DotStoreGetIndexLongestMatchingColumnDot(DotStore *store, int y) { return s
 DotGrid *NewDotGrid() { return new DotGrid(); }
 void DelDotGrid(DotGrid *grid) { delete grid; }
 void DotGridCreate(DotGrid *grid, int width, int height) { grid->Create(width, height); }
+void DotGridCreateCells(DotGrid *grid, int width, int height, int celltype) { grid->Create(width, height, celltype); }
+int DotGridGetCellType(DotGrid *grid) { return grid->GetCellType(); }
 void DotGridSetPoint(DotGrid *grid, int x, int y, int point) { grid->SetPoint(x,y,point); }
 int DotGridGetPoint(DotGrid *grid, int x, int y) { return grid->GetPoint(x,y); }
 int DotGridGetData(DotGrid *grid, int pos) { return grid->GetData(pos); }
@@ -920,14 +1044,91 @@ int DotGridGetSize(DotGrid *grid) { return grid->GetSize(); }
 int DotGridGetMax(DotGrid *grid) { return grid->GetMax(); }
 int DotGridGetMin(DotGrid *grid) { return grid->GetMin(); }
 unsigned char *DotGridToString(DotGrid *grid) { return grid->ToString(); }
-void FreeString(unsigned char *string) { assert(string); delete string; }
+unsigned char *DotGridNormalise(DotGrid *grid, int mode, int bits, double clip) { return grid->ToString(mode,bits,clip); }
+void FreeString(unsigned char *string) { assert(string); delete [] string; }
 void DotGridCalculate(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int window)
 {
 	grid->CalculateGrid(source, x1, y1, x2, y2, scale, window);
 }
+void DotGridCalculateCoverage(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale)
+{
+	grid->CalculateCoverageGrid(source, x1, y1, x2, y2, scale);
+}
+void DotGridCalculateCells(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int window, int celltype)
+{
+	grid->CalculateGrid(source, x1, y1, x2, y2, scale, window, celltype);
+}
+void DotGridCalculateCoverageCells(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int celltype)
+{
+	grid->CalculateCoverageGrid(source, x1, y1, x2, y2, scale, celltype);
+}
+void DotGridCalculateFractional(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale)
+{
+	grid->CalculateFractionalGrid(source, x1, y1, x2, y2, scale);
+}
+
+// the transforms of the sources of a grid, from arrays of their fields. Free with delete []
+static GridTransform *MakeTransforms(int num, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets)
+{
+	GridTransform *transforms=new GridTransform[num];
+	for(int i=0; i<num; i++)
+	{
+		transforms[i].flip=flips[i]!=0;
+		transforms[i].transpose=transposes[i]!=0;
+		transforms[i].xoffset=xoffsets[i];
+		transforms[i].yoffset=yoffsets[i];
+	}
+	return transforms;
+}
+void DotGridCalculateSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale, int window, int celltype)
+{
+	GridTransform *transforms=MakeTransforms(num, flips, transposes, xoffsets, yoffsets);
+	grid->CalculateGrid(num, sources, transforms, x1, y1, x2, y2, scale, window, celltype);
+	delete [] transforms;
+}
+void DotGridCalculateCoverageSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale, int celltype)
+{
+	GridTransform *transforms=MakeTransforms(num, flips, transposes, xoffsets, yoffsets);
+	grid->CalculateCoverageGrid(num, sources, transforms, x1, y1, x2, y2, scale, celltype);
+	delete [] transforms;
+}
+void DotGridCalculateFractionalSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale)
+{
+	GridTransform *transforms=MakeTransforms(num, flips, transposes, xoffsets, yoffsets);
+	grid->CalculateFractionalGrid(num, sources, transforms, x1, y1, x2, y2, scale);
+	delete [] transforms;
+}
+int DotGridIsFractional(DotGrid *grid) { return grid->IsFractional(); }
+float DotGridGetFraction(DotGrid *grid, int x, int y) { return grid->GetFraction(x,y); }
+const float *DotGridGetFractions(DotGrid *grid) { return grid->GetFractions(); }
 void DotGridAddInplace(DotGrid *source, DotGrid *add) { source->AddInplace(add); }
 void DotGridFlipInplace(DotGrid *grid) { grid->FlipInplace(); }
 int *DotGridCalculateHistogram(DotGrid *grid) {return grid->CalculateHistogram();}
+int DotGridWriteImage(DotGrid *grid, const char *path, int format, int mode, int bits, double clip, int invert)
+{
+	return grid->WriteImage(path, format, mode, bits, clip, invert!=0);
+}
+int DotGridWriteBandedImage(const char *path, DotStore *source, DotStore *flipped, double x1, double y1, double x2, double y2, double scale, int window, int format, int mode, int bits, double clip, int invert)
+{
+	return DotGrid::WriteBandedImage(path, source, flipped, x1, y1, x2, y2, scale, window, format, mode, bits, clip, invert!=0);
+}
+int WriteTilePyramid(const char *path, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, Coord width, Coord height, double scale, int window, int layout, int tilesize, int format, int mode, int bits, double clip, int invert)
+{
+	GridTransform *transforms=MakeTransforms(num, flips, transposes, xoffsets, yoffsets);
+	TilePyramid pyramid;
+	bool ok=pyramid.Write(path, num, sources, transforms, width, height, scale, window, layout, tilesize, format, mode, bits, clip, invert!=0);
+	delete [] transforms;
+	return ok;
+}
+
+DensityPyramid *NewDensityPyramid() { return new DensityPyramid(); }
+void DelDensityPyramid(DensityPyramid *pyramid) { delete pyramid; }
+void DensityPyramidCreate(DensityPyramid *pyramid, DotStore *forward, DotStore *reverse, Coord width, Coord height, Coord cellsize) { pyramid->Create(forward, reverse, width, height, cellsize); }
+long long DensityPyramidWriteSection(DensityPyramid *pyramid, int fd, long long offset) { return pyramid->Write(fd, offset); }
+long long DensityPyramidReadSection(DensityPyramid *pyramid, int fd, long long offset) { return pyramid->Read(fd, offset); }
+int DensityPyramidResample(DensityPyramid *pyramid, DotGrid *grid, double x1, double y1, double x2, double y2, double scale, int strands) { return pyramid->Resample(grid, x1, y1, x2, y2, scale, strands); }
+Coord DensityPyramidGetCellSize(DensityPyramid *pyramid) { return pyramid->GetCellSize(); }
+int DensityPyramidGetNumLevels(DensityPyramid *pyramid) { return pyramid->GetNumLevels(); }
 
 // unsigned char *DotStoreImageToString(DotStore *store, int xseqsize, int yseqsize, int longest, int window)
 // {
@@ -3,6 +3,12 @@
 
 #include "DotStore.h"
 #include "DotGrid.h"
+#include "DotFile.h"
+#include "DotSink.h"
+#include "DotExport.h"
+#include "Checkpoint.h"
+#include "TilePyramid.h"
+#include "DensityPyramid.h"
 
 extern "C" {
 
@@ -17,12 +23,17 @@ typedef unsigned long long int u64;
 /* this gives us a maximum ktuple size of 16 for 4 base pairs. But will work well on 32 bit systems */
 typedef unsigned int TupleID;
 
-/* the type of var our C and D tables are */
+/* the type of var our C and D tables are. They hold sequence positions so they follow our coordinate size */
+#ifdef FRECKLE_64BIT_COORDS
+typedef u64 TupleStore;
+#else
 typedef unsigned int TupleStore;
+#endif
 
 extern const char *Bases;
 extern const char *Aminos;
 extern const char *TranslateUniversal;
+extern const int CoordSize;
 
 // this is a bit mask for the tuple id
 #define BASE_MASK(basestring)	(basestring==Bases?7:(basestring==Aminos?31:0))
@@ -39,65 +50,156 @@ extern const char *TranslateUniversal;
 int ipow(int x, int n);
 TupleID getTupleID(const char *tuple, int len, const char *bases=Bases);
 TupleStore **buildMappingTables( const char *sequence, int ktuplesize, const char *bases=Bases );
-void freeMappingTables(int **tables);
+void freeMappingTables(TupleStore **tables);
 int sum(int *buffer, int length);
-int matchAboveThreshold(const char *seq1, int p1, const char *seq2, int p2, int k, int threshold, int window);
-DotStore *doComparison(unsigned int **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, const char *bases=Bases );
+Coord matchAboveThreshold(const char *seq1, Coord p1, const char *seq2, Coord p2, int k, int threshold, int window);
+DotStore *doComparison(TupleStore **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, const char *bases=Bases, ComparisonCheckpoint *checkpoint=NULL );
+bool doComparisonToSink(TupleStore **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, DotSink *sink, const char *bases=Bases, ComparisonCheckpoint *checkpoint=NULL );
 DotStore *makeDotComparison(const char *seq1, const char *seq2, int ktuplesize, int window, int mismatch, int minmatch);
 
 // lbdot comparison
 char *strrev( char *str);
 void Init_code_tables();
-void EncodeNTSeq(const char *seq, int p1, int p2, int *c,int *d, int nm, int nMaxDNAKtup);
-int EncodeNTSeqConditional(const char *seq, int p1, int p2, int *c,int *d,int *cd, int nm, int maxHints, int nMaxDNAKtup);
+void EncodeNTSeq(const char *seq, Coord p1, Coord p2, Coord *c,Coord *d, int nm, int nMaxDNAKtup);
+int EncodeNTSeqConditional(const char *seq, Coord p1, Coord p2, Coord *c,Coord *d,int *cd, int nm, int maxHints, int nMaxDNAKtup);
 int GetNtCode(const char *seq, int ktup, int intval, const int *v);
 void ComplementSeq(char  *a);
 char *RCseq(char *a);
-DotStore **DoFastComparison(char *Seq1, char *Seq2, int SeqLen1, int SeqLen2,
-						   int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup);
+DotStore **DoFastComparison(char *Seq1, char *Seq2, Coord SeqLen1, Coord SeqLen2,
+						   int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup, ComparisonCheckpoint *checkpoint=NULL);
+bool DoFastComparisonToSinks(char *Seq1, char *Seq2, Coord SeqLen1, Coord SeqLen2,
+						   int CompWind,int CompMism, int nMaxRepeatKtup, int nMaxDNAKtup, DotSink *PlusDots, DotSink *MinusDots, ComparisonCheckpoint *checkpoint=NULL);
 
 // helper functions
 DotStore *NewDotStore();
 void DelDotStore(DotStore *store);
-void DotStoreAddDot(DotStore *store, int x, int y, int len);
-int DotStoreGetDotX(DotStore *store, int index);
-int DotStoreGetDotY(DotStore *store, int index);
-int DotStoreGetDotLength(DotStore *store, int index);
-Dot *DotStoreGetDot(DotStore *store, int index);
-int DotStoreGetNumDots(DotStore *store);
+void DotStoreAddDot(DotStore *store, Coord x, Coord y, Coord len);
+Coord DotStoreGetDotX(DotStore *store, Coord index);
+Coord DotStoreGetDotY(DotStore *store, Coord index);
+Coord DotStoreGetDotLength(DotStore *store, Coord index);
+Dot *DotStoreGetDot(DotStore *store, Coord index);
+Coord DotStoreGetNumDots(DotStore *store);
 void DotStoreCreateIndex(DotStore *store);
 void DotStoreDestroyIndex(DotStore *store);
-int *DotStoreToBuffer(DotStore *store);
-void DotStoreFromBuffer(DotStore *store, int *buffer);
-int DotStoreBufferSize(DotStore *store, int *buffer);
-void FreeIntBuffer(int *buffer);
-DotStore *DotStoreFilter(DotStore *store, int minlen);
+Coord *DotStoreToBuffer(DotStore *store);
+void DotStoreFromBuffer(DotStore *store, Coord *buffer);
+Coord DotStoreBufferSize(DotStore *store, Coord *buffer);
+void FreeIntBuffer(Coord *buffer);
+DotStore *DotStoreFilter(DotStore *store, Coord minlen);
+void DotStoreFilterInPlace(DotStore *store, Coord minlen);
 void DotStoreInterpolate(DotStore *store, int window);
+void DotStoreSetSymmetric(DotStore *store, int symmetric);
+int DotStoreIsSymmetric(DotStore *store);
+void DotStoreUnfold(DotStore *store);
+Coord DotStoreGetLogicalNumDots(DotStore *store);
+void DotStoreAppend(DotStore *store, DotStore *other, Coord dx, Coord dy);
+void DotStoreOffset(DotStore *store, Coord dx, Coord dy);
+void DotStoreFlipX(DotStore *store, Coord xlength);
+void DotStoreFlipY(DotStore *store, Coord ylength);
+void DotStoreTranspose(DotStore *store);
+int DotStoreNumHistogramBins();
+long long DotStoreGetLengthHistogram(DotStore *store, int bin);
+long long DotStoreGetTotalBases(DotStore *store);
+Coord DotStoreGetMinLength(DotStore *store);
+Coord DotStoreGetMaxLength(DotStore *store);
+Coord DotStoreLengthThreshold(DotStore *store, Coord n);
+void DotStoreSetMemoryLimit(DotStore *store, long long bytes, const char *tmpdir);
+void SetDefaultDotStoreMemoryLimit(long long bytes, const char *tmpdir);
+
+// dot plot file sections
+long long DotStoreWriteSection(DotStore *store, int fd, long long offset);
+long long DotStoreReadSection(DotStore *store, int fd, long long offset);
+long long DotStoreReadSectionRegion(DotStore *store, int fd, long long offset, Coord x1, Coord y1, Coord x2, Coord y2);
+
+// native dot files
+int DotStoreWriteMapFile(DotStore *store, const char *path);
+int DotStoreMapFile(DotStore *store, const char *path);
+
+// dot sinks
+DotSink *NewDotStoreSink(DotStore *store);
+DotSink *NewDotFileSink(const char *path);
+DotSink *NewFilterDotSink(DotSink *next, Coord minlength);
+CountingDotSink *NewCountingDotSink();
+void DelDotSink(DotSink *sink);
+int DotSinkClose(DotSink *sink);
+Coord CountingDotSinkGetNum(CountingDotSink *sink);
+Coord CountingDotSinkGetLogicalNum(CountingDotSink *sink);
+long long CountingDotSinkGetTotalBases(CountingDotSink *sink);
+
+// text export
+DotExporter *NewDotExporter();
+void DelDotExporter(DotExporter *exporter);
+int DotExporterOpen(DotExporter *exporter, const char *path, int compress);
+void DotExporterSetRecords(DotExporter *exporter, int axis, int num, const Coord *starts, const char * const *names);
+int DotExporterWrite(DotExporter *exporter, DotStore *store, char strand, Coord xoffset, Coord yoffset, Coord ylength, Coord minlength);
+int DotExporterClose(DotExporter *exporter);
+
+// comparison checkpoints
+ComparisonCheckpoint *NewComparisonCheckpoint(const char *path, int interval);
+void DelComparisonCheckpoint(ComparisonCheckpoint *checkpoint);
 
 // maximums
-void DotStoreSetMaxX(DotStore *store, int max);
-void DotStoreSetMaxY(DotStore *store, int max);
-int DotStoreGetMaxX(DotStore *store);
-int DotStoreGetMaxY(DotStore *store);
+void DotStoreSetMaxX(DotStore *store, Coord max);
+void DotStoreSetMaxY(DotStore *store, Coord max);
+Coord DotStoreGetMaxX(DotStore *store);
+Coord DotStoreGetMaxY(DotStore *store);
 
 // conservation helper functions
-Dot *DotStoreGetIndexLongestMatchingRowDot(DotStore *store, int x);
-Dot *DotStoreGetIndexLongestMatchingColumnDot(DotStore *store, int y);
+Dot *DotStoreGetIndexLongestMatchingRowDot(DotStore *store, Coord x);
+Dot *DotStoreGetIndexLongestMatchingColumnDot(DotStore *store, Coord y);
+MatchProfile *DotStoreGetProfile(DotStore *store);
+Coord DotStoreCountAreaBases(DotStore *store, Coord x1, Coord y1, Coord x2, Coord y2);
+void DotStoreCreateAreaTable(DotStore *store, Coord cellsize);
+Coord MatchProfileGetWidth(MatchProfile *profile);
+Coord MatchProfileGetHeight(MatchProfile *profile);
+const Coord *MatchProfileGetRowLengths(MatchProfile *profile);
+const Coord *MatchProfileGetRowXs(MatchProfile *profile);
+const Coord *MatchProfileGetRowCovers(MatchProfile *profile);
+const Coord *MatchProfileGetColumnLengths(MatchProfile *profile);
+const Coord *MatchProfileGetColumnYs(MatchProfile *profile);
+const Coord *MatchProfileGetColumnCovers(MatchProfile *profile);
 
 // DotGrid helper functions and wrappers
 DotGrid *NewDotGrid();
 void DelDotGrid(DotGrid *grid);
+void DotGridCreate(DotGrid *grid, int width, int height);
+void DotGridCreateCells(DotGrid *grid, int width, int height, int celltype);
+int DotGridGetCellType(DotGrid *grid);
 int DotGridWidth(DotGrid *grid);
 int DotGridHeight(DotGrid *grid);
 int DotGridGetSize(DotGrid *grid);
 int DotGridGetMax(DotGrid *grid);
 int DotGridGetMin(DotGrid *grid);
 unsigned char *DotGridToString(DotGrid *grid);
+unsigned char *DotGridNormalise(DotGrid *grid, int mode, int bits, double clip);
 void FreeString(unsigned char *string);
 void DotGridCalculate(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int window);
+void DotGridCalculateCoverage(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale);
+void DotGridCalculateCells(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int window, int celltype);
+void DotGridCalculateCoverageCells(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale, int celltype);
+void DotGridCalculateFractional(DotGrid *grid, DotStore *source, double x1, double y1, double x2, double y2, double scale);
+void DotGridCalculateSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale, int window, int celltype);
+void DotGridCalculateCoverageSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale, int celltype);
+void DotGridCalculateFractionalSources(DotGrid *grid, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, double x1, double y1, double x2, double y2, double scale);
+int DotGridIsFractional(DotGrid *grid);
+float DotGridGetFraction(DotGrid *grid, int x, int y);
+const float *DotGridGetFractions(DotGrid *grid);
 void DotGridAddInplace(DotGrid *source, DotGrid *add);
 void DotGridFlipInplace(DotGrid *grid);
 int *DotGridCalculateHistogram(DotGrid *grid);
+int DotGridWriteImage(DotGrid *grid, const char *path, int format, int mode, int bits, double clip, int invert);
+int DotGridWriteBandedImage(const char *path, DotStore *source, DotStore *flipped, double x1, double y1, double x2, double y2, double scale, int window, int format, int mode, int bits, double clip, int invert);
+int WriteTilePyramid(const char *path, int num, DotStore **sources, const int *flips, const int *transposes, const Coord *xoffsets, const Coord *yoffsets, Coord width, Coord height, double scale, int window, int layout, int tilesize, int format, int mode, int bits, double clip, int invert);
+
+// density pyramids
+DensityPyramid *NewDensityPyramid();
+void DelDensityPyramid(DensityPyramid *pyramid);
+void DensityPyramidCreate(DensityPyramid *pyramid, DotStore *forward, DotStore *reverse, Coord width, Coord height, Coord cellsize);
+long long DensityPyramidWriteSection(DensityPyramid *pyramid, int fd, long long offset);
+long long DensityPyramidReadSection(DensityPyramid *pyramid, int fd, long long offset);
+int DensityPyramidResample(DensityPyramid *pyramid, DotGrid *grid, double x1, double y1, double x2, double y2, double scale, int strands);
+Coord DensityPyramidGetCellSize(DensityPyramid *pyramid);
+int DensityPyramidGetNumLevels(DensityPyramid *pyramid);
 
 
 
@@ -0,0 +1,116 @@
+#include <cxxtest/TestSuite.h>
+
+#include "AreaTable.h"
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// every block of cells sums to what was added to it
+	void testSum(void)
+	{
+		srand(50);
+		const int width=23, height=17;
+		long long cells[height][width];
+		AreaTable table(10,width,height);
+		for(int y=0; y<height; y++)
+			for(int x=0; x<width; x++)
+			{
+				cells[y][x]=rand()%1000;
+				table.Add(x,y,cells[y][x]);
+			}
+		table.Add(3,4,7);
+		cells[4][3]+=7;
+		table.Integrate();
+
+		TS_ASSERT_EQUALS(table.GetCellSize(), 10);
+		TS_ASSERT_EQUALS(table.GetWidth(), width);
+		TS_ASSERT_EQUALS(table.GetHeight(), height);
+
+		for(int q=0; q<300; q++)
+		{
+			int x1=rand()%width, y1=rand()%height;
+			int x2=x1+rand()%(width-x1), y2=y1+rand()%(height-y1);
+			long long sum=0;
+			for(int y=y1; y<=y2; y++)
+				for(int x=x1; x<=x2; x++)
+					sum+=cells[y][x];
+			TS_ASSERT_EQUALS(table.Sum(x1,y1,x2,y2), sum);
+		}
+	}
+
+	// a store counts any rectangle the same with a table as without, pieces of matches on one diagonal and all
+	void testCountAreaBases(void)
+	{
+		srand(51);
+		DotStore *ds=new DotStore(), *plain=new DotStore();
+		for(int i=0; i<2000; i++)
+		{
+			Coord x=rand()%2000, y=rand()%1500, length=1+rand()%(i%10?20:300);
+			ds->AddDot(x, y, length);
+			plain->AddDot(x, y, length);
+			if(i%50==0)
+			{
+				// a second piece of the same match further down its diagonal
+				ds->AddDot(x+length/2, y+length/2, length);
+				plain->AddDot(x+length/2, y+length/2, length);
+			}
+		}
+		ds->CreateIndex();
+		plain->CreateIndex();
+
+		TS_ASSERT(!ds->GetAreaTable());
+		ds->CreateAreaTable(16);
+		TS_ASSERT(ds->GetAreaTable());
+		TS_ASSERT_EQUALS(ds->GetAreaTable()->GetCellSize(), 16);
+
+		for(int q=0; q<300; q++)
+		{
+			Coord x1=rand()%2400-100, y1=rand()%1900-100;
+			Coord x2=x1+rand()%(q%3?100:800), y2=y1+rand()%(q%3?100:800);
+			TS_ASSERT_EQUALS(ds->CountAreaBases(x1,y1,x2,y2), plain->CountAreaBases(x1,y1,x2,y2));
+		}
+		TS_ASSERT_EQUALS(ds->CountAreaBases(0,0,2399,1899), plain->CountAreaBases(0,0,2399,1899));
+		TS_ASSERT_EQUALS(ds->CountAreaBases(0,0,15,15), plain->CountAreaBases(0,0,15,15));
+
+		// a change to the dots throws the table away
+		ds->AddDot(100,100,50);
+		plain->AddDot(100,100,50);
+		TS_ASSERT(!ds->GetAreaTable());
+		TS_ASSERT_EQUALS(ds->CountAreaBases(64,64,191,191), plain->CountAreaBases(64,64,191,191));
+
+		delete ds;
+		delete plain;
+	}
+
+	// the reflections of a symmetric store go in the table too
+	void testSymmetric(void)
+	{
+		srand(52);
+		DotStore *half=new DotStore(), *full=new DotStore();
+		half->SetSymmetric(true);
+		for(int i=0; i<1000; i++)
+		{
+			Coord y=rand()%1000, x=y+(i%3?1+i:0), length=1+rand()%100;
+			half->AddDot(x, y, length);
+			full->AddDot(x, y, length);
+			if(x!=y)
+				full->AddDot(y, x, length);
+		}
+		half->CreateIndex();
+		full->CreateIndex();
+		half->CreateAreaTable(32);
+
+		for(int q=0; q<200; q++)
+		{
+			Coord x1=rand()%2200, y1=rand()%2200;
+			Coord x2=x1+rand()%500, y2=y1+rand()%500;
+			TS_ASSERT_EQUALS(half->CountAreaBases(x1,y1,x2,y2), full->CountAreaBases(x1,y1,x2,y2));
+		}
+
+		delete half;
+		delete full;
+	}
+};
@@ -0,0 +1,103 @@
+#include <cxxtest/TestSuite.h>
+
+#include "Checkpoint.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// a pretend engine: position p on strand s finds the dot (p, p*s+1, 10+p%5). It is killed just after stop
+	void RunEngine(ComparisonCheckpoint *checkpoint, unsigned long long hash, DotSink *forward, DotSink *reverse, int stop, int markevery)
+	{
+		int strand;
+		Coord position;
+		checkpoint->Start(hash, forward, reverse, &strand, &position);
+		DotSink *sinks[2]={checkpoint->GetSink(0, forward), checkpoint->GetSink(1, reverse)};
+
+		for(int s=strand; s<2; s++)
+			for(Coord p=(s==strand)?position:0; p<100; p++)
+			{
+				if(!(p%markevery))
+					checkpoint->Mark(s, p);
+				if(s*100+p==stop)
+					return;
+				sinks[s]->AddDot(p, p*s+1, 10+p%5);
+			}
+
+		sinks[0]->Close();
+		sinks[1]->Close();
+		checkpoint->Finish();
+	}
+
+	// a killed comparison resumed from its checkpoint finds exactly the dots an uninterrupted one does
+	void testResume(void)
+	{
+		char path[]="/tmp/testCheckpointXXXXXX";
+		int fd=mkstemp(path);
+		TS_ASSERT(fd!=-1);
+		close(fd);
+		unlink(path);
+
+		unsigned long long hash=ComparisonCheckpoint::Hash("ACGT",4,"GGCA",4,NULL,0);
+
+		CountingDotSink whole[2];
+		ComparisonCheckpoint *checkpoint=new ComparisonCheckpoint(path);
+		RunEngine(checkpoint, hash, &whole[0], &whole[1], -1, 7);
+		delete checkpoint;
+		TS_ASSERT(access(path, F_OK)!=0);
+
+		// killed part way down the reverse strand, then again after it has resumed
+		CountingDotSink first[2], second[2], third[2];
+		checkpoint=new ComparisonCheckpoint(path);
+		RunEngine(checkpoint, hash, &first[0], &first[1], 130, 7);
+		delete checkpoint;
+		TS_ASSERT(access(path, F_OK)==0);
+
+		checkpoint=new ComparisonCheckpoint(path);
+		RunEngine(checkpoint, hash, &second[0], &second[1], 175, 7);
+		delete checkpoint;
+
+		checkpoint=new ComparisonCheckpoint(path);
+		RunEngine(checkpoint, hash, &third[0], &third[1], -1, 7);
+		delete checkpoint;
+		TS_ASSERT(access(path, F_OK)!=0);
+
+		for(int s=0; s<2; s++)
+		{
+			TS_ASSERT_EQUALS(third[s].GetNum(), whole[s].GetNum());
+			TS_ASSERT_EQUALS(third[s].GetTotalBases(), whole[s].GetTotalBases());
+		}
+	}
+
+	// a checkpoint of different inputs is thrown away
+	void testDifferentInputs(void)
+	{
+		char path[]="/tmp/testCheckpointXXXXXX";
+		int fd=mkstemp(path);
+		TS_ASSERT(fd!=-1);
+		close(fd);
+
+		int parameters[2]={10,0};
+		unsigned long long hash=ComparisonCheckpoint::Hash("ACGT",4,"GGCA",4,parameters,2);
+		parameters[1]=1;
+		TS_ASSERT(hash!=ComparisonCheckpoint::Hash("ACGT",4,"GGCA",4,parameters,2));
+		TS_ASSERT(hash!=ComparisonCheckpoint::Hash("ACG",3,"TGGCA",5,parameters,2));
+
+		CountingDotSink first[2], second[2];
+		ComparisonCheckpoint *checkpoint=new ComparisonCheckpoint(path);
+		RunEngine(checkpoint, hash, &first[0], &first[1], 50, 7);
+		delete checkpoint;
+
+		checkpoint=new ComparisonCheckpoint(path);
+		int strand;
+		Coord position;
+		TS_ASSERT(checkpoint->Start(hash+1, &second[0], &second[1], &strand, &position));
+		TS_ASSERT_EQUALS(strand, 0);
+		TS_ASSERT_EQUALS(position, 0);
+		TS_ASSERT_EQUALS(second[0].GetNum(), 0);
+		checkpoint->Finish();
+		delete checkpoint;
+	}
+};
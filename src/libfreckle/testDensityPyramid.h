@@ -0,0 +1,167 @@
+#include <cxxtest/TestSuite.h>
+
+#include "DensityPyramid.h"
+#include "SectionIO.h"
+#include "testStores.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// every cell of the finest level is the bases in its square, and every cell above the sum of the four below it
+	void testCreate(void)
+	{
+		DotStore *forward=MakeRandomStore(49,3000), *reverse=MakeRandomStore(50,3000);
+		DensityPyramid pyramid;
+		pyramid.Create(forward,reverse,1000,700,10);
+
+		// 100 by 70 halves 7 times down to a single cell
+		TS_ASSERT_EQUALS(pyramid.GetCellSize(), 10);
+		TS_ASSERT_EQUALS(pyramid.GetNumLevels(), 8);
+		TS_ASSERT_EQUALS(pyramid.GetLevelWidth(0), 100);
+		TS_ASSERT_EQUALS(pyramid.GetLevelHeight(0), 70);
+		TS_ASSERT_EQUALS(pyramid.GetLevelWidth(7), 1);
+
+		for(int y=0; y<70; y+=3)
+			for(int x=0; x<100; x+=7)
+			{
+				TS_ASSERT_EQUALS(pyramid.GetCell(0,false,x,y), forward->CountAreaBases(x*10,y*10,x*10+9,y*10+9));
+				TS_ASSERT_EQUALS(pyramid.GetCell(0,true,x,y), reverse->CountAreaBases(x*10,y*10,x*10+9,y*10+9));
+			}
+
+		for(int level=1; level<pyramid.GetNumLevels(); level++)
+			for(int strand=0; strand<2; strand++)
+			{
+				long long above=0, below=0;
+				for(int y=0; y<pyramid.GetLevelHeight(level); y++)
+					for(int x=0; x<pyramid.GetLevelWidth(level); x++)
+						above+=pyramid.GetCell(level,strand,x,y);
+				for(int y=0; y<pyramid.GetLevelHeight(level-1); y++)
+					for(int x=0; x<pyramid.GetLevelWidth(level-1); x++)
+						below+=pyramid.GetCell(level-1,strand,x,y);
+				TS_ASSERT_EQUALS(above, below);
+			}
+		TS_ASSERT_EQUALS(pyramid.GetCell(7,false,0,0), forward->CountAreaBases(0,0,999,699));
+
+		// picked to fit
+		DensityPyramid fitted;
+		fitted.Create(forward,NULL,3000,700);
+		TS_ASSERT_EQUALS(fitted.GetCellSize(), 3);
+		TS_ASSERT_EQUALS(fitted.GetLevelWidth(0), 1000);
+		TS_ASSERT_EQUALS(fitted.GetCell(0,true,10,10), 0);
+
+		delete forward;
+		delete reverse;
+	}
+
+	// written after some other section and read back the same, the end where the next section starts
+	void testReadWrite(void)
+	{
+		DotStore *forward=MakeRandomStore(51,3000), *reverse=MakeRandomStore(52,3000);
+		DensityPyramid pyramid;
+		pyramid.Create(forward,reverse,1000,700,8);
+
+		char path[]="/tmp/testDensityPyramidXXXXXX";
+		int fd=mkstemp(path);
+		TS_ASSERT(fd>=0);
+		long long end=pyramid.Write(fd,100);
+		TS_ASSERT(end>100+DENSITYPYRAMID_HEADERSIZE);
+		TS_ASSERT_EQUALS((long long)lseek(fd,0,SEEK_END), end);
+
+		DensityPyramid read;
+		TS_ASSERT_EQUALS(read.Read(fd,100), end);
+		TS_ASSERT_EQUALS(read.GetCellSize(), 8);
+		TS_ASSERT_EQUALS(read.GetWidth(), 1000);
+		TS_ASSERT_EQUALS(read.GetHeight(), 700);
+		TS_ASSERT_EQUALS(read.GetNumLevels(), pyramid.GetNumLevels());
+		for(int level=0; level<pyramid.GetNumLevels(); level++)
+			for(int strand=0; strand<2; strand++)
+				for(int y=0; y<pyramid.GetLevelHeight(level); y++)
+					for(int x=0; x<pyramid.GetLevelWidth(level); x++)
+						if(read.GetCell(level,strand,x,y)!=pyramid.GetCell(level,strand,x,y))
+						{
+							TS_FAIL("cells differ");
+							level=pyramid.GetNumLevels();
+							strand=2;
+							y=pyramid.GetLevelHeight(0);
+							break;
+						}
+
+		// nothing there
+		DensityPyramid missing;
+		TS_ASSERT_EQUALS(missing.Read(fd,0), -1);
+
+		// a header whose sizes can't be right is turned away before anything is made from them
+		unsigned char good[8], bad[8];
+		TS_ASSERT(ReadAt(fd,good,8,100+12));
+		Put64(bad,0);
+		TS_ASSERT(WriteAt(fd,bad,8,100+12));				// no cell size
+		TS_ASSERT_EQUALS(read.Read(fd,100), -1);
+		TS_ASSERT(WriteAt(fd,good,8,100+12));
+		Put64(bad,1<<30);
+		TS_ASSERT(WriteAt(fd,bad,8,100+20));				// far more cells than the section could hold
+		TS_ASSERT_EQUALS(read.Read(fd,100), -1);
+		Put64(bad,1000);
+		TS_ASSERT(WriteAt(fd,bad,8,100+20));
+		TS_ASSERT_EQUALS(read.Read(fd,100), end);
+		Put64(bad,end);
+		TS_ASSERT(WriteAt(fd,bad,8,100+44));				// running past the end of the file
+		TS_ASSERT_EQUALS(read.Read(fd,100), -1);
+
+		close(fd);
+		unlink(path);
+		delete forward;
+		delete reverse;
+	}
+
+	// on the cells of a level it is the coverage grid, and in between it keeps every base
+	void testResample(void)
+	{
+		DotStore *forward=MakeRandomStore(53,3000), *reverse=MakeRandomStore(54,3000);
+		DotStore *sources[2]={forward,reverse};
+		GridTransform transforms[2];
+		transforms[1].flip=true;
+
+		DensityPyramid pyramid;
+		pyramid.Create(forward,reverse,1000,700,5);
+
+		DotGrid *grid=new DotGrid(), *expected=new DotGrid();
+		TS_ASSERT(pyramid.Resample(grid,0,0,1000,700,20.0));
+		expected->CalculateCoverageGrid(2,sources,transforms,0,0,1000,700,20.0,DOTGRID_INT32);
+		TS_ASSERT_EQUALS(grid->GetWidth(), 50);
+		TS_ASSERT_EQUALS(grid->GetHeight(), 35);
+		for(int y=0; y<35; y++)
+			for(int x=0; x<50; x++)
+				TS_ASSERT_EQUALS((int)grid->GetFraction(x,y), expected->GetPoint(x,y));
+
+		// one strand
+		TS_ASSERT(pyramid.Resample(grid,200,100,600,500,10.0,DENSITYPYRAMID_FORWARD));
+		expected->Destroy();
+		expected->CalculateCoverageGrid(forward,200,100,600,500,10.0,DOTGRID_INT32);
+		for(int y=0; y<40; y+=3)
+			for(int x=0; x<40; x+=3)
+				TS_ASSERT_EQUALS((int)grid->GetFraction(x,y), expected->GetPoint(x,y));
+
+		// off the cells the bases are spread out, but none are lost, even in the cells past the end of the plot
+		DensityPyramid uneven;
+		uneven.Create(forward,reverse,1000,700,6);
+		TS_ASSERT(uneven.Resample(grid,0,0,1000,700,13.7));
+		double total=0.0;
+		for(int y=0; y<grid->GetHeight(); y++)
+			for(int x=0; x<grid->GetWidth(); x++)
+				total+=grid->GetFraction(x,y);
+		double bases=(double)forward->CountAreaBases(0,0,999,699)+reverse->CountAreaBases(0,0,999,699);
+		TS_ASSERT_DELTA(total, bases, bases*1e-5);
+
+		// finer than the pyramid
+		TS_ASSERT(!pyramid.Resample(grid,0,0,100,100,2.0));
+
+		delete grid;
+		delete expected;
+		delete forward;
+		delete reverse;
+	}
+};
@@ -0,0 +1,121 @@
+#include <cxxtest/TestSuite.h>
+
+#include "DiagonalIndex.h"
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// how far down the diagonal the next dot is, found by looking one base at a time
+	Coord Walk(DotStore *ds, Coord x, Coord y, Coord limit)
+	{
+		for(Coord gap=1; gap<=limit; gap++)
+			if(ds->GetIndexDot(x+gap,y+gap))
+				return gap;
+		return 0;
+	}
+
+	// gaps give what walking the diagonal does, from dots and from between them
+	void testGaps(void)
+	{
+		srand(23);
+		DotStore *ds=new DotStore();
+		for(int i=0; i<20000; i++)
+			ds->AddDot(rand()%2000, rand()%2000, 1+rand()%20);
+		ds->CreateIndex();
+
+		DiagonalIndex *index=new DiagonalIndex(ds->GetHead(), ds->GetNum());
+		TS_ASSERT_EQUALS(index->GetNum(), 20000);
+
+		for(int i=0; i<20000; i+=7)
+		{
+			Dot *dot=ds->GetDot(i);
+			TS_ASSERT_EQUALS(index->Gap(dot->x,dot->y), Walk(ds,dot->x,dot->y,2000));
+		}
+		for(int q=0; q<2000; q++)
+		{
+			Coord x=rand()%2100-50, y=rand()%2100-50;
+			TS_ASSERT_EQUALS(index->Gap(x,y), Walk(ds,x,y,2100));
+		}
+
+		// off the ends of the diagonals
+		TS_ASSERT_EQUALS(index->Gap(5000,0), 0);
+		TS_ASSERT_EQUALS(index->Gap(0,5000), 0);
+		TS_ASSERT_EQUALS(index->Gap(1999,1999), 0);
+
+		delete index;
+		delete ds;
+	}
+
+	// a symmetric store walks its reflected dots' diagonals as well
+	void testSymmetric(void)
+	{
+		srand(29);
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		for(int i=0; i<5000; i++)
+		{
+			Coord y=rand()%1000;
+			ds->AddDot(y+rand()%(1000-y), y, 1+rand()%20);
+		}
+		ds->CreateIndex();
+
+		for(int q=0; q<2000; q++)
+		{
+			Coord x=rand()%1000, y=rand()%1000;
+			TS_ASSERT_EQUALS(ds->GetIndexDiagonalGap(x,y), Walk(ds,x,y,1000));
+		}
+
+		delete ds;
+	}
+
+	// a removed dot is passed over, and only the one of two at the same place
+	void testRemove(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->AddDot(10,0,5);
+		ds->AddDot(20,10,5);
+		ds->AddDot(30,20,5);
+		ds->AddDot(30,20,7);
+		ds->AddDot(40,30,5);
+
+		DiagonalIndex *index=new DiagonalIndex(ds->GetHead(), ds->GetNum());
+		TS_ASSERT_EQUALS(index->Gap(10,0), 10);
+		index->Remove(20,10);
+		TS_ASSERT_EQUALS(index->Gap(10,0), 20);
+		TS_ASSERT_EQUALS(index->Gap(15,5), 15);
+		index->Remove(30,20);
+		TS_ASSERT_EQUALS(index->Gap(10,0), 20);
+		index->Remove(30,20);
+		TS_ASSERT_EQUALS(index->Gap(10,0), 30);
+		TS_ASSERT_EQUALS(index->Gap(40,30), 0);
+
+		delete index;
+		delete ds;
+	}
+
+	// diagonals far too many to table, and too spread out to sort on keys, are still searched
+	void testSparse(void)
+	{
+		DotStore *ds=new DotStore();
+		Coord far=(sizeof(Coord)==8)?(Coord)1<<60:(Coord)1<<29;
+		for(int i=0; i<100; i++)
+		{
+			ds->AddDot(i*(far/100), -i*(far/100), 1);
+			ds->AddDot(i*(far/100)+i+1, -i*(far/100)+i+1, 1);
+		}
+
+		DiagonalIndex *index=new DiagonalIndex(ds->GetHead(), ds->GetNum());
+		for(int i=0; i<100; i++)
+		{
+			TS_ASSERT_EQUALS(index->Gap(i*(far/100), -i*(far/100)), i+1);
+			TS_ASSERT_EQUALS(index->Gap(i*(far/100)+i+1, -i*(far/100)+i+1), 0);
+			TS_ASSERT_EQUALS(index->Gap(i*(far/100)+1, -i*(far/100)), 0);
+		}
+
+		delete index;
+		delete ds;
+	}
+};
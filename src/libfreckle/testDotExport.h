@@ -0,0 +1,105 @@
+#include <cxxtest/TestSuite.h>
+
+#include "DotExport.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// read a whole (possibly gzipped) text file back
+	char *Slurp(const char *path)
+	{
+		gzFile in=gzopen(path,"rb");
+		TS_ASSERT(in);
+		size_t capacity=1<<20, length=0;
+		char *data=(char *)malloc(capacity);
+		int got;
+		while((got=gzread(in, data+length, capacity-length-1))>0)
+		{
+			length+=got;
+			if(capacity-length<2)
+				data=(char *)realloc(data, capacity*=2);
+		}
+		data[length]=0;
+		gzclose(in);
+		return data;
+	}
+
+	int CountLines(const char *text)
+	{
+		int lines=0;
+		for(; *text; text++)
+			if(*text=='\n')
+				lines++;
+		return lines;
+	}
+
+	// records, strands and the reverse complement flip
+	void testLines(void)
+	{
+		char path[]="/tmp/testDotExportXXXXXX";
+		close(mkstemp(path));
+
+		const Coord xstarts[]={0,100,250};
+		const char *xnames[]={"chr1","chr2","chr3"};
+		const Coord ystarts[]={0,1000};
+		const char *ynames[]={"seqA","seqB"};
+
+		DotStore *forward=new DotStore();
+		forward->AddDot(120,1005,10);
+		forward->AddDot(5,3,4);
+		DotStore *reverse=new DotStore();
+		reverse->AddDot(260,0,20);
+
+		DotExporter exporter;
+		TS_ASSERT(exporter.Open(path));
+		exporter.SetRecords(0,3,xstarts,xnames);
+		exporter.SetRecords(1,2,ystarts,ynames);
+		TS_ASSERT(exporter.Write(forward,'+'));
+		TS_ASSERT(exporter.Write(reverse,'-',0,1000,500));
+		TS_ASSERT(exporter.Close());
+
+		char *text=Slurp(path);
+		TS_ASSERT_EQUALS(strcmp(text,
+			"chr2\t20\t30\t+\tseqB\t5\t15\t10\n"
+			"chr1\t5\t9\t+\tseqA\t3\t7\t4\n"
+			"chr3\t10\t30\t-\tseqB\t480\t500\t20\n"), 0);
+
+		free(text);
+		unlink(path);
+		delete forward;
+		delete reverse;
+	}
+
+	// many blocks worth, gzipped, with the mirrors of a symmetric store and a length filter
+	void testManyCompressed(void)
+	{
+		char path[]="/tmp/testDotExportXXXXXX";
+		close(mkstemp(path));
+
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		for(int i=0; i<100000; i++)
+			ds->AddDot(i+i%3, i, 1+i%20);
+		Coord expected=0;
+		for(int i=0; i<100000; i++)
+			if(1+i%20>=5)
+				expected+=(i%3)?2:1;
+
+		DotExporter exporter;
+		TS_ASSERT(exporter.Open(path,true));
+		TS_ASSERT(exporter.Write(ds,'+',0,0,0,5));
+		TS_ASSERT(exporter.Close());
+
+		char *text=Slurp(path);
+		TS_ASSERT_EQUALS(CountLines(text), expected);
+		TS_ASSERT(!strncmp(text,"*\t",2));
+
+		free(text);
+		unlink(path);
+		delete ds;
+	}
+};
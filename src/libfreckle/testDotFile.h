@@ -0,0 +1,221 @@
+#include <cxxtest/TestSuite.h>
+
+#include "DotFile.h"
+#include "SectionIO.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// does a store come back exactly as it went out, across lots of tiles and with negative coordinates
+	void testRoundTrip(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetMaxX(100000);
+		ds->SetMaxY(50000);
+
+		srand(1);
+		for(int i=0; i<20000; i++)
+			ds->AddDot(rand()%100000, rand()%50000, 1+rand()%300);
+		ds->AddDot(-5000, -20, 10);
+
+		FILE *file=tmpfile();
+		TS_ASSERT(file);
+
+		// start part way in, like a section after the pickled header
+		DotFile out(fileno(file), 123);
+		long long end=out.Write(ds, 4096);
+		TS_ASSERT(end>123);
+		TS_ASSERT(out.GetNumTiles()>1);
+
+		DotStore *back=new DotStore();
+		DotFile in(fileno(file), 123);
+		TS_ASSERT(in.Read(back));
+		TS_ASSERT_EQUALS(in.GetEnd(), end);
+		TS_ASSERT_EQUALS(back->GetNum(), ds->GetNum());
+		TS_ASSERT_EQUALS(back->GetMaxX(), 100000);
+		TS_ASSERT_EQUALS(back->GetMaxY(), 50000);
+		TS_ASSERT_EQUALS(back->GetTotalBases(), ds->GetTotalBases());
+
+		// the order changes, so compare as a grid of sums
+		long long sumin=0, sumout=0;
+		for(int i=0; i<ds->GetNum(); i++)
+		{
+			sumin+=ds->GetDotX(i)*3+ds->GetDotY(i)*5+ds->GetDotLength(i)*7;
+			sumout+=back->GetDotX(i)*3+back->GetDotY(i)*5+back->GetDotLength(i)*7;
+		}
+		TS_ASSERT_EQUALS(sumin, sumout);
+
+		fclose(file);
+		delete back;
+		delete ds;
+	}
+
+	// a region read gets exactly the dots that reach the region, including long ones from earlier tiles
+	void testRegion(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetMaxX(40000);
+		ds->SetMaxY(40000);
+		for(int i=0; i<40000; i+=7)
+			ds->AddDot(i, (i*13)%40000, 1+i%50);
+		ds->AddDot(100, 100, 20000);				// starts well outside the region, but runs through it
+
+		FILE *file=tmpfile();
+		DotFile out(fileno(file), 0);
+		TS_ASSERT(out.Write(ds, 4096)>0);
+
+		Coord x1=15000, y1=16000, x2=21000, y2=23000;
+		Coord expected=0;
+		for(int i=0; i<ds->GetNum(); i++)
+		{
+			Dot *dot=ds->GetDot(i);
+			if(dot->x<x2 && dot->y<y2 && dot->x+dot->length>x1 && dot->y+dot->length>y1)
+				expected++;
+		}
+		TS_ASSERT(expected>1);
+
+		DotStore *back=new DotStore();
+		DotFile in(fileno(file), 0);
+		TS_ASSERT(in.ReadRegion(back, x1, y1, x2, y2));
+		TS_ASSERT_EQUALS(back->GetNum(), expected);
+		TS_ASSERT_EQUALS(back->GetMaxLength(), 20000);
+
+		fclose(file);
+		delete back;
+		delete ds;
+	}
+
+	// only half of a symmetric store is saved, but a region below the diagonal still gets the dots reflected into it
+	void testSymmetricRegion(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		ds->SetMaxX(20000);
+		ds->SetMaxY(20000);
+		ds->AddDot(5000, 100, 50);
+		for(int i=0; i<20000; i+=11)
+			ds->AddDot(i, (i*7)%(i+1), 1+i%40);
+
+		FILE *file=tmpfile();
+		DotFile out(fileno(file), 0);
+		TS_ASSERT(out.Write(ds, 1024)>0);
+		ds->CreateIndex();
+
+		DotStore *back=new DotStore();
+		DotFile in(fileno(file), 0);
+		TS_ASSERT(in.ReadRegion(back, 0, 4900, 300, 5200));
+		TS_ASSERT(back->IsSymmetric());
+		back->CreateIndex();
+		TS_ASSERT_EQUALS(back->CountAreaBases(0, 4900, 299, 5199), ds->CountAreaBases(0, 4900, 299, 5199));
+		TS_ASSERT(back->CountAreaBases(0, 4900, 299, 5199)>=50);
+
+		// either way round the region gets the same bases as the whole store
+		Coord x1=3000, y1=9000, x2=7000, y2=12000;
+		TS_ASSERT(in.ReadRegion(back, x1, y1, x2, y2));
+		back->CreateIndex();
+		TS_ASSERT_EQUALS(back->CountAreaBases(x1, y1, x2-1, y2-1), ds->CountAreaBases(x1, y1, x2-1, y2-1));
+		TS_ASSERT(in.ReadRegion(back, y1, x1, y2, x2));
+		back->CreateIndex();
+		TS_ASSERT_EQUALS(back->CountAreaBases(y1, x1, y2-1, x2-1), ds->CountAreaBases(y1, x1, y2-1, x2-1));
+		TS_ASSERT(back->GetNum()<ds->GetNum());
+
+		fclose(file);
+		delete back;
+		delete ds;
+	}
+
+	// symmetric stores stay symmetric, and an empty store is fine
+	void testSymmetricAndEmpty(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		ds->AddDot(10, 10, 50);
+		ds->AddDot(30, 5, 4);
+
+		FILE *file=tmpfile();
+		DotFile out(fileno(file), 0);
+		long long end=out.Write(ds);
+		TS_ASSERT(end>0);
+
+		// a second, empty, section straight after the first
+		DotStore *empty=new DotStore();
+		DotFile outempty(fileno(file), end);
+		TS_ASSERT(outempty.Write(empty)>end);
+
+		DotStore *back=new DotStore();
+		DotFile in(fileno(file), 0);
+		TS_ASSERT(in.Read(back));
+		TS_ASSERT(back->IsSymmetric());
+		TS_ASSERT_EQUALS(back->GetNum(), 2);
+		TS_ASSERT_EQUALS(back->GetLogicalNum(), 3);
+
+		DotFile inempty(fileno(file), in.GetEnd());
+		TS_ASSERT(inempty.Read(back));
+		TS_ASSERT(!back->IsSymmetric());
+		TS_ASSERT_EQUALS(back->GetNum(), 0);
+
+		// and there's nothing after that
+		DotFile nothing(fileno(file), inempty.GetEnd());
+		TS_ASSERT(!nothing.Open());
+
+		fclose(file);
+		delete back;
+		delete empty;
+		delete ds;
+	}
+
+	// a header or directory entry that points past the end of the file is turned away before anything is made from it
+	void testCorrupt(void)
+	{
+		DotStore *ds=new DotStore();
+		srand(31);
+		for(int i=0; i<5000; i++)
+			ds->AddDot(rand()%20000, rand()%20000, 1+rand()%100);
+
+		FILE *file=tmpfile();
+		int fd=fileno(file);
+		DotFile out(fd, 10);
+		long long end=out.Write(ds, 4096);
+		TS_ASSERT(out.GetNumTiles()>1);
+
+		unsigned char header[DOTFILE_HEADERSIZE], entry[DOTFILE_TILEENTRYSIZE], bad[8];
+		TS_ASSERT(ReadAt(fd, header, DOTFILE_HEADERSIZE, 10));
+		long long directory=10+Get64(header+52);
+		TS_ASSERT(ReadAt(fd, entry, DOTFILE_TILEENTRYSIZE, directory));
+
+		// each damage is undone again before the next
+		struct { long long position, value; } damage[]={
+			{10+12, 0},					// no tile size
+			{10+44, 1LL<<40},				// far more tiles than there is directory
+			{10+52, end},					// the directory past the end
+			{10+60, end},					// the section past the end of the file
+			{directory+32, end},				// a tile block past the end
+			{directory+40, 1LL<<40},			// a tile block longer than the file
+			{directory+48, 1LL<<40},			// decoding to more than zlib could make of it
+			{directory+16, 1LL<<40},			// more dots than its bytes could hold
+		};
+		for(unsigned int i=0; i<sizeof(damage)/sizeof(damage[0]); i++)
+		{
+			unsigned char was[8];
+			TS_ASSERT(ReadAt(fd, was, 8, damage[i].position));
+			Put64(bad, damage[i].value);
+			TS_ASSERT(WriteAt(fd, bad, 8, damage[i].position));
+			DotFile in(fd, 10);
+			TS_ASSERT(!in.Open());
+			TS_ASSERT(WriteAt(fd, was, 8, damage[i].position));
+		}
+
+		// and put back it reads again
+		DotStore *back=new DotStore();
+		DotFile in(fd, 10);
+		TS_ASSERT(in.Read(back));
+		TS_ASSERT_EQUALS(back->GetNum(), ds->GetNum());
+
+		fclose(file);
+		delete back;
+		delete ds;
+	}
+};
@@ -1,6 +1,10 @@
 #include <cxxtest/TestSuite.h>
 
 #include "DotGrid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "DotStore.h"
 
 class MyTestSuite : public CxxTest::TestSuite
@@ -61,6 +65,475 @@ public:
 		delete ds;
 	}
 
+	// every point of the grid is what asking CountAreaMatches() about its cell gives, whatever the scale
+	void testCalculateGridCells(void)
+	{
+		for(int symmetric=0; symmetric<2; symmetric++)
+		{
+			srand(42+symmetric);
+			DotStore *ds=new DotStore();
+			ds->SetSymmetric(symmetric);
+			for(int i=0; i<5000; i++)
+			{
+				Coord x=rand()%600, y=rand()%600;
+				ds->AddDot(x, y, 1+rand()%(i%20?12:100));
+				if(i%3==0)
+					ds->AddDot(x+3+rand()%8, y+3+rand()%8, 1+rand()%12);
+			}
+			ds->Interpolate(5);
+			ds->CreateIndex();
+
+			// and some that arrive after the index
+			for(int i=0; i<200; i++)
+				ds->AddDot(rand()%600, rand()%600, 1+rand()%5);
+
+			double scales[4]={1.0, 2.5, 7.0, 31.3};
+			for(int s=0; s<4; s++)
+			{
+				double x1=-3.5, y1=11.25, scale=scales[s];
+				double x2=x1+(int)(560/scale)*scale, y2=y1+(int)(590/scale)*scale;
+
+				DotGrid *dg=new DotGrid();
+				dg->CalculateGrid(ds,x1,y1,x2,y2,scale,5);
+				for(int y=0; y<dg->GetHeight(); y++)
+					for(int x=0; x<dg->GetWidth(); x++)
+						TS_ASSERT_EQUALS(dg->GetPoint(x,y), ds->CountAreaMatches(x*scale+x1, y*scale+y1, (x+1)*scale+x1, (y+1)*scale+y1, 5));
+				delete dg;
+			}
+
+			delete ds;
+		}
+	}
+
+	// a fractional grid on whole bases is the coverage grid, and at any other scale it still holds every base once
+	void testCalculateFractionalGrid(void)
+	{
+		for(int symmetric=0; symmetric<2; symmetric++)
+		{
+			srand(43+symmetric);
+			DotStore *ds=new DotStore();
+			ds->SetSymmetric(symmetric);
+			for(int i=0; i<3000; i++)
+				ds->AddDot(rand()%900, rand()%900, 1+rand()%(i%50?30:400));
+			ds->CreateIndex();
+			for(int i=0; i<100; i++)
+				ds->AddDot(rand()%900, rand()%900, 1+rand()%30);
+
+			DotGrid *whole=new DotGrid(), *fractional=new DotGrid();
+			whole->CalculateCoverageGrid(ds,0,0,1000,1000,10);
+			fractional->CalculateFractionalGrid(ds,0,0,1000,1000,10);
+			TS_ASSERT(fractional->IsFractional());
+			TS_ASSERT_EQUALS(fractional->GetWidth(), 100);
+			for(int y=0; y<100; y++)
+				for(int x=0; x<100; x++)
+					TS_ASSERT_EQUALS(fractional->GetFraction(x,y), (float)whole->GetPoint(x,y));
+			delete whole;
+			delete fractional;
+
+			// the last column and row are the bit left over
+			double scales[3]={3.7, 13.0/3.0, 61.5};
+			for(int s=0; s<3; s++)
+			{
+				fractional=new DotGrid();
+				fractional->CalculateFractionalGrid(ds,100,50,917,1000,scales[s]);
+				TS_ASSERT_EQUALS(fractional->GetWidth(), (int)ceil(817/scales[s]));
+				TS_ASSERT_EQUALS(fractional->GetHeight(), (int)ceil(950/scales[s]));
+
+				double total=0.0;
+				for(int y=0; y<fractional->GetHeight(); y++)
+					for(int x=0; x<fractional->GetWidth(); x++)
+						total+=fractional->GetFraction(x,y);
+				TS_ASSERT_DELTA(total, (double)ds->CountAreaBases(100,50,916,999), 0.01);
+				delete fractional;
+			}
+
+			delete ds;
+		}
+
+		// a cell across two bases of a match has half of each
+		DotStore *ds=new DotStore();
+		ds->AddDot(10,10,2);
+		ds->CreateIndex();
+		DotGrid *dg=new DotGrid();
+		dg->CalculateFractionalGrid(ds,9.5,9.5,12.5,12.5,1.0);
+		TS_ASSERT_DELTA(dg->GetFraction(0,0), 0.5, 1e-6);
+		TS_ASSERT_DELTA(dg->GetFraction(1,1), 1.0, 1e-6);
+		TS_ASSERT_DELTA(dg->GetFraction(2,2), 0.5, 1e-6);
+		TS_ASSERT_DELTA(dg->GetFraction(1,0), 0.0, 1e-6);
+
+		// and flips and adds like any other grid
+		dg->FlipInplace();
+		TS_ASSERT_DELTA(dg->GetFraction(0,2), 0.5, 1e-6);
+		dg->AddInplace(dg);
+		TS_ASSERT_DELTA(dg->GetFraction(1,1), 2.0, 1e-6);
+		unsigned char *string=dg->ToString();
+		TS_ASSERT_EQUALS(string[4], 0);
+		TS_ASSERT_EQUALS(string[1], 255);
+		delete [] string;
+
+		delete dg;
+		delete ds;
+	}
+
+	// a forward and a flipped reverse store made into one grid are the grids of each flipped and added, and a
+	// transposed and moved store is the store of its dots transposed and moved
+	void testCalculateGridSources(void)
+	{
+		srand(47);
+		DotStore *forward=new DotStore(), *reverse=new DotStore(), *moved=new DotStore();
+		forward->SetSymmetric(true);
+		for(int i=0; i<3000; i++)
+		{
+			forward->AddDot(rand()%600, rand()%600, 1+rand()%(i%20?12:100));
+			Coord x=rand()%600, y=rand()%600, length=1+rand()%(i%20?12:100);
+			reverse->AddDot(x, y, length);
+			moved->AddDot(y+7, x+5, length);
+		}
+		forward->CreateIndex();
+		reverse->CreateIndex();
+		moved->CreateIndex();
+
+		DotStore *sources[2]={forward,reverse};
+		GridTransform transforms[2];
+		transforms[1].flip=true;
+		double x1=-3.5, y1=11.25, scale=7.0, x2=x1+80*scale, y2=y1+83*scale;
+
+		int types[2]={DOTGRID_INT32, DOTGRID_UINT16};
+		for(int t=0; t<2; t++)
+		{
+			DotGrid *fused=new DotGrid(), *expected=new DotGrid(), *flipped=new DotGrid();
+			fused->CalculateGrid(2,sources,transforms,x1,y1,x2,y2,scale,5,types[t]);
+			expected->CalculateGrid(forward,x1,y1,x2,y2,scale,5,DOTGRID_INT32);
+			flipped->CalculateGrid(reverse,x1,y1,x2,y2,scale,5,DOTGRID_INT32);
+			flipped->FlipInplace();
+			expected->AddInplace(flipped);
+			TS_ASSERT_EQUALS(fused->GetCellType(), types[t]);
+			bool same=true;
+			for(int y=0; y<expected->GetHeight(); y++)
+				for(int x=0; x<expected->GetWidth(); x++)
+					same=same && fused->GetPoint(x,y)==expected->GetPoint(x,y);
+			TS_ASSERT(same);
+			delete fused;
+			delete expected;
+			delete flipped;
+		}
+
+		DotGrid *fused=new DotGrid(), *expected=new DotGrid(), *flipped=new DotGrid();
+		fused->CalculateCoverageGrid(2,sources,transforms,0,0,600,600,10);
+		expected->CalculateCoverageGrid(forward,0,0,600,600,10,DOTGRID_INT32);
+		flipped->CalculateCoverageGrid(reverse,0,0,600,600,10,DOTGRID_INT32);
+		flipped->FlipInplace();
+		expected->AddInplace(flipped);
+		bool same=true;
+		for(int y=0; y<60; y++)
+			for(int x=0; x<60; x++)
+				same=same && fused->GetPoint(x,y)==expected->GetPoint(x,y);
+		TS_ASSERT(same);
+		delete fused;
+		delete expected;
+		delete flipped;
+
+		fused=new DotGrid();
+		expected=new DotGrid();
+		flipped=new DotGrid();
+		fused->CalculateFractionalGrid(2,sources,transforms,0,0,600,605,6.5);
+		expected->CalculateFractionalGrid(forward,0,0,600,605,6.5);
+		flipped->CalculateFractionalGrid(reverse,0,0,600,605,6.5);
+		flipped->FlipInplace();
+		expected->AddInplace(flipped);
+		same=true;
+		for(int y=0; y<expected->GetHeight(); y++)
+			for(int x=0; x<expected->GetWidth(); x++)
+				same=same && fabs(fused->GetFraction(x,y)-expected->GetFraction(x,y))<1e-3;
+		TS_ASSERT(same);
+		delete fused;
+		delete expected;
+		delete flipped;
+
+		// transposed, then moved
+		GridTransform transform;
+		transform.transpose=true;
+		transform.xoffset=7;
+		transform.yoffset=5;
+		for(int kind=0; kind<3; kind++)
+		{
+			fused=new DotGrid();
+			expected=new DotGrid();
+			if(kind==0)
+			{
+				fused->CalculateGrid(1,&reverse,&transform,x1,y1,x2,y2,scale,5);
+				expected->CalculateGrid(moved,x1,y1,x2,y2,scale,5);
+			}
+			else if(kind==1)
+			{
+				fused->CalculateCoverageGrid(1,&reverse,&transform,0,0,600,600,10);
+				expected->CalculateCoverageGrid(moved,0,0,600,600,10);
+			}
+			else
+			{
+				fused->CalculateFractionalGrid(1,&reverse,&transform,0,0,600,605,6.5);
+				expected->CalculateFractionalGrid(moved,0,0,600,605,6.5);
+			}
+			same=true;
+			for(int y=0; y<expected->GetHeight(); y++)
+				for(int x=0; x<expected->GetWidth(); x++)
+					if(kind==2)
+						same=same && fabs(fused->GetFraction(x,y)-expected->GetFraction(x,y))<1e-3;
+					else
+						same=same && fused->GetPoint(x,y)==expected->GetPoint(x,y);
+			TS_ASSERT(same);
+			delete fused;
+			delete expected;
+		}
+
+		delete forward;
+		delete reverse;
+		delete moved;
+	}
+
+	// every normalisation mode, from one lookup table
+	void testNormalise(void)
+	{
+		// an empty grid is white whatever the mode
+		DotGrid *dg=new DotGrid();
+		dg->Create(10,10);
+		for(int mode=DOTGRID_EQUALISE; mode<=DOTGRID_PERCENTILE; mode++)
+		{
+			unsigned char *string=dg->ToString(mode);
+			for(int pos=0; pos<100; pos++)
+				TS_ASSERT_EQUALS(string[pos], 255);
+			delete [] string;
+		}
+
+		// half empty, and the rest counting up from 1 to 50, with one outlier
+		for(int pos=0; pos<50; pos++)
+			dg->SetPoint(pos%10,pos/10+5,pos+1);
+		dg->SetPoint(0,0,1000);
+
+		unsigned char *string=dg->ToString(DOTGRID_LINEAR);
+		TS_ASSERT_EQUALS(string[0], 0);
+		TS_ASSERT_EQUALS(string[1], 255);
+		TS_ASSERT_EQUALS(string[50+49], (unsigned char)(255.-255.*50./1000.));
+		delete [] string;
+
+		// log spreads out the small counts the outlier squashes
+		string=dg->ToString(DOTGRID_LOG);
+		TS_ASSERT_EQUALS(string[0], 0);
+		TS_ASSERT_EQUALS(string[1], 255);
+		TS_ASSERT_EQUALS(string[50], (unsigned char)(255.-255.*log(2.)/log(1001.)));
+		TS_ASSERT(string[50+49]<128);
+		delete [] string;
+
+		// clipping the busiest 10% of the 51 cells ignores the outlier
+		string=dg->ToString(DOTGRID_PERCENTILE,8,0.1);
+		TS_ASSERT_EQUALS(string[0], 0);
+		TS_ASSERT_EQUALS(string[50+49], 0);
+		TS_ASSERT_EQUALS(string[50+45], 0);
+		TS_ASSERT_EQUALS(string[50+44], (unsigned char)(255.-255.*45./46.));
+		TS_ASSERT_EQUALS(string[50], (unsigned char)(255.-255./46.));
+		delete [] string;
+
+		// equalised, as it always was
+		string=dg->ToString();
+		for(int pos=50; pos<100; pos++)
+			TS_ASSERT_EQUALS(string[pos], (unsigned char)(255.-255.*100.*(double)(pos-49)/(51.*100.)));
+		TS_ASSERT_EQUALS(string[0], 0);
+		TS_ASSERT_EQUALS(string[1], 255);
+		delete [] string;
+
+		// and 16 bits
+		string=dg->ToString(DOTGRID_LINEAR,16);
+		unsigned short *wide=(unsigned short *)string;
+		TS_ASSERT_EQUALS(wide[0], 0);
+		TS_ASSERT_EQUALS(wide[1], 65535);
+		TS_ASSERT_EQUALS(wide[50+49], (unsigned short)(65535.-65535.*50./1000.));
+		delete [] string;
+
+		delete dg;
+	}
+
+	// a grid written a band at a time is the very image of one made whole
+	void testWriteBandedImage(void)
+	{
+		DotStore *forward=new DotStore();
+		DotStore *reverse=new DotStore();
+		forward->SetSymmetric(true);
+		srand(3);
+		for(int i=0; i<20000; i++)
+		{
+			forward->AddDot(rand()%5000,rand()%5000,1+rand()%40);
+			reverse->AddDot(rand()%5000,rand()%5000,1+rand()%40);
+		}
+		forward->CreateIndex();
+		reverse->CreateIndex();
+
+		char whole[]="/tmp/testDotGridXXXXXX";
+		char banded[]="/tmp/testDotGridXXXXXX";
+		close(mkstemp(whole));
+		close(mkstemp(banded));
+
+		DotGrid *dg=new DotGrid();
+		DotGrid *flipped=new DotGrid();
+		dg->CalculateGrid(forward,0,0,5000,4900,23.7,10);
+		flipped->CalculateGrid(reverse,0,0,5000,4900,23.7,10);
+		flipped->FlipInplace();
+		dg->AddInplace(flipped);
+		TS_ASSERT(dg->GetHeight()>DOTGRID_IMAGEBAND*2);
+
+		for(int mode=DOTGRID_EQUALISE; mode<=DOTGRID_PERCENTILE; mode++)
+		{
+			TS_ASSERT(dg->WriteImage(whole,IMAGEWRITER_PNM,mode,16,DOTGRID_CLIP,true));
+			TS_ASSERT(DotGrid::WriteBandedImage(banded,forward,reverse,0,0,5000,4900,23.7,10,IMAGEWRITER_PNM,mode,16,DOTGRID_CLIP,true));
+
+			FILE *a=fopen(whole,"rb"), *b=fopen(banded,"rb");
+			int ca, cb, bytes=0;
+			bool same=true;
+			do
+			{
+				ca=fgetc(a);
+				cb=fgetc(b);
+				same=same && ca==cb;
+				bytes++;
+			}
+			while(ca!=EOF && cb!=EOF);
+			fclose(a);
+			fclose(b);
+			TS_ASSERT(same);
+			TS_ASSERT(bytes>dg->GetSize()*2);
+		}
+
+		// and the levels are ToString()'s
+		TS_ASSERT(dg->WriteImage(whole,IMAGEWRITER_PNM,DOTGRID_LOG));
+		unsigned char *string=dg->ToString(DOTGRID_LOG);
+		FILE *in=fopen(whole,"rb");
+		char header[64];
+		sprintf(header,"P5\n%d %d\n255\n",dg->GetWidth(),dg->GetHeight());
+		fseek(in,strlen(header),SEEK_SET);
+		bool same=true;
+		for(int pos=0; pos<dg->GetSize(); pos++)
+			same=same && fgetc(in)==string[pos];
+		TS_ASSERT(same);
+		fclose(in);
+		delete [] string;
+
+		unlink(whole);
+		unlink(banded);
+		delete dg;
+		delete flipped;
+		delete forward;
+		delete reverse;
+	}
+
+	// narrow cells saturate, are picked to fit, and give the same grids as ints
+	void testCellTypes(void)
+	{
+		DotGrid *dg=new DotGrid();
+		dg->Create(4,3,DOTGRID_UINT8);
+		dg->SetPoint(0,0,300);
+		dg->SetPoint(1,0,-5);
+		dg->SetPoint(2,0,17);
+		TS_ASSERT_EQUALS(dg->GetPoint(0,0), 255);
+		TS_ASSERT_EQUALS(dg->GetPoint(1,0), 0);
+		TS_ASSERT_EQUALS(dg->GetPoint(2,0), 17);
+		dg->FlipInplace();
+		TS_ASSERT_EQUALS(dg->GetPoint(2,2), 17);
+		delete dg;
+
+		dg=new DotGrid();
+		dg->Create(4,3,DOTGRID_UINT16);
+		dg->SetPoint(3,1,70000);
+		TS_ASSERT_EQUALS(dg->GetPoint(3,1), 65535);
+		delete dg;
+
+		DotStore *ds=new DotStore();
+		srand(5);
+		for(int i=0; i<20000; i++)
+			ds->AddDot(rand()%3000,rand()%3000,1+rand()%30);
+		ds->CreateIndex();
+
+		// a cell 10 across can't count more than 11*11 bases, and one 30 across more than 31*31
+		DotGrid *ints=new DotGrid();
+		DotGrid *narrow=new DotGrid();
+		ints->CalculateGrid(ds,0,0,3000,3000,10,10,DOTGRID_INT32);
+		narrow->CalculateGrid(ds,0,0,3000,3000,10,10);
+		TS_ASSERT_EQUALS(ints->GetCellType(), DOTGRID_INT32);
+		TS_ASSERT_EQUALS(narrow->GetCellType(), DOTGRID_UINT8);
+		bool same=true;
+		for(int pos=0; pos<ints->GetSize(); pos++)
+			same=same && ints->GetData(pos)==narrow->GetData(pos);
+		TS_ASSERT(same);
+		unsigned char *a=ints->ToString(), *b=narrow->ToString();
+		TS_ASSERT(!memcmp(a,b,ints->GetSize()));
+		delete [] a;
+		delete [] b;
+		delete ints;
+		delete narrow;
+
+		ints=new DotGrid();
+		narrow=new DotGrid();
+		ints->CalculateCoverageGrid(ds,0,0,3000,3000,30,DOTGRID_INT32);
+		narrow->CalculateCoverageGrid(ds,0,0,3000,3000,30);
+		TS_ASSERT_EQUALS(narrow->GetCellType(), DOTGRID_UINT16);
+		same=true;
+		for(int pos=0; pos<ints->GetSize(); pos++)
+			same=same && ints->GetData(pos)==narrow->GetData(pos);
+		TS_ASSERT(same);
+		delete ints;
+		delete narrow;
+		delete ds;
+
+		// nor more than the store has. Adding widens a picked type rather than saturating it
+		ds=new DotStore();
+		for(int k=0; k<10; k++)
+			ds->AddDot(k,0,20);
+		ds->CreateIndex();
+		narrow=new DotGrid();
+		narrow->CalculateCoverageGrid(ds,0,0,100,100,100);
+		TS_ASSERT_EQUALS(narrow->GetCellType(), DOTGRID_UINT8);
+		TS_ASSERT_EQUALS(narrow->GetPoint(0,0), 200);
+		narrow->AddInplace(narrow);
+		TS_ASSERT_EQUALS(narrow->GetCellType(), DOTGRID_UINT16);
+		TS_ASSERT_EQUALS(narrow->GetPoint(0,0), 400);
+		delete narrow;
+
+		// but one asked for saturates
+		narrow=new DotGrid();
+		narrow->CalculateCoverageGrid(ds,0,0,100,100,100,DOTGRID_UINT8);
+		narrow->AddInplace(narrow);
+		TS_ASSERT_EQUALS(narrow->GetCellType(), DOTGRID_UINT8);
+		TS_ASSERT_EQUALS(narrow->GetPoint(0,0), 255);
+		delete narrow;
+		delete ds;
+	}
+
+	// one long match, not interpolated, still lights up every cell it crosses
+	void testCalculateCoverageGrid(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->AddDot(0,0,1000);
+		ds->AddDot(500,0,250);
+		ds->CreateIndex();
+
+		DotGrid *dg=new DotGrid();
+		dg->CalculateCoverageGrid(ds,0,0,1000,1000,10);
+		TS_ASSERT(dg->GetWidth()==100 && dg->GetHeight()==100);
+
+		int total=0;
+		for(int y=0; y<100; y++)
+			for(int x=0; x<100; x++)
+			{
+				total+=dg->GetPoint(x,y);
+				if(x==y)
+					TS_ASSERT(dg->GetPoint(x,y)==10);
+				if(x==y+50 && y<25)
+					TS_ASSERT(dg->GetPoint(x,y)==10);
+			}
+		TS_ASSERT(total==1250);
+
+		delete dg;
+		delete ds;
+	}
+
 	// testGridToString
 	void notestToString(void)
 	{
@@ -0,0 +1,92 @@
+#include <cxxtest/TestSuite.h>
+
+#include "DotSink.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// a store sink gives the same store as adding the dots directly
+	void testStoreSink(void)
+	{
+		DotStore *ds=new DotStore();
+		DotStoreSink sink(ds);
+		sink.SetSymmetric(true);
+		sink.AddDot(10,10,5);
+		sink.AddDot(20,5,7);
+		TS_ASSERT(sink.Close());
+
+		TS_ASSERT(ds->IsSymmetric());
+		TS_ASSERT_EQUALS(ds->GetNum(), 2);
+		TS_ASSERT_EQUALS(ds->GetLogicalNum(), 3);
+		delete ds;
+	}
+
+	// the filter passes on only the long dots, one at a time or in batches, and the counter sees them all
+	void testFilterAndCount(void)
+	{
+		CountingDotSink counter;
+		FilterDotSink filter(&counter, 10);
+
+		filter.SetSymmetric(true);
+		filter.AddDot(1,1,20);
+		filter.AddDot(5,1,9);
+
+		Dot batch[5]={{7,2,10},{8,3,3},{9,4,11},{10,5,12},{11,6,1}};
+		filter.AddDots(batch,5);
+		TS_ASSERT(filter.Close());
+
+		TS_ASSERT_EQUALS(counter.GetNum(), 4);
+		TS_ASSERT_EQUALS(counter.GetLogicalNum(), 7);
+		// the dot on the diagonal isn't mirrored
+		TS_ASSERT_EQUALS(counter.GetTotalBases(), (20+10+11+12)*2-20);
+		TS_ASSERT_EQUALS(counter.GetMaxLength(), 20);
+
+		// the doubled sum goes past what an int can hold
+		CountingDotSink big;
+		big.SetSymmetric(true);
+		big.AddDot(0,1000000000,1000000000);
+		big.AddDot(1000000000,1000000000,1000000000);
+		big.AddDot(2000000000,0,100000000);
+		TS_ASSERT_EQUALS(big.GetTotalBases(), 3200000000LL);
+	}
+
+	// a file sink streams through a small buffer, and the file maps back in as the store we would have built
+	void testFileSink(void)
+	{
+		char path[]="/tmp/testDotSinkXXXXXX";
+		int fd=mkstemp(path);
+		TS_ASSERT(fd!=-1);
+		close(fd);
+
+		DotStore *ds=new DotStore();
+		DotFileSink *sink=new DotFileSink(path, 1000);
+		for(int i=0; i<20000; i++)
+		{
+			ds->AddDot(i*3, i/7, 1+i%77);
+			sink->AddDot(i*3, i/7, 1+i%77);
+		}
+		TS_ASSERT_EQUALS(sink->GetNum(), 20000);
+		TS_ASSERT(sink->Close());
+		delete sink;
+
+		DotStore *mapped=new DotStore();
+		TS_ASSERT(mapped->MapFile(path));
+		TS_ASSERT_EQUALS(mapped->GetNum(), ds->GetNum());
+		TS_ASSERT_EQUALS(mapped->GetMaxX(), ds->GetMaxX());
+		TS_ASSERT_EQUALS(mapped->GetMaxY(), ds->GetMaxY());
+		TS_ASSERT_EQUALS(mapped->GetTotalBases(), ds->GetTotalBases());
+		TS_ASSERT_EQUALS(mapped->GetMinLength(), 1);
+		TS_ASSERT_EQUALS(mapped->GetMaxLength(), 77);
+		for(int bin=0; bin<(int)DOTSTORE_HISTOGRAMBINS; bin++)
+			TS_ASSERT_EQUALS(mapped->GetLengthHistogram(bin), ds->GetLengthHistogram(bin));
+		for(int i=0; i<20000; i+=997)
+			TS_ASSERT(mapped->GetDot(i)->x==ds->GetDot(i)->x && mapped->GetDot(i)->length==ds->GetDot(i)->length);
+
+		unlink(path);
+		delete mapped;
+		delete ds;
+	}
+};
@@ -118,6 +118,65 @@ public:
 		delete chunk;
 	}
 
+	void testFilter()
+	{
+		DotStorageChunk *chunk=new DotStorageChunk();
+		for(int i=0; i<1000; i++)
+			chunk->AddDot(i,i+1,i%7);
+
+		// the survivors keep their order
+		TS_ASSERT_EQUALS(chunk->Filter(4), 1000-(143*3-1));
+		TS_ASSERT_EQUALS(chunk->GetNum(), 143*3-1);
+		for(int i=0, n=0; i<1000; i++)
+			if(i%7>=4)
+			{
+				TS_ASSERT_EQUALS(chunk->GetDotX(n), i);
+				TS_ASSERT_EQUALS(chunk->GetDotLength(n), i%7);
+				n++;
+			}
+
+		TS_ASSERT_EQUALS(chunk->Filter(4), 0);
+		TS_ASSERT_EQUALS(chunk->Filter(100), 143*3-1);
+		TS_ASSERT(chunk->IsEmpty());
+
+		delete chunk;
+	}
+
+	void testAddDots()
+	{
+		Dot source[100];
+		for(int i=0; i<100; i++)
+		{
+			source[i].x=i;
+			source[i].y=2*i;
+			source[i].length=i+1;
+		}
+
+		DotStorageChunk *chunk=new DotStorageChunk();
+
+		// fill up to within 40 of the top, so only some of the second copy fits
+		for(int i=0; i<DOTSTORAGECHUNKSIZE-140; i++)
+			chunk->AddDot(0,0,1);
+		TS_ASSERT(chunk->AddDots(source,100,10,-5)==100);
+		TS_ASSERT(chunk->AddDots(source,100,0,0)==40);
+		TS_ASSERT(chunk->IsFull());
+
+		Dot *dot=chunk->GetDot(DOTSTORAGECHUNKSIZE-140+7);
+		TS_ASSERT(dot->x==17 && dot->y==9 && dot->length==8);
+
+		// and the in place transforms
+		chunk->Transpose();
+		TS_ASSERT(dot->x==9 && dot->y==17);
+		chunk->FlipY(100);
+		TS_ASSERT(dot->y==83);
+		chunk->FlipX(100);
+		TS_ASSERT(dot->x==91);
+		chunk->Offset(-91,17);
+		TS_ASSERT(dot->x==0 && dot->y==100 && dot->length==8);
+
+		delete chunk;
+	}
+
 	void testAddition( void )
 	{
 		TS_ASSERT( 1 + 1 > 1 );
@@ -3,6 +3,8 @@
 #include "DotStore.h"
 
 #include <stdlib.h>
+#include <memory.h>
+#include <unistd.h>
 
 class MyTestSuite : public CxxTest::TestSuite
 {
@@ -183,7 +185,7 @@ public:
 			ds->AddDot(i,i,258867-i);
 
 		// save the buffer
-		int *buffer=ds->ToBuffer();
+		Coord *buffer=ds->ToBuffer();
 
 		// delete the dotstore
 		delete ds;
@@ -207,6 +209,413 @@ public:
 // 		delete ds;
 	}
 
+	// test a store that is forced to spill most of its chunks to disk
+	void testSpill(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetMemoryLimit(4*DOTSTORAGECHUNKBYTES);
+
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+			ds->AddDot(i,int(i/100),i%1000);
+
+		TS_ASSERT(ds->GetNum()==TEST_DOTSTORE_NUMPOINTS);
+		TS_ASSERT(ds->GetNumSpilledChunks()>0);
+
+		// test they all came back correctly
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+		{
+			TS_ASSERT(ds->GetDot(i)->x==i);
+			TS_ASSERT(ds->GetDot(i)->y==int(i/100));
+			TS_ASSERT(ds->GetDot(i)->length==i%1000);
+		}
+
+		// filtering and indexing work straight off the spilled chunks
+		DotStore *filtered=ds->Filter(500);
+		TS_ASSERT(filtered->GetNum()==TEST_DOTSTORE_NUMPOINTS/2);
+		delete filtered;
+
+		ds->CreateIndex();
+		TS_ASSERT(ds->GetIndexDot(20152,201)->length==152);
+
+		// and keep up with the chunks spilled from under it
+		for(int i=0; i<3*DOTSTORAGECHUNKSIZE; i++)
+			ds->AddDot(i,-1,7);
+		TS_ASSERT(ds->GetIndexDot(20152,201)->length==152);
+		TS_ASSERT(ds->GetIndexDot(20152,-1)->length==7);
+		ds->DestroyIndex();
+
+		// a spilled dot can still be deleted
+		ds->DelDot(0);
+		TS_ASSERT(ds->GetDot(0)->x==1);
+		TS_ASSERT(ds->GetNum()==TEST_DOTSTORE_NUMPOINTS+3*DOTSTORAGECHUNKSIZE-1);
+
+		delete ds;
+	}
+
+	// a dot deleted under the index stays deleted, and the index stays, as the chunks around it are spilled
+	void testSpillUnderIndex(void)
+	{
+		DotStore *ds=new DotStore();
+		ds->SetMemoryLimit(4*DOTSTORAGECHUNKBYTES);
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+			ds->AddDot(i,int(i/100),1+i%1000);
+		ds->CreateIndex();
+
+		ds->DelDot(1);
+		Coord spilled=ds->GetNumSpilledChunks();
+		for(int i=0; i<DOTSTORAGECHUNKSIZE-200; i++)
+			ds->AddDot(i,-2,5);
+		TS_ASSERT(ds->GetNumSpilledChunks()>spilled);
+
+		TS_ASSERT(ds->GetIndexDot(1,0)==NULL);
+		TS_ASSERT_EQUALS(ds->GetIndexDot(20152,201)->length, 153);
+		TS_ASSERT_EQUALS(ds->GetIndexDot(300,-2)->length, 5);
+		TS_ASSERT_EQUALS(ds->GetNumDeleted(), 1);
+
+		// and is left out of the dots counted from the front
+		TS_ASSERT_EQUALS(ds->GetNum(), TEST_DOTSTORE_NUMPOINTS+DOTSTORAGECHUNKSIZE-201);
+		TS_ASSERT_EQUALS(ds->GetDot(1)->x, 2);
+
+		delete ds;
+	}
+
+	// the room a delete or a filter leaves in a full chunk takes the next dot, however many chunks have been filled since
+	void testRefill(void)
+	{
+		DotStore *ds=new DotStore();
+		for(int i=0; i<3*DOTSTORAGECHUNKSIZE; i++)
+			ds->AddDot(i, 0, i<DOTSTORAGECHUNKSIZE?1:5);
+		ds->DelDot(DOTSTORAGECHUNKSIZE+10);
+		ds->AddDot(-1, 0, 5);
+		TS_ASSERT_EQUALS(ds->GetDot(2*DOTSTORAGECHUNKSIZE-1)->x, -1);
+
+		ds->FilterInPlace(2);
+		TS_ASSERT_EQUALS(ds->GetNum(), 2*DOTSTORAGECHUNKSIZE);
+		ds->AddDot(-2, 0, 5);
+		TS_ASSERT_EQUALS(ds->GetDot(0)->x, -2);
+
+		delete ds;
+	}
+
+	// how many mappings we have, or -1 where there is no /proc to ask
+	int CountMappings()
+	{
+		FILE *maps=fopen("/proc/self/maps", "r");
+		if(!maps)
+			return -1;
+		int count=0;
+		for(int c=fgetc(maps); c!=EOF; c=fgetc(maps))
+			if(c=='\n')
+				count++;
+		fclose(maps);
+		return count;
+	}
+
+	// the chunks of a big store are mapped a slab at a time, and spilled a slab at a time, not one mapping each
+	void testSpillMappings(void)
+	{
+		int before=CountMappings();
+		DotStore *ds=new DotStore();
+		ds->SetMemoryLimit(4*DOTSTORAGECHUNKBYTES);
+		const int chunks=4*DOTSTORAGESLABCHUNKS;
+		for(int i=0; i<chunks*DOTSTORAGECHUNKSIZE; i++)
+			ds->AddDot(i, i%1000, 1+i%50);
+		TS_ASSERT(ds->GetNumSpilledChunks()>=chunks-5);
+
+		int after=CountMappings();
+		if(before>=0)
+			TS_ASSERT(after-before<=4*3);
+
+		TS_ASSERT_EQUALS(ds->GetDot(12345)->x, 12345);
+		delete ds;
+	}
+
+	void testMapFile(void)
+	{
+		char path[]="/tmp/testDotStoreXXXXXX";
+		int fd=mkstemp(path);
+		TS_ASSERT(fd!=-1);
+		close(fd);
+
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+			ds->AddDot(i,int(i/100),1+i%1000);
+		TS_ASSERT(ds->WriteMapFile(path));
+
+		DotStore *mapped=new DotStore();
+		TS_ASSERT(mapped->MapFile(path));
+		TS_ASSERT(mapped->GetNumBorrowedChunks()==TEST_DOTSTORE_NUMPOINTS/DOTSTORAGECHUNKSIZE);
+		TS_ASSERT(mapped->GetNumSpilledChunks()==0);
+		TS_ASSERT(mapped->IsSymmetric());
+		TS_ASSERT(mapped->GetNum()==ds->GetNum());
+		TS_ASSERT(mapped->GetLogicalNum()==ds->GetLogicalNum());
+		TS_ASSERT(mapped->GetMaxX()==ds->GetMaxX() && mapped->GetMaxY()==ds->GetMaxY());
+		TS_ASSERT(mapped->GetTotalBases()==ds->GetTotalBases());
+		TS_ASSERT(mapped->GetMaxLength()==1000);
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+			TS_ASSERT(mapped->GetDot(i)->x==i && mapped->GetDot(i)->length==1+i%1000);
+
+		// changes are copy on write. they show in the store but never reach the file
+		mapped->DelDot(0);
+		mapped->AddDot(5,5,5);
+		mapped->Offset(1,1);
+		TS_ASSERT(mapped->GetDot(0)->x==2);
+
+		DotStore *again=new DotStore();
+		TS_ASSERT(again->MapFile(path));
+		TS_ASSERT(again->GetDot(0)->x==0);
+		TS_ASSERT(again->GetDot(TEST_DOTSTORE_NUMPOINTS-1)->x==TEST_DOTSTORE_NUMPOINTS-1);
+
+		// emptying lets go of the file
+		again->Empty();
+		TS_ASSERT(again->GetNumBorrowedChunks()==0);
+		again->AddDot(1,2,3);
+		TS_ASSERT(again->GetNum()==1);
+
+		unlink(path);
+		delete again;
+		delete mapped;
+		delete ds;
+	}
+
+	void testWideCoordinates(void)
+	{
+		// the largest coordinates this build can hold, close to 2^62 when built with FRECKLE_64BIT_COORDS
+		Coord big=(Coord)1<<(sizeof(Coord)*8-2);
+		DotStore *ds=new DotStore();
+
+		ds->AddDot(big,big+7,big/2);
+		ds->AddDot(5,big-3,100);
+		ds->AddDot(big+11,9,big);
+
+		TS_ASSERT(ds->GetNum()==3);
+		TS_ASSERT(ds->GetMaxX()==big+11);
+		TS_ASSERT(ds->GetMaxY()==big+7);
+		TS_ASSERT(ds->GetDotLength(2)==big);
+
+		// through the buffer and back
+		Coord *buffer=ds->ToBuffer();
+		DotStore *copy=new DotStore();
+		copy->FromBuffer(buffer);
+		delete [] buffer;
+
+		TS_ASSERT(copy->GetNum()==3);
+		TS_ASSERT(copy->GetDotX(0)==big);
+		TS_ASSERT(copy->GetDotY(0)==big+7);
+		TS_ASSERT(copy->GetDotLength(0)==big/2);
+		TS_ASSERT(copy->GetDotY(1)==big-3);
+		TS_ASSERT(copy->GetMaxX()==big+11);
+
+		// and through the index
+		copy->CreateIndex();
+		TS_ASSERT(copy->GetIndexDot(5,big-3)!=NULL);
+		TS_ASSERT(copy->GetIndexDot(big+11,9)->length==big);
+
+		delete copy;
+		delete ds;
+	}
+
+	void testSymmetric(void)
+	{
+		// the same self comparison stored in full and by half
+		DotStore *full=new DotStore();
+		DotStore *half=new DotStore();
+		half->SetSymmetric(true);
+
+		for(int i=0; i<200; i++)
+		{
+			full->AddDot(2*i+5,i,1+(i*7)%20);
+			full->AddDot(i,2*i+5,1+(i*7)%20);
+			half->AddDot(2*i+5,i,1+(i*7)%20);
+		}
+		for(int i=0; i<400; i+=50)
+		{
+			full->AddDot(i,i,30);
+			half->AddDot(i,i,30);
+		}
+
+		// dots below the diagonal get reflected onto it
+		half->AddDot(3,100,4);
+		full->AddDot(3,100,4);
+		full->AddDot(100,3,4);
+
+		TS_ASSERT(half->GetNum()==209);
+		TS_ASSERT(half->GetLogicalNum()==full->GetNum());
+		TS_ASSERT(half->GetMaxX()==full->GetMaxX());
+		TS_ASSERT(half->GetMaxY()==full->GetMaxY());
+
+		full->CreateIndex();
+		half->CreateIndex();
+
+		TS_ASSERT(half->GetIndexDot(3,100)->length==4);
+		TS_ASSERT(half->GetIndexDot(10,25)->x==10);
+		TS_ASSERT(half->GetIndexDot(10,25)->y==25);
+		TS_ASSERT(half->GetIndexDot(11,25)==NULL);
+
+		for(int i=0; i<410; i++)
+		{
+			Dot *a=full->GetIndexLongestMatchingRowDot(i);
+			Dot *b=half->GetIndexLongestMatchingRowDot(i);
+			TS_ASSERT((a==NULL)==(b==NULL));
+			if(a && b)
+				TS_ASSERT(a->length==b->length);
+
+			a=full->GetIndexLongestMatchingColumnDot(i);
+			b=half->GetIndexLongestMatchingColumnDot(i);
+			TS_ASSERT((a==NULL)==(b==NULL));
+			if(a && b)
+				TS_ASSERT(a->length==b->length);
+		}
+
+		// the area counts should be no different
+		for(int y=0; y<410; y+=10)
+			for(int x=0; x<410; x+=10)
+				TS_ASSERT(half->CountAreaMatches(x,y,x+10,y+10,5)==full->CountAreaMatches(x,y,x+10,y+10,5));
+
+		// unfolding gives us back the full store
+		half->Unfold();
+		TS_ASSERT(!half->IsSymmetric());
+		TS_ASSERT(half->GetNum()==full->GetNum());
+		TS_ASSERT(half->GetIndexDot(10,25)->length==full->GetIndexDot(10,25)->length);
+
+		delete full;
+		delete half;
+	}
+
+	void testTransforms(void)
+	{
+		DotStore *a=new DotStore();
+		DotStore *b=new DotStore();
+		for(int i=0; i<TEST_DOTSTORE_NUMPOINTS; i++)
+		{
+			a->AddDot(i,i%500,i%7+1);
+			b->AddDot(i%300,i,i%5+1);
+		}
+
+		// stitch b in after a, offset into its own tile
+		a->Append(b,1000,2000);
+		TS_ASSERT(a->GetNum()==2*TEST_DOTSTORE_NUMPOINTS);
+		TS_ASSERT(a->GetDotX(TEST_DOTSTORE_NUMPOINTS+301)==1001);
+		TS_ASSERT(a->GetDotY(TEST_DOTSTORE_NUMPOINTS+301)==2301);
+		TS_ASSERT(a->GetDotLength(TEST_DOTSTORE_NUMPOINTS+301)==301%5+1);
+		TS_ASSERT(a->GetMaxY()==TEST_DOTSTORE_NUMPOINTS-1+2000);
+
+		// appending ourselves only takes the dots that were there to start with
+		b->Append(b);
+		TS_ASSERT(b->GetNum()==2*TEST_DOTSTORE_NUMPOINTS);
+		TS_ASSERT(b->GetDotY(TEST_DOTSTORE_NUMPOINTS+12345)==12345);
+
+		// flipping twice takes us back to where we started
+		b->FlipY(TEST_DOTSTORE_NUMPOINTS);
+		TS_ASSERT(b->GetDotY(10)==TEST_DOTSTORE_NUMPOINTS-10);
+		b->FlipY(TEST_DOTSTORE_NUMPOINTS);
+		TS_ASSERT(b->GetDotY(10)==10);
+
+		b->FlipX(300);
+		TS_ASSERT(b->GetDotX(10)==290);
+
+		b->Transpose();
+		TS_ASSERT(b->GetDotX(10)==10);
+		TS_ASSERT(b->GetDotY(10)==290);
+		TS_ASSERT(b->GetMaxX()==TEST_DOTSTORE_NUMPOINTS-1);
+
+		b->Offset(-10,5);
+		TS_ASSERT(b->GetDotX(10)==0);
+		TS_ASSERT(b->GetDotY(10)==295);
+
+		// a symmetric store stays symmetric under a diagonal offset, and unfolds when added to an ordinary one
+		DotStore *s=new DotStore();
+		s->SetSymmetric(true);
+		s->AddDot(10,2,5);
+		s->AddDot(4,4,5);
+		s->Offset(3,3);
+		TS_ASSERT(s->IsSymmetric());
+		TS_ASSERT(s->GetLogicalNum()==3);
+
+		DotStore *c=new DotStore();
+		c->Append(s);
+		TS_ASSERT(c->GetNum()==3);
+		c->CreateIndex();
+		TS_ASSERT(c->GetIndexDot(5,13)!=NULL);
+		TS_ASSERT(c->GetIndexDot(7,7)!=NULL);
+
+		// interpolation splits the long dots
+		c->Interpolate(2);
+		TS_ASSERT(c->GetNum()==9);
+
+		delete a;
+		delete b;
+		delete c;
+		delete s;
+	}
+
+	void testStatistics(void)
+	{
+		DotStore *ds=new DotStore();
+		TS_ASSERT(ds->GetMinLength()==0);
+		TS_ASSERT(ds->GetMaxLength()==0);
+
+		Coord total=0;
+		for(int i=0; i<1000; i++)
+		{
+			ds->AddDot(i,2*i,i+1);
+			total+=i+1;
+		}
+
+		TS_ASSERT(ds->GetTotalBases()==total);
+		TS_ASSERT(ds->GetMinLength()==1);
+		TS_ASSERT(ds->GetMaxLength()==1000);
+		TS_ASSERT(ds->GetLengthHistogram(0)==1);		// 1
+		TS_ASSERT(ds->GetLengthHistogram(1)==2);		// 2,3
+		TS_ASSERT(ds->GetLengthHistogram(9)==1000-511);	// 512 to 1000
+		TS_ASSERT(ds->LengthThreshold(489)==512);
+		TS_ASSERT(ds->LengthThreshold(490)==256);
+		TS_ASSERT(ds->LengthThreshold(1001)==0);
+
+		// removing the longest makes the maximum go stale
+		ds->DelDot(999);
+		ds->DelDot(0);
+		TS_ASSERT(ds->GetMaxLength()==999);
+		TS_ASSERT(ds->GetMinLength()==2);
+		TS_ASSERT(ds->GetTotalBases()==total-1001);
+
+		// the bulk operations keep them up to date too
+		DotStore *copy=new DotStore();
+		copy->Append(ds,5,5);
+		copy->Interpolate(500);
+		TS_ASSERT(copy->GetNum()==998+499);
+		TS_ASSERT(copy->GetLengthHistogram(0)==1);		// the 501 leaves a 1 behind
+		TS_ASSERT(copy->GetTotalBases()==total-1001+(1+499)*499/2);
+
+		// a symmetric store counts its reflections
+		DotStore *half=new DotStore();
+		half->SetSymmetric(true);
+		half->AddDot(10,10,3);
+		half->AddDot(20,10,6);
+		TS_ASSERT(half->GetLengthHistogram(1)==1);
+		TS_ASSERT(half->GetLengthHistogram(2)==2);
+		TS_ASSERT(half->GetTotalBases()==15);
+		half->Unfold();
+		TS_ASSERT(half->GetLengthHistogram(2)==2);
+		TS_ASSERT(half->GetTotalBases()==15);
+
+		// the sums go past what an int can hold well before the coordinates do
+		DotStore *big=new DotStore();
+		big->SetSymmetric(true);
+		big->AddDot(0,1000000000,1000000000);
+		big->AddDot(1000000000,1000000000,1000000000);
+		big->AddDot(2000000000,0,100000000);
+		TS_ASSERT(big->GetTotalBases()==3200000000LL);
+		TS_ASSERT(big->GetLengthHistogram(29)==3);
+		TS_ASSERT(big->GetLengthHistogram(26)==2);
+
+		delete big;
+		delete half;
+		delete copy;
+		delete ds;
+	}
+
 	#define RANDINT(max) (rand()%max)
 	void testFilter(void)
 	{
@@ -247,6 +656,205 @@ public:
 		delete ds;
 	}
 
+	// filtering in place drops the same dots, and counts them out
+	void testFilterInPlace(void)
+	{
+		srand(41);
+		DotStore *ds=new DotStore();
+		ds->SetSymmetric(true);
+		for(int i=0; i<20000; i++)
+			ds->AddDot(RANDINT(3000), RANDINT(3000), 1+RANDINT(60));
+		for(int i=0; i<500; i++)
+			ds->AddDot(i*5, i*5, 1+RANDINT(60));
+
+		DotStore *filtered=ds->Filter(25);
+		ds->FilterInPlace(25);
+		TS_ASSERT_EQUALS(ds->GetNum(), filtered->GetNum());
+		TS_ASSERT_EQUALS(ds->GetTotalBases(), filtered->GetTotalBases());
+		TS_ASSERT_EQUALS(ds->GetLogicalNum(), filtered->GetLogicalNum());
+		TS_ASSERT_EQUALS(ds->GetMinLength(), 25);
+		for(Coord i=0; i<ds->GetNum(); i+=97)
+			TS_ASSERT_EQUALS(ds->GetDot(i)->x, filtered->GetDot(i)->x);
+
+		delete filtered;
+		delete ds;
+	}
+
+	// answer the same queries from two stores holding the same dots
+	void CheckSameIndex(DotStore *ds, DotStore *fresh)
+	{
+		for(Coord y=0; y<1000; y+=100)
+			for(Coord x=0; x<1000; x+=100)
+			{
+				TS_ASSERT_EQUALS(ds->CountAreaMatches(x,y,x+100,y+100,10), fresh->CountAreaMatches(x,y,x+100,y+100,10));
+				TS_ASSERT_EQUALS(ds->CountAreaBases(x,y,x+99,y+99), fresh->CountAreaBases(x,y,x+99,y+99));
+			}
+
+		for(Coord p=0; p<1000; p+=7)
+		{
+			Dot *a=ds->GetIndexLongestMatchingRowDot(p), *b=fresh->GetIndexLongestMatchingRowDot(p);
+			TS_ASSERT_EQUALS(a?a->length:0, b?b->length:0);
+			a=ds->GetIndexLongestMatchingColumnDot(p);
+			b=fresh->GetIndexLongestMatchingColumnDot(p);
+			TS_ASSERT_EQUALS(a?a->length:0, b?b->length:0);
+		}
+
+		for(DotStorageChunk *chunk=fresh->GetHead(); chunk; chunk=chunk->GetNext())
+			for(int i=0; i<chunk->GetNum(); i+=13)
+			{
+				Dot *dot=chunk->GetDot(i);
+				TS_ASSERT(ds->GetIndexDot(dot->x,dot->y)!=NULL);
+				TS_ASSERT_EQUALS(ds->GetIndexDiagonalGap(dot->x,dot->y), fresh->GetIndexDiagonalGap(dot->x,dot->y));
+			}
+	}
+
+	// the same store indexed from scratch
+	DotStore *Reindexed(DotStore *ds)
+	{
+		DotStore *fresh=new DotStore();
+		fresh->SetSymmetric(ds->IsSymmetric());
+		fresh->Append(ds);
+		fresh->CreateIndex();
+		return fresh;
+	}
+
+	// the counts of a store, over the whole of it and in pieces, on a grid and from an area table
+	void CheckSameCounts(DotStore *ds, DotStore *expected)
+	{
+		TS_ASSERT_EQUALS(ds->CountAreaMatches(0,0,100,100,1), expected->CountAreaMatches(0,0,100,100,1));
+		for(Coord x=0; x<100; x+=7)
+			TS_ASSERT_EQUALS(ds->CountAreaMatches(x,0,x+7,100,1), expected->CountAreaMatches(x,0,x+7,100,1));
+		TS_ASSERT_EQUALS(ds->CountAreaBases(0,0,99,99), expected->CountAreaBases(0,0,99,99));
+
+		int grid[100], expectedgrid[100];
+		memset(grid, 0, sizeof(grid));
+		memset(expectedgrid, 0, sizeof(expectedgrid));
+		ds->AddGridMatches(grid,10,10,0,0,10.0,1);
+		expected->AddGridMatches(expectedgrid,10,10,0,0,10.0,1);
+		for(int i=0; i<100; i++)
+			TS_ASSERT_EQUALS(grid[i], expectedgrid[i]);
+
+		ds->CreateAreaTable(8);
+		expected->CreateAreaTable(8);
+		TS_ASSERT_EQUALS(ds->CountAreaBases(0,0,95,95), expected->CountAreaBases(0,0,95,95));
+	}
+
+	// dots starting at the same place are one match as long as the longest of them, as they were in the quad tree
+	void testSamePlace(void)
+	{
+		DotStore *ds=new DotStore(), *expected=new DotStore();
+		ds->AddDot(10,10,5);
+		ds->AddDot(10,10,10);
+		ds->AddDot(50,20,4);
+		ds->CreateIndex();
+		expected->AddDot(10,10,10);
+		expected->AddDot(50,20,4);
+		expected->CreateIndex();
+
+		TS_ASSERT_EQUALS(ds->CountAreaMatches(0,0,100,100,1), 14);
+		TS_ASSERT_EQUALS(ds->GetIndexDot(10,10)->length, 10);
+		CheckSameCounts(ds, expected);
+
+		// with the longest gone the other one is counted
+		ds->DelDot(1);
+		expected->Empty();
+		expected->AddDot(10,10,5);
+		expected->AddDot(50,20,4);
+		expected->CreateIndex();
+		TS_ASSERT_EQUALS(ds->GetIndexDot(10,10)->length, 5);
+		CheckSameCounts(ds, expected);
+
+		// and a longer one added after the index is made takes over
+		ds->AddDot(10,10,12);
+		ds->AddDot(50,20,2);
+		expected->Empty();
+		expected->AddDot(10,10,12);
+		expected->AddDot(50,20,4);
+		expected->CreateIndex();
+		TS_ASSERT_EQUALS(ds->GetIndexDot(10,10)->length, 12);
+		CheckSameCounts(ds, expected);
+
+		delete ds;
+		delete expected;
+	}
+
+	// a dot where no other dot of the test has been put, on or above the diagonal so a symmetric store keeps it there.
+	// p steps through the million places of a thousand by thousand plot without coming back to any
+	void AddPlaced(DotStore *ds, int &n, Coord length)
+	{
+		Coord p;
+		do
+			p=((Coord)n++*7919)%1000000;
+		while(p%1000<p/1000);
+		ds->AddDot(p%1000, p/1000, length);
+	}
+
+	// dots added, deleted and filtered after the index is made are found by the queries as if it had been made then
+	void testIncrementalIndex(void)
+	{
+		for(int symmetric=0; symmetric<2; symmetric++)
+		{
+			srand(43+symmetric);
+			int placed=0;
+			DotStore *ds=new DotStore();
+			ds->SetSymmetric(symmetric);
+			for(int i=0; i<30000; i++)
+				AddPlaced(ds, placed, 1+RANDINT(40));
+			ds->CreateIndex();
+
+			// a few at a time, with queries in between
+			for(int batch=0; batch<4; batch++)
+			{
+				for(int i=0; i<50; i++)
+					AddPlaced(ds, placed, 1+RANDINT(200));
+				TS_ASSERT(ds->IsIndexed());
+				DotStore *fresh=Reindexed(ds);
+				CheckSameIndex(ds, fresh);
+				delete fresh;
+			}
+
+			// a whole store at once, more than is kept pending
+			DotStore *more=new DotStore();
+			for(int i=0; i<10000; i++)
+				AddPlaced(more, placed, 1+RANDINT(40));
+			ds->Append(more);
+			delete more;
+			DotStore *fresh=Reindexed(ds);
+			CheckSameIndex(ds, fresh);
+			delete fresh;
+
+			// deleted dots are only marked under the index, pending ones included
+			for(int i=0; i<100; i++)
+			{
+				ds->DelDot(RANDINT(ds->GetNum()));
+				if(i%10==0)
+					AddPlaced(ds, placed, 1+RANDINT(40));
+			}
+			ds->AddDot(500, 500, 300);
+			ds->DelDot(ds->GetNum()-2);
+			fresh=Reindexed(ds);
+			CheckSameIndex(ds, fresh);
+			delete fresh;
+			TS_ASSERT_EQUALS(ds->GetNumDeleted(), 101);
+
+			// as are the few a filter drops
+			ds->FilterInPlace(2);
+			fresh=Reindexed(ds);
+			CheckSameIndex(ds, fresh);
+			delete fresh;
+			TS_ASSERT(ds->GetNumDeleted()>101);
+
+			// until so many go that the index is made again without them
+			ds->FilterInPlace(20);
+			fresh=Reindexed(ds);
+			CheckSameIndex(ds, fresh);
+			delete fresh;
+			TS_ASSERT_EQUALS(ds->GetNumDeleted(), 0);
+
+			delete ds;
+		}
+	}
+
 	// data must be in i,x,y,len columns, whitespace delimited
 	#define DATASET		"segfaultdata.txt"
 
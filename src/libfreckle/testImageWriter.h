@@ -0,0 +1,145 @@
+#include <cxxtest/TestSuite.h>
+
+#include "ImageWriter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// read a whole file back
+	unsigned char *Slurp(const char *path, size_t &length)
+	{
+		FILE *in=fopen(path,"rb");
+		TS_ASSERT(in);
+		fseek(in,0,SEEK_END);
+		length=ftell(in);
+		fseek(in,0,SEEK_SET);
+		unsigned char *data=new unsigned char[length];
+		TS_ASSERT_EQUALS(fread(data,1,length,in), length);
+		fclose(in);
+		return data;
+	}
+
+	unsigned int GetBigEndian(const unsigned char *p)
+	{
+		return ((unsigned int)p[0]<<24)|((unsigned int)p[1]<<16)|((unsigned int)p[2]<<8)|p[3];
+	}
+
+	// some rows that won't compress much, so the PNG needs several IDAT chunks
+	unsigned char *Noise(int bytes)
+	{
+		unsigned char *rows=new unsigned char[bytes];
+		srand(17);
+		for(int i=0; i<bytes; i++)
+			rows[i]=rand()&0xff;
+		return rows;
+	}
+
+	void testPGM(void)
+	{
+		char path[]="/tmp/testImageWriterXXXXXX";
+		close(mkstemp(path));
+
+		unsigned short samples[6]={0,1,255,256,65534,65535};
+
+		ImageWriter writer;
+		TS_ASSERT(writer.Open(path,3,2,IMAGEWRITER_PNM,16));
+		TS_ASSERT_EQUALS(writer.GetRowBytes(), 6);
+		TS_ASSERT(writer.WriteRows((unsigned char *)samples,1));
+		TS_ASSERT(writer.WriteRows((unsigned char *)(samples+3),1,true));
+		TS_ASSERT(writer.Close());
+
+		// big endian, and the second row inverted
+		size_t length;
+		unsigned char *data=Slurp(path,length);
+		const char *header="P5\n3 2\n65535\n";
+		TS_ASSERT_EQUALS(length, strlen(header)+12);
+		TS_ASSERT(!memcmp(data,header,strlen(header)));
+		const unsigned char expected[12]={0,0, 0,1, 0,255, 254,255, 0,1, 0,0};
+		TS_ASSERT(!memcmp(data+strlen(header),expected,12));
+
+		// short of rows is a failure
+		TS_ASSERT(writer.Open(path,3,2,IMAGEWRITER_PNM,8,3));
+		TS_ASSERT(writer.WriteRows((unsigned char *)samples,1));
+		TS_ASSERT(!writer.Close());
+
+		delete [] data;
+		unlink(path);
+	}
+
+	// the chunks are sound and the image data inflates back to the rows
+	void testPNG(void)
+	{
+		char path[]="/tmp/testImageWriterXXXXXX";
+		close(mkstemp(path));
+
+		int width=1000, height=300;
+		unsigned char *rows=Noise(width*height);
+
+		ImageWriter writer;
+		TS_ASSERT(writer.Open(path,width,height));
+		for(int y=0; y<height; y+=7)
+			TS_ASSERT(writer.WriteRows(rows+y*width,y+7<height?7:height-y,true));
+		TS_ASSERT(writer.Close());
+
+		size_t length;
+		unsigned char *data=Slurp(path,length);
+		const unsigned char signature[8]={137,'P','N','G','\r','\n',26,'\n'};
+		TS_ASSERT(!memcmp(data,signature,8));
+
+		// gather the IDATs, checking every CRC
+		unsigned char *compressed=new unsigned char[length];
+		size_t compressedlength=0;
+		int idats=0;
+		bool ended=false;
+		for(size_t pos=8; pos<length;)
+		{
+			unsigned int chunklength=GetBigEndian(data+pos);
+			const unsigned char *type=data+pos+4;
+			uLong crc=crc32(crc32(0L,Z_NULL,0),type,chunklength+4);
+			TS_ASSERT_EQUALS(crc, GetBigEndian(type+4+chunklength));
+
+			if(!memcmp(type,"IHDR",4))
+			{
+				TS_ASSERT_EQUALS(GetBigEndian(type+4), (unsigned int)width);
+				TS_ASSERT_EQUALS(GetBigEndian(type+8), (unsigned int)height);
+				TS_ASSERT_EQUALS(type[12], 8);
+				TS_ASSERT_EQUALS(type[13], 0);
+			}
+			else if(!memcmp(type,"IDAT",4))
+			{
+				memcpy(compressed+compressedlength,type+4,chunklength);
+				compressedlength+=chunklength;
+				idats++;
+			}
+			else if(!memcmp(type,"IEND",4))
+				ended=true;
+			pos+=chunklength+12;
+		}
+		TS_ASSERT(ended);
+		TS_ASSERT(idats>1);
+
+		// every row behind its filter byte, inverted
+		uLongf rawlength=(width+1)*height;
+		unsigned char *raw=new unsigned char[rawlength];
+		TS_ASSERT_EQUALS(uncompress(raw,&rawlength,compressed,compressedlength), Z_OK);
+		TS_ASSERT_EQUALS(rawlength, (uLongf)(width+1)*height);
+		bool same=true;
+		for(int y=0; y<height; y++)
+		{
+			same=same && raw[y*(width+1)]==0;
+			for(int x=0; x<width; x++)
+				same=same && raw[y*(width+1)+1+x]==255-rows[y*width+x];
+		}
+		TS_ASSERT(same);
+
+		delete [] raw;
+		delete [] compressed;
+		delete [] data;
+		delete [] rows;
+		unlink(path);
+	}
+};
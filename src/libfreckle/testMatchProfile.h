@@ -0,0 +1,123 @@
+#include <cxxtest/TestSuite.h>
+
+#include "MatchProfile.h"
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// the longest match starting on, and covering, row or column p, the slow way
+	Coord Longest(DotStore *ds, Coord p, bool column, bool covering)
+	{
+		Coord longest=0;
+		for(DotStorageChunk *chunk=ds->GetHead(); chunk; chunk=chunk->GetNext())
+			for(int i=0; i<chunk->GetNum(); i++)
+			{
+				Dot *dot=chunk->GetDot(i);
+				Coord start=column?dot->x:dot->y;
+				if((covering?(p>=start && p<start+dot->length):p==start) && dot->length>longest)
+					longest=dot->length;
+			}
+		return longest;
+	}
+
+	// the profile gives what looking at every dot would
+	void testProfile(void)
+	{
+		srand(31);
+		DotStore *ds=new DotStore();
+		for(int i=0; i<3000; i++)
+			ds->AddDot(rand()%1000, rand()%700, 1+rand()%(i%10?10:200));
+
+		MatchProfile *profile=new MatchProfile(ds->GetHead(), ds->GetNum(), false);
+		TS_ASSERT(profile->GetWidth()>=1000 && profile->GetWidth()<=1200);
+		TS_ASSERT(profile->GetHeight()>=700 && profile->GetHeight()<=900);
+
+		for(Coord p=0; p<1250; p++)
+		{
+			TS_ASSERT_EQUALS(profile->GetRowLength(p), Longest(ds,p,false,false));
+			TS_ASSERT_EQUALS(profile->GetColumnLength(p), Longest(ds,p,true,false));
+			TS_ASSERT_EQUALS(profile->GetRowCover(p), Longest(ds,p,false,true));
+			TS_ASSERT_EQUALS(profile->GetColumnCover(p), Longest(ds,p,true,true));
+		}
+
+		// and says where the longest matches start
+		ds->CreateIndex();
+		for(Coord p=0; p<700; p++)
+		{
+			if(profile->GetRowLength(p))
+				TS_ASSERT(ds->GetIndexDot(profile->GetRowX(p), p)!=NULL);
+			if(profile->GetColumnLength(p))
+				TS_ASSERT(ds->GetIndexDot(p, profile->GetColumnY(p))!=NULL);
+		}
+
+		delete profile;
+		delete ds;
+	}
+
+	// a symmetric store profiles as its unfolded self does, and the row and column lookups come from the profile
+	void testSymmetric(void)
+	{
+		srand(37);
+		DotStore *half=new DotStore(), *full=new DotStore();
+		half->SetSymmetric(true);
+		for(int i=0; i<2000; i++)
+		{
+			Coord y=rand()%500, x=y+rand()%(500-y), length=1+rand()%30;
+			half->AddDot(x, y, length);
+			full->AddDot(x, y, length);
+			if(x!=y)
+				full->AddDot(y, x, length);
+		}
+		half->CreateIndex();
+		full->CreateIndex();
+
+		// looked up before and after the profile is made
+		Coord rows[600], columns[600];
+		for(Coord p=0; p<600; p++)
+		{
+			Dot *dot=half->GetIndexLongestMatchingRowDot(p);
+			rows[p]=dot?dot->length:0;
+			dot=half->GetIndexLongestMatchingColumnDot(p);
+			columns[p]=dot?dot->length:0;
+		}
+
+		MatchProfile *profile=half->GetProfile();
+		MatchProfile *unfolded=full->GetProfile();
+		TS_ASSERT_EQUALS(profile->GetWidth(), unfolded->GetWidth());
+		TS_ASSERT_EQUALS(profile->GetHeight(), unfolded->GetHeight());
+		for(Coord p=0; p<600; p++)
+		{
+			TS_ASSERT_EQUALS(profile->GetRowLength(p), unfolded->GetRowLength(p));
+			TS_ASSERT_EQUALS(profile->GetColumnLength(p), unfolded->GetColumnLength(p));
+			TS_ASSERT_EQUALS(profile->GetRowCover(p), unfolded->GetRowCover(p));
+			TS_ASSERT_EQUALS(profile->GetColumnCover(p), unfolded->GetColumnCover(p));
+
+			Dot *dot=half->GetIndexLongestMatchingRowDot(p);
+			TS_ASSERT_EQUALS(dot?dot->length:0, rows[p]);
+			if(dot)
+				TS_ASSERT(half->GetIndexDot(dot->x, dot->y)!=NULL);
+			dot=half->GetIndexLongestMatchingColumnDot(p);
+			TS_ASSERT_EQUALS(dot?dot->length:0, columns[p]);
+			if(dot)
+				TS_ASSERT(half->GetIndexDot(dot->x, dot->y)!=NULL);
+		}
+
+		delete half;
+		delete full;
+	}
+
+	// an empty store has an empty profile
+	void testEmpty(void)
+	{
+		DotStore *ds=new DotStore();
+		MatchProfile *profile=new MatchProfile(ds->GetHead(), 0, false);
+		TS_ASSERT_EQUALS(profile->GetWidth(), 0);
+		TS_ASSERT_EQUALS(profile->GetRowLength(0), 0);
+		TS_ASSERT_EQUALS(profile->GetColumnCover(5), 0);
+		delete profile;
+		delete ds;
+	}
+};
@@ -0,0 +1,205 @@
+#include <cxxtest/TestSuite.h>
+
+#include "MortonIndex.h"
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	static int ComparePlaces(const void *a, const void *b)
+	{
+		const Dot *da=(const Dot *)a, *db=(const Dot *)b;
+		if(da->x!=db->x)
+			return da->x<db->x?-1:1;
+		if(da->y!=db->y)
+			return da->y<db->y?-1:1;
+		return 0;
+	}
+
+	// how many places of the store have dots in the rectangle, the slow way. Dots at the same place are one match
+	Coord Count(DotStore *ds, Coord x1, Coord y1, Coord x2, Coord y2)
+	{
+		Dot *found=new Dot[ds->GetNum()>0?ds->GetNum():1];
+		Coord n=0;
+		for(DotStorageChunk *chunk=ds->GetHead(); chunk; chunk=chunk->GetNext())
+			for(int i=0; i<chunk->GetNum(); i++)
+			{
+				Dot *dot=chunk->GetDot(i);
+				if(dot->x>=x1 && dot->x<=x2 && dot->y>=y1 && dot->y<=y2)
+					found[n++]=*dot;
+			}
+
+		qsort(found, n, sizeof(Dot), ComparePlaces);
+		Coord count=0;
+		for(Coord i=0; i<n; i++)
+			if(!i || ComparePlaces(found+i-1, found+i))
+				count++;
+		delete [] found;
+		return count;
+	}
+
+	// queries give what looking at every dot would, in and around the dots and on their edges
+	void testQueries(void)
+	{
+		srand(17);
+		DotStore *ds=new DotStore();
+		for(int i=0; i<50000; i++)
+			ds->AddDot(1000+rand()%30000, 500+rand()%20000, 1+rand()%50);
+
+		MortonIndex *index=new MortonIndex(ds->GetHead(), ds->GetNum());
+		TS_ASSERT_EQUALS(index->GetNum(), 50000);
+
+		for(int q=0; q<200; q++)
+		{
+			Coord x1=rand()%32000, y1=rand()%22000;
+			Coord x2=x1+rand()%(q%2?50:5000), y2=y1+rand()%(q%2?50:5000);
+			LinkedListVal<Dot *> *result=index->SpatialQuery(x1,y1,x2,y2);
+			TS_ASSERT_EQUALS(result->Length(), Count(ds,x1,y1,x2,y2));
+			for(LinkedListVal<Dot *>::Iterator i(*result); !i.Done(); i++)
+				TS_ASSERT((*i)->x>=x1 && (*i)->x<=x2 && (*i)->y>=y1 && (*i)->y<=y2);
+			delete result;
+		}
+
+		// every dot can be found where it is
+		for(int i=0; i<50000; i+=101)
+		{
+			Dot *dot=ds->GetDot(i);
+			LinkedListVal<Dot *> *result=index->SpatialQuery(dot->x,dot->y,dot->x,dot->y);
+			TS_ASSERT_EQUALS(result->Length(), Count(ds,dot->x,dot->y,dot->x,dot->y));
+			delete result;
+
+			Dot *found=index->GetDot(dot->x,dot->y);
+			TS_ASSERT(found && found->x==dot->x && found->y==dot->y);
+		}
+
+		// and nothing is found where there are no dots
+		for(int q=0; q<1000; q++)
+		{
+			Coord x=rand()%32000, y=rand()%22000;
+			TS_ASSERT_EQUALS(index->GetDot(x,y)!=NULL, Count(ds,x,y,x,y)>0);
+		}
+		TS_ASSERT(index->GetDot(0,0)==NULL);
+		TS_ASSERT(index->GetDot(100000,100000)==NULL);
+
+		// and all of them at once
+		LinkedListVal<Dot *> *result=index->SpatialQuery(0,0,100000,100000);
+		TS_ASSERT_EQUALS(result->Length(), 50000);
+		delete result;
+
+		delete index;
+		delete ds;
+	}
+
+	// counting, and filling a buffer, agree with a listing
+	void testCountAndBuffer(void)
+	{
+		srand(5);
+		DotStore *ds=new DotStore();
+		for(int i=0; i<20000; i++)
+			ds->AddDot(rand()%5000, rand()%5000, 1);
+		MortonIndex *index=new MortonIndex(ds->GetHead(), ds->GetNum());
+
+		Dot *buffer[64];
+		for(int q=0; q<200; q++)
+		{
+			Coord x1=rand()%5000, y1=rand()%5000;
+			Coord x2=x1+rand()%(q%2?30:2000), y2=y1+rand()%(q%2?30:2000);
+			Coord expected=Count(ds,x1,y1,x2,y2);
+
+			TS_ASSERT_EQUALS(index->Count(x1,y1,x2,y2), expected);
+			TS_ASSERT_EQUALS(index->SpatialQuery(x1,y1,x2,y2,buffer,64), expected);
+			for(int i=0; i<expected && i<64; i++)
+				TS_ASSERT(buffer[i]->x>=x1 && buffer[i]->x<=x2 && buffer[i]->y>=y1 && buffer[i]->y<=y2);
+		}
+
+		delete index;
+		delete ds;
+	}
+
+	// an empty store, and dots all in the same place, make indexes that still answer
+	void testDegenerate(void)
+	{
+		DotStore *ds=new DotStore();
+		MortonIndex *index=new MortonIndex(ds->GetHead(), 0);
+		LinkedListVal<Dot *> *result=index->SpatialQuery(0,0,10,10);
+		TS_ASSERT_EQUALS(result->Length(), 0);
+		delete result;
+		delete index;
+
+		for(int i=0; i<100; i++)
+			ds->AddDot(7,9,i+1);
+		index=new MortonIndex(ds->GetHead(), ds->GetNum());
+		result=index->SpatialQuery(7,9,7,9);
+		TS_ASSERT_EQUALS(result->Length(), 1);
+		delete result;
+		result=index->SpatialQuery(8,9,20,20);
+		TS_ASSERT_EQUALS(result->Length(), 0);
+		delete result;
+
+		// they are one match, as long as the longest of them
+		TS_ASSERT_EQUALS(index->GetNum(), 1);
+		TS_ASSERT_EQUALS(index->GetDot(7,9)->length, 100);
+		TS_ASSERT_EQUALS(index->Count(0,0,7,9), 1);
+		delete index;
+		delete ds;
+	}
+
+	// dots spread across the whole coordinate range lose the low bits of their codes, but are still found exactly
+	void testWideSpread(void)
+	{
+		DotStore *ds=new DotStore();
+		Coord far=(sizeof(Coord)==8)?(Coord)1<<40:(Coord)1<<30;
+		for(int i=0; i<1000; i++)
+			ds->AddDot(i*(far/1000)+i%3, i%3, 5);
+		ds->AddDot(far, far, 5);
+
+		// a copy of one, and a dot just beside it with the same code
+		Coord x1=far/1000+1;
+		ds->AddDot(x1, 1, 9);
+		ds->AddDot(x1+1, 1, 5);
+
+		MortonIndex *index=new MortonIndex(ds->GetHead(), ds->GetNum());
+		TS_ASSERT_EQUALS(index->GetNum(), 1002);
+		TS_ASSERT_EQUALS(index->GetDot(x1,1)->length, 9);
+		TS_ASSERT_EQUALS(index->GetDot(x1+1,1)->length, 5);
+		for(int i=0; i<1000; i+=37)
+		{
+			Coord x=i*(far/1000)+i%3;
+			LinkedListVal<Dot *> *result=index->SpatialQuery(x,0,x,2);
+			TS_ASSERT_EQUALS(result->Length(), 1);
+			delete result;
+			result=index->SpatialQuery(x+1,0,x+1,far);
+			TS_ASSERT_EQUALS(result->Length(), 0);
+			delete result;
+		}
+		LinkedListVal<Dot *> *result=index->SpatialQuery(far,far,far,far);
+		TS_ASSERT_EQUALS(result->Length(), 1);
+		delete result;
+
+		delete index;
+		delete ds;
+	}
+
+	// a store spanning all 32 bits of the codes, with a crowd of dots right up in the last corner of the tree
+	void testFullSpan(void)
+	{
+		Coord low=-((Coord)1<<30), high=((Coord)1<<30)+((Coord)1<<29);
+		DotStore *ds=new DotStore();
+		ds->AddDot(low, low, 1);
+		for(int i=0; i<100; i++)
+			ds->AddDot(high-i%10, high-i/10, 1);
+
+		MortonIndex *index=new MortonIndex(ds->GetHead(), ds->GetNum());
+		LinkedListVal<Dot *> *result=index->SpatialQuery(high-4,high-9,high,high);
+		TS_ASSERT_EQUALS(result->Length(), 50);
+		delete result;
+		result=index->SpatialQuery(low,low,high,high);
+		TS_ASSERT_EQUALS(result->Length(), 101);
+		delete result;
+
+		delete index;
+		delete ds;
+	}
+};
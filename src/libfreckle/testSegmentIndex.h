@@ -0,0 +1,135 @@
+#include <cxxtest/TestSuite.h>
+
+#include "SegmentIndex.h"
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+// remembers how many segments it saw and how much of them
+struct TallyVisitor
+{
+	Coord segments, bases;
+
+	TallyVisitor() { segments=bases=0; }
+
+	inline void Visit(Dot *dot, Coord first, Coord last) { segments++; bases+=last-first+1; }
+};
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// how many of the store's segments cross the rectangle, and how many of their bases are in it, the slow way
+	void Tally(DotStore *ds, Coord x1, Coord y1, Coord x2, Coord y2, Coord *segments, Coord *bases)
+	{
+		*segments=*bases=0;
+		for(DotStorageChunk *chunk=ds->GetHead(); chunk; chunk=chunk->GetNext())
+			for(int i=0; i<chunk->GetNum(); i++)
+			{
+				Dot *dot=chunk->GetDot(i);
+				Coord in=0;
+				for(Coord t=0; t<dot->length; t++)
+					if(dot->x+t>=x1 && dot->x+t<=x2 && dot->y+t>=y1 && dot->y+t<=y2)
+						in++;
+				if(in)
+				{
+					(*segments)++;
+					*bases+=in;
+				}
+			}
+	}
+
+	// queries find every segment crossing a rectangle, long or short, and clip it exactly
+	void testQueries(void)
+	{
+		srand(41);
+		DotStore *ds=new DotStore();
+		for(int i=0; i<5000; i++)
+			ds->AddDot(rand()%20000, rand()%20000, 1+rand()%(i%50?30:5000));
+
+		SegmentIndex *index=new SegmentIndex(ds->GetHead(), ds->GetNum());
+		TS_ASSERT_EQUALS(index->GetNum(), 5000);
+
+		for(int q=0; q<100; q++)
+		{
+			Coord x1=rand()%22000, y1=rand()%22000;
+			Coord x2=x1+rand()%(q%2?20:3000), y2=y1+rand()%(q%2?20:3000);
+
+			TallyVisitor visitor;
+			index->Query(x1,y1,x2,y2,visitor);
+
+			Coord segments, bases;
+			Tally(ds,x1,y1,x2,y2,&segments,&bases);
+			TS_ASSERT_EQUALS(visitor.segments, segments);
+			TS_ASSERT_EQUALS(visitor.bases, bases);
+			TS_ASSERT_EQUALS(index->CountBases(x1,y1,x2,y2), bases);
+		}
+
+		delete index;
+		delete ds;
+	}
+
+	// a store counts the same bases whether its long matches have been chopped up or not
+	void testInterpolated(void)
+	{
+		srand(43);
+		DotStore *whole=new DotStore(), *chopped=new DotStore();
+		for(int i=0; i<2000; i++)
+		{
+			// one match to a diagonal, so none overlap
+			Coord y=rand()%10000, length=1+rand()%(i%20?20:2000);
+			whole->AddDot(y+i*7-7000, y, length);
+			chopped->AddDot(y+i*7-7000, y, length);
+		}
+		chopped->Interpolate(10);
+		TS_ASSERT(chopped->GetNum()>whole->GetNum());
+		whole->CreateIndex();
+		chopped->CreateIndex();
+
+		for(int q=0; q<200; q++)
+		{
+			Coord x1=rand()%12000-2000, y1=rand()%12000;
+			Coord x2=x1+rand()%500, y2=y1+rand()%500;
+			Coord segments, bases;
+			Tally(whole,x1,y1,x2,y2,&segments,&bases);
+			TS_ASSERT_EQUALS(whole->CountAreaBases(x1,y1,x2,y2), bases);
+			TS_ASSERT_EQUALS(chopped->CountAreaBases(x1,y1,x2,y2), bases);
+		}
+
+		delete whole;
+		delete chopped;
+	}
+
+	// a symmetric store counts its reflections, and the cells of a grid add up to the whole
+	void testSymmetric(void)
+	{
+		srand(47);
+		DotStore *half=new DotStore(), *full=new DotStore();
+		half->SetSymmetric(true);
+		for(int i=0; i<1000; i++)
+		{
+			Coord y=rand()%1000, x=y+(i%3?1+i:0), length=1+rand()%100;
+			half->AddDot(x, y, length);
+			full->AddDot(x, y, length);
+			if(x!=y)
+				full->AddDot(y, x, length);
+		}
+		half->CreateIndex();
+		full->CreateIndex();
+
+		for(int q=0; q<200; q++)
+		{
+			Coord x1=rand()%2200, y1=rand()%2200;
+			Coord x2=x1+rand()%300, y2=y1+rand()%300;
+			TS_ASSERT_EQUALS(half->CountAreaBases(x1,y1,x2,y2), full->CountAreaBases(x1,y1,x2,y2));
+		}
+
+		Coord total=0;
+		for(Coord y=0; y<2200; y+=100)
+			for(Coord x=0; x<2200; x+=100)
+				total+=half->CountAreaBases(x,y,x+99,y+99);
+		TS_ASSERT_EQUALS(total, half->CountAreaBases(0,0,2199,2199));
+
+		delete half;
+		delete full;
+	}
+};
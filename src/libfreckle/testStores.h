@@ -0,0 +1,20 @@
+#ifndef _TESTSTORES_H_
+#define _TESTSTORES_H_
+
+#include "DotStore.h"
+
+#include <stdlib.h>
+
+// the stores the pyramid suites build their plots from, not a suite itself. num short random dots over a 1000 by 700
+// plot, with every twentieth one up to 100 long, indexed. The same seed always makes the same store
+static DotStore *MakeRandomStore(int seed, int num)
+{
+	srand(seed);
+	DotStore *ds=new DotStore();
+	for(int i=0; i<num; i++)
+		ds->AddDot(rand()%1000, rand()%700, 1+rand()%(i%20?12:100));
+	ds->CreateIndex();
+	return ds;
+}
+
+#endif
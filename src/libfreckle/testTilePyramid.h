@@ -0,0 +1,190 @@
+#include <cxxtest/TestSuite.h>
+
+#include "TilePyramid.h"
+#include "testStores.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+class MyTestSuite : public CxxTest::TestSuite
+{
+public:
+	// the pixels of a PGM, and its size. NULL if it isn't there
+	unsigned char *ReadPGM(const char *path, int &width, int &height)
+	{
+		FILE *in=fopen(path,"rb");
+		if(!in)
+			return NULL;
+		int max;
+		TS_ASSERT_EQUALS(fscanf(in,"P5 %d %d %d",&width,&height,&max), 3);
+		fgetc(in);
+		unsigned char *pixels=new unsigned char[width*height];
+		TS_ASSERT_EQUALS(fread(pixels,1,width*height,in), (size_t)(width*height));
+		fclose(in);
+		return pixels;
+	}
+
+	// a level put back together from its tiles
+	unsigned char *ReadLevel(const char *path, int layout, int zoom, int width, int height, int tilesize)
+	{
+		unsigned char *level=new unsigned char[width*height];
+		char name[256];
+		for(int row=0; row*tilesize<height; row++)
+			for(int column=0; column*tilesize<width; column++)
+			{
+				if(layout==TILEPYRAMID_XYZ)
+					snprintf(name,sizeof(name),"%s/%d/%d/%d.pgm",path,zoom,column,row);
+				else
+					snprintf(name,sizeof(name),"%s_files/%d/%d_%d.pgm",path,zoom,column,row);
+				int tilewidth, tileheight;
+				unsigned char *tile=ReadPGM(name,tilewidth,tileheight);
+				TS_ASSERT(tile);
+				if(!tile)
+					continue;
+
+				int cells=width-column*tilesize<tilesize?width-column*tilesize:tilesize;
+				int rows=height-row*tilesize<tilesize?height-row*tilesize:tilesize;
+				bool full=layout==TILEPYRAMID_XYZ;
+				TS_ASSERT_EQUALS(tilewidth, full?tilesize:cells);
+				TS_ASSERT_EQUALS(tileheight, full?tilesize:rows);
+				for(int y=0; y<rows; y++)
+					memcpy(level+(row*tilesize+y)*width+column*tilesize,tile+y*tilewidth,cells);
+				delete [] tile;
+			}
+		return level;
+	}
+
+	// the image WriteImage() makes of a grid
+	unsigned char *GridImage(DotGrid *grid)
+	{
+		char path[]="/tmp/testTilePyramidXXXXXX";
+		close(mkstemp(path));
+		TS_ASSERT(grid->WriteImage(path,IMAGEWRITER_PNM));
+		int width, height;
+		unsigned char *pixels=ReadPGM(path,width,height);
+		unlink(path);
+		return pixels;
+	}
+
+	// every level is the image of its grid: the finest the grid of the dots, and each of the others the means of the
+	// one below it, rounded up
+	void testXYZ(void)
+	{
+		DotStore *forward=MakeRandomStore(48,4000), *reverse=MakeRandomStore(49,4000);
+		DotStore *sources[2]={forward,reverse};
+		GridTransform transforms[2];
+		transforms[1].flip=true;
+
+		char path[]="/tmp/testTilePyramidXXXXXX";
+		TS_ASSERT(mkdtemp(path));
+		TilePyramid pyramid;
+		TS_ASSERT(pyramid.Write(path,2,sources,transforms,1000,700,5.0,5,TILEPYRAMID_XYZ,32,IMAGEWRITER_PNM));
+
+		// 200 by 140, then 100 by 70, 50 by 35 and 25 by 18, which fits in a tile
+		TS_ASSERT_EQUALS(pyramid.GetNumLevels(), 4);
+		TS_ASSERT_EQUALS(pyramid.GetLevelWidth(3), 200);
+		TS_ASSERT_EQUALS(pyramid.GetLevelHeight(3), 140);
+		TS_ASSERT_EQUALS(pyramid.GetLevelHeight(0), 18);
+
+		DotGrid *grid=new DotGrid();
+		grid->CalculateGrid(2,sources,transforms,0,0,1000,700,5.0,5,DOTGRID_INT32);
+		for(int zoom=3; zoom>=0; zoom--)
+		{
+			int width=pyramid.GetLevelWidth(zoom), height=pyramid.GetLevelHeight(zoom);
+			TS_ASSERT(grid->GetWidth()==width && grid->GetHeight()==height);
+
+			unsigned char *expected=GridImage(grid);
+			unsigned char *level=ReadLevel(path,TILEPYRAMID_XYZ,zoom,width,height,32);
+			TS_ASSERT(!memcmp(level,expected,width*height));
+			delete [] level;
+			delete [] expected;
+
+			// the level above
+			DotGrid *above=new DotGrid();
+			above->Create((width+1)/2,(height+1)/2);
+			for(int y=0; y<above->GetHeight(); y++)
+				for(int x=0; x<above->GetWidth(); x++)
+				{
+					int sum=0, n=0;
+					for(int dy=0; dy<2; dy++)
+						for(int dx=0; dx<2; dx++)
+							if(2*x+dx<width && 2*y+dy<height)
+							{
+								sum+=grid->GetPoint(2*x+dx,2*y+dy);
+								n++;
+							}
+					above->SetPoint(x,y,(sum+n-1)/n);
+				}
+			delete grid;
+			grid=above;
+		}
+		delete grid;
+
+		// no tiles past the plot, and the padding of the ones at its edge is empty
+		char name[256];
+		snprintf(name,sizeof(name),"%s/3/7/0.pgm",path);
+		TS_ASSERT(access(name,F_OK)!=0);
+		snprintf(name,sizeof(name),"%s/3/6/4.pgm",path);
+		int width, height;
+		unsigned char *tile=ReadPGM(name,width,height);
+		TS_ASSERT(tile);
+		TS_ASSERT_EQUALS(tile[31*32+31], 255);
+		delete [] tile;
+
+		snprintf(name,sizeof(name),"rm -r %s",path);
+		TS_ASSERT_EQUALS(system(name), 0);
+		delete forward;
+		delete reverse;
+	}
+
+	// down to a single pixel, the tiles at the edges cut short
+	void testDeepZoom(void)
+	{
+		DotStore *ds=MakeRandomStore(50,4000);
+
+		char dir[]="/tmp/testTilePyramidXXXXXX";
+		TS_ASSERT(mkdtemp(dir));
+		char path[256];
+		snprintf(path,sizeof(path),"%s/plot",dir);
+
+		TilePyramid pyramid;
+		TS_ASSERT(pyramid.Write(path,1,&ds,NULL,1000,700,10.0,5,TILEPYRAMID_DEEPZOOM,16,IMAGEWRITER_PNM));
+
+		// 100 by 70 is 7 halvings from one pixel
+		TS_ASSERT_EQUALS(pyramid.GetNumLevels(), 8);
+		TS_ASSERT_EQUALS(pyramid.GetLevelWidth(0), 1);
+		TS_ASSERT_EQUALS(pyramid.GetLevelHeight(0), 1);
+		TS_ASSERT_EQUALS(pyramid.GetLevelWidth(7), 100);
+
+		DotGrid *grid=new DotGrid();
+		grid->CalculateGrid(ds,0,0,1000,700,10.0,5,DOTGRID_INT32);
+		unsigned char *expected=GridImage(grid);
+		unsigned char *level=ReadLevel(path,TILEPYRAMID_DEEPZOOM,7,100,70,16);
+		TS_ASSERT(!memcmp(level,expected,100*70));
+		delete [] level;
+		delete [] expected;
+		delete grid;
+
+		int width, height;
+		char name[sizeof(path)+32];
+		snprintf(name,sizeof(name),"%s_files/0/0_0.pgm",path);
+		unsigned char *tile=ReadPGM(name,width,height);
+		TS_ASSERT(tile && width==1 && height==1);
+		delete [] tile;
+
+		snprintf(name,sizeof(name),"%s.dzi",path);
+		FILE *in=fopen(name,"r");
+		TS_ASSERT(in);
+		char descriptor[1024];
+		size_t length=fread(descriptor,1,sizeof(descriptor)-1,in);
+		descriptor[length]=0;
+		fclose(in);
+		TS_ASSERT(strstr(descriptor,"TileSize=\"16\""));
+		TS_ASSERT(strstr(descriptor,"<Size Width=\"100\" Height=\"70\"/>"));
+
+		snprintf(name,sizeof(name),"rm -r %s",dir);
+		TS_ASSERT_EQUALS(system(name), 0);
+		delete ds;
+	}
+};
@@ -0,0 +1,57 @@
+from ctypes import *
+
+from DotGrid import DotGrid
+
+# which strands MakeGrid adds up. These match the DENSITYPYRAMID_ defines in DensityPyramid.h
+FORWARD=1
+REVERSE=2
+BOTH=3
+
+class DensityPyramid:
+	"""The bases of match in every cell of a plot at a ladder of resolutions, for its forward and reverse stores. Made
+	once and saved with the plot, so views coarser than its finest cells are drawn from it rather than from the dots"""
+	def __init__(self):
+		# keep hold of the library we were made with, like DotStore does
+		self.lib=self.lib
+		self.pyramid=self.lib.NewDensityPyramid()
+		
+	def __del__(self):
+		assert(self.pyramid)
+		self.lib.DelDensityPyramid(self.pyramid)
+		self.pyramid=None
+		
+	def Create(self, forward, reverse, width, height, cellsize=0):
+		"""Count up the bases of the indexed stores forward and reverse (which may be None) of a plot width by height.
+		cellsize 0 picks one that keeps the finest level within 1024 cells a side"""
+		assert forward.lib==self.lib
+		self.lib.DensityPyramidCreate(self.pyramid, forward.dotstore, reverse and reverse.dotstore or None, width, height, cellsize)
+		
+	def WriteSection(self, stream):
+		"""Write the pyramid as a section of a dot plot file at the current position of stream"""
+		stream.flush()
+		end=self.lib.DensityPyramidWriteSection(self.pyramid, stream.fileno(), stream.tell())
+		if end<0:
+			raise IOError("Could not write pyramid section")
+		stream.seek(end)
+		
+	def ReadSection(self, stream):
+		"""Replace our levels with a section read from the current position of stream"""
+		end=self.lib.DensityPyramidReadSection(self.pyramid, stream.fileno(), stream.tell())
+		if end<0:
+			raise IOError("Could not read pyramid section")
+		stream.seek(end)
+		
+	def GetCellSize(self):
+		"""the bases across a cell of the finest level. Views any finer need the dots"""
+		return self.lib.DensityPyramidGetCellSize(self.pyramid)
+	
+	def GetNumLevels(self):
+		return self.lib.DensityPyramidGetNumLevels(self.pyramid)
+	
+	def MakeGrid(self, x1, y1, x2, y2, scale, strands=BOTH):
+		"""A fractional DotGrid of the bases in each cell of the area, sized as DotGrid.CalculateFractional sizes it
+		and with the reverse strand upside down. None if scale is finer than GetCellSize()"""
+		grid=DotGrid()
+		if not self.lib.DensityPyramidResample(self.pyramid, grid.dotgrid, x1, y1, x2, y2, scale, strands):
+			return None
+		return grid
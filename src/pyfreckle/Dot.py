@@ -20,3 +20,18 @@ class Dot(Structure):
 		parts=old[1:-1].split(" ")
 		return "<%s (%d,%d,%d) at %s>"%(parts[0],self.x,self.y,self.length,parts[-1])
 
+class Dot64(Structure):
+	"""Wrapper for C struct Dot when libfreckle is built with FRECKLE_64BIT_COORDS.
+	
+	struct
+	{
+		long long x;
+		long long y;
+		long long length;
+	};
+	"""
+	_fields_ = [ 	("x", c_longlong),
+			("y", c_longlong),
+			("length", c_longlong)	]
+	
+	__repr__=Dot.__dict__['__repr__']
@@ -0,0 +1,32 @@
+from ctypes import *
+
+class DotExporter:
+	"""Writes dots out as tab separated lines of xname, xstart, xend, strand, yname, ystart, yend and length.
+	Coordinates are from 0 within each named record and ends are one past the last base"""
+	def __init__(self, filename, compress=False):
+		# keep hold of the library we were made with, like DotStore does
+		self.lib=self.lib
+		self.exporter=self.lib.NewDotExporter()
+		if not self.lib.DotExporterOpen(self.exporter, filename, compress):
+			raise IOError("Could not create %s"%filename)
+		
+	def __del__(self):
+		assert(self.exporter)
+		self.lib.DelDotExporter(self.exporter)
+		self.exporter=None
+		
+	def SetRecords(self, axis, starts, names):
+		"""Name the sequence records along an axis (0 for x, 1 for y). starts are where each begins on the axis"""
+		assert len(starts)==len(names)
+		coord=self.lib.CoordSize==8 and c_longlong or c_int
+		self.lib.DotExporterSetRecords(self.exporter, axis, len(starts), (coord*len(starts))(*starts), (c_char_p*len(names))(*names))
+		
+	def Write(self, dotstore, strand='+', xoffset=0, yoffset=0, ylength=0, minlength=0):
+		"""Write out the dots of a DotStore. The y coordinates of a '-' store are turned back to forward ones when ylength is given"""
+		assert dotstore.lib==self.lib
+		if not self.lib.DotExporterWrite(self.exporter, dotstore.dotstore, strand, xoffset, yoffset, ylength, minlength):
+			raise IOError("Could not write the dots out")
+		
+	def Close(self):
+		if not self.lib.DotExporterClose(self.exporter):
+			raise IOError("Could not finish writing the dots out")
@@ -1,5 +1,47 @@
 from ctypes import *
 
+# how ToString turns counts into grey levels. These match the DOTGRID_ defines in DotGrid.h
+EQUALISE=0
+LINEAR=1
+LOG=2
+PERCENTILE=3
+
+# what the cells of a grid are. These match the DOTGRID_ defines in DotGrid.h. AUTO picks the narrowest that a
+# calculation can't saturate
+AUTO=0
+UINT8=1
+UINT16=2
+INT32=3
+FLOAT=4
+
+# the image file formats. These match the IMAGEWRITER_ defines in ImageWriter.h
+PNG=0
+PNM=1
+
+# how a tile pyramid is laid out. These match the TILEPYRAMID_ defines in TilePyramid.h
+XYZ=0
+DEEPZOOM=1
+
+class GridTransform:
+	"""Where the dots of one of several stores go on the grid calculated from them all. Each dot is transposed if asked,
+	then moved by xoffset and yoffset, and the grid is turned upside down if flip is set, as FlipInplace would"""
+	def __init__(self, flip=False, transpose=False, xoffset=0, yoffset=0):
+		self.flip=flip
+		self.transpose=transpose
+		self.xoffset=xoffset
+		self.yoffset=yoffset
+
+def Sources(lib, sources, transforms):
+	"""the library arguments for a list of stores and a list of their GridTransforms (None for none)"""
+	num=len(sources)
+	if transforms==None:
+		transforms=[GridTransform()]*num
+	assert len(transforms)==num
+	c_coord=lib.CoordSize==8 and c_longlong or c_int
+	return (num, (c_void_p*num)(*[cast(source.dotstore,c_void_p) for source in sources]),
+		(c_int*num)(*[int(t.flip) for t in transforms]), (c_int*num)(*[int(t.transpose) for t in transforms]),
+		(c_coord*num)(*[t.xoffset for t in transforms]), (c_coord*num)(*[t.yoffset for t in transforms]))
+
 class DotGrid:
 	def __init__(self, dotgrid=None):
 		if dotgrid==None:
@@ -12,8 +54,11 @@ class DotGrid:
 		self.lib.DelDotGrid(self.dotgrid)
 		self.dotgrid=None
 		
-	def Create(self,x,y):
-		self.lib.DotGridCreate(self.dotgrid,x,y)
+	def Create(self,x,y,celltype=INT32):
+		self.lib.DotGridCreateCells(self.dotgrid,x,y,celltype)
+		
+	def GetCellType(self):
+		return self.lib.DotGridGetCellType(self.dotgrid)
 		
 	def GetWidth(self):
 		return self.lib.DotGridWidth(self.dotgrid)
@@ -39,17 +84,57 @@ class DotGrid:
 	def GetMin(self):
 		return self.lib.DotGridGetMin(self.dotgrid)
 	
-	def ToString(self):
-		string=self.lib.DotGridToString(self.dotgrid)
-		st=string_at(string,self.GetSize())
+	def ToString(self, mode=EQUALISE, bits=8, clip=0.01):
+		"""the grid as a luminance image string, darker where there are more matches. mode is one of EQUALISE, LINEAR,
+		LOG or PERCENTILE, bits is 8 or 16 (native byte order), and clip is the fraction of the non empty cells
+		PERCENTILE clips to black"""
+		string=self.lib.DotGridNormalise(self.dotgrid,mode,bits,c_double(clip))
+		st=string_at(string,self.GetSize()*bits/8)
 		self.lib.FreeString(string)
 		return st
 		
 	def CalculateHistogram(self):
 		return self.lib.DotGridCalculateHistogram(self.dotgrid)
 		
-	def Calculate(self, source, x1, y1, x2, y2, scale, window):
-		self.lib.DotGridCalculate(self.dotgrid, source.dotstore, c_double(x1), c_double(y1), c_double(x2), c_double(y2), c_double(scale), int(window))
+	def WriteImage(self, filename, format=PNG, mode=EQUALISE, bits=8, clip=0.01, invert=False):
+		"""Write the grid straight out to a PNG or PGM file a row at a time, normalised as ToString does it"""
+		if not self.lib.DotGridWriteImage(self.dotgrid, filename, format, mode, bits, clip, invert):
+			raise IOError("Could not write %s"%filename)
+		
+	def Calculate(self, source, x1, y1, x2, y2, scale, window, celltype=AUTO, transforms=None):
+		"""celltype is one of AUTO, UINT8, UINT16 or INT32. Narrower cells take less memory, and saturate. source may be
+		a list of stores to add together in one pass, each placed by the GridTransform of the same place in transforms"""
+		if isinstance(source,(list,tuple)):
+			self.lib.DotGridCalculateSources(self.dotgrid, *(Sources(self.lib,source,transforms)+(x1, y1, x2, y2, scale, int(window), celltype)))
+		else:
+			self.lib.DotGridCalculateCells(self.dotgrid, source.dotstore, c_double(x1), c_double(y1), c_double(x2), c_double(y2), c_double(scale), int(window), celltype)
+		
+	def CalculateCoverage(self, source, x1, y1, x2, y2, scale, celltype=AUTO, transforms=None):
+		"""Like Calculate, but counting the bases of every match crossing each cell, so source needn't be interpolated"""
+		if isinstance(source,(list,tuple)):
+			self.lib.DotGridCalculateCoverageSources(self.dotgrid, *(Sources(self.lib,source,transforms)+(x1, y1, x2, y2, scale, celltype)))
+		else:
+			self.lib.DotGridCalculateCoverageCells(self.dotgrid, source.dotstore, c_double(x1), c_double(y1), c_double(x2), c_double(y2), c_double(scale), celltype)
+		
+	def CalculateFractional(self, source, x1, y1, x2, y2, scale, transforms=None):
+		"""Like CalculateCoverage, but anti-aliased. Each point is the exact length of match in its cell, as a float, and
+		the last column and row end at x2 and y2 rather than being dropped when scale doesn't divide the window"""
+		if isinstance(source,(list,tuple)):
+			self.lib.DotGridCalculateFractionalSources(self.dotgrid, *(Sources(self.lib,source,transforms)+(x1, y1, x2, y2, scale)))
+		else:
+			self.lib.DotGridCalculateFractional(self.dotgrid, source.dotstore, c_double(x1), c_double(y1), c_double(x2), c_double(y2), c_double(scale))
+		
+	def IsFractional(self):
+		return self.lib.DotGridIsFractional(self.dotgrid)!=0
+	
+	def GetFraction(self,x,y):
+		return self.lib.DotGridGetFraction(self.dotgrid,x,y)
+	
+	def GetFractions(self):
+		"""the whole fractional grid as a numpy array of height rows of width floats"""
+		import numpy
+		data=string_at(self.lib.DotGridGetFractions(self.dotgrid),self.GetSize()*sizeof(c_float))
+		return numpy.frombuffer(data,dtype=numpy.float32).reshape((self.GetHeight(),self.GetWidth()))
 		
 	def AddInplace(self, dotgrid):
 		self.lib.DotGridAddInplace(self.dotgrid, dotgrid.dotgrid)
@@ -68,6 +153,26 @@ class DotGrid:
 		return image
 
 
+def WriteBandedImage(filename, source, flipped, x1, y1, x2, y2, scale, window, format=PNG, mode=EQUALISE, bits=8, clip=0.01, invert=False):
+	"""Write the image of the grid Calculate would make of source, with that of flipped (a DotStore or None) flipped
+	upside down and added, a band of rows at a time so the whole grid is never held"""
+	# the library the stores were made with
+	lib=source.lib
+	if flipped!=None:
+		assert flipped.lib==lib
+	if not lib.DotGridWriteBandedImage(filename, source.dotstore, flipped and flipped.dotstore, x1, y1, x2, y2, scale, window, format, mode, bits, clip, invert):
+		raise IOError("Could not write %s"%filename)
+
+def WriteTilePyramid(path, sources, width, height, scale, window, transforms=None, layout=XYZ, tilesize=256, format=PNG, mode=EQUALISE, bits=8, clip=0.01, invert=False):
+	"""Write the plot of width by height bases the sources make together as a pyramid of tiles for a zoomable viewer.
+	The finest level has cells scale bases across, and each level above is half its size. layout XYZ writes
+	path/z/x/y.png, and DEEPZOOM writes path.dzi and path_files/level/column_row.png. The sources and transforms are as
+	for DotGrid.Calculate, and the rest as for WriteBandedImage"""
+	lib=sources[0].lib
+	if not lib.WriteTilePyramid(path, *(Sources(lib,sources,transforms)+(width, height, scale, window, layout, tilesize, format, mode, bits, clip, invert))):
+		raise IOError("Could not write the tiles of %s"%path)
+
+
 
 
 import unittest
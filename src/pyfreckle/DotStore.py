@@ -5,15 +5,23 @@ from ctypes import *
 from Dot import Dot
 
 class DotStore:
+	# the Dot structure and the struct/ctypes coordinate types of the library in use. UseWideCoordinates() changes these
+	Dot=Dot
+	coordformat="i"
+	c_coord=c_int
+	
 	def __init__(self, dotstore=None):
+		# keep hold of the library we were made with, so switching to wide coordinates later doesn't affect us
+		self.lib,self.Dot,self.coordformat,self.c_coord=self.lib,self.Dot,self.coordformat,self.c_coord
+		
 		if dotstore==None:
 			self.dotstore=self.lib.NewDotStore()
 		else:
 			self.dotstore=dotstore
 			
-		self.lib.DotStoreGetDot.restype=POINTER(Dot)
-		self.lib.DotStoreGetIndexLongestMatchingRowDot.restype=POINTER(Dot)
-		self.lib.DotStoreGetIndexLongestMatchingColumnDot.restype=POINTER(Dot)
+		self.lib.DotStoreGetDot.restype=POINTER(self.Dot)
+		self.lib.DotStoreGetIndexLongestMatchingRowDot.restype=POINTER(self.Dot)
+		self.lib.DotStoreGetIndexLongestMatchingColumnDot.restype=POINTER(self.Dot)
 		
 		
 	def __del__(self):
@@ -32,9 +40,56 @@ class DotStore:
 	
 	def FlipY(self, ylength):
 		"""Flip all the y values to their inversions"""
-		for i in range(len(self)):
-			dot = self[i]
-			dot.y = ylength-dot.y
+		self.lib.DotStoreFlipY(self.dotstore, ylength)
+		
+	def FlipX(self, xlength):
+		"""Flip all the x values to their inversions"""
+		self.lib.DotStoreFlipX(self.dotstore, xlength)
+		
+	def Transpose(self):
+		"""Swap the x and y of every dot"""
+		self.lib.DotStoreTranspose(self.dotstore)
+		
+	def Offset(self, dx, dy):
+		"""Move every dot by dx,dy"""
+		self.lib.DotStoreOffset(self.dotstore, dx, dy)
+		
+	def Append(self, other, dx=0, dy=0):
+		"""Add all the dots of another DotStore to this one, moved by dx,dy"""
+		assert other.lib==self.lib
+		self.lib.DotStoreAppend(self.dotstore, other.dotstore, dx, dy)
+	
+	def SetSymmetric(self, symmetric=True):
+		"""Mark an empty store as a self comparison that only keeps the dots on or above the diagonal. The rest are
+		reflected on the fly. Setting it to False unfolds the reflections into real dots"""
+		self.lib.DotStoreSetSymmetric(self.dotstore, int(symmetric))
+		
+	def IsSymmetric(self):
+		return bool(self.lib.DotStoreIsSymmetric(self.dotstore))
+		
+	def Unfold(self):
+		"""Add the reflection of every off diagonal dot of a symmetric store, so iterating over it sees them all"""
+		self.lib.DotStoreUnfold(self.dotstore)
+		
+	def GetLogicalNum(self):
+		"""The number of dots we represent, including the reflections of a symmetric store"""
+		return self.lib.DotStoreGetLogicalNumDots(self.dotstore)
+	
+	def GetLengthHistogram(self):
+		"""The number of dots in each length bin. Bin n holds the lengths from 2**n to 2**(n+1)-1"""
+		return [self.lib.DotStoreGetLengthHistogram(self.dotstore,b) for b in xrange(self.lib.DotStoreNumHistogramBins())]
+		
+	def LengthThreshold(self, n):
+		"""The largest power of two length that at least n dots reach. Handy as a filter length to keep the n longest"""
+		return self.lib.DotStoreLengthThreshold(self.dotstore, n)
+		
+	def Statistics(self):
+		"""Summary statistics of the match lengths. These are kept as the dots are added so no dots are visited"""
+		return {	'count':self.GetLogicalNum(),
+				'bases':self.lib.DotStoreGetTotalBases(self.dotstore),
+				'minlength':self.lib.DotStoreGetMinLength(self.dotstore),
+				'maxlength':self.lib.DotStoreGetMaxLength(self.dotstore),
+				'histogram':self.GetLengthHistogram()	}
 	
 	def AddDot(self,x,y,length):
 		#print self,"::AddDot",x,y,length
@@ -52,6 +107,10 @@ class DotStore:
 	def GetMaxY(self):
 		return self.lib.DotStoreGetMaxY(self.dotstore)
 		
+	def SetMemoryLimit(self, megabytes, tmpdir=None):
+		"""Spill full chunks of dots to a temporary file in tmpdir once more than megabytes of them are in ram"""
+		self.lib.DotStoreSetMemoryLimit(self.dotstore, int(megabytes)*1024*1024, tmpdir)
+		
 	def Interpolate(self, window):
 		assert type(window)==int
 		self.lib.DotStoreInterpolate(self.dotstore, window)
@@ -63,11 +122,40 @@ class DotStore:
 		return dot.contents
 	
 	def GetIndexLongestMatchingColumnDot(self,x):
-		dot = self.lib.DotStoreGetIndexLongestMatchingColumnDot(self.dotstore,x).contents
+		dot = self.lib.DotStoreGetIndexLongestMatchingColumnDot(self.dotstore,x)
 		if not bool(dot):
 			return None
 		return dot.contents
 	
+	def CountAreaBases(self, x1, y1, x2, y2):
+		"""How many bases of matches are in the rectangle x1,y1 - x2,y2 (inclusive). Matches are found whole wherever
+		they start, so the store needn't be interpolated. The index must have been created"""
+		return self.lib.DotStoreCountAreaBases(self.dotstore, x1, y1, x2, y2)
+	
+	def CreateAreaTable(self, cellsize):
+		"""Make a summed-area table of the bases, cellsize across, so CountAreaBases counts the whole cells of a
+		rectangle in constant time and only goes to the index for its edges. It goes when the dots change"""
+		self.lib.DotStoreCreateAreaTable(self.dotstore, cellsize)
+	
+	def GetProfile(self):
+		"""The longest matches of every row and column as numpy arrays. rowlength and rowx are the longest match starting
+		on each row and the x it starts at, rowcover the longest over any of each row, and column* the same for the
+		columns. A length of 0 is no match. The index must have been created, and once this is made the longest row
+		and column lookups above are answered from it"""
+		import numpy
+		profile=self.lib.DotStoreGetProfile(self.dotstore)
+		height,width=self.lib.MatchProfileGetHeight(profile),self.lib.MatchProfileGetWidth(profile)
+		dtype=sizeof(self.c_coord)==8 and numpy.int64 or numpy.int32
+		
+		# copied out, as the profile goes when the index does
+		array=lambda name,size: numpy.frombuffer(string_at(getattr(self.lib,"MatchProfileGet"+name)(profile),size*sizeof(self.c_coord)),dtype=dtype)
+		return {	'rowlength':array("RowLengths",height),
+				'rowx':array("RowXs",height),
+				'rowcover':array("RowCovers",height),
+				'columnlength':array("ColumnLengths",width),
+				'columny':array("ColumnYs",width),
+				'columncover':array("ColumnCovers",width)	}
+	
 	def GetDot(self, index):
 		if index<0:
 			index=len(self)+index
@@ -99,7 +187,15 @@ class DotStore:
 		self.lib.FreeIntBuffer(buffer)
 		
 	def Filter(self, minmatch):
-		return DotStore(self.lib.DotStoreFilter(self.dotstore, minmatch))
+		# the filtered store must use the same library as us
+		from copy import copy
+		filtered=copy(self)
+		filtered.dotstore=self.lib.DotStoreFilter(self.dotstore, minmatch)
+		return filtered
+
+	def FilterInPlace(self, minmatch):
+		# drops our short dots. any index we have is kept up to date
+		self.lib.DotStoreFilterInPlace(self.dotstore, minmatch)
 	
 	def ToString(self):
 		import struct
@@ -109,7 +205,7 @@ class DotStore:
 		length=self.lib.DotStoreBufferSize(self.dotstore,buff)
 		
 		# write it to the stream
-		data=struct.pack("%di"%(length), *buff[:length])
+		data=struct.pack("%d%s"%(length,self.coordformat), *buff[:length])
 		
 		# free the buffer
 		self.FreeBuffer(buff)
@@ -119,15 +215,12 @@ class DotStore:
 	def FromString(self, string):
 		import struct
 		
-		data=string[:struct.calcsize("3i")]
-		maxx,maxy,length=struct.unpack("3i",data)
-		
-		# turn into a shitload of ints. We don't need to free this because it was created in python
-		array=apply( c_int*(length+3), struct.unpack("%di"%(length+3),string) )
+		data=string[:struct.calcsize("3"+self.coordformat)]
+		maxx,maxy,length=struct.unpack("3"+self.coordformat,data)
 		
-		print len(array)
-		
-		#sys.exit(0)
+		# the string is already laid out as the buffer the library wants, so copy it straight into a ctypes array.
+		# We don't need to free this because it was created in python
+		array=(self.c_coord*(length*3+3)).from_buffer_copy(string)
 		
 		self.FromBuffer(array)
 		
@@ -136,28 +229,45 @@ class DotStore:
 		import struct
 		
 		# read the first three elements from the stream
-		data=stream.read(struct.calcsize("3i"))
-		maxx,maxy,length=struct.unpack("3i",data)
-		
-		#print maxx,maxy,length,struct.calcsize("%di"%length)
+		data=stream.read(struct.calcsize("3"+self.coordformat))
+		maxx,maxy,length=struct.unpack("3"+self.coordformat,data)
 		
 		# read length more
-		data+=stream.read(struct.calcsize("%di"%length*3))
-		
-		#print "read",len(data)
-		
-		#array=c_int*(length+3)
-		#print array
+		data+=stream.read(struct.calcsize("%d%s"%(length*3,self.coordformat)))
 		
-		# turn into a shitload of ints. We don't need to free this because it was created in python
-		array=apply( c_int*(length*3+3), struct.unpack("%di"%(length*3+3),data) )
-		
-		#print "applied",len(array)
-		
-		self.FromBuffer(array)
+		self.FromString(data)
 	
 	def Save(self,stream):
 		stream.write(self.ToString())
 	
+	def WriteMapFile(self, path):
+		"""Write the dots to path as a native dot file that MapFile can load without parsing. A cache for this machine only"""
+		if not self.lib.DotStoreWriteMapFile(self.dotstore, path):
+			raise IOError("Could not write dot file %s"%path)
+	
+	def MapFile(self, path):
+		"""Replace our dots with the ones in a dot file written by WriteMapFile, mapping them in rather than reading them"""
+		if not self.lib.DotStoreMapFile(self.dotstore, path):
+			raise IOError("Could not map dot file %s"%path)
+	
+	def WriteSection(self, stream):
+		"""Write the dots as a tiled, compressed section of a version 0.2 dot plot file at the current position of stream"""
+		stream.flush()
+		end=self.lib.DotStoreWriteSection(self.dotstore, stream.fileno(), stream.tell())
+		if end<0:
+			raise IOError("Could not write dot section")
+		stream.seek(end)
+	
+	def ReadSection(self, stream, region=None):
+		"""Replace our dots with a section read from the current position of stream. region (x1,y1,x2,y2) only loads the dots reaching into it"""
+		if region:
+			x1,y1,x2,y2=region
+			end=self.lib.DotStoreReadSectionRegion(self.dotstore, stream.fileno(), stream.tell(), x1, y1, x2, y2)
+		else:
+			end=self.lib.DotStoreReadSection(self.dotstore, stream.fileno(), stream.tell())
+		if end<0:
+			raise IOError("Could not read dot section")
+		stream.seek(end)
+	
 	
 	
\ No newline at end of file
@@ -10,38 +10,41 @@ from ctypes import *
 import os
 
 # dynamically locate our .so file in the same directory as this module
-try:
-	import sys
-	if sys.frozen:
-		# we are frozen in a package. Grab it from our unpacked directory
-		__library_c_source__=os.path.join(os.environ['LD_LIBRARY_PATH'].split(':')[0],"libfreckle.so")
-		lib=cdll.LoadLibrary(__library_c_source__)
-except AttributeError, e:
+def findLibrary(name):
+	"""Load the shared library called name, from our unpacked directory when frozen, otherwise the usual places"""
+	try:
+		import sys
+		if sys.frozen:
+			# we are frozen in a package. Grab it from our unpacked directory
+			return cdll.LoadLibrary(os.path.join(os.environ['LD_LIBRARY_PATH'].split(':')[0],name))
+	except AttributeError, e:
+		pass
+		
 	OPATHS=['./','/usr/local/lib','/usr/lib','/lib',os.path.dirname(__file__)]
 	PATH=OPATHS[::-1]
-	lib=None
-	while lib==None:
-		if len(PATH)==0:
-			#no library could be found
-			raise Exception, "libfreckle.so could not be found. tried " + ','.join(OPATHS)
-		__library_c_source__=os.path.join(PATH.pop(),"libfreckle.so")
+	while len(PATH):
 		try:
-			lib=cdll.LoadLibrary(__library_c_source__)
+			return cdll.LoadLibrary(os.path.join(PATH.pop(),name))
 		except OSError, e:
 			pass
 		
+	#no library could be found
+	raise Exception, name+" could not be found. tried " + ','.join(OPATHS)
 
-# import the modules into this namespace
-from DotGrid import DotGrid
-from DotStore import DotStore
+lib=findLibrary("libfreckle.so")
 
-# set a static class variable that is the library
-DotGrid.lib=lib
-DotStore.lib=lib
+# the 64 bit coordinate build of the library. Only loaded when a sequence is too long for the normal one
+lib64=None
 
-# set vairables
-lib.Bases=c_char_p.in_dll(lib, "Bases")
-lib.Aminos=c_char_p.in_dll(lib, "Aminos")
+# the last default memory limit set, so it can be passed on to lib64 if it gets loaded later
+memorylimit=None
+
+# import the modules into this namespace
+from DotGrid import DotGrid, GridTransform, WriteBandedImage, WriteTilePyramid, EQUALISE, LINEAR, LOG, PERCENTILE, PNG, PNM, AUTO, UINT8, UINT16, INT32, FLOAT, XYZ, DEEPZOOM
+from DotExporter import DotExporter
+from DotStore import DotStore
+from DensityPyramid import DensityPyramid, FORWARD, REVERSE, BOTH
+from Dot import Dot, Dot64
 
 class c_void(Structure):
     # c_void_p is a buggy return type, converting to int, so
@@ -49,31 +52,148 @@ class c_void(Structure):
     # POINTER(c_void), so it can be treated as a real pointer.
     _fields_ = [('dummy', c_int)]
     
-# set passing and return types where needed
-lib.buildMappingTables.argtypes = [POINTER(c_char), c_int, POINTER(c_char)]
-lib.buildMappingTables.restype = POINTER(c_void)
-lib.doComparison.argtypes=[POINTER(c_void), POINTER(c_char), POINTER(c_char), c_int, c_int, c_int, c_int, POINTER(c_char)]
-lib.DotStoreToBuffer.restype = POINTER(c_int)
-lib.DotStoreFromBuffer.argtypes = [ POINTER(c_void), POINTER(c_int) ]
-lib.NewDotStore.restype=POINTER(c_void)
-lib.DotStoreGetMaxX.restype=c_int
-lib.DotStoreGetMaxY.restype=c_int
-lib.DotStoreSetMaxX.argtypes=[c_void_p,c_int]
-lib.DotStoreSetMaxY.argtypes=[c_void_p,c_int]
-lib.DotGridToString.argtypes=[POINTER(c_void)]
-lib.DotGridToString.restype=POINTER(c_void)
-lib.NewDotGrid.argtypes=[]
-lib.NewDotGrid.restype=POINTER(c_void)
-
 class c_pointers(Structure):
 	_fields_ = [ ('forward', POINTER(c_void)),('reverse',POINTER(c_void))]
 
-lib.DoFastComparison.restype=POINTER(c_pointers)
+def setTypes(lib):
+	"""set the passing and return types of a loaded library. Coordinates are ints or long longs depending on how it was built"""
+	lib.CoordSize=c_int.in_dll(lib, "CoordSize").value
+	c_coord = lib.CoordSize==8 and c_longlong or c_int
+	
+	# set vairables
+	lib.Bases=c_char_p.in_dll(lib, "Bases")
+	lib.Aminos=c_char_p.in_dll(lib, "Aminos")
+
+	# set passing and return types where needed
+	lib.buildMappingTables.argtypes = [POINTER(c_char), c_int, POINTER(c_char)]
+	lib.buildMappingTables.restype = POINTER(c_void)
+	lib.doComparison.argtypes=[POINTER(c_void), POINTER(c_char), POINTER(c_char), c_int, c_int, c_int, c_int, POINTER(c_char), c_void_p]
+	lib.doComparison.restype=POINTER(c_void)
+	lib.makeDotComparison.restype=POINTER(c_void)
+	lib.DoFastComparison.argtypes=[c_char_p, c_char_p, c_coord, c_coord, c_int, c_int, c_int, c_int, c_void_p]
+	lib.DoFastComparison.restype=POINTER(c_pointers)
+	lib.DoFastComparisonToSinks.argtypes=[c_char_p, c_char_p, c_coord, c_coord, c_int, c_int, c_int, c_int, c_void_p, c_void_p, c_void_p]
+	lib.DoFastComparisonToSinks.restype=c_bool
+	lib.NewDotFileSink.argtypes=[c_char_p]
+	lib.NewDotFileSink.restype=c_void_p
+	lib.NewFilterDotSink.argtypes=[c_void_p,c_coord]
+	lib.NewFilterDotSink.restype=c_void_p
+	lib.DelDotSink.argtypes=[c_void_p]
+	lib.NewComparisonCheckpoint.argtypes=[c_char_p,c_int]
+	lib.NewComparisonCheckpoint.restype=c_void_p
+	lib.DelComparisonCheckpoint.argtypes=[c_void_p]
+	lib.DotStoreToBuffer.restype = POINTER(c_coord)
+	lib.DotStoreFromBuffer.argtypes = [ POINTER(c_void), POINTER(c_coord) ]
+	lib.DotStoreBufferSize.restype=c_coord
+	lib.NewDotStore.restype=POINTER(c_void)
+	lib.DotStoreAddDot.argtypes=[c_void_p,c_coord,c_coord,c_coord]
+	lib.DotStoreGetDotX.argtypes=lib.DotStoreGetDotY.argtypes=lib.DotStoreGetDotLength.argtypes=lib.DotStoreGetDot.argtypes=[c_void_p,c_coord]
+	lib.DotStoreGetDotX.restype=lib.DotStoreGetDotY.restype=lib.DotStoreGetDotLength.restype=c_coord
+	lib.DotStoreGetNumDots.restype=c_coord
+	lib.DotStoreGetLogicalNumDots.restype=c_coord
+	lib.DotStoreFilter.argtypes=[c_void_p,c_coord]
+	lib.DotStoreFilter.restype=POINTER(c_void)
+	lib.DotStoreFilterInPlace.argtypes=[c_void_p,c_coord]
+	lib.DotStoreGetMaxX.restype=c_coord
+	lib.DotStoreGetMaxY.restype=c_coord
+	lib.DotStoreSetMaxX.argtypes=[c_void_p,c_coord]
+	lib.DotStoreSetMaxY.argtypes=[c_void_p,c_coord]
+	lib.DotStoreGetLengthHistogram.restype=lib.DotStoreGetTotalBases.restype=c_longlong
+	lib.DotStoreGetMinLength.restype=lib.DotStoreGetMaxLength.restype=c_coord
+	lib.DotStoreLengthThreshold.argtypes=[c_void_p,c_coord]
+	lib.DotStoreLengthThreshold.restype=c_coord
+	lib.DotStoreAppend.argtypes=[c_void_p,c_void_p,c_coord,c_coord]
+	lib.DotStoreOffset.argtypes=[c_void_p,c_coord,c_coord]
+	lib.DotStoreFlipX.argtypes=lib.DotStoreFlipY.argtypes=[c_void_p,c_coord]
+	lib.DotStoreGetIndexLongestMatchingRowDot.argtypes=lib.DotStoreGetIndexLongestMatchingColumnDot.argtypes=[c_void_p,c_coord]
+	lib.DotStoreGetProfile.argtypes=[c_void_p]
+	lib.DotStoreGetProfile.restype=c_void_p
+	lib.DotStoreCountAreaBases.argtypes=[c_void_p,c_coord,c_coord,c_coord,c_coord]
+	lib.DotStoreCountAreaBases.restype=c_coord
+	lib.DotStoreCreateAreaTable.argtypes=[c_void_p,c_coord]
+	lib.MatchProfileGetWidth.argtypes=lib.MatchProfileGetHeight.argtypes=[c_void_p]
+	lib.MatchProfileGetWidth.restype=lib.MatchProfileGetHeight.restype=c_coord
+	for array in ("RowLengths","RowXs","RowCovers","ColumnLengths","ColumnYs","ColumnCovers"):
+		getattr(lib,"MatchProfileGet"+array).argtypes=[c_void_p]
+		getattr(lib,"MatchProfileGet"+array).restype=POINTER(c_coord)
+	lib.DotStoreSetMemoryLimit.argtypes=[c_void_p,c_longlong,c_char_p]
+	lib.SetDefaultDotStoreMemoryLimit.argtypes=[c_longlong,c_char_p]
+	lib.DotStoreWriteMapFile.argtypes=lib.DotStoreMapFile.argtypes=[c_void_p,c_char_p]
+	lib.DotStoreWriteSection.argtypes=lib.DotStoreReadSection.argtypes=[c_void_p,c_int,c_longlong]
+	lib.DotStoreReadSectionRegion.argtypes=[c_void_p,c_int,c_longlong,c_coord,c_coord,c_coord,c_coord]
+	lib.DotStoreWriteSection.restype=lib.DotStoreReadSection.restype=lib.DotStoreReadSectionRegion.restype=c_longlong
+	lib.NewDotExporter.restype=c_void_p
+	lib.DelDotExporter.argtypes=lib.DotExporterClose.argtypes=[c_void_p]
+	lib.DotExporterOpen.argtypes=[c_void_p,c_char_p,c_int]
+	lib.DotExporterSetRecords.argtypes=[c_void_p,c_int,c_int,c_void_p,c_void_p]
+	lib.DotExporterWrite.argtypes=[c_void_p,c_void_p,c_char,c_coord,c_coord,c_coord,c_coord]
+	lib.DotGridToString.argtypes=[POINTER(c_void)]
+	lib.DotGridToString.restype=POINTER(c_void)
+	lib.DotGridNormalise.argtypes=[POINTER(c_void),c_int,c_int,c_double]
+	lib.DotGridNormalise.restype=POINTER(c_void)
+	lib.DotGridWriteImage.argtypes=[POINTER(c_void),c_char_p,c_int,c_int,c_int,c_double,c_int]
+	lib.DotGridWriteBandedImage.argtypes=[c_char_p,c_void_p,c_void_p,c_double,c_double,c_double,c_double,c_double,c_int,c_int,c_int,c_int,c_double,c_int]
+	lib.NewDotGrid.argtypes=[]
+	lib.NewDotGrid.restype=POINTER(c_void)
+	sources=[c_void_p,c_int,c_void_p,c_void_p,c_void_p,POINTER(c_coord),POINTER(c_coord),c_double,c_double,c_double,c_double,c_double]
+	lib.DotGridCalculateSources.argtypes=sources+[c_int,c_int]
+	lib.DotGridCalculateCoverageSources.argtypes=sources+[c_int]
+	lib.DotGridCalculateFractionalSources.argtypes=sources
+	lib.WriteTilePyramid.argtypes=[c_char_p]+sources[1:7]+[c_coord,c_coord,c_double,c_int,c_int,c_int,c_int,c_int,c_int,c_double,c_int]
+	lib.DotGridGetFraction.restype=c_float
+	lib.DotGridGetFractions.restype=POINTER(c_float)
+	lib.NewDensityPyramid.restype=c_void_p
+	lib.DelDensityPyramid.argtypes=[c_void_p]
+	lib.DensityPyramidCreate.argtypes=[c_void_p,POINTER(c_void),POINTER(c_void),c_coord,c_coord,c_coord]
+	lib.DensityPyramidWriteSection.argtypes=lib.DensityPyramidReadSection.argtypes=[c_void_p,c_int,c_longlong]
+	lib.DensityPyramidWriteSection.restype=lib.DensityPyramidReadSection.restype=c_longlong
+	lib.DensityPyramidResample.argtypes=[c_void_p,POINTER(c_void),c_double,c_double,c_double,c_double,c_double,c_int]
+	lib.DensityPyramidGetCellSize.argtypes=lib.DensityPyramidGetNumLevels.argtypes=[c_void_p]
+	lib.DensityPyramidGetCellSize.restype=c_coord
+
+setTypes(lib)
+
+# set a static class variable that is the library
+DotGrid.lib=lib
+DotStore.lib=lib
+DotExporter.lib=lib
+DensityPyramid.lib=lib
+
+def UseWideCoordinates():
+	"""Switch every DotStore and DotGrid created from now on over to the 64 bit coordinate build of libfreckle. Needed
+	when a sequence is 2^31 bases or longer. Existing stores keep using the library they were created with"""
+	global lib, lib64
+	if lib64==None:
+		lib64=findLibrary("libfreckle64.so")
+		setTypes(lib64)
+		if memorylimit:
+			lib64.SetDefaultDotStoreMemoryLimit(*memorylimit)
+	lib=lib64
+	DotGrid.lib=lib
+	DotStore.lib=lib
+	DotExporter.lib=lib
+	DensityPyramid.lib=lib
+	DotStore.Dot=Dot64
+	DotStore.coordformat="q"
+	DotStore.c_coord=c_longlong
+
+def WideCoordinates():
+	"""Returns True if we are using the 64 bit coordinate build of libfreckle"""
+	return lib.CoordSize==8
 
 # now our base library functions
 #def buildMappingTables( sequence, ktuplesize ):
 	#return lib.buildMappingTables(sequence, ktuplesize)
 
+def SetDefaultMemoryLimit(megabytes, tmpdir=None):
+	"""Limit the ram every DotStore created from now on uses for its dots. Past the limit, full chunks of dots are spilled
+	to a temporary file in tmpdir and mapped back in when needed. Use 0 for no limit"""
+	global memorylimit
+	memorylimit=(int(megabytes)*1024*1024, tmpdir)
+	lib.SetDefaultDotStoreMemoryLimit(*memorylimit)
+	if lib64:
+		lib64.SetDefaultDotStoreMemoryLimit(*memorylimit)
+
 def makeDotComparison(seq1, seq2, ktuplesize=4, window=10, mismatch=0, minmatch=4):
 	return DotStore(lib.makeDotComparison(seq1,seq2,ktuplesize,window,mismatch,minmatch))
 
@@ -81,14 +201,41 @@ def buildMappingTables( sequence, ktuplesize, alphabet=lib.Bases ):
 	return lib.buildMappingTables(sequence, ktuplesize, alphabet)
 
 #DotStore *doComparison(int **tables, const char *tablesequence, const char *newsequence, int ktuplesize, int window, int mismatch, int minmatch, const char *bases=Bases );
-def doComparison(tables, tabseq, newseq, ktup, window, mismatch, minmatch, bases=lib.Bases):
-	return DotStore(lib.doComparison(tables,tabseq,newseq,ktup,window,mismatch,minmatch,bases))
+def Checkpointed(comparison, checkpoint, interval, *args):
+	"""Run a comparison function of the library with a ComparisonCheckpoint kept in the file checkpoint (or none if it
+	is None) as its last argument"""
+	if checkpoint==None:
+		return comparison(*(args+(None,)))
+	handle=lib.NewComparisonCheckpoint(checkpoint, interval)
+	try:
+		return comparison(*(args+(handle,)))
+	finally:
+		lib.DelComparisonCheckpoint(handle)
+
+def doComparison(tables, tabseq, newseq, ktup, window, mismatch, minmatch, bases=lib.Bases, checkpoint=None, interval=60):
+	return DotStore(Checkpointed(lib.doComparison,checkpoint,interval,tables,tabseq,newseq,ktup,window,mismatch,minmatch,bases))
 	
-def doFastComparison(seq1, seq2, ktuplesize=4, window=10, mismatch=0, minmatch=4):
-	results=lib.DoFastComparison(seq1,seq2,len(seq1),len(seq2),window,mismatch,0,ktuplesize)
+def doFastComparison(seq1, seq2, ktuplesize=4, window=10, mismatch=0, minmatch=4, checkpoint=None, interval=60):
+	"""Compare two sequences with the lbdot engine. If checkpoint is a filename the comparison's progress is saved there
+	every interval seconds, and if the comparison is killed, running it again with the same sequences and parameters
+	carries on from there. The file is removed when the comparison completes"""
+	results=Checkpointed(lib.DoFastComparison,checkpoint,interval,seq1,seq2,len(seq1),len(seq2),window,mismatch,0,ktuplesize)
 	forward,backward = DotStore(results.contents.forward),DotStore(results.contents.reverse)
 	return forward,backward
 
+def doFastComparisonToFiles(seq1, seq2, forwardpath, reversepath, ktuplesize=4, window=10, mismatch=0, minmatch=0, checkpoint=None, interval=60):
+	"""Like doFastComparison, but the dots are streamed straight out to two dot files instead of being held in ram.
+	Only the dots at least minmatch long are kept. Load the results with DotStore.MapFile"""
+	sinks=[lib.NewDotFileSink(path) for path in (forwardpath, reversepath)]
+	filters=minmatch and [lib.NewFilterDotSink(sink, minmatch) for sink in sinks] or []
+	try:
+		args=(seq1,seq2,len(seq1),len(seq2),window,mismatch,0,ktuplesize)+tuple(filters or sinks)
+		ok=Checkpointed(lib.DoFastComparisonToSinks,checkpoint,interval,*args)
+	finally:
+		[lib.DelDotSink(sink) for sink in filters+sinks]
+	if not ok:
+		raise IOError("Could not write the dots to %s and %s"%(forwardpath,reversepath))
+
 def findLongestMatch(tables, sequence, 	compseq, ktup, window, mismatch, minmatch, bases=lib.Bases):
 	print "DoFastComparison..."
 	#dotstore = doComparison( tables, sequence, compseq, ktup, window, mismatch, minmatch, bases )